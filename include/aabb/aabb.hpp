@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_AABB_HPP__
+#define __GEOMETRY_AABB_HPP__
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <limits>
+
+#include "mat4/mat4.hpp"
+#include "soa/vec3_soa.hpp"
+#include "vec3/vec3.hpp"
+
+namespace geometry
+{
+// Axis aligned bounding box. A default constructed box is empty (min > max),
+// so that extending it by a point gives the box of that point.
+template <typename T>
+struct Aabb
+{
+  Vec3<T> min;
+  Vec3<T> max;
+
+  Aabb()
+  {
+    const T inf = std::numeric_limits<T>::infinity();
+    min = Vec3<T>(inf, inf, inf);
+    max = Vec3<T>(-inf, -inf, -inf);
+  }
+
+  Aabb(const Vec3<T> &min, const Vec3<T> &max) : min(min), max(max) {}
+
+  inline bool empty() const
+  {
+    return min.data.coords.x > max.data.coords.x
+           || min.data.coords.y > max.data.coords.y
+           || min.data.coords.z > max.data.coords.z;
+  }
+
+  inline Vec3<T> center() const
+  {
+    return Vec3<T>(
+        T(0.5) * (min.data.coords.x + max.data.coords.x),
+        T(0.5) * (min.data.coords.y + max.data.coords.y),
+        T(0.5) * (min.data.coords.z + max.data.coords.z));
+  }
+
+  inline Vec3<T> extents() const
+  {
+    return Vec3<T>(
+        max.data.coords.x - min.data.coords.x,
+        max.data.coords.y - min.data.coords.y,
+        max.data.coords.z - min.data.coords.z);
+  }
+
+  inline void extend(const T x, const T y, const T z)
+  {
+    min.data.coords.x = x < min.data.coords.x ? x : min.data.coords.x;
+    min.data.coords.y = y < min.data.coords.y ? y : min.data.coords.y;
+    min.data.coords.z = z < min.data.coords.z ? z : min.data.coords.z;
+    max.data.coords.x = x > max.data.coords.x ? x : max.data.coords.x;
+    max.data.coords.y = y > max.data.coords.y ? y : max.data.coords.y;
+    max.data.coords.z = z > max.data.coords.z ? z : max.data.coords.z;
+  }
+
+  inline void extend(const Vec3<T> &p)
+  {
+    extend(p.data.coords.x, p.data.coords.y, p.data.coords.z);
+  }
+
+  inline void extend(const Aabb<T> &box)
+  {
+    extend(box.min);
+    extend(box.max);
+  }
+
+  inline bool contains(const T x, const T y, const T z) const
+  {
+    return x >= min.data.coords.x && y >= min.data.coords.y
+           && z >= min.data.coords.z && x <= max.data.coords.x
+           && y <= max.data.coords.y && z <= max.data.coords.z;
+  }
+
+  inline bool intersects(const Aabb<T> &box) const
+  {
+    for(int i = 0; i < 3; i++)
+    {
+      if(box.max.data.data[i] < min.data.data[i]
+         || box.min.data.data[i] > max.data.data[i])
+        return false;
+    }
+    return true;
+  }
+
+  // Box of the 8 transformed corners, computed with Arvo's method : each
+  // output coordinate is the translation plus, for every input axis, the
+  // smaller (or larger) of the matrix coefficient times the min and max.
+  // Assumes an affine matrix (last row 0 0 0 1).
+  inline Aabb<T> transform(const Mat4<float> &m) const
+  {
+    Aabb<T> ret;
+    if(empty())
+      return ret;
+    for(int i = 0; i < 3; i++)
+    {
+      T lo = T(m.data.array[i][3]);
+      T hi = lo;
+      for(int j = 0; j < 3; j++)
+      {
+        const T a = T(m.data.array[i][j]) * min.data.data[j];
+        const T b = T(m.data.array[i][j]) * max.data.data[j];
+        lo += a < b ? a : b;
+        hi += a < b ? b : a;
+      }
+      ret.min.data.data[i] = lo;
+      ret.max.data.data[i] = hi;
+    }
+    return ret;
+  }
+};
+
+template <typename T>
+inline Aabb<T> unite(const Aabb<T> &a, const Aabb<T> &b)
+{
+  Aabb<T> ret = a;
+  ret.extend(b);
+  return ret;
+}
+
+// Empty if the boxes do not overlap
+template <typename T>
+inline Aabb<T> intersection(const Aabb<T> &a, const Aabb<T> &b)
+{
+  Aabb<T> ret;
+  for(int i = 0; i < 3; i++)
+  {
+    const T lo = a.min.data.data[i] > b.min.data.data[i] ? a.min.data.data[i]
+                                                         : b.min.data.data[i];
+    const T hi = a.max.data.data[i] < b.max.data.data[i] ? a.max.data.data[i]
+                                                         : b.max.data.data[i];
+    ret.min.data.data[i] = lo;
+    ret.max.data.data[i] = hi;
+  }
+  if(ret.empty())
+    return Aabb<T>();
+  return ret;
+}
+
+// -----------------------------------------------------------------------------
+
+// Bounds of n points stored as SoA, with a parallel vectorized min / max
+// reduction
+template <typename T>
+inline Aabb<T>
+computeAabb(const T *x, const T *y, const T *z, const size_t n)
+{
+  const T inf = std::numeric_limits<T>::infinity();
+  T minX = inf, minY = inf, minZ = inf;
+  T maxX = -inf, maxY = -inf, maxZ = -inf;
+
+#pragma omp parallel for simd reduction(min : minX, minY, minZ)                \
+    reduction(max : maxX, maxY, maxZ)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    minX = x[i] < minX ? x[i] : minX;
+    minY = y[i] < minY ? y[i] : minY;
+    minZ = z[i] < minZ ? z[i] : minZ;
+    maxX = x[i] > maxX ? x[i] : maxX;
+    maxY = y[i] > maxY ? y[i] : maxY;
+    maxZ = z[i] > maxZ ? z[i] : maxZ;
+  }
+
+  return Aabb<T>(Vec3<T>(minX, minY, minZ), Vec3<T>(maxX, maxY, maxZ));
+}
+
+template <typename T>
+inline Aabb<T> computeAabb(const Vec3SoA<T> &points)
+{
+  return computeAabb(
+      points.x.data(), points.y.data(), points.z.data(), points.size());
+}
+
+// Sum of n points, accumulated in double precision
+template <typename T>
+inline Vec3<double>
+sumPoints(const T *x, const T *y, const T *z, const size_t n)
+{
+  double sx = 0.0, sy = 0.0, sz = 0.0;
+
+#pragma omp parallel for simd reduction(+ : sx, sy, sz)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    sx += x[i];
+    sy += y[i];
+    sz += z[i];
+  }
+
+  return Vec3<double>(sx, sy, sz);
+}
+
+template <typename T>
+inline Vec3<double> sumPoints(const Vec3SoA<T> &points)
+{
+  return sumPoints(
+      points.x.data(), points.y.data(), points.z.data(), points.size());
+}
+
+template <typename T>
+inline Vec3<T> centroid(const Vec3SoA<T> &points)
+{
+  if(points.empty())
+    return Vec3<T>();
+  const Vec3<double> s = sumPoints(points);
+  const double inv = 1.0 / double(points.size());
+  return Vec3<T>(
+      T(s.data.coords.x * inv), T(s.data.coords.y * inv),
+      T(s.data.coords.z * inv));
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_AABB_HPP__
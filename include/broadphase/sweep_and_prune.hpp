@@ -0,0 +1,426 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_SWEEP_AND_PRUNE_HPP__
+#define __GEOMETRY_SWEEP_AND_PRUNE_HPP__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "aabb/aabb.hpp"
+#include "mat4/mat4.hpp"
+#include "parallel/parallel.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+// Candidate pair of overlapping bodies, with a < b
+struct BodyPair
+{
+  uint32_t a;
+  uint32_t b;
+};
+
+namespace broadphase
+{
+// Maps a float to an unsigned key with the same ordering
+inline uint64_t floatKey(const float v)
+{
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return uint64_t(bits ^ ((bits >> 31) ? 0xffffffffu : 0x80000000u));
+}
+
+// Stable insertion sort of (keys, ids) by key. Gives up once more than
+// maxShifts moves were done, leaving a permutation that is not sorted, and
+// returns false in that case.
+inline bool insertionSort(
+    float *keys, uint32_t *ids, const size_t n, const size_t maxShifts)
+{
+  size_t shifts = 0;
+  for(size_t i = 1; i < n; i++)
+  {
+    const float key = keys[i];
+    if(!(key < keys[i - 1]))
+      continue;
+    const uint32_t id = ids[i];
+    size_t j = i;
+    while(j > 0 && key < keys[j - 1])
+    {
+      keys[j] = keys[j - 1];
+      ids[j] = ids[j - 1];
+      j--;
+    }
+    keys[j] = key;
+    ids[j] = id;
+    shifts += i - j;
+    if(shifts > maxShifts)
+      return false;
+  }
+  return true;
+}
+} // namespace broadphase
+
+// Sort and sweep broadphase over axis aligned boxes. The bodies are kept
+// sorted by the min endpoint of their box along the sweep axis, and the order
+// of the previous frame is repaired with an insertion sort, which is close to
+// linear when the bodies move little between frames. A full parallel radix
+// sort is only used for the first frame, when the number of bodies changes, or
+// when the insertion sort does too many moves.
+//
+// The sweep walks the sorted boxes in parallel : each box is tested against
+// the following ones until their min endpoint passes its max, the overlap on
+// the three axes being evaluated for a tile of boxes at a time with vectorized
+// comparisons.
+//
+// In multi axis mode the order along all three axes is maintained (one axis
+// per thread) and each frame sweeps the axis along which the box centers are
+// the most spread, which keeps the number of false candidates low when the
+// distribution of the bodies changes over time. Otherwise the axis is chosen
+// on the first frame and kept.
+class SweepAndPrune
+{
+public:
+  explicit SweepAndPrune(const bool multiAxis = true)
+      : multiAxis_(multiAxis), axis_(-1), numBodies_(0)
+  {}
+
+  inline size_t size() const { return numBodies_; }
+
+  // Sweep axis of the last update, -1 before the first one
+  inline int axis() const { return axis_; }
+
+  // Forgets the order of the previous frame
+  inline void reset()
+  {
+    axis_ = -1;
+    numBodies_ = 0;
+    for(int a = 0; a < 3; a++)
+    {
+      keys_[a].clear();
+      order_[a].clear();
+    }
+  }
+
+  // Candidate pairs of the boxes [boxMin[i], boxMax[i]]. Boxes that touch
+  // overlap, as for Aabb::intersects(). Pairs come in no particular order.
+  void update(
+      const Vec3SoA<float> &boxMin, const Vec3SoA<float> &boxMax,
+      std::vector<BodyPair> &pairs)
+  {
+    if(boxMax.size() != boxMin.size())
+      throw std::invalid_argument("SweepAndPrune : size mismatch");
+    const float *lo[3] = {boxMin.x.data(), boxMin.y.data(), boxMin.z.data()};
+    const float *hi[3] = {boxMax.x.data(), boxMax.y.data(), boxMax.z.data()};
+    sortAndSweep(lo, hi, boxMin.size(), pairs);
+  }
+
+  // Bodies given by their world pose and the box bounding them in their local
+  // frame. The world box is the box of the transformed local box.
+  void update(
+      const std::vector<Mat4<float>> &poses,
+      const std::vector<Aabb<float>> &localBounds, std::vector<BodyPair> &pairs)
+  {
+    const size_t n = poses.size();
+    if(localBounds.size() != n)
+      throw std::invalid_argument("SweepAndPrune : size mismatch");
+    min_.resize(n);
+    max_.resize(n);
+
+#pragma omp parallel for
+    for(int64_t i = 0; i < int64_t(n); i++)
+    {
+      const Aabb<float> box = localBounds[i].transform(poses[i]);
+      min_.set(size_t(i), box.min);
+      max_.set(size_t(i), box.max);
+    }
+    update(min_, max_, pairs);
+  }
+
+  // Bodies given by their world pose and a bounding sphere in their local
+  // frame. Poses are assumed rigid, so that the radius is left unchanged.
+  void update(
+      const std::vector<Mat4<float>> &poses, const Vec3SoA<float> &centers,
+      const std::vector<float> &radii, std::vector<BodyPair> &pairs)
+  {
+    const size_t n = poses.size();
+    if(centers.size() != n || radii.size() != n)
+      throw std::invalid_argument("SweepAndPrune : size mismatch");
+    min_.resize(n);
+    max_.resize(n);
+
+#pragma omp parallel for
+    for(int64_t i = 0; i < int64_t(n); i++)
+    {
+      const float(*m)[4] = poses[i].data.array;
+      const float x = centers.x[i], y = centers.y[i], z = centers.z[i];
+      const float r = radii[i];
+      const float cx = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3];
+      const float cy = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3];
+      const float cz = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3];
+      min_.x[i] = cx - r;
+      min_.y[i] = cy - r;
+      min_.z[i] = cz - r;
+      max_.x[i] = cx + r;
+      max_.y[i] = cy + r;
+      max_.z[i] = cz + r;
+    }
+    update(min_, max_, pairs);
+  }
+
+private:
+  static const size_t tileSize = 16;
+
+  bool multiAxis_;
+  int axis_;
+  size_t numBodies_;
+
+  // Body ids sorted by min endpoint along each axis, and the sorted endpoints
+  std::vector<float> keys_[3];
+  std::vector<uint32_t> order_[3];
+
+  // Boxes built from poses
+  Vec3SoA<float> min_;
+  Vec3SoA<float> max_;
+
+  // Boxes in sweep order, and per chunk results
+  std::vector<float> sweepMax_;
+  std::vector<float> otherMin_[2];
+  std::vector<float> otherMax_[2];
+  std::vector<std::vector<BodyPair>> chunkPairs_;
+  std::vector<size_t> chunkOffsets_;
+
+  // Radix sort buffers
+  std::vector<uint64_t> radixKeys_;
+  std::vector<uint64_t> tmpKeys_;
+  std::vector<uint32_t> tmpIds_;
+
+  // Axis with the largest variance of the box centers
+  static int spreadAxis(
+      const float *const lo[3], const float *const hi[3], const size_t n)
+  {
+    double s[3] = {0.0, 0.0, 0.0};
+    double s2[3] = {0.0, 0.0, 0.0};
+    for(int a = 0; a < 3; a++)
+    {
+      const float *l = lo[a];
+      const float *h = hi[a];
+      double sum = 0.0, sum2 = 0.0;
+#pragma omp parallel for simd reduction(+ : sum, sum2)
+      for(int64_t i = 0; i < int64_t(n); i++)
+      {
+        const double c = 0.5 * (double(l[i]) + double(h[i]));
+        sum += c;
+        sum2 += c * c;
+      }
+      s[a] = sum;
+      s2[a] = sum2;
+    }
+    int best = 0;
+    double bestVar = -1.0;
+    for(int a = 0; a < 3; a++)
+    {
+      const double var = s2[a] - s[a] * s[a] / double(n);
+      if(var > bestVar)
+      {
+        bestVar = var;
+        best = a;
+      }
+    }
+    return best;
+  }
+
+  void fullSort(const int a, const float *lo)
+  {
+    const size_t n = numBodies_;
+    std::vector<uint32_t> &ids = order_[a];
+    std::vector<float> &keys = keys_[a];
+    radixKeys_.resize(n);
+    ids.resize(n);
+
+#pragma omp parallel for
+    for(int64_t i = 0; i < int64_t(n); i++)
+    {
+      radixKeys_[i] = broadphase::floatKey(lo[i]);
+      ids[i] = uint32_t(i);
+    }
+    parallel::radixSortPairs(radixKeys_, ids, tmpKeys_, tmpIds_, 32);
+
+    keys.resize(n);
+#pragma omp parallel for
+    for(int64_t i = 0; i < int64_t(n); i++)
+      keys[i] = lo[ids[i]];
+  }
+
+  void sortAndSweep(
+      const float *const lo[3], const float *const hi[3], const size_t n,
+      std::vector<BodyPair> &pairs)
+  {
+    pairs.clear();
+    if(n >= size_t(UINT32_MAX))
+      throw std::invalid_argument("SweepAndPrune : too many bodies");
+
+    const bool rebuild = n != numBodies_ || axis_ < 0;
+    numBodies_ = n;
+    if(n < 2)
+    {
+      axis_ = axis_ < 0 ? 0 : axis_;
+      return;
+    }
+
+    if(multiAxis_ || axis_ < 0)
+      axis_ = spreadAxis(lo, hi, n);
+
+    // Axes whose order is maintained
+    bool active[3] = {multiAxis_, multiAxis_, multiAxis_};
+    active[axis_] = true;
+    bool sorted[3] = {false, false, false};
+
+    if(!rebuild)
+    {
+      // Refresh the endpoints in the order of the previous frame, then repair
+      // the order, one axis per thread
+#pragma omp parallel for schedule(dynamic, 1)
+      for(int a = 0; a < 3; a++)
+      {
+        if(!active[a] || order_[a].size() != n)
+          continue;
+        const uint32_t *ids = order_[a].data();
+        float *keys = keys_[a].data();
+        const float *l = lo[a];
+        for(size_t i = 0; i < n; i++)
+          keys[i] = l[ids[i]];
+        sorted[a] = broadphase::insertionSort(
+            keys, order_[a].data(), n, 8 * n + 1024);
+      }
+    }
+    for(int a = 0; a < 3; a++)
+      if(active[a] && !sorted[a])
+        fullSort(a, lo[a]);
+
+    sweep(lo, hi, n, pairs);
+  }
+
+  void sweep(
+      const float *const lo[3], const float *const hi[3], const size_t n,
+      std::vector<BodyPair> &pairs)
+  {
+    const int s = axis_;
+    const int u = (s + 1) % 3;
+    const int v = (s + 2) % 3;
+    const uint32_t *ids = order_[s].data();
+
+    // Boxes in sweep order, so that the tile tests read contiguous memory
+    sweepMax_.resize(n);
+    for(int k = 0; k < 2; k++)
+    {
+      otherMin_[k].resize(n);
+      otherMax_[k].resize(n);
+    }
+    const float *sMin = keys_[s].data();
+    float *sMax = sweepMax_.data();
+    float *uMin = otherMin_[0].data();
+    float *uMax = otherMax_[0].data();
+    float *vMin = otherMin_[1].data();
+    float *vMax = otherMax_[1].data();
+
+#pragma omp parallel for
+    for(int64_t i = 0; i < int64_t(n); i++)
+    {
+      const uint32_t id = ids[i];
+      sMax[i] = hi[s][id];
+      uMin[i] = lo[u][id];
+      uMax[i] = hi[u][id];
+      vMin[i] = lo[v][id];
+      vMax[i] = hi[v][id];
+    }
+
+    // Boxes at the front of the order tend to have more followers to test
+    // than the ones at the back, so chunks are small and dynamically handed
+    const int nChunks = 16 * parallel::maxThreads();
+    chunkPairs_.resize(size_t(nChunks));
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int c = 0; c < nChunks; c++)
+    {
+      std::vector<BodyPair> &out = chunkPairs_[c];
+      out.clear();
+      size_t begin, end;
+      parallel::chunkRange(n, nChunks, c, begin, end);
+
+      uint8_t hit[tileSize] = {0};
+      for(size_t i = begin; i < end; i++)
+      {
+        const float hiS = sMax[i];
+        const float loS = sMin[i];
+        const float loU = uMin[i], hiU = uMax[i];
+        const float loV = vMin[i], hiV = vMax[i];
+        for(size_t j = i + 1; j < n && sMin[j] <= hiS; j += tileSize)
+        {
+          const size_t e = j + tileSize < n ? j + tileSize : n;
+          const int count = int(e - j);
+#pragma omp simd
+          for(int t = 0; t < count; t++)
+          {
+            const size_t k = j + size_t(t);
+            hit[t] = uint8_t(
+                (sMin[k] <= hiS) & (sMax[k] >= loS) & (uMin[k] <= hiU)
+                & (uMax[k] >= loU) & (vMin[k] <= hiV) & (vMax[k] >= loV));
+          }
+          // Most tiles have no hit at all
+          uint64_t any[tileSize / 8];
+          memcpy(any, hit, sizeof(any));
+          if((any[0] | any[1]) == 0)
+            continue;
+          for(int t = 0; t < count; t++)
+          {
+            if(hit[t])
+            {
+              const uint32_t a = ids[i];
+              const uint32_t b = ids[j + size_t(t)];
+              BodyPair p;
+              p.a = a < b ? a : b;
+              p.b = a < b ? b : a;
+              out.push_back(p);
+            }
+          }
+        }
+      }
+    }
+
+    chunkOffsets_.resize(size_t(nChunks) + 1);
+    chunkOffsets_[0] = 0;
+    for(int c = 0; c < nChunks; c++)
+      chunkOffsets_[c + 1] = chunkOffsets_[c] + chunkPairs_[c].size();
+    pairs.resize(chunkOffsets_[nChunks]);
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int c = 0; c < nChunks; c++)
+    {
+      if(!chunkPairs_[c].empty())
+        memcpy(
+            pairs.data() + chunkOffsets_[c], chunkPairs_[c].data(),
+            chunkPairs_[c].size() * sizeof(BodyPair));
+    }
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_SWEEP_AND_PRUNE_HPP__
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_INTRINSICS_HPP__
+#define __GEOMETRY_INTRINSICS_HPP__
+
+#include <math.h>
+
+#include "mat4/mat4.hpp"
+
+namespace geometry
+{
+// Pinhole camera intrinsics. The camera looks down +z, pixel coordinates are
+// u = fx * x / z + cx and v = fy * y / z + cy.
+struct Intrinsics
+{
+  float fx;
+  float fy;
+  float cx;
+  float cy;
+
+  Intrinsics() : fx(1.0f), fy(1.0f), cx(0.0f), cy(0.0f) {}
+
+  Intrinsics(const float fx, const float fy, const float cx, const float cy)
+      : fx(fx), fy(fy), cx(cx), cy(cy)
+  {}
+
+  // Same conventions as mat4f_create_perspective() : fovy in degrees and
+  // aspect = width / height
+  static inline Intrinsics
+  fromPerspective(const float fovy, const int width, const int height)
+  {
+    const float theta = (float) M_PI * fovy * 0.5f / 180.0f;
+    const float f = 0.5f * float(height) / tanf(theta);
+    return Intrinsics(f, f, 0.5f * float(width), 0.5f * float(height));
+  }
+
+  // Extracts the focal lengths of a projection matrix built with
+  // mat4f_create_perspective()
+  static inline Intrinsics
+  fromProjection(const Mat4<float> &proj, const int width, const int height)
+  {
+    return Intrinsics(
+        0.5f * float(width) * proj.data.array[0][0],
+        0.5f * float(height) * proj.data.array[1][1], 0.5f * float(width),
+        0.5f * float(height));
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_INTRINSICS_HPP__
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_MULTI_VIEW_HPP__
+#define __GEOMETRY_MULTI_VIEW_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "mat4/mat4.hpp"
+#include "soa/mat4_soa.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+// Camera matrices for many views at once, for renderers and data generators
+// that draw the same scene from a large set of viewpoints. Conventions are
+// those of mat4f_lookAt() and mat4f_create_perspective(), one camera per SoA
+// lane.
+
+// View matrices mat4f_lookAt(positions[i], targets[i], ups[i]) : the rows of
+// the rotation are the camera right, up and backward axes, so the view is
+// built from them directly rather than through a 4x4 inverse. If poses is not
+// NULL it receives the inverse (camera to world) transforms, whose columns
+// are the same axes and the position. The right axis is normalized, which
+// mat4f_lookAt() skips when up is not orthogonal to the viewing direction;
+// an up parallel to it gives a null rotation.
+inline void lookAtBatch(
+    const Vec3SoA<float> &positions, const Vec3SoA<float> &targets,
+    const Vec3SoA<float> &ups, Mat4SoA &views, Mat4SoA *poses = NULL)
+{
+  const size_t n = positions.size();
+  if(targets.size() != n || ups.size() != n)
+    throw std::invalid_argument("lookAtBatch : input size mismatch");
+
+  views.resize(n);
+  if(poses != NULL)
+    poses->resize(n);
+
+  const float *px = positions.x.data();
+  const float *py = positions.y.data();
+  const float *pz = positions.z.data();
+  const float *tx = targets.x.data();
+  const float *ty = targets.y.data();
+  const float *tz = targets.z.data();
+  const float *ux = ups.x.data();
+  const float *uy = ups.y.data();
+  const float *uz = ups.z.data();
+  float *v[16];
+  float *p[16];
+  for(int c = 0; c < 16; c++)
+  {
+    v[c] = views.m[c].data();
+    p[c] = poses != NULL ? poses->m[c].data() : NULL;
+  }
+  const bool withPoses = poses != NULL;
+
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    float f[3] = {px[i] - tx[i], py[i] - ty[i], pz[i] - tz[i]};
+    const float lenF = sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+    const float invF = lenF > 0.0f ? 1.0f / lenF : 0.0f;
+    for(int k = 0; k < 3; k++)
+      f[k] *= invF;
+
+    float r[3] = {
+        uy[i] * f[2] - uz[i] * f[1], uz[i] * f[0] - ux[i] * f[2],
+        ux[i] * f[1] - uy[i] * f[0]};
+    const float lenR = sqrtf(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+    const float invR = lenR > 0.0f ? 1.0f / lenR : 0.0f;
+    for(int k = 0; k < 3; k++)
+      r[k] *= invR;
+
+    const float u[3] = {
+        f[1] * r[2] - f[2] * r[1], f[2] * r[0] - f[0] * r[2],
+        f[0] * r[1] - f[1] * r[0]};
+    v[0][i] = r[0];
+    v[1][i] = r[1];
+    v[2][i] = r[2];
+    v[3][i] = -(r[0] * px[i] + r[1] * py[i] + r[2] * pz[i]);
+    v[4][i] = u[0];
+    v[5][i] = u[1];
+    v[6][i] = u[2];
+    v[7][i] = -(u[0] * px[i] + u[1] * py[i] + u[2] * pz[i]);
+    v[8][i] = f[0];
+    v[9][i] = f[1];
+    v[10][i] = f[2];
+    v[11][i] = -(f[0] * px[i] + f[1] * py[i] + f[2] * pz[i]);
+    v[12][i] = 0.0f;
+    v[13][i] = 0.0f;
+    v[14][i] = 0.0f;
+    v[15][i] = 1.0f;
+
+    if(withPoses)
+    {
+      const float pos[3] = {px[i], py[i], pz[i]};
+      for(int a = 0; a < 3; a++)
+      {
+        p[4 * a][i] = r[a];
+        p[4 * a + 1][i] = u[a];
+        p[4 * a + 2][i] = f[a];
+        p[4 * a + 3][i] = pos[a];
+      }
+      p[12][i] = 0.0f;
+      p[13][i] = 0.0f;
+      p[14][i] = 0.0f;
+      p[15][i] = 1.0f;
+    }
+  }
+}
+
+// Same with an up vector shared by all the cameras
+inline void lookAtBatch(
+    const Vec3SoA<float> &positions, const Vec3SoA<float> &targets,
+    const Vec3<float> &up, Mat4SoA &views, Mat4SoA *poses = NULL)
+{
+  const size_t n = positions.size();
+  Vec3SoA<float> ups;
+  ups.x.assign(n, up.data.coords.x);
+  ups.y.assign(n, up.data.coords.y);
+  ups.z.assign(n, up.data.coords.z);
+  lookAtBatch(positions, targets, ups, views, poses);
+}
+
+// Projection matrices mat4f_create_perspective(fovy[i], aspect[i], near[i],
+// far[i]), fovy in degrees
+inline void perspectiveBatch(
+    const float *fovy, const float *aspect, const float *near,
+    const float *far, const size_t n, Mat4SoA &projections)
+{
+  projections.resize(n);
+  float *m[16];
+  for(int c = 0; c < 16; c++)
+    m[c] = projections.m[c].data();
+
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    const float theta = (float) M_PI * fovy[i] * 0.5f / 180.0f;
+    const float invTan = 1.0f / tanf(theta);
+    const float invRange = 1.0f / (far[i] - near[i]);
+    for(int c = 0; c < 16; c++)
+      m[c][i] = 0.0f;
+    m[0][i] = invTan / aspect[i];
+    m[5][i] = invTan;
+    m[10][i] = -(near[i] + far[i]) * invRange;
+    m[11][i] = -2.0f * near[i] * far[i] * invRange;
+    m[14][i] = -1.0f;
+  }
+}
+
+// View-projection matrices projections[i] * views[i]. The perspective has
+// five non zero coefficients and the view a (0, 0, 0, 1) last row, so the
+// product is expanded by hand rather than done with mulBatch().
+inline void viewProjectionBatch(
+    const Mat4SoA &projections, const Mat4SoA &views, Mat4SoA &res)
+{
+  const size_t n = views.size();
+  if(projections.size() != n)
+    throw std::invalid_argument("viewProjectionBatch : input size mismatch");
+  res.resize(n);
+  const float *p[16];
+  const float *v[16];
+  float *m[16];
+  for(int c = 0; c < 16; c++)
+  {
+    p[c] = projections.m[c].data();
+    v[c] = views.m[c].data();
+    m[c] = res.m[c].data();
+  }
+
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    for(int c = 0; c < 4; c++)
+    {
+      m[c][i] = p[0][i] * v[c][i];
+      m[4 + c][i] = p[5][i] * v[4 + c][i];
+      m[8 + c][i] = p[10][i] * v[8 + c][i];
+      m[12 + c][i] = p[14][i] * v[8 + c][i];
+    }
+    m[11][i] += p[11][i];
+  }
+}
+
+// Transforms points by every matrix of a batch and divides by w. Outputs are
+// view major (view * points.size() + point) and w is the clip space w, equal
+// to the depth in front of a perspective camera : points with w <= 0 are
+// behind it and get undefined coordinates.
+inline void projectViews(
+    const Mat4SoA &viewProjections, const Vec3SoA<float> &points, float *x,
+    float *y, float *z, float *w)
+{
+  static const size_t blockSize = 4096;
+
+  const size_t nViews = viewProjections.size();
+  const size_t n = points.size();
+  const size_t nBlocks = (n + blockSize - 1) / blockSize;
+  const float *px = points.x.data();
+  const float *py = points.y.data();
+  const float *pz = points.z.data();
+
+  // Each task is one view over a range of points, so that large batches of
+  // views and large point clouds both keep all the threads busy
+#pragma omp parallel for schedule(static)
+  for(int64_t t = 0; t < int64_t(nViews * nBlocks); t++)
+  {
+    const size_t view = size_t(t) / nBlocks;
+    const size_t begin = (size_t(t) % nBlocks) * blockSize;
+    const size_t end = std::min(begin + blockSize, n);
+
+    float a[16];
+    for(int c = 0; c < 16; c++)
+      a[c] = viewProjections.m[c][view];
+    float *ox = x + view * n;
+    float *oy = y + view * n;
+    float *oz = z + view * n;
+    float *ow = w + view * n;
+
+#pragma omp simd
+    for(size_t i = begin; i < end; i++)
+    {
+      const float cx = a[0] * px[i] + a[1] * py[i] + a[2] * pz[i] + a[3];
+      const float cy = a[4] * px[i] + a[5] * py[i] + a[6] * pz[i] + a[7];
+      const float cz = a[8] * px[i] + a[9] * py[i] + a[10] * pz[i] + a[11];
+      const float cw = a[12] * px[i] + a[13] * py[i] + a[14] * pz[i] + a[15];
+      const float invW = 1.0f / cw;
+      ox[i] = cx * invW;
+      oy[i] = cy * invW;
+      oz[i] = cz * invW;
+      ow[i] = cw;
+    }
+  }
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_MULTI_VIEW_HPP__
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_PROJECTION_HPP__
+#define __GEOMETRY_PROJECTION_HPP__
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "camera/intrinsics.hpp"
+#include "mat4/mat4.hpp"
+#include "mat4/rigid_transform.hpp"
+#include "parallel/parallel.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+// Batch camera kernels. Depth maps are row major and metric, a depth <= 0
+// marking an invalid pixel, and poses map camera space to world space. Every
+// kernel works on whole rows or on contiguous SoA ranges so that the
+// per-element work (one rigid transform plus one divide) is vectorized,
+// while rows and ranges are spread over threads.
+
+// Back-projects the valid pixels of a depth map to world space. Points are
+// written in row major pixel order; if pixels is not NULL it receives the
+// pixel index (v * width + u) of each point.
+inline void deproject(
+    const float *depth, const int width, const int height,
+    const Intrinsics &K, const Mat4<float> &pose, Vec3SoA<float> &points,
+    std::vector<uint32_t> *pixels = NULL)
+{
+  const RigidTransform c2w = rigidFromMat4(pose);
+  const float invFx = 1.0f / K.fx;
+  const float invFy = 1.0f / K.fy;
+
+  // Valid pixel count per row, then exclusive prefix sum to compact the output
+  std::vector<size_t> offsets(size_t(height) + 1, 0);
+#pragma omp parallel for schedule(static)
+  for(int v = 0; v < height; v++)
+  {
+    size_t count = 0;
+    const float *row = depth + size_t(v) * width;
+#pragma omp simd reduction(+ : count)
+    for(int u = 0; u < width; u++)
+      count += row[u] > 0.0f ? 1 : 0;
+    offsets[v + 1] = count;
+  }
+  for(int v = 0; v < height; v++)
+    offsets[v + 1] += offsets[v];
+
+  points.resize(offsets[height]);
+  if(pixels != NULL)
+    pixels->resize(offsets[height]);
+
+  float *px = points.x.data();
+  float *py = points.y.data();
+  float *pz = points.z.data();
+  uint32_t *ids = pixels != NULL ? pixels->data() : NULL;
+
+#pragma omp parallel for schedule(static)
+  for(int v = 0; v < height; v++)
+  {
+    const float *row = depth + size_t(v) * width;
+    const float yn = (float(v) - K.cy) * invFy;
+    size_t dst = offsets[v];
+    for(int u = 0; u < width; u++)
+    {
+      const float d = row[u];
+      if(!(d > 0.0f))
+        continue;
+      const float xc = (float(u) - K.cx) * invFx * d;
+      const float yc = yn * d;
+      px[dst] = c2w.r[0][0] * xc + c2w.r[0][1] * yc + c2w.r[0][2] * d
+                + c2w.t[0];
+      py[dst] = c2w.r[1][0] * xc + c2w.r[1][1] * yc + c2w.r[1][2] * d
+                + c2w.t[1];
+      pz[dst] = c2w.r[2][0] * xc + c2w.r[2][1] * yc + c2w.r[2][2] * d
+                + c2w.t[2];
+      if(ids != NULL)
+        ids[dst] = uint32_t(v * width + u);
+      dst++;
+    }
+  }
+}
+
+namespace camera
+{
+// Serial kernel of project(), vectorized over the points
+inline void projectRange(
+    const float *x, const float *y, const float *z, const size_t n,
+    const Intrinsics &K, const RigidTransform &w2c, float *u, float *v,
+    float *depth)
+{
+#pragma omp simd
+  for(size_t i = 0; i < n; i++)
+  {
+    const float xc = w2c.r[0][0] * x[i] + w2c.r[0][1] * y[i]
+                     + w2c.r[0][2] * z[i] + w2c.t[0];
+    const float yc = w2c.r[1][0] * x[i] + w2c.r[1][1] * y[i]
+                     + w2c.r[1][2] * z[i] + w2c.t[1];
+    const float zc = w2c.r[2][0] * x[i] + w2c.r[2][1] * y[i]
+                     + w2c.r[2][2] * z[i] + w2c.t[2];
+    const float invZ = 1.0f / zc;
+    u[i] = K.fx * xc * invZ + K.cx;
+    v[i] = K.fy * yc * invZ + K.cy;
+    depth[i] = zc;
+  }
+}
+} // namespace camera
+
+// Projects world points in a camera. u and v receive the pixel coordinates
+// and z the depth in camera space; points behind the camera get z <= 0 and
+// undefined pixel coordinates.
+inline void project(
+    const float *x, const float *y, const float *z, const size_t n,
+    const Intrinsics &K, const Mat4<float> &pose, float *u, float *v,
+    float *depth)
+{
+  const RigidTransform w2c = rigidInverseFromMat4(pose);
+
+#pragma omp parallel
+  {
+    size_t begin, end;
+    parallel::chunkRange(
+        n, parallel::numThreads(), parallel::threadId(), begin, end);
+    camera::projectRange(
+        x + begin, y + begin, z + begin, end - begin, K, w2c, u + begin,
+        v + begin, depth + begin);
+  }
+}
+
+inline void project(
+    const Vec3SoA<float> &points, const Intrinsics &K, const Mat4<float> &pose,
+    float *u, float *v, float *depth)
+{
+  project(
+      points.x.data(), points.y.data(), points.z.data(), points.size(), K,
+      pose, u, v, depth);
+}
+
+// Renders a point cloud to a depth map keeping the closest point per pixel.
+// Points are projected in parallel and the z-buffer is resolved with an
+// atomic min on the bit pattern of the depth, which orders like the float
+// itself for positive values. Empty pixels are set to 0.
+inline void splatDepth(
+    const Vec3SoA<float> &points, const Intrinsics &K, const Mat4<float> &pose,
+    const int width, const int height, float *depth)
+{
+  static const uint32_t empty = 0x7f800000; // +inf
+
+  const size_t n = points.size();
+  const size_t nPixels = size_t(width) * size_t(height);
+  std::vector<uint32_t> zbuffer(nPixels, empty);
+  uint32_t *zb = zbuffer.data();
+
+  const RigidTransform w2c = rigidInverseFromMat4(pose);
+  static const size_t batchSize = 1024;
+  const int64_t nBatches = int64_t((n + batchSize - 1) / batchSize);
+
+#pragma omp parallel
+  {
+    float u[batchSize], v[batchSize], z[batchSize];
+
+#pragma omp for schedule(static)
+    for(int64_t b = 0; b < nBatches; b++)
+    {
+      const size_t begin = size_t(b) * batchSize;
+      const size_t count = std::min(batchSize, n - begin);
+      camera::projectRange(
+          points.x.data() + begin, points.y.data() + begin,
+          points.z.data() + begin, count, K, w2c, u, v, z);
+
+      for(size_t i = 0; i < count; i++)
+      {
+        if(!(z[i] > 0.0f) || u[i] < -0.5f || v[i] < -0.5f
+           || u[i] >= float(width) - 0.5f || v[i] >= float(height) - 0.5f)
+          continue;
+
+        uint32_t bits;
+        memcpy(&bits, &z[i], sizeof(float));
+        uint32_t *dst
+            = zb + size_t(int(v[i] + 0.5f)) * width + size_t(int(u[i] + 0.5f));
+        uint32_t cur = __atomic_load_n(dst, __ATOMIC_RELAXED);
+        while(bits < cur
+              && !__atomic_compare_exchange_n(
+                  dst, &cur, bits, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {}
+      }
+    }
+  }
+
+#pragma omp parallel for simd schedule(static)
+  for(int64_t i = 0; i < int64_t(nPixels); i++)
+  {
+    float d;
+    memcpy(&d, &zb[i], sizeof(float));
+    depth[i] = zb[i] == empty ? 0.0f : d;
+  }
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_PROJECTION_HPP__
@@ -0,0 +1,747 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_DISTANCE_FIELD_HPP__
+#define __GEOMETRY_DISTANCE_FIELD_HPP__
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "aabb/aabb.hpp"
+#include "mesh/tri_mesh.hpp"
+#include "parallel/parallel.hpp"
+#include "predicates/predicates.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+namespace sdf
+{
+// Triangles prepared for point distance queries : the vertices, the unit
+// normal (zero for a degenerate triangle), the in-plane normals n x e of the
+// three edges, pointing inwards for a counterclockwise triangle, and the
+// inverse squared edge lengths (zero for a degenerate edge).
+//
+// Field k of triangle i is stored at data[k * fieldStride + i * triStride].
+// The triangles of a mesh are interleaved (fieldStride 1), so that the
+// random accesses of the sweeps read a single triangle from one place, and
+// the triangles of a brick are copied to separate arrays (triStride 1) for
+// the kernels that are vectorized over triangles.
+struct Triangles
+{
+  enum Field
+  {
+    AX, AY, AZ, BX, BY, BZ, CX, CY, CZ,
+    NX, NY, NZ,
+    M0X, M0Y, M0Z, M1X, M1Y, M1Z, M2X, M2Y, M2Z,
+    INV_AB, INV_BC, INV_CA,
+    NUM_FIELDS
+  };
+
+  std::vector<float> data;
+  size_t count;
+  size_t fieldStride;
+  size_t triStride;
+
+  explicit Triangles(const bool interleaved = true)
+      : count(0), fieldStride(1), triStride(NUM_FIELDS)
+  {
+    if(!interleaved)
+    {
+      fieldStride = 0;
+      triStride = 1;
+    }
+  }
+
+  inline size_t size() const { return count; }
+
+  // Storage is not preserved
+  inline void resize(const size_t n)
+  {
+    count = n;
+    data.resize(n * NUM_FIELDS);
+    if(triStride == 1)
+      fieldStride = n;
+  }
+
+  inline float *tri(const size_t i) { return data.data() + i * triStride; }
+
+  inline const float *tri(const size_t i) const
+  {
+    return data.data() + i * triStride;
+  }
+
+  static inline void cross(const float *u, const float *v, float *res)
+  {
+    res[0] = u[1] * v[2] - u[2] * v[1];
+    res[1] = u[2] * v[0] - u[0] * v[2];
+    res[2] = u[0] * v[1] - u[1] * v[0];
+  }
+
+  static inline float invLength2(const float *e)
+  {
+    const float len2 = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+    return len2 > 0.0f ? 1.0f / len2 : 0.0f;
+  }
+
+  inline void
+  set(const size_t i, const Vec3<float> &pa, const Vec3<float> &pb,
+      const Vec3<float> &pc)
+  {
+    const float *v[3] = {pa.data.data, pb.data.data, pc.data.data};
+    float e[3][3], nrm[3], m[3][3];
+    for(int k = 0; k < 3; k++)
+    {
+      e[0][k] = v[1][k] - v[0][k];
+      e[1][k] = v[2][k] - v[1][k];
+      e[2][k] = v[0][k] - v[2][k];
+    }
+    cross(e[0], e[1], nrm);
+    const float len2 = nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2];
+    const float inv = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+    for(int k = 0; k < 3; k++)
+      nrm[k] *= inv;
+    for(int k = 0; k < 3; k++)
+      cross(nrm, e[k], m[k]);
+
+    float *t = tri(i);
+    const size_t fs = fieldStride;
+    for(int k = 0; k < 3; k++)
+    {
+      t[(AX + k) * fs] = v[0][k];
+      t[(BX + k) * fs] = v[1][k];
+      t[(CX + k) * fs] = v[2][k];
+      t[(NX + k) * fs] = nrm[k];
+      t[(M0X + k) * fs] = m[0][k];
+      t[(M1X + k) * fs] = m[1][k];
+      t[(M2X + k) * fs] = m[2][k];
+    }
+    t[INV_AB * fs] = invLength2(e[0]);
+    t[INV_BC * fs] = invLength2(e[1]);
+    t[INV_CA * fs] = invLength2(e[2]);
+  }
+
+  // Copies triangle j of src at index i
+  inline void copy(const size_t i, const Triangles &src, const size_t j)
+  {
+    float *dst = tri(i);
+    const float *t = src.tri(j);
+    for(int k = 0; k < NUM_FIELDS; k++)
+      dst[k * fieldStride] = t[k * src.fieldStride];
+  }
+};
+
+// Squared distance from (dx, dy, dz), relative to the segment origin, to the
+// segment of direction (ex, ey, ez)
+inline float segmentDist2(
+    const float dx, const float dy, const float dz, const float ex,
+    const float ey, const float ez, const float invLen2)
+{
+  const float len2 = ex * ex + ey * ey + ez * ez;
+  float proj = dx * ex + dy * ey + dz * ez;
+  proj = proj > 0.0f ? proj : 0.0f;
+  proj = proj < len2 ? proj : len2;
+  const float t = proj * invLen2;
+  const float rx = dx - t * ex;
+  const float ry = dy - t * ey;
+  const float rz = dz - t * ez;
+  return rx * rx + ry * ry + rz * rz;
+}
+
+// Squared distance from p to the triangle whose fields are at t[k * fs].
+// Both the plane and the three edge distances are computed and the result
+// selected without branches, so that loops over triangles vectorize.
+inline float pointTriangleDist2(
+    const float *t, const size_t fs, const float px, const float py,
+    const float pz)
+{
+  typedef Triangles T;
+  const float ax = t[T::AX * fs], ay = t[T::AY * fs], az = t[T::AZ * fs];
+  const float bx = t[T::BX * fs], by = t[T::BY * fs], bz = t[T::BZ * fs];
+  const float cx = t[T::CX * fs], cy = t[T::CY * fs], cz = t[T::CZ * fs];
+  const float nx = t[T::NX * fs], ny = t[T::NY * fs], nz = t[T::NZ * fs];
+  const float apx = px - ax, apy = py - ay, apz = pz - az;
+  const float bpx = px - bx, bpy = py - by, bpz = pz - bz;
+  const float cpx = px - cx, cpy = py - cy, cpz = pz - cz;
+
+  const float s0 = apx * t[T::M0X * fs] + apy * t[T::M0Y * fs]
+                   + apz * t[T::M0Z * fs];
+  const float s1 = bpx * t[T::M1X * fs] + bpy * t[T::M1Y * fs]
+                   + bpz * t[T::M1Z * fs];
+  const float s2 = cpx * t[T::M2X * fs] + cpy * t[T::M2Y * fs]
+                   + cpz * t[T::M2Z * fs];
+  const float s01 = s0 < s1 ? s0 : s1;
+  const float sMin = s01 < s2 ? s01 : s2;
+  const float n2 = nx * nx + ny * ny + nz * nz;
+  const float h = apx * nx + apy * ny + apz * nz;
+  const float dIn = h * h;
+
+  const float d0 = segmentDist2(
+      apx, apy, apz, bx - ax, by - ay, bz - az, t[T::INV_AB * fs]);
+  const float d1 = segmentDist2(
+      bpx, bpy, bpz, cx - bx, cy - by, cz - bz, t[T::INV_BC * fs]);
+  const float d2 = segmentDist2(
+      cpx, cpy, cpz, ax - cx, ay - cy, az - cz, t[T::INV_CA * fs]);
+  const float dEdge = d0 < d1 ? d0 : d1;
+  const float dOut = dEdge < d2 ? dEdge : d2;
+  // The plane distance only applies when p projects inside the triangle,
+  // and is then the smallest. Selecting it through a penalty keeps it
+  // computed unconditionally, otherwise GCC sinks it into a branch that it
+  // then refuses to if-convert.
+  const float faceMin = sMin >= 0.0f ? 0.0f : FLT_MAX;
+  const float penalty = n2 > 0.0f ? faceMin : FLT_MAX;
+  const float dFace = dIn > penalty ? dIn : penalty;
+  return dFace < dOut ? dFace : dOut;
+}
+
+inline float pointTriangleDist2(
+    const Triangles &tris, const size_t i, const float px, const float py,
+    const float pz)
+{
+  return pointTriangleDist2(tris.tri(i), tris.fieldStride, px, py, pz);
+}
+
+// Squared distances from p to all the triangles of a non interleaved set
+inline void pointTrianglesDist2(
+    const Triangles &tris, const float px, const float py, const float pz,
+    float *dist2)
+{
+  const float *t = tris.data.data();
+  const size_t fs = tris.fieldStride;
+  const int64_t n = int64_t(tris.size());
+#pragma omp simd
+  for(int64_t i = 0; i < n; i++)
+    dist2[i] = pointTriangleDist2(t + i, fs, px, py, pz);
+}
+
+// Projection of triangle abc on the (y, z) plane contains q, with the edges
+// shared by two triangles owned by exactly one of them (top-left rule on the
+// counterclockwise projection). On success, returns the barycentric weights
+// of q.
+inline bool rayHitsTriangle(
+    const double *a, const double *b, const double *c, const double *q,
+    double *w)
+{
+  const double *v[3] = {a, b, c};
+  const double area = orient2d(a, b, c);
+  if(area == 0.0)
+    return false;
+  if(area < 0.0)
+    std::swap(v[1], v[2]);
+
+  double o[3];
+  for(int e = 0; e < 3; e++)
+  {
+    const double *e0 = v[(e + 1) % 3];
+    const double *e1 = v[(e + 2) % 3];
+    o[e] = orient2d(e0, e1, q);
+    if(o[e] < 0.0)
+      return false;
+    if(o[e] == 0.0)
+    {
+      const double du = e1[0] - e0[0];
+      const double dv = e1[1] - e0[1];
+      if(!(dv < 0.0 || (dv == 0.0 && du < 0.0)))
+        return false;
+    }
+  }
+  // Weights in the input vertex order
+  w[0] = o[0];
+  w[1] = area < 0.0 ? o[2] : o[1];
+  w[2] = area < 0.0 ? o[1] : o[2];
+  return true;
+}
+} // namespace sdf
+
+// Distance field sampled on a dense grid. Sample (x, y, z) is at
+// origin + voxelSize * (x, y, z), and values are stored x first.
+//
+// build() computes the distances to a triangle mesh in three steps :
+// - triangles are binned to bricks of brickSide^3 samples, and every sample
+//   of a brick gets its exact distance to the triangles of the brick, with a
+//   kernel vectorized over triangles. Samples within band voxels of the
+//   surface are exact.
+// - the closest triangle is propagated to the rest of the grid with fast
+//   sweeping in the 8 octant orders, each sample keeping the closest of its
+//   own triangle and of the triangles of its upwind neighbours. Away from
+//   the band the result is the distance to a triangle, so never too small,
+//   and is typically within a tenth of a voxel of the true distance.
+// - for a signed field, the sign is the parity of the number of crossings of
+//   the surface by a ray along x, counted per triangle with exact predicates.
+//   This needs a closed mesh, and distances are negative inside.
+//
+// Lookups are trilinear, points outside of the grid being clamped to it.
+class DistanceField
+{
+public:
+  static const int brickSide = 8;
+
+  DistanceField(
+      const int nx, const int ny, const int nz, const float voxelSize,
+      const Vec3<float> &origin)
+      : nx_(nx), ny_(ny), nz_(nz), voxelSize_(voxelSize)
+  {
+    if(nx < 2 || ny < 2 || nz < 2 || !(voxelSize > 0.0f))
+      throw std::invalid_argument("DistanceField : invalid grid parameters");
+    dist_.assign(size_t(nx) * size_t(ny) * size_t(nz), FLT_MAX);
+    origin_[0] = origin.data.coords.x;
+    origin_[1] = origin.data.coords.y;
+    origin_[2] = origin.data.coords.z;
+  }
+
+  // Field of a mesh on a grid covering its bounds plus padding
+  static DistanceField fromMesh(
+      const TriMesh &mesh, const float voxelSize, const float padding,
+      const bool signedDistance = true, const int band = 1)
+  {
+    const Aabb<float> box = mesh.bounds();
+    if(box.empty())
+      throw std::invalid_argument("DistanceField : empty mesh");
+    int n[3];
+    for(int i = 0; i < 3; i++)
+    {
+      const float extent = box.max.data.data[i] - box.min.data.data[i];
+      n[i] = std::max(2, int(ceilf((extent + 2.0f * padding) / voxelSize)) + 1);
+    }
+    const Vec3<float> origin(
+        box.min.data.coords.x - padding, box.min.data.coords.y - padding,
+        box.min.data.coords.z - padding);
+    DistanceField ret(n[0], n[1], n[2], voxelSize, origin);
+    ret.build(mesh, signedDistance, band);
+    return ret;
+  }
+
+  inline int nx() const { return nx_; }
+  inline int ny() const { return ny_; }
+  inline int nz() const { return nz_; }
+  inline float voxelSize() const { return voxelSize_; }
+  inline const float *origin() const { return origin_; }
+  inline const float *data() const { return dist_.data(); }
+
+  inline float value(const int x, const int y, const int z) const
+  {
+    return dist_[index(x, y, z)];
+  }
+
+  void build(
+      const TriMesh &mesh, const bool signedDistance = true, const int band = 1)
+  {
+    const size_t nf = mesh.numFaces();
+    for(size_t i = 0; i < mesh.indices.size(); i++)
+      if(mesh.indices[i] >= mesh.numVertices())
+        throw std::invalid_argument("DistanceField : invalid mesh indices");
+    if(uint64_t(nf) >= uint64_t(INT32_MAX))
+      throw std::invalid_argument("DistanceField : too many faces");
+
+    tris_.resize(nf);
+#pragma omp parallel for
+    for(int64_t f = 0; f < int64_t(nf); f++)
+    {
+      const uint32_t *ids = mesh.indices.data() + 3 * f;
+      tris_.set(
+          size_t(f), mesh.positions.get(ids[0]), mesh.positions.get(ids[1]),
+          mesh.positions.get(ids[2]));
+    }
+
+    std::fill(dist_.begin(), dist_.end(), FLT_MAX);
+    closest_.assign(dist_.size(), -1);
+    if(nf == 0)
+      return;
+
+    computeBand(std::max(band, 0));
+    for(int octant = 0; octant < 8; octant++)
+      sweep(octant & 1 ? -1 : 1, octant & 2 ? -1 : 1, octant & 4 ? -1 : 1);
+
+#pragma omp parallel for simd
+    for(int64_t i = 0; i < int64_t(dist_.size()); i++)
+      dist_[i] = sqrtf(dist_[i]);
+    if(signedDistance)
+      computeSign();
+
+    std::vector<int32_t>().swap(closest_);
+    tris_ = sdf::Triangles();
+  }
+
+  // Trilinear lookup at a world position, and the gradient of the
+  // interpolant if grad is not NULL
+  inline float distance(
+      const float x, const float y, const float z, float *grad = NULL) const
+  {
+    float d, gx, gy, gz;
+    lookup(x, y, z, d, gx, gy, gz);
+    if(grad != NULL)
+    {
+      grad[0] = gx;
+      grad[1] = gy;
+      grad[2] = gz;
+    }
+    return d;
+  }
+
+  inline float distance(const Vec3<float> &p, float *grad = NULL) const
+  {
+    return distance(p.data.coords.x, p.data.coords.y, p.data.coords.z, grad);
+  }
+
+  // Batch lookups, vectorized over points
+  void distances(const Vec3SoA<float> &points, float *dist) const
+  {
+    const float *px = points.x.data();
+    const float *py = points.y.data();
+    const float *pz = points.z.data();
+
+#pragma omp parallel for simd
+    for(int64_t i = 0; i < int64_t(points.size()); i++)
+    {
+      float gx, gy, gz;
+      lookup(px[i], py[i], pz[i], dist[i], gx, gy, gz);
+    }
+  }
+
+  void distances(
+      const Vec3SoA<float> &points, float *dist,
+      Vec3SoA<float> &gradients) const
+  {
+    const float *px = points.x.data();
+    const float *py = points.y.data();
+    const float *pz = points.z.data();
+    gradients.resize(points.size());
+    float *gx = gradients.x.data();
+    float *gy = gradients.y.data();
+    float *gz = gradients.z.data();
+
+#pragma omp parallel for simd
+    for(int64_t i = 0; i < int64_t(points.size()); i++)
+      lookup(px[i], py[i], pz[i], dist[i], gx[i], gy[i], gz[i]);
+  }
+
+private:
+  int nx_, ny_, nz_;
+  float voxelSize_;
+  float origin_[3];
+  std::vector<float> dist_;
+
+  // Build state
+  sdf::Triangles tris_;
+  std::vector<int32_t> closest_;
+
+  inline size_t index(const int x, const int y, const int z) const
+  {
+    return size_t(x) + size_t(nx_) * (size_t(y) + size_t(ny_) * size_t(z));
+  }
+
+  inline void sample(const int x, const int y, const int z, float *p) const
+  {
+    p[0] = origin_[0] + float(x) * voxelSize_;
+    p[1] = origin_[1] + float(y) * voxelSize_;
+    p[2] = origin_[2] + float(z) * voxelSize_;
+  }
+
+  // Clamped cell and offset along one axis
+  static inline void
+  cellOf(const float g, const int n, int &i, float &t)
+  {
+    const float c = g < 0.0f ? 0.0f : (g > float(n - 1) ? float(n - 1) : g);
+    i = int(c);
+    i = i > n - 2 ? n - 2 : i;
+    t = c - float(i);
+  }
+
+  inline void lookup(
+      const float x, const float y, const float z, float &d, float &gx,
+      float &gy, float &gz) const
+  {
+    const float invSize = 1.0f / voxelSize_;
+    int ix, iy, iz;
+    float tx, ty, tz;
+    cellOf((x - origin_[0]) * invSize, nx_, ix, tx);
+    cellOf((y - origin_[1]) * invSize, ny_, iy, ty);
+    cellOf((z - origin_[2]) * invSize, nz_, iz, tz);
+
+    const size_t sy = size_t(nx_);
+    const size_t sz = size_t(nx_) * size_t(ny_);
+    const float *v = dist_.data() + index(ix, iy, iz);
+    const float c000 = v[0], c100 = v[1];
+    const float c010 = v[sy], c110 = v[sy + 1];
+    const float c001 = v[sz], c101 = v[sz + 1];
+    const float c011 = v[sz + sy], c111 = v[sz + sy + 1];
+
+    const float x00 = c000 + tx * (c100 - c000);
+    const float x10 = c010 + tx * (c110 - c010);
+    const float x01 = c001 + tx * (c101 - c001);
+    const float x11 = c011 + tx * (c111 - c011);
+    const float y0 = x00 + ty * (x10 - x00);
+    const float y1 = x01 + ty * (x11 - x01);
+    d = y0 + tz * (y1 - y0);
+
+    const float dx00 = c100 - c000, dx10 = c110 - c010;
+    const float dx01 = c101 - c001, dx11 = c111 - c011;
+    const float dx0 = dx00 + ty * (dx10 - dx00);
+    const float dx1 = dx01 + ty * (dx11 - dx01);
+    gx = (dx0 + tz * (dx1 - dx0)) * invSize;
+    gy = ((x10 - x00) + tz * ((x11 - x01) - (x10 - x00))) * invSize;
+    gz = (y1 - y0) * invSize;
+  }
+
+  // Exact distances around the surface. Triangles are binned to the bricks
+  // their bounds (grown by band voxels) overlap, then bricks are processed in
+  // parallel, each sample being tested against all the triangles of its
+  // brick at once.
+  void computeBand(const int band)
+  {
+    const size_t nf = tris_.size();
+    const int nb[3] = {(nx_ + brickSide - 1) / brickSide,
+                       (ny_ + brickSide - 1) / brickSide,
+                       (nz_ + brickSide - 1) / brickSide};
+    const int n[3] = {nx_, ny_, nz_};
+    const float invSize = 1.0f / voxelSize_;
+
+    const int nThreads = parallel::maxThreads();
+    std::vector<std::vector<uint64_t>> threadKeys(nThreads);
+    std::vector<std::vector<uint32_t>> threadTris(nThreads);
+
+#pragma omp parallel num_threads(nThreads)
+    {
+      std::vector<uint64_t> &keys = threadKeys[parallel::threadId()];
+      std::vector<uint32_t> &ids = threadTris[parallel::threadId()];
+#pragma omp for schedule(static)
+      for(int64_t f = 0; f < int64_t(nf); f++)
+      {
+        const float *t = tris_.tri(size_t(f));
+        int lo[3], hi[3];
+        bool outside = false;
+        for(int i = 0; i < 3; i++)
+        {
+          const float va = t[sdf::Triangles::AX + i];
+          const float vb = t[sdf::Triangles::BX + i];
+          const float vc = t[sdf::Triangles::CX + i];
+          const float vmin = std::min(va, std::min(vb, vc));
+          const float vmax = std::max(va, std::max(vb, vc));
+          const float gmin = (vmin - origin_[i]) * invSize - float(band);
+          const float gmax = (vmax - origin_[i]) * invSize + float(band);
+          if(gmax < 0.0f || gmin > float(n[i] - 1))
+            outside = true;
+          lo[i] = std::max(0, int(floorf(gmin))) / brickSide;
+          hi[i] = std::min(n[i] - 1, int(ceilf(gmax))) / brickSide;
+        }
+        if(outside)
+          continue;
+        for(int bz = lo[2]; bz <= hi[2]; bz++)
+          for(int by = lo[1]; by <= hi[1]; by++)
+            for(int bx = lo[0]; bx <= hi[0]; bx++)
+            {
+              keys.push_back(
+                  uint64_t(bx)
+                  + uint64_t(nb[0]) * (uint64_t(by) + uint64_t(nb[1]) * bz));
+              ids.push_back(uint32_t(f));
+            }
+      }
+    }
+
+    std::vector<uint64_t> keys, tmpKeys;
+    std::vector<uint32_t> ids, tmpIds;
+    for(int t = 0; t < nThreads; t++)
+    {
+      keys.insert(keys.end(), threadKeys[t].begin(), threadKeys[t].end());
+      ids.insert(ids.end(), threadTris[t].begin(), threadTris[t].end());
+    }
+    std::vector<std::vector<uint64_t>>().swap(threadKeys);
+    std::vector<std::vector<uint32_t>>().swap(threadTris);
+
+    int bits = 1;
+    while((uint64_t(1) << bits) < uint64_t(nb[0]) * nb[1] * nb[2])
+      bits++;
+    parallel::radixSortPairs(keys, ids, tmpKeys, tmpIds, bits);
+    std::vector<size_t> starts, counts;
+    const size_t nBricks = parallel::segmentStarts(keys, starts, counts);
+
+#pragma omp parallel
+    {
+      sdf::Triangles local(false);
+      std::vector<float> dist2;
+
+#pragma omp for schedule(dynamic, 1)
+      for(int64_t s = 0; s < int64_t(nBricks); s++)
+      {
+        const size_t begin = starts[s];
+        const size_t count = starts[s + 1] - begin;
+        local.resize(count);
+        dist2.resize(count);
+        for(size_t i = 0; i < count; i++)
+          local.copy(i, tris_, ids[begin + i]);
+
+        const uint64_t key = keys[begin];
+        const int bx = int(key % uint64_t(nb[0]));
+        const int by = int((key / uint64_t(nb[0])) % uint64_t(nb[1]));
+        const int bz = int(key / (uint64_t(nb[0]) * uint64_t(nb[1])));
+        const int x1 = std::min(nx_, (bx + 1) * brickSide);
+        const int y1 = std::min(ny_, (by + 1) * brickSide);
+        const int z1 = std::min(nz_, (bz + 1) * brickSide);
+        for(int z = bz * brickSide; z < z1; z++)
+          for(int y = by * brickSide; y < y1; y++)
+            for(int x = bx * brickSide; x < x1; x++)
+            {
+              float p[3];
+              sample(x, y, z, p);
+              sdf::pointTrianglesDist2(local, p[0], p[1], p[2], dist2.data());
+              size_t best = 0;
+              for(size_t i = 1; i < count; i++)
+                best = dist2[i] < dist2[best] ? i : best;
+              const size_t id = index(x, y, z);
+              dist_[id] = dist2[best];
+              closest_[id] = int32_t(ids[begin + best]);
+            }
+      }
+    }
+  }
+
+  // Keeps the triangle of a neighbour sample if it is closer.
+  // Distances are squared until the end of build().
+  inline void
+  relax(const size_t id, const size_t prev, const int x, const int y,
+        const int z)
+  {
+    const int32_t t = closest_[prev];
+    if(t < 0 || t == closest_[id])
+      return;
+    float p[3];
+    sample(x, y, z, p);
+    const float d = sdf::pointTriangleDist2(tris_, t, p[0], p[1], p[2]);
+    if(d < dist_[id])
+    {
+      dist_[id] = d;
+      closest_[id] = t;
+    }
+  }
+
+  // Same for a whole x row against a neighbour row along y or z
+  inline void
+  relaxRow(const size_t row, const size_t prev, const int y, const int z)
+  {
+    for(int x = 0; x < nx_; x++)
+      relax(row + size_t(x), prev + size_t(x), x, y, z);
+  }
+
+  // Gauss-Seidel sweep in the octant (sx, sy, sz) : every sample takes the
+  // triangles of its upwind neighbours along the three axes. Row (y, z)
+  // depends on rows (y - sy, z) and (y, z - sz), so the rows of an
+  // anti-diagonal y + z = level are independent and processed in parallel.
+  void sweep(const int sx, const int sy, const int sz)
+  {
+    const int nLevels = ny_ + nz_ - 1;
+    for(int level = 0; level < nLevels; level++)
+    {
+      const int k0 = std::max(0, level - (ny_ - 1));
+      const int k1 = std::min(nz_ - 1, level);
+#pragma omp parallel for schedule(static)
+      for(int k = k0; k <= k1; k++)
+      {
+        const int j = level - k;
+        const int y = sy > 0 ? j : ny_ - 1 - j;
+        const int z = sz > 0 ? k : nz_ - 1 - k;
+        const size_t row = index(0, y, z);
+        if(k > 0)
+          relaxRow(row, index(0, y, z - sz), y, z);
+        if(j > 0)
+          relaxRow(row, index(0, y - sy, z), y, z);
+        const int x0 = sx > 0 ? 1 : nx_ - 2;
+        for(int x = x0; x >= 0 && x < nx_; x += sx)
+          relax(row + size_t(x), row + size_t(x - sx), x, y, z);
+      }
+    }
+  }
+
+  // Inside / outside from the parity of the surface crossings of the rays
+  // along +x through each (y, z) row of samples. Each triangle flags the
+  // first sample after each of its crossings, and the flags are accumulated
+  // along the rows.
+  void computeSign()
+  {
+    const size_t nf = tris_.size();
+    std::vector<uint8_t> flips(dist_.size(), 0);
+    const float invSize = 1.0f / voxelSize_;
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for(int64_t f = 0; f < int64_t(nf); f++)
+    {
+      typedef sdf::Triangles T;
+      const float *t = tris_.tri(size_t(f));
+      const double a[2] = {t[T::AY], t[T::AZ]};
+      const double b[2] = {t[T::BY], t[T::BZ]};
+      const double c[2] = {t[T::CY], t[T::CZ]};
+      const int y0 = std::max(
+          0, int(ceilf((std::min(a[0], std::min(b[0], c[0])) - origin_[1])
+                       * invSize)) - 1);
+      const int y1 = std::min(
+          ny_ - 1,
+          int(floorf((std::max(a[0], std::max(b[0], c[0])) - origin_[1])
+                     * invSize)) + 1);
+      const int z0 = std::max(
+          0, int(ceilf((std::min(a[1], std::min(b[1], c[1])) - origin_[2])
+                       * invSize)) - 1);
+      const int z1 = std::min(
+          nz_ - 1,
+          int(floorf((std::max(a[1], std::max(b[1], c[1])) - origin_[2])
+                     * invSize)) + 1);
+
+      for(int z = z0; z <= z1; z++)
+      {
+        for(int y = y0; y <= y1; y++)
+        {
+          float p[3];
+          sample(0, y, z, p);
+          const double q[2] = {p[1], p[2]};
+          double w[3];
+          if(!sdf::rayHitsTriangle(a, b, c, q, w))
+            continue;
+          const double hit
+              = (w[0] * t[T::AX] + w[1] * t[T::BX] + w[2] * t[T::CX])
+                / (w[0] + w[1] + w[2]);
+          const double g = (hit - double(origin_[0])) / double(voxelSize_);
+          const int x = g < 0.0 ? 0 : int(ceil(g));
+          if(x < nx_)
+          {
+            uint8_t &flip = flips[index(x, y, z)];
+#pragma omp atomic
+            flip ^= uint8_t(1);
+          }
+        }
+      }
+    }
+
+#pragma omp parallel for collapse(2) schedule(static)
+    for(int z = 0; z < nz_; z++)
+      for(int y = 0; y < ny_; y++)
+      {
+        uint8_t inside = 0;
+        for(int x = 0; x < nx_; x++)
+        {
+          const size_t id = index(x, y, z);
+          inside ^= flips[id];
+          dist_[id] = inside ? -dist_[id] : dist_[id];
+        }
+      }
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_DISTANCE_FIELD_HPP__
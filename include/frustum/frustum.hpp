@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_FRUSTUM_HPP__
+#define __GEOMETRY_FRUSTUM_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include "aabb/aabb.hpp"
+#include "mat4/mat4.hpp"
+
+namespace geometry
+{
+// View frustum as 6 normalized planes a * x + b * y + c * z + d >= 0 (inside),
+// in the order left, right, bottom, top, near, far.
+struct Frustum
+{
+  float planes[6][4];
+
+  // Extracts the planes of a view-projection matrix (clip = m * p, OpenGL
+  // clip volume -w <= x, y, z <= w as produced by mat4f_create_perspective())
+  // with the Gribb-Hartmann method. With a projection matrix alone the planes
+  // are in view space, with projection * view they are in world space.
+  static inline Frustum fromMatrix(const Mat4<float> &m)
+  {
+    Frustum ret;
+    const float(*a)[4] = m.data.array;
+    for(int i = 0; i < 3; i++)
+    {
+      for(int j = 0; j < 4; j++)
+      {
+        ret.planes[2 * i][j] = a[3][j] + a[i][j];
+        ret.planes[2 * i + 1][j] = a[3][j] - a[i][j];
+      }
+    }
+    for(int p = 0; p < 6; p++)
+    {
+      const float len = sqrtf(
+          ret.planes[p][0] * ret.planes[p][0]
+          + ret.planes[p][1] * ret.planes[p][1]
+          + ret.planes[p][2] * ret.planes[p][2]);
+      const float inv = len > 0.0f ? 1.0f / len : 0.0f;
+      for(int j = 0; j < 4; j++)
+        ret.planes[p][j] *= inv;
+    }
+    return ret;
+  }
+
+  inline bool containsPoint(const float x, const float y, const float z) const
+  {
+    for(int p = 0; p < 6; p++)
+    {
+      if(planes[p][0] * x + planes[p][1] * y + planes[p][2] * z + planes[p][3]
+         < 0.0f)
+        return false;
+    }
+    return true;
+  }
+
+  inline bool
+  testSphere(const float x, const float y, const float z, const float r) const
+  {
+    for(int p = 0; p < 6; p++)
+    {
+      if(planes[p][0] * x + planes[p][1] * y + planes[p][2] * z + planes[p][3]
+         < -r)
+        return false;
+    }
+    return true;
+  }
+
+  inline bool testAabb(const float *minC, const float *maxC) const
+  {
+    const float c[3] = {0.5f * (minC[0] + maxC[0]), 0.5f * (minC[1] + maxC[1]),
+                        0.5f * (minC[2] + maxC[2])};
+    const float e[3] = {0.5f * (maxC[0] - minC[0]), 0.5f * (maxC[1] - minC[1]),
+                        0.5f * (maxC[2] - minC[2])};
+    for(int p = 0; p < 6; p++)
+    {
+      const float dist = planes[p][0] * c[0] + planes[p][1] * c[1]
+                         + planes[p][2] * c[2] + planes[p][3];
+      const float radius = fabsf(planes[p][0]) * e[0]
+                           + fabsf(planes[p][1]) * e[1]
+                           + fabsf(planes[p][2]) * e[2];
+      if(dist < -radius)
+        return false;
+    }
+    return true;
+  }
+
+  inline bool testAabb(const Aabb<float> &box) const
+  {
+    return testAabb(box.min.data.data, box.max.data.data);
+  }
+};
+
+// -----------------------------------------------------------------------------
+
+// Batch culling kernels. Objects are given as SoA arrays and the result is a
+// bitmask, bit (i % 64) of mask[i / 64] being set when object i may be
+// visible. The tests are conservative : an object is only rejected when it is
+// fully outside one of the planes. Each 64 bit word is computed by a
+// vectorized loop over its 64 objects (8 or 16 per instruction depending on
+// the vector width) and words are spread over threads.
+namespace frustum
+{
+inline uint64_t packBits(const uint8_t *vis)
+{
+  uint64_t ret = 0;
+  for(int i = 0; i < 64; i++)
+    ret |= uint64_t(vis[i]) << i;
+  return ret;
+}
+} // namespace frustum
+
+inline void cullSpheres(
+    const Frustum &f, const float *x, const float *y, const float *z,
+    const float *r, const size_t n, uint64_t *mask)
+{
+  const int64_t nWords = int64_t((n + 63) / 64);
+
+#pragma omp parallel for schedule(static)
+  for(int64_t w = 0; w < nWords; w++)
+  {
+    const size_t begin = size_t(w) * 64;
+    const int count = int(n - begin < 64 ? n - begin : 64);
+    uint8_t vis[64] = {0};
+
+#pragma omp simd
+    for(int i = 0; i < count; i++)
+    {
+      const size_t id = begin + size_t(i);
+      bool in = true;
+      for(int p = 0; p < 6; p++)
+      {
+        const float dist = f.planes[p][0] * x[id] + f.planes[p][1] * y[id]
+                           + f.planes[p][2] * z[id] + f.planes[p][3];
+        in = in && dist >= -r[id];
+      }
+      vis[i] = in ? 1 : 0;
+    }
+    mask[w] = frustum::packBits(vis);
+  }
+}
+
+// Axis aligned boxes given by their min and max corners
+inline void cullAabbs(
+    const Frustum &f, const float *minX, const float *minY, const float *minZ,
+    const float *maxX, const float *maxY, const float *maxZ, const size_t n,
+    uint64_t *mask)
+{
+  const int64_t nWords = int64_t((n + 63) / 64);
+
+  float absPlanes[6][3];
+  for(int p = 0; p < 6; p++)
+    for(int j = 0; j < 3; j++)
+      absPlanes[p][j] = fabsf(f.planes[p][j]);
+
+#pragma omp parallel for schedule(static)
+  for(int64_t w = 0; w < nWords; w++)
+  {
+    const size_t begin = size_t(w) * 64;
+    const int count = int(n - begin < 64 ? n - begin : 64);
+    uint8_t vis[64] = {0};
+
+#pragma omp simd
+    for(int i = 0; i < count; i++)
+    {
+      const size_t id = begin + size_t(i);
+      const float cx = 0.5f * (minX[id] + maxX[id]);
+      const float cy = 0.5f * (minY[id] + maxY[id]);
+      const float cz = 0.5f * (minZ[id] + maxZ[id]);
+      const float ex = 0.5f * (maxX[id] - minX[id]);
+      const float ey = 0.5f * (maxY[id] - minY[id]);
+      const float ez = 0.5f * (maxZ[id] - minZ[id]);
+      bool in = true;
+      for(int p = 0; p < 6; p++)
+      {
+        const float dist = f.planes[p][0] * cx + f.planes[p][1] * cy
+                           + f.planes[p][2] * cz + f.planes[p][3];
+        const float radius = absPlanes[p][0] * ex + absPlanes[p][1] * ey
+                             + absPlanes[p][2] * ez;
+        in = in && dist >= -radius;
+      }
+      vis[i] = in ? 1 : 0;
+    }
+    mask[w] = frustum::packBits(vis);
+  }
+}
+
+// Oriented boxes given by their center, half extents and unit axes
+// (u, v, w), each component being a separate array
+inline void cullObbs(
+    const Frustum &f, const float *cx, const float *cy, const float *cz,
+    const float *ex, const float *ey, const float *ez, const float *ux,
+    const float *uy, const float *uz, const float *vx, const float *vy,
+    const float *vz, const float *wx, const float *wy, const float *wz,
+    const size_t n, uint64_t *mask)
+{
+  const int64_t nWords = int64_t((n + 63) / 64);
+
+#pragma omp parallel for schedule(static)
+  for(int64_t w = 0; w < nWords; w++)
+  {
+    const size_t begin = size_t(w) * 64;
+    const int count = int(n - begin < 64 ? n - begin : 64);
+    uint8_t vis[64] = {0};
+
+#pragma omp simd
+    for(int i = 0; i < count; i++)
+    {
+      const size_t id = begin + size_t(i);
+      bool in = true;
+      for(int p = 0; p < 6; p++)
+      {
+        const float a = f.planes[p][0];
+        const float b = f.planes[p][1];
+        const float c = f.planes[p][2];
+        const float dist = a * cx[id] + b * cy[id] + c * cz[id] + f.planes[p][3];
+        const float radius
+            = ex[id] * fabsf(a * ux[id] + b * uy[id] + c * uz[id])
+              + ey[id] * fabsf(a * vx[id] + b * vy[id] + c * vz[id])
+              + ez[id] * fabsf(a * wx[id] + b * wy[id] + c * wz[id]);
+        in = in && dist >= -radius;
+      }
+      vis[i] = in ? 1 : 0;
+    }
+    mask[w] = frustum::packBits(vis);
+  }
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_FRUSTUM_HPP__
@@ -26,5 +26,38 @@
 #include "vec3/vec3.hpp"
 #include "vec4/vec4.hpp"
 #include "mat4/mat4.hpp"
+#include "mat4/rigid_transform.hpp"
+#include "lie/lie.hpp"
+#include "linalg/small_solve.hpp"
+#include "linalg/pairwise_distance.hpp"
+#include "predicates/predicates.hpp"
+
+#include "aabb/aabb.hpp"
+#include "camera/intrinsics.hpp"
+#include "camera/projection.hpp"
+#include "camera/multi_view.hpp"
+#include "frustum/frustum.hpp"
+#include "broadphase/sweep_and_prune.hpp"
+#include "soa/vec3_soa.hpp"
+#include "soa/mat4_soa.hpp"
+#include "soa/transform_points.hpp"
+#include "soa/quantized.hpp"
+#include "knn/kdtree.hpp"
+#include "icp/icp.hpp"
+#include "sym3/sym3.hpp"
+#include "normals/normals.hpp"
+#include "ransac/ransac.hpp"
+#include "distance_field/distance_field.hpp"
+#include "tsdf/tsdf_volume.hpp"
+#include "hull/convex_hull.hpp"
+#include "marching_cubes/marching_cubes.hpp"
+#include "voxel_grid/voxel_grid.hpp"
+#include "simplify/simplify.hpp"
+#include "mesh/tri_mesh.hpp"
+#include "io/point_cloud_io.hpp"
+#include "io/serialize.hpp"
+#include "stream/pipeline.hpp"
+#include "transform_tree/transform_tree.hpp"
+#include "skinning/skinning.hpp"
 
 #endif // __GEOMETRY_CXX_HPP__
@@ -0,0 +1,766 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_CONVEX_HULL_HPP__
+#define __GEOMETRY_CONVEX_HULL_HPP__
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mesh/tri_mesh.hpp"
+#include "parallel/parallel.hpp"
+#include "predicates/predicates.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+namespace hull
+{
+// Triangle of the hull, counterclockwise seen from outside. adj[i] is the
+// face across the edge v[i] -> v[i + 1].
+struct Face
+{
+  uint32_t v[3];
+  int32_t adj[3];
+  double a[3]; // First vertex
+  double n[3]; // (v1 - v0) x (v2 - v0), not normalized
+  double m[3]; // Sums of the absolute products of n, for the error bound
+  std::vector<uint32_t> outside;
+  uint32_t furthest;
+  double furthestDist;
+  bool alive;
+};
+
+struct HorizonEdge
+{
+  uint32_t a, b;
+  int32_t face; // Non visible face beyond the edge
+};
+
+// Quickhull (Barber, Dobkin and Huhdanpaa) on exact orientation tests.
+// A point is outside a face when it is strictly above its plane; the sign
+// is decided in double with a forward error bound, and by orient3d when the
+// bound is not conclusive, so that the hull is always convex. Coplanar faces
+// are kept triangulated.
+class QuickHull
+{
+public:
+  explicit QuickHull(const Vec3SoA<float> &points)
+      : px_(points.x.data()), py_(points.y.data()), pz_(points.z.data()),
+        n_(points.size()), stamp_(0)
+  {}
+
+  // Returns false if the points do not span a volume
+  bool run(TriMesh &mesh, std::vector<uint32_t> *ids)
+  {
+    mesh.clear();
+    if(ids != NULL)
+      ids->clear();
+    faces_.clear();
+    pending_.clear();
+    if(n_ < 4)
+      return false;
+
+    std::vector<uint32_t> extremes;
+    findExtremes(extremes);
+    if(!initialSimplex(extremes))
+      return false;
+
+    // Hull of the extreme points first : it is cheap, and most of the
+    // input lies inside it
+    for(size_t i = 0; i < extremes.size(); i++)
+      assign(extremes[i], 0, faces_.size());
+    expand();
+
+    partition();
+    expand();
+
+    output(mesh, ids);
+    return true;
+  }
+
+private:
+  const float *px_, *py_, *pz_;
+  size_t n_;
+  std::vector<Face> faces_;
+  std::vector<int32_t> pending_;
+  std::vector<uint32_t> mark_;
+  std::vector<char> visible_;
+  uint32_t stamp_;
+  std::vector<int32_t> stack_;
+  std::vector<int32_t> visibleFaces_;
+  std::vector<HorizonEdge> horizon_;
+  std::vector<uint32_t> orphans_;
+
+  inline void point(const uint32_t i, double *p) const
+  {
+    p[0] = px_[i];
+    p[1] = py_[i];
+    p[2] = pz_[i];
+  }
+
+  void setPlane(Face &f) const
+  {
+    double b[3], c[3], u[3], w[3];
+    point(f.v[0], f.a);
+    point(f.v[1], b);
+    point(f.v[2], c);
+    for(int k = 0; k < 3; k++)
+    {
+      u[k] = b[k] - f.a[k];
+      w[k] = c[k] - f.a[k];
+    }
+    for(int k = 0; k < 3; k++)
+    {
+      const int k1 = (k + 1) % 3, k2 = (k + 2) % 3;
+      f.n[k] = u[k1] * w[k2] - u[k2] * w[k1];
+      f.m[k] = fabs(u[k1] * w[k2]) + fabs(u[k2] * w[k1]);
+    }
+  }
+
+  // Signed distance of point i to the plane of f, scaled by |n|. Returns
+  // true if the point is strictly outside.
+  inline bool outside(const Face &f, const uint32_t i, double &dist) const
+  {
+    double p[3], d[3];
+    point(i, p);
+    for(int k = 0; k < 3; k++)
+      d[k] = p[k] - f.a[k];
+    dist = f.n[0] * d[0] + f.n[1] * d[1] + f.n[2] * d[2];
+    // Error of dist : products and sums of rounded differences
+    const double bound
+        = 32.0 * predicates::epsilon
+          * (f.m[0] * fabs(d[0]) + f.m[1] * fabs(d[1]) + f.m[2] * fabs(d[2]));
+    if(dist > bound)
+      return true;
+    if(dist < -bound)
+      return false;
+    double b[3], c[3];
+    point(f.v[1], b);
+    point(f.v[2], c);
+    return orient3d(f.a, b, c, p) < 0.0;
+  }
+
+  inline void addOutside(Face &f, const uint32_t i, const double dist)
+  {
+    if(f.outside.empty() || dist > f.furthestDist)
+    {
+      f.furthest = i;
+      f.furthestDist = dist;
+    }
+    f.outside.push_back(i);
+  }
+
+  // Assigns point i to the first face in [begin, end) it is outside of
+  inline void assign(const uint32_t i, const size_t begin, const size_t end)
+  {
+    for(size_t f = begin; f < end; f++)
+    {
+      double dist;
+      if(faces_[f].alive && outside(faces_[f], i, dist))
+      {
+        if(faces_[f].outside.empty())
+          pending_.push_back(int32_t(f));
+        addOutside(faces_[f], i, dist);
+        return;
+      }
+    }
+  }
+
+  inline int32_t newFace(const uint32_t a, const uint32_t b, const uint32_t c)
+  {
+    Face f;
+    f.v[0] = a;
+    f.v[1] = b;
+    f.v[2] = c;
+    f.adj[0] = f.adj[1] = f.adj[2] = -1;
+    f.furthest = 0;
+    f.furthestDist = 0.0;
+    f.alive = true;
+    setPlane(f);
+    faces_.push_back(f);
+    return int32_t(faces_.size() - 1);
+  }
+
+  // Index of the edge a -> b in face f
+  inline int edgeIndex(const Face &f, const uint32_t a, const uint32_t b) const
+  {
+    for(int j = 0; j < 3; j++)
+      if(f.v[j] == a && f.v[(j + 1) % 3] == b)
+        return j;
+    return -1;
+  }
+
+  // Extreme points along the 13 directions of the 3x3x3 stencil, both ways
+  void findExtremes(std::vector<uint32_t> &extremes) const
+  {
+    static const int nDirs = 13;
+    static const float dirs[nDirs][3]
+        = {{1, 0, 0},  {0, 1, 0},  {0, 0, 1},  {1, 1, 0},  {1, -1, 0},
+           {1, 0, 1},  {1, 0, -1}, {0, 1, 1},  {0, 1, -1}, {1, 1, 1},
+           {1, 1, -1}, {1, -1, 1}, {-1, 1, 1}};
+
+    const int nThreads = parallel::maxThreads();
+    std::vector<float> lo(size_t(nThreads) * nDirs, FLT_MAX);
+    std::vector<float> hi(size_t(nThreads) * nDirs, -FLT_MAX);
+    std::vector<uint32_t> loId(size_t(nThreads) * nDirs, 0);
+    std::vector<uint32_t> hiId(size_t(nThreads) * nDirs, 0);
+    int nt = 1;
+
+#pragma omp parallel num_threads(nThreads)
+    {
+#pragma omp single
+      nt = parallel::numThreads();
+
+      const int tid = parallel::threadId();
+      size_t begin, end;
+      parallel::chunkRange(n_, nt, tid, begin, end);
+      float *tlo = lo.data() + size_t(tid) * nDirs;
+      float *thi = hi.data() + size_t(tid) * nDirs;
+      uint32_t *tloId = loId.data() + size_t(tid) * nDirs;
+      uint32_t *thiId = hiId.data() + size_t(tid) * nDirs;
+      // Vectorized min / max over blocks of points, the index being searched
+      // only in the blocks that improve on the current extreme
+      static const size_t blockSize = 256;
+      for(size_t b = begin; b < end; b += blockSize)
+      {
+        const size_t e = b + blockSize < end ? b + blockSize : end;
+        for(int d = 0; d < nDirs; d++)
+        {
+          const float ux = dirs[d][0], uy = dirs[d][1], uz = dirs[d][2];
+          float bl = FLT_MAX, bh = -FLT_MAX;
+#pragma omp simd reduction(min : bl) reduction(max : bh)
+          for(size_t i = b; i < e; i++)
+          {
+            const float v = ux * px_[i] + uy * py_[i] + uz * pz_[i];
+            bl = v < bl ? v : bl;
+            bh = v > bh ? v : bh;
+          }
+          if(bl < tlo[d] || bh > thi[d])
+          {
+            for(size_t i = b; i < e; i++)
+            {
+              const float v = ux * px_[i] + uy * py_[i] + uz * pz_[i];
+              if(v < tlo[d])
+              {
+                tlo[d] = v;
+                tloId[d] = uint32_t(i);
+              }
+              if(v > thi[d])
+              {
+                thi[d] = v;
+                thiId[d] = uint32_t(i);
+              }
+            }
+          }
+        }
+      }
+    }
+
+    extremes.clear();
+    for(int d = 0; d < nDirs; d++)
+    {
+      int bestLo = 0, bestHi = 0;
+      for(int t = 1; t < nt; t++)
+      {
+        if(lo[size_t(t) * nDirs + d] < lo[size_t(bestLo) * nDirs + d])
+          bestLo = t;
+        if(hi[size_t(t) * nDirs + d] > hi[size_t(bestHi) * nDirs + d])
+          bestHi = t;
+      }
+      extremes.push_back(loId[size_t(bestLo) * nDirs + d]);
+      extremes.push_back(hiId[size_t(bestHi) * nDirs + d]);
+    }
+    std::sort(extremes.begin(), extremes.end());
+    extremes.erase(
+        std::unique(extremes.begin(), extremes.end()), extremes.end());
+  }
+
+  // Tetrahedron from the two most distant extremes, the point furthest from
+  // their line and the point furthest from the plane of the three
+  bool initialSimplex(const std::vector<uint32_t> &extremes)
+  {
+    double best = -1.0;
+    uint32_t i0 = 0, i1 = 0;
+    for(size_t i = 0; i < extremes.size(); i++)
+    {
+      for(size_t j = i + 1; j < extremes.size(); j++)
+      {
+        double p[3], q[3];
+        point(extremes[i], p);
+        point(extremes[j], q);
+        const double d = (p[0] - q[0]) * (p[0] - q[0])
+                         + (p[1] - q[1]) * (p[1] - q[1])
+                         + (p[2] - q[2]) * (p[2] - q[2]);
+        if(d > best)
+        {
+          best = d;
+          i0 = extremes[i];
+          i1 = extremes[j];
+        }
+      }
+    }
+    if(!(best > 0.0))
+      return false;
+
+    double a[3], b[3], u[3];
+    point(i0, a);
+    point(i1, b);
+    for(int k = 0; k < 3; k++)
+      u[k] = b[k] - a[k];
+    const auto lineScore = [&](const double *p) {
+      const double w[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+      const double cx = u[1] * w[2] - u[2] * w[1];
+      const double cy = u[2] * w[0] - u[0] * w[2];
+      const double cz = u[0] * w[1] - u[1] * w[0];
+      return cx * cx + cy * cy + cz * cz;
+    };
+    // Candidates are taken among the extremes, all the points being scanned
+    // only for degenerate extremes
+    uint32_t i2 = bestOf(lineScore, extremes);
+    double c[3];
+    point(i2, c);
+    if(!collinearSafe(a, b, c))
+    {
+      i2 = furthest(lineScore);
+      point(i2, c);
+      if(!collinearSafe(a, b, c))
+        return false;
+    }
+
+    const auto planeScore = [&](const double *p) {
+      double det, bound;
+      predicates::orient3dFilter(a, b, c, p, det, bound);
+      return fabs(det);
+    };
+    uint32_t i3 = bestOf(planeScore, extremes);
+    double d[3];
+    point(i3, d);
+    if(orient3d(a, b, c, d) == 0.0)
+    {
+      i3 = furthest(planeScore);
+      point(i3, d);
+    }
+    if(orient3d(a, b, c, d) == 0.0)
+    {
+      // Nearly flat input : look for any point off the plane
+      size_t i = 0;
+      for(; i < n_; i++)
+      {
+        point(uint32_t(i), d);
+        if(orient3d(a, b, c, d) != 0.0)
+          break;
+      }
+      if(i == n_)
+        return false;
+      i3 = uint32_t(i);
+    }
+
+    uint32_t v[4] = {i0, i1, i2, i3};
+    if(orient3d(a, b, c, d) < 0.0)
+    {
+      v[1] = i2;
+      v[2] = i1;
+    }
+    newFace(v[0], v[1], v[2]);
+    newFace(v[0], v[3], v[1]);
+    newFace(v[1], v[3], v[2]);
+    newFace(v[2], v[3], v[0]);
+    for(int f = 0; f < 4; f++)
+      for(int j = 0; j < 3; j++)
+        for(int g = 0; g < 4; g++)
+        {
+          const int e = edgeIndex(
+              faces_[g], faces_[f].v[(j + 1) % 3], faces_[f].v[j]);
+          if(g != f && e >= 0)
+            faces_[f].adj[j] = g;
+        }
+    return true;
+  }
+
+  // False if c lies exactly on the line ab
+  static inline bool
+  collinearSafe(const double *a, const double *b, const double *c)
+  {
+    const double xy[3][2] = {{a[0], a[1]}, {b[0], b[1]}, {c[0], c[1]}};
+    const double yz[3][2] = {{a[1], a[2]}, {b[1], b[2]}, {c[1], c[2]}};
+    const double zx[3][2] = {{a[2], a[0]}, {b[2], b[0]}, {c[2], c[0]}};
+    return orient2d(xy[0], xy[1], xy[2]) != 0.0
+           || orient2d(yz[0], yz[1], yz[2]) != 0.0
+           || orient2d(zx[0], zx[1], zx[2]) != 0.0;
+  }
+
+  template <typename Score>
+  uint32_t bestOf(const Score &score, const std::vector<uint32_t> &ids) const
+  {
+    double s = -1.0;
+    uint32_t ret = ids[0];
+    for(size_t i = 0; i < ids.size(); i++)
+    {
+      double p[3];
+      point(ids[i], p);
+      const double v = score(p);
+      if(v > s)
+      {
+        s = v;
+        ret = ids[i];
+      }
+    }
+    return ret;
+  }
+
+  // Index maximizing score over all the points
+  template <typename Score>
+  uint32_t furthest(const Score &score) const
+  {
+    const int nThreads = parallel::maxThreads();
+    std::vector<double> best(size_t(nThreads), -1.0);
+    std::vector<uint32_t> bestId(size_t(nThreads), 0);
+#pragma omp parallel num_threads(nThreads)
+    {
+      const int tid = parallel::threadId();
+      size_t begin, end;
+      parallel::chunkRange(n_, parallel::numThreads(), tid, begin, end);
+      for(size_t i = begin; i < end; i++)
+      {
+        double p[3];
+        point(uint32_t(i), p);
+        const double s = score(p);
+        if(s > best[tid])
+        {
+          best[tid] = s;
+          bestId[tid] = uint32_t(i);
+        }
+      }
+    }
+    int t = 0;
+    for(int i = 1; i < nThreads; i++)
+      t = best[i] > best[t] ? i : t;
+    return bestId[t];
+  }
+
+  // Assigns every input point to a face of the current hull, in parallel.
+  // Points inside a ball and a box centred at the vertex centroid, both
+  // fitting in the hull, are rejected first. The others are tested against
+  // all the face planes in single precision, with a margin far above the
+  // float rounding error, and only those not clearly inside go through the
+  // exact tests.
+  void partition()
+  {
+    std::vector<int32_t> alive;
+    std::vector<uint32_t> verts;
+    for(size_t f = 0; f < faces_.size(); f++)
+    {
+      if(!faces_[f].alive)
+        continue;
+      alive.push_back(int32_t(f));
+      for(int j = 0; j < 3; j++)
+        verts.push_back(faces_[f].v[j]);
+    }
+    const int32_t nAlive = int32_t(alive.size());
+
+    // The axis extremes are on the hull, so the vertex bounds are those of
+    // the whole input
+    double c[3] = {0.0, 0.0, 0.0}, lo[3], hi[3];
+    point(verts[0], lo);
+    point(verts[0], hi);
+    for(size_t i = 0; i < verts.size(); i++)
+    {
+      double p[3];
+      point(verts[i], p);
+      for(int k = 0; k < 3; k++)
+      {
+        c[k] += p[k] / double(verts.size());
+        lo[k] = p[k] < lo[k] ? p[k] : lo[k];
+        hi[k] = p[k] > hi[k] ? p[k] : hi[k];
+      }
+    }
+    double ext[3], maxAbs[3];
+    for(int k = 0; k < 3; k++)
+    {
+      ext[k] = 0.5 * (hi[k] - lo[k]);
+      maxAbs[k] = fabs(lo[k]) > fabs(hi[k]) ? fabs(lo[k]) : fabs(hi[k]);
+    }
+
+    // Unit planes u.p <= w, shifted by the float error margin
+    double r = DBL_MAX, s = DBL_MAX;
+    std::vector<float> ux(nAlive), uy(nAlive), uz(nAlive), uw(nAlive);
+    for(int32_t i = 0; i < nAlive; i++)
+    {
+      const Face &f = faces_[alive[i]];
+      const double len
+          = sqrt(f.n[0] * f.n[0] + f.n[1] * f.n[1] + f.n[2] * f.n[2]);
+      const double u[3] = {f.n[0] / len, f.n[1] / len, f.n[2] / len};
+      const double w = u[0] * f.a[0] + u[1] * f.a[1] + u[2] * f.a[2];
+      const double gap = w - (u[0] * c[0] + u[1] * c[1] + u[2] * c[2]);
+      const double spread
+          = fabs(u[0]) * ext[0] + fabs(u[1]) * ext[1] + fabs(u[2]) * ext[2];
+      r = gap < r ? gap : r;
+      s = spread > 0.0 && gap / spread < s ? gap / spread : s;
+      const double tol = 1e-6
+                         * (fabs(u[0]) * maxAbs[0] + fabs(u[1]) * maxAbs[1]
+                            + fabs(u[2]) * maxAbs[2] + fabs(w));
+      ux[i] = float(u[0]);
+      uy[i] = float(u[1]);
+      uz[i] = float(u[2]);
+      uw[i] = float(w - tol);
+    }
+    const double shrink = 1.0 - 1e-6;
+    const double r2 = r > 0.0 ? r * r * shrink : 0.0;
+    const double hx = s * ext[0] * shrink, hy = s * ext[1] * shrink;
+    const double hz = s * ext[2] * shrink;
+    const float *fx = ux.data(), *fy = uy.data(), *fz = uz.data();
+    const float *fw = uw.data();
+
+    // Blocks of the remaining points are tested against all the planes, the
+    // inner loop running over the points of the block
+    static const size_t blockSize = 512;
+    const int64_t nBlocks = int64_t((n_ + blockSize - 1) / blockSize);
+    std::vector<int32_t> faceOf(n_);
+#pragma omp parallel for schedule(dynamic, 8)
+    for(int64_t b = 0; b < nBlocks; b++)
+    {
+      const size_t begin = size_t(b) * blockSize;
+      const size_t end = begin + blockSize < n_ ? begin + blockSize : n_;
+      float bx[blockSize], by[blockSize], bz[blockSize], excess[blockSize];
+      uint32_t ids[blockSize];
+      size_t m = 0;
+      for(size_t i = begin; i < end; i++)
+      {
+        faceOf[i] = -1;
+        const double dx = px_[i] - c[0], dy = py_[i] - c[1];
+        const double dz = pz_[i] - c[2];
+        if(dx * dx + dy * dy + dz * dz < r2
+           || (fabs(dx) < hx && fabs(dy) < hy && fabs(dz) < hz))
+          continue;
+        bx[m] = px_[i];
+        by[m] = py_[i];
+        bz[m] = pz_[i];
+        excess[m] = -FLT_MAX;
+        ids[m++] = uint32_t(i);
+      }
+
+      for(int32_t f = 0; f < nAlive; f++)
+      {
+        const float vx = fx[f], vy = fy[f], vz = fz[f], vw = fw[f];
+#pragma omp simd
+        for(size_t k = 0; k < m; k++)
+        {
+          const float e = vx * bx[k] + vy * by[k] + vz * bz[k] - vw;
+          excess[k] = e > excess[k] ? e : excess[k];
+        }
+      }
+
+      for(size_t k = 0; k < m; k++)
+      {
+        if(excess[k] < 0.0f)
+          continue;
+        for(int32_t f = 0; f < nAlive; f++)
+        {
+          double dist;
+          if(outside(faces_[alive[f]], ids[k], dist))
+          {
+            faceOf[ids[k]] = alive[f];
+            break;
+          }
+        }
+      }
+    }
+
+    for(size_t i = 0; i < n_; i++)
+    {
+      const int32_t f = faceOf[i];
+      if(f < 0)
+        continue;
+      double dist;
+      outside(faces_[f], uint32_t(i), dist);
+      if(faces_[f].outside.empty())
+        pending_.push_back(f);
+      addOutside(faces_[f], uint32_t(i), dist);
+    }
+  }
+
+  // Adds the furthest outside points of the pending faces until no face has
+  // outside points left
+  void expand()
+  {
+    while(!pending_.empty())
+    {
+      const int32_t f = pending_.back();
+      pending_.pop_back();
+      if(faces_[f].alive && !faces_[f].outside.empty())
+        addPoint(f);
+    }
+  }
+
+  void addPoint(const int32_t f0)
+  {
+    const uint32_t p = faces_[f0].furthest;
+
+    // Visible faces by a traversal from f0, and the horizon edges between
+    // visible and non visible faces
+    if(++stamp_ == 0)
+    {
+      std::fill(mark_.begin(), mark_.end(), 0);
+      stamp_ = 1;
+    }
+    mark_.resize(faces_.size(), 0);
+    visible_.resize(faces_.size(), 0);
+    visibleFaces_.clear();
+    horizon_.clear();
+    stack_.assign(1, f0);
+    mark_[f0] = stamp_;
+    visible_[f0] = 1;
+    while(!stack_.empty())
+    {
+      const int32_t f = stack_.back();
+      stack_.pop_back();
+      visibleFaces_.push_back(f);
+      for(int j = 0; j < 3; j++)
+      {
+        const int32_t g = faces_[f].adj[j];
+        if(mark_[g] != stamp_)
+        {
+          double dist;
+          mark_[g] = stamp_;
+          visible_[g] = outside(faces_[g], p, dist) ? 1 : 0;
+          if(visible_[g])
+            stack_.push_back(g);
+        }
+        if(!visible_[g])
+        {
+          HorizonEdge e;
+          e.a = faces_[f].v[j];
+          e.b = faces_[f].v[(j + 1) % 3];
+          e.face = g;
+          horizon_.push_back(e);
+        }
+      }
+    }
+
+    // Cone of new faces from the horizon to p
+    const size_t first = faces_.size();
+    for(size_t k = 0; k < horizon_.size(); k++)
+    {
+      const HorizonEdge &e = horizon_[k];
+      const int32_t nf = newFace(e.a, e.b, p);
+      faces_[nf].adj[0] = e.face;
+      faces_[e.face].adj[edgeIndex(faces_[e.face], e.b, e.a)] = nf;
+    }
+    const size_t end = faces_.size();
+    for(size_t k = first; k < end; k++)
+    {
+      const uint32_t b = faces_[k].v[1];
+      for(size_t l = first; l < end; l++)
+      {
+        if(faces_[l].v[0] == b)
+        {
+          faces_[k].adj[1] = int32_t(l);
+          faces_[l].adj[2] = int32_t(k);
+          break;
+        }
+      }
+    }
+
+    // The outside points of the visible faces go to the new faces or are
+    // now inside
+    orphans_.clear();
+    for(size_t k = 0; k < visibleFaces_.size(); k++)
+    {
+      Face &f = faces_[visibleFaces_[k]];
+      f.alive = false;
+      for(size_t i = 0; i < f.outside.size(); i++)
+        if(f.outside[i] != p)
+          orphans_.push_back(f.outside[i]);
+      std::vector<uint32_t>().swap(f.outside);
+    }
+
+    const size_t no = orphans_.size();
+    std::vector<int32_t> faceOf(no);
+    std::vector<double> distOf(no);
+#pragma omp parallel for if(no > 8192)
+    for(int64_t i = 0; i < int64_t(no); i++)
+    {
+      faceOf[i] = -1;
+      for(size_t k = first; k < end; k++)
+      {
+        double dist;
+        if(outside(faces_[k], orphans_[i], dist))
+        {
+          faceOf[i] = int32_t(k);
+          distOf[i] = dist;
+          break;
+        }
+      }
+    }
+    for(size_t i = 0; i < no; i++)
+      if(faceOf[i] >= 0)
+        addOutside(faces_[faceOf[i]], orphans_[i], distOf[i]);
+    for(size_t k = first; k < end; k++)
+      if(!faces_[k].outside.empty())
+        pending_.push_back(int32_t(k));
+  }
+
+  void output(TriMesh &mesh, std::vector<uint32_t> *ids) const
+  {
+    std::vector<int32_t> remap(n_, -1);
+    std::vector<uint32_t> used;
+    for(size_t f = 0; f < faces_.size(); f++)
+    {
+      if(!faces_[f].alive)
+        continue;
+      for(int j = 0; j < 3; j++)
+      {
+        const uint32_t v = faces_[f].v[j];
+        if(remap[v] < 0)
+        {
+          remap[v] = int32_t(used.size());
+          used.push_back(v);
+        }
+        mesh.indices.push_back(uint32_t(remap[v]));
+      }
+    }
+    mesh.positions.resize(used.size());
+    for(size_t i = 0; i < used.size(); i++)
+      mesh.positions.set(i, px_[used[i]], py_[used[i]], pz_[used[i]]);
+    if(ids != NULL)
+      *ids = used;
+  }
+};
+} // namespace hull
+
+// Convex hull of a point set as a closed triangle mesh, faces counterclockwise
+// seen from outside, vertices in order of first use. ids receives the input
+// index of each hull vertex. Returns false, with an empty mesh, when the
+// points are all coplanar.
+// The extreme points along 26 directions are hulled first; a parallel pass
+// then discards the input points inside that hull, usually the vast majority,
+// before quickhull runs on the remaining ones.
+inline bool convexHull(
+    const Vec3SoA<float> &points, TriMesh &mesh,
+    std::vector<uint32_t> *ids = NULL)
+{
+  hull::QuickHull qh(points);
+  return qh.run(mesh, ids);
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_CONVEX_HULL_HPP__
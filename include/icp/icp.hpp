@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_ICP_HPP__
+#define __GEOMETRY_ICP_HPP__
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "knn/kdtree.hpp"
+#include "lie/lie.hpp"
+#include "linalg/small_solve.hpp"
+#include "mat4/mat4.hpp"
+#include "parallel/parallel.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+enum IcpMethod
+{
+  ICP_POINT_TO_POINT,
+  ICP_POINT_TO_PLANE
+};
+
+struct IcpResult
+{
+  Mat4<float> transform; // Maps the source cloud onto the target cloud
+  float rmse;            // Of the correspondences of the last iteration
+  size_t inliers;
+  int iterations;
+  bool converged;
+};
+
+namespace icp
+{
+// Rigid transform in double precision : p' = r * p + t
+typedef SE3<double> Transform;
+
+// Eigen decomposition of a symmetric 4x4 matrix with cyclic Jacobi rotations.
+// On return the diagonal of a holds the eigenvalues and the columns of v the
+// eigenvectors.
+inline void jacobiEigen4(double a[4][4], double v[4][4])
+{
+  for(int i = 0; i < 4; i++)
+    for(int j = 0; j < 4; j++)
+      v[i][j] = i == j ? 1.0 : 0.0;
+
+  for(int sweep = 0; sweep < 50; sweep++)
+  {
+    double off = 0.0;
+    for(int p = 0; p < 4; p++)
+      for(int q = p + 1; q < 4; q++)
+        off += a[p][q] * a[p][q];
+    if(off < 1e-30)
+      return;
+
+    for(int p = 0; p < 4; p++)
+    {
+      for(int q = p + 1; q < 4; q++)
+      {
+        if(fabs(a[p][q]) < 1e-300)
+          continue;
+        const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        const double t = (theta >= 0.0 ? 1.0 : -1.0)
+                         / (fabs(theta) + sqrt(theta * theta + 1.0));
+        const double c = 1.0 / sqrt(t * t + 1.0);
+        const double s = t * c;
+        for(int k = 0; k < 4; k++)
+        {
+          const double akp = a[k][p];
+          const double akq = a[k][q];
+          a[k][p] = c * akp - s * akq;
+          a[k][q] = s * akp + c * akq;
+        }
+        for(int k = 0; k < 4; k++)
+        {
+          const double apk = a[p][k];
+          const double aqk = a[q][k];
+          a[p][k] = c * apk - s * aqk;
+          a[q][k] = s * apk + c * aqk;
+        }
+        for(int k = 0; k < 4; k++)
+        {
+          const double vkp = v[k][p];
+          const double vkq = v[k][q];
+          v[k][p] = c * vkp - s * vkq;
+          v[k][q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+}
+
+// Closed form rigid alignment (Horn, 1987) from the correspondence sums :
+// s = sum(p), sq = sum(q) and spq = sum(p * q^T). The optimal rotation is the
+// eigenvector of largest eigenvalue of a symmetric 4x4 matrix built from the
+// centered cross covariance, read as a unit quaternion. Unlike the SVD
+// formulation it never produces a reflection.
+inline Transform
+horn(const double *sp, const double *sq, const double spq[3][3],
+     const double n)
+{
+  double cp[3], cq[3], h[3][3];
+  for(int i = 0; i < 3; i++)
+  {
+    cp[i] = sp[i] / n;
+    cq[i] = sq[i] / n;
+  }
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      h[i][j] = spq[i][j] - n * cp[i] * cq[j];
+
+  double a[4][4] = {
+      {h[0][0] + h[1][1] + h[2][2], h[1][2] - h[2][1], h[2][0] - h[0][2],
+       h[0][1] - h[1][0]},
+      {h[1][2] - h[2][1], h[0][0] - h[1][1] - h[2][2], h[0][1] + h[1][0],
+       h[2][0] + h[0][2]},
+      {h[2][0] - h[0][2], h[0][1] + h[1][0], -h[0][0] + h[1][1] - h[2][2],
+       h[1][2] + h[2][1]},
+      {h[0][1] - h[1][0], h[2][0] + h[0][2], h[1][2] + h[2][1],
+       -h[0][0] - h[1][1] + h[2][2]}};
+  double v[4][4];
+  jacobiEigen4(a, v);
+
+  int best = 0;
+  for(int i = 1; i < 4; i++)
+    best = a[i][i] > a[best][best] ? i : best;
+  const double w = v[0][best];
+  const double x = v[1][best];
+  const double y = v[2][best];
+  const double z = v[3][best];
+
+  Transform ret;
+  ret.r[0][0] = w * w + x * x - y * y - z * z;
+  ret.r[0][1] = 2.0 * (x * y - w * z);
+  ret.r[0][2] = 2.0 * (x * z + w * y);
+  ret.r[1][0] = 2.0 * (x * y + w * z);
+  ret.r[1][1] = w * w - x * x + y * y - z * z;
+  ret.r[1][2] = 2.0 * (y * z - w * x);
+  ret.r[2][0] = 2.0 * (x * z - w * y);
+  ret.r[2][1] = 2.0 * (y * z + w * x);
+  ret.r[2][2] = w * w - x * x - y * y + z * z;
+  for(int i = 0; i < 3; i++)
+  {
+    ret.t[i] = cq[i]
+               - (ret.r[i][0] * cp[0] + ret.r[i][1] * cp[1]
+                  + ret.r[i][2] * cp[2]);
+  }
+  return ret;
+}
+
+// Transform given in coordinates centred on c, expressed in the original
+// coordinates : p' = r * (p - c) + t + c
+inline Transform uncenter(const Transform &centred, const double *c)
+{
+  Transform ret = centred;
+  for(int i = 0; i < 3; i++)
+  {
+    ret.t[i] += c[i]
+                - (ret.r[i][0] * c[0] + ret.r[i][1] * c[1]
+                   + ret.r[i][2] * c[2]);
+  }
+  return ret;
+}
+} // namespace icp
+
+// -----------------------------------------------------------------------------
+
+// Iterative closest point registration of a source cloud onto a target cloud.
+// Each iteration first matches every source point to its closest target
+// point in parallel, writing the matched pairs to SoA buffers, then reduces
+// the pairs into the closed form (point to point) or Gauss-Newton (point to
+// plane) normal equations with a vectorized reduction.
+// The pairs are reduced in double relative to the first matched target
+// point, so that clouds far from the origin (scans in world or map
+// coordinates) do not lose the covariance to cancellation, and convergence
+// is measured on the update in these centred coordinates.
+// The target cloud and its normals must outlive the calls to align().
+class Icp
+{
+public:
+  explicit Icp(const IcpMethod method = ICP_POINT_TO_PLANE)
+      : method_(method), maxIterations_(30), maxDistance_(0.1f),
+        translationTolerance_(1e-5f), rotationTolerance_(1e-5f),
+        target_(NULL), normals_(NULL)
+  {}
+
+  inline void setMethod(const IcpMethod method) { method_ = method; }
+  inline void setMaxIterations(const int n) { maxIterations_ = n; }
+  inline void setMaxCorrespondenceDistance(const float d) { maxDistance_ = d; }
+
+  // Iterations stop when the update is below both tolerances (translation in
+  // distance units, rotation in radians)
+  inline void setTolerance(const float translation, const float rotation)
+  {
+    translationTolerance_ = translation;
+    rotationTolerance_ = rotation;
+  }
+
+  void setTarget(
+      const Vec3SoA<float> &points, const Vec3SoA<float> *normals = NULL)
+  {
+    if(normals != NULL && normals->size() != points.size())
+      throw std::invalid_argument("Icp : target normals size mismatch");
+    target_ = &points;
+    normals_ = normals;
+    tree_.build(points);
+  }
+
+  inline const KdTree &targetTree() const { return tree_; }
+
+  IcpResult align(const Vec3SoA<float> &source)
+  {
+    Mat4<float> identity;
+    identity.data = mat4f_identity();
+    return align(source, identity);
+  }
+
+  IcpResult align(const Vec3SoA<float> &source, const Mat4<float> &guess)
+  {
+    if(target_ == NULL)
+      throw std::logic_error("Icp : no target set");
+    if(method_ == ICP_POINT_TO_PLANE && normals_ == NULL)
+      throw std::logic_error("Icp : point to plane requires target normals");
+
+    icp::Transform transform = icp::Transform::fromMat4(guess);
+    IcpResult ret;
+    ret.rmse = 0.0f;
+    ret.inliers = 0;
+    ret.iterations = 0;
+    ret.converged = false;
+
+    for(int it = 0; it < maxIterations_; it++)
+    {
+      ret.iterations = it + 1;
+      double sumDist2 = 0.0;
+      ret.inliers = match(source, transform, sumDist2);
+      if(ret.inliers < 6)
+        break;
+      ret.rmse = float(sqrt(sumDist2 / double(ret.inliers)));
+
+      // Reference point of the centred coordinates
+      const double c[3]
+          = {double(q_.x[0]), double(q_.y[0]), double(q_.z[0])};
+      icp::Transform delta;
+      if(method_ == ICP_POINT_TO_POINT)
+        delta = pointToPoint(ret.inliers, c);
+      else if(!pointToPlane(ret.inliers, c, delta))
+        break;
+      transform = icp::uncenter(delta, c).compose(transform);
+
+      const double angle = acos(std::max(
+          -1.0,
+          std::min(
+              1.0,
+              0.5 * (delta.r[0][0] + delta.r[1][1] + delta.r[2][2] - 1.0))));
+      const double shift = sqrt(
+          delta.t[0] * delta.t[0] + delta.t[1] * delta.t[1]
+          + delta.t[2] * delta.t[2]);
+      if(shift < translationTolerance_ && angle < rotationTolerance_)
+      {
+        ret.converged = true;
+        break;
+      }
+    }
+
+    ret.transform = transform.toMat4();
+    return ret;
+  }
+
+private:
+  IcpMethod method_;
+  int maxIterations_;
+  float maxDistance_;
+  float translationTolerance_;
+  float rotationTolerance_;
+
+  const Vec3SoA<float> *target_;
+  const Vec3SoA<float> *normals_;
+  KdTree tree_;
+
+  // Matched pairs of the current iteration, compacted
+  std::vector<int64_t> matches_;
+  std::vector<float> dists2_;
+  Vec3SoA<float> p_;
+  Vec3SoA<float> q_;
+  Vec3SoA<float> n_;
+
+  // Transforms the source and finds correspondences, returns the number of
+  // pairs written to p_, q_ (and n_)
+  size_t match(
+      const Vec3SoA<float> &source, const icp::Transform &transform,
+      double &sumDist2)
+  {
+    const size_t n = source.size();
+    const int64_t sn = int64_t(n);
+    matches_.resize(n);
+    dists2_.resize(n);
+    p_.resize(n);
+
+    // In double, so that far from the origin the points are rounded once
+    const double(*r)[3] = transform.r;
+    const double *t = transform.t;
+
+    const float maxDist2 = maxDistance_ * maxDistance_;
+#pragma omp parallel for schedule(dynamic, 256)
+    for(int64_t i = 0; i < sn; i++)
+    {
+      const double x = source.x[i];
+      const double y = source.y[i];
+      const double z = source.z[i];
+      const float px = float(r[0][0] * x + r[0][1] * y + r[0][2] * z + t[0]);
+      const float py = float(r[1][0] * x + r[1][1] * y + r[1][2] * z + t[1]);
+      const float pz = float(r[2][0] * x + r[2][1] * y + r[2][2] * z + t[2]);
+      p_.set(size_t(i), px, py, pz);
+      matches_[i] = tree_.nearest(px, py, pz, maxDist2, dists2_[i]);
+    }
+
+    // Compact the pairs
+    size_t count = 0;
+    sumDist2 = 0.0;
+    for(size_t i = 0; i < n; i++)
+    {
+      if(matches_[i] < 0)
+        continue;
+      p_.set(count, p_.x[i], p_.y[i], p_.z[i]);
+      matches_[count] = matches_[i];
+      sumDist2 += dists2_[i];
+      count++;
+    }
+
+    q_.resize(count);
+    if(method_ == ICP_POINT_TO_PLANE)
+      n_.resize(count);
+    const int64_t sCount = int64_t(count);
+#pragma omp parallel for schedule(static)
+    for(int64_t i = 0; i < sCount; i++)
+    {
+      const size_t id = size_t(matches_[i]);
+      q_.set(size_t(i), target_->x[id], target_->y[id], target_->z[id]);
+      if(method_ == ICP_POINT_TO_PLANE)
+        n_.set(size_t(i), normals_->x[id], normals_->y[id], normals_->z[id]);
+    }
+    return count;
+  }
+
+  // Closed form update in coordinates centred on c
+  icp::Transform pointToPoint(const size_t count, const double *c)
+  {
+    const float *px = p_.x.data();
+    const float *py = p_.y.data();
+    const float *pz = p_.z.data();
+    const float *qx = q_.x.data();
+    const float *qy = q_.y.data();
+    const float *qz = q_.z.data();
+    const double cx = c[0], cy = c[1], cz = c[2];
+
+    // sum(p), sum(q), sum(p * q^T)
+    double acc[15] = {0.0};
+#pragma omp parallel for simd reduction(+ : acc[:15])
+    for(int64_t i = 0; i < int64_t(count); i++)
+    {
+      const double ax = px[i] - cx, ay = py[i] - cy, az = pz[i] - cz;
+      const double bx = qx[i] - cx, by = qy[i] - cy, bz = qz[i] - cz;
+      acc[0] += ax;
+      acc[1] += ay;
+      acc[2] += az;
+      acc[3] += bx;
+      acc[4] += by;
+      acc[5] += bz;
+      acc[6] += ax * bx;
+      acc[7] += ax * by;
+      acc[8] += ax * bz;
+      acc[9] += ay * bx;
+      acc[10] += ay * by;
+      acc[11] += ay * bz;
+      acc[12] += az * bx;
+      acc[13] += az * by;
+      acc[14] += az * bz;
+    }
+
+    const double spq[3][3]
+        = {{acc[6], acc[7], acc[8]},
+           {acc[9], acc[10], acc[11]},
+           {acc[12], acc[13], acc[14]}};
+    return icp::horn(acc, acc + 3, spq, double(count));
+  }
+
+  // Linearizes the rotation around the current estimate : the residual of a
+  // pair is r = (p - q).n + (p x n).w + n.t, giving the 6x6 normal equations
+  // sum(J J^T) x = -sum(J r) with J = [p x n, n]. p is centred on c, and so
+  // is the update.
+  bool pointToPlane(
+      const size_t count, const double *c, icp::Transform &delta)
+  {
+    const float *px = p_.x.data();
+    const float *py = p_.y.data();
+    const float *pz = p_.z.data();
+    const float *qx = q_.x.data();
+    const float *qy = q_.y.data();
+    const float *qz = q_.z.data();
+    const float *nx = n_.x.data();
+    const float *ny = n_.y.data();
+    const float *nz = n_.z.data();
+
+    // Upper triangle of J J^T (21 values) followed by J r (6 values)
+    const double cx = c[0], cy = c[1], cz = c[2];
+    double acc[27] = {0.0};
+#pragma omp parallel for simd reduction(+ : acc[:27])
+    for(int64_t i = 0; i < int64_t(count); i++)
+    {
+      const double ax = px[i] - cx, ay = py[i] - cy, az = pz[i] - cz;
+      const double mx = nx[i], my = ny[i], mz = nz[i];
+      const double j[6]
+          = {ay * mz - az * my, az * mx - ax * mz, ax * my - ay * mx,
+             mx, my, mz};
+      const double r = (double(px[i]) - qx[i]) * mx
+                       + (double(py[i]) - qy[i]) * my
+                       + (double(pz[i]) - qz[i]) * mz;
+      int k = 0;
+      for(int a = 0; a < 6; a++)
+        for(int b = a; b < 6; b++)
+          acc[k++] += j[a] * j[b];
+      for(int a = 0; a < 6; a++)
+        acc[21 + a] += j[a] * r;
+    }
+
+    double a[6][6], b[6], x[6];
+    int k = 0;
+    for(int i = 0; i < 6; i++)
+    {
+      for(int j = i; j < 6; j++)
+      {
+        a[i][j] = acc[k];
+        a[j][i] = acc[k];
+        k++;
+      }
+      b[i] = -acc[21 + i];
+    }
+    if(!solveCholesky<6, double>(a, b, x))
+      return false;
+
+    delta = icp::Transform::fromParts(SO3<double>::exp(x), x + 3);
+    return true;
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_ICP_HPP__
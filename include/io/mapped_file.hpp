@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_MAPPED_FILE_HPP__
+#define __GEOMETRY_MAPPED_FILE_HPP__
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <string>
+
+namespace geometry
+{
+// Read-only memory mapping of a whole file. The mapping lives as long as the
+// object, which can be moved but not copied.
+class MappedFile
+{
+public:
+  MappedFile() : data_(NULL), size_(0) {}
+
+  explicit MappedFile(const std::string &path) : data_(NULL), size_(0)
+  {
+    open(path);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&cp) : data_(cp.data_), size_(cp.size_)
+  {
+    cp.data_ = NULL;
+    cp.size_ = 0;
+  }
+
+  MappedFile &operator=(MappedFile &&cp)
+  {
+    if(this != &cp)
+    {
+      close();
+      data_ = cp.data_;
+      size_ = cp.size_;
+      cp.data_ = NULL;
+      cp.size_ = 0;
+    }
+    return *this;
+  }
+
+  ~MappedFile() { close(); }
+
+  void open(const std::string &path)
+  {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+      throw std::runtime_error("MappedFile : cannot open " + path);
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+      ::close(fd);
+      throw std::runtime_error("MappedFile : cannot stat " + path);
+    }
+    size_ = size_t(st.st_size);
+    if(size_ > 0)
+    {
+      void *ptr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(ptr == MAP_FAILED)
+      {
+        ::close(fd);
+        size_ = 0;
+        throw std::runtime_error("MappedFile : cannot map " + path);
+      }
+      data_ = static_cast<const uint8_t *>(ptr);
+      // Loaders read the whole file, usually from several threads
+      madvise(ptr, size_, MADV_WILLNEED);
+    }
+    ::close(fd);
+  }
+
+  void close()
+  {
+    if(data_ != NULL)
+      munmap(const_cast<uint8_t *>(data_), size_);
+    data_ = NULL;
+    size_ = 0;
+  }
+
+  inline const uint8_t *data() const { return data_; }
+
+  inline size_t size() const { return size_; }
+
+  inline bool isOpen() const { return data_ != NULL; }
+
+private:
+  const uint8_t *data_;
+  size_t size_;
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_MAPPED_FILE_HPP__
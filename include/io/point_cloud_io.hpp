@@ -0,0 +1,658 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_POINT_CLOUD_IO_HPP__
+#define __GEOMETRY_POINT_CLOUD_IO_HPP__
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "io/mapped_file.hpp"
+#include "parallel/parallel.hpp"
+#include "soa/vec3_soa.hpp"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#  error "point_cloud_io.hpp assumes a little endian host"
+#endif
+
+namespace geometry
+{
+// Strided view of float32 point coordinates inside a memory mapping. Each
+// component pointer addresses the first point, consecutive points being
+// stride bytes apart. Interleaved formats (PLY, XYZ) give stride > 4; the
+// native format stores each component contiguously (stride == 4), and its
+// arrays can be handed directly to the batch kernels.
+struct PointView
+{
+  size_t size;
+  size_t stride;
+  const uint8_t *x, *y, *z;
+  const uint8_t *nx, *ny, *nz; // NULL if the file has no normals
+
+  PointView()
+      : size(0), stride(0), x(NULL), y(NULL), z(NULL), nx(NULL), ny(NULL),
+        nz(NULL)
+  {}
+
+  inline bool hasNormals() const { return nx != NULL; }
+
+  inline bool contiguous() const { return stride == sizeof(float); }
+
+  static inline float read(const uint8_t *c, const size_t i, const size_t s)
+  {
+    float v;
+    memcpy(&v, c + i * s, sizeof(float));
+    return v;
+  }
+
+  inline float getX(const size_t i) const { return read(x, i, stride); }
+  inline float getY(const size_t i) const { return read(y, i, stride); }
+  inline float getZ(const size_t i) const { return read(z, i, stride); }
+
+  // Component arrays, only valid for contiguous views
+  inline const float *xData() const { return array(x); }
+  inline const float *yData() const { return array(y); }
+  inline const float *zData() const { return array(z); }
+  inline const float *nxData() const { return array(nx); }
+  inline const float *nyData() const { return array(ny); }
+  inline const float *nzData() const { return array(nz); }
+
+  // Parallel copy (deinterleaving) into SoA storage
+  inline void
+  copyTo(Vec3SoA<float> &points, Vec3SoA<float> *normals = NULL) const
+  {
+    copyRange(0, size, points, normals);
+  }
+
+  // Same for the count points starting at begin
+  void copyRange(
+      const size_t begin, const size_t count, Vec3SoA<float> &points,
+      Vec3SoA<float> *normals = NULL) const
+  {
+    if(begin > size || count > size - begin)
+      throw std::out_of_range("PointView : range out of bounds");
+    points.resize(count);
+    const bool withNormals = normals != NULL && hasNormals();
+    if(withNormals)
+      normals->resize(count);
+
+    const int64_t n = int64_t(count);
+#pragma omp parallel for
+    for(int64_t i = 0; i < n; i++)
+    {
+      const size_t j = begin + size_t(i);
+      points.x[i] = read(x, j, stride);
+      points.y[i] = read(y, j, stride);
+      points.z[i] = read(z, j, stride);
+      if(withNormals)
+      {
+        normals->x[i] = read(nx, j, stride);
+        normals->y[i] = read(ny, j, stride);
+        normals->z[i] = read(nz, j, stride);
+      }
+    }
+  }
+
+private:
+  inline const float *array(const uint8_t *c) const
+  {
+    if(!contiguous())
+      throw std::logic_error("PointView : view is not contiguous");
+    return reinterpret_cast<const float *>(c);
+  }
+};
+
+namespace io
+{
+// Native point cloud format : a 64 byte header followed by the x, y, z and
+// optionally nx, ny, nz float32 arrays, each starting on a 64 byte boundary.
+static const char nativeMagic[8] = {'G', 'E', 'O', 'S', 'O', 'A', '0', '1'};
+static const uint32_t nativeHasNormals = 1;
+static const size_t nativeAlignment = 64;
+
+struct NativeHeader
+{
+  char magic[8];
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t count;
+  uint8_t padding[40];
+};
+
+inline size_t nativeArrayBytes(const uint64_t count)
+{
+  const size_t bytes = size_t(count) * sizeof(float);
+  return (bytes + nativeAlignment - 1) / nativeAlignment * nativeAlignment;
+}
+
+// Fast decimal float parser ([+-]digits[.digits][(e|E)[+-]digits]). Advances
+// p past the number and returns false if there is none.
+inline bool parseFloat(const char *&p, const char *end, float &value)
+{
+  static const double pow10[23]
+      = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+         1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  const char *s = p;
+  bool negative = false;
+  if(s < end && (*s == '-' || *s == '+'))
+    negative = *s++ == '-';
+
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any = false;
+  for(; s < end && *s >= '0' && *s <= '9'; s++, any = true)
+  {
+    if(digits < 19)
+    {
+      mantissa = mantissa * 10 + uint64_t(*s - '0');
+      digits += mantissa > 0 ? 1 : 0;
+    }
+    else
+      exponent++;
+  }
+  if(s < end && *s == '.')
+  {
+    for(s++; s < end && *s >= '0' && *s <= '9'; s++, any = true)
+    {
+      if(digits < 19)
+      {
+        mantissa = mantissa * 10 + uint64_t(*s - '0');
+        digits += mantissa > 0 ? 1 : 0;
+        exponent--;
+      }
+    }
+  }
+  if(!any)
+    return false;
+  if(s < end && (*s == 'e' || *s == 'E'))
+  {
+    const char *e = s + 1;
+    bool negExp = false;
+    if(e < end && (*e == '-' || *e == '+'))
+      negExp = *e++ == '-';
+    if(e < end && *e >= '0' && *e <= '9')
+    {
+      int ev = 0;
+      for(; e < end && *e >= '0' && *e <= '9'; e++)
+        ev = ev < 10000 ? ev * 10 + (*e - '0') : ev;
+      exponent += negExp ? -ev : ev;
+      s = e;
+    }
+  }
+
+  double v = double(mantissa);
+  if(exponent < 0)
+    v = exponent >= -22 ? v / pow10[-exponent] : v * pow(10.0, exponent);
+  else if(exponent > 0)
+    v = exponent <= 22 ? v * pow10[exponent] : v * pow(10.0, exponent);
+  value = float(negative ? -v : v);
+  p = s;
+  return true;
+}
+
+inline bool isBlank(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// A row is a line with something else than blanks, not starting with '#'
+inline bool isRow(const char *p, const char *lineEnd)
+{
+  while(p < lineEnd && isBlank(*p))
+    p++;
+  return p < lineEnd && *p != '#';
+}
+
+// Parses the rows of an ASCII table in parallel. The text is split in one
+// chunk per thread at line boundaries; a first pass counts the rows of each
+// chunk, giving each chunk its output offset, and a second pass parses them.
+// columns[0..2] are the columns of x, y, z and columns[3..5] those of the
+// normal (-1 if absent). At most maxRows rows are read.
+inline size_t parseAsciiRows(
+    const char *begin, const char *end, const size_t maxRows,
+    const int *columns, Vec3SoA<float> &points, Vec3SoA<float> *normals)
+{
+  const bool withNormals = normals != NULL && columns[3] >= 0;
+  int nColumns = 0;
+  for(int c = 0; c < (withNormals ? 6 : 3); c++)
+    nColumns = columns[c] + 1 > nColumns ? columns[c] + 1 : nColumns;
+
+  const int nChunks = parallel::maxThreads();
+  std::vector<const char *> starts(size_t(nChunks) + 1);
+  for(int c = 0; c < nChunks; c++)
+  {
+    size_t b, e;
+    parallel::chunkRange(size_t(end - begin), nChunks, c, b, e);
+    const char *s = begin + b;
+    while(s > begin && s < end && s[-1] != '\n')
+      s++;
+    starts[c] = s;
+  }
+  starts[nChunks] = end;
+
+  std::vector<size_t> offsets(size_t(nChunks) + 1, 0);
+#pragma omp parallel for num_threads(nChunks)
+  for(int c = 0; c < nChunks; c++)
+  {
+    size_t count = 0;
+    for(const char *p = starts[c]; p < starts[c + 1];)
+    {
+      const char *lineEnd = static_cast<const char *>(
+          memchr(p, '\n', size_t(starts[c + 1] - p)));
+      lineEnd = lineEnd == NULL ? starts[c + 1] : lineEnd;
+      count += isRow(p, lineEnd) ? 1 : 0;
+      p = lineEnd + 1;
+    }
+    offsets[c + 1] = count;
+  }
+  for(int c = 0; c < nChunks; c++)
+    offsets[c + 1] += offsets[c];
+
+  const size_t total = offsets[nChunks] < maxRows ? offsets[nChunks] : maxRows;
+  points.resize(total);
+  if(withNormals)
+    normals->resize(total);
+
+  int failed = 0;
+#pragma omp parallel for num_threads(nChunks) reduction(+ : failed)
+  for(int c = 0; c < nChunks; c++)
+  {
+    size_t row = offsets[c];
+    for(const char *p = starts[c]; p < starts[c + 1] && row < total;)
+    {
+      const char *lineEnd = static_cast<const char *>(
+          memchr(p, '\n', size_t(starts[c + 1] - p)));
+      lineEnd = lineEnd == NULL ? starts[c + 1] : lineEnd;
+      if(isRow(p, lineEnd))
+      {
+        float values[16];
+        int n = 0;
+        const char *s = p;
+        while(n < nColumns && n < 16)
+        {
+          while(s < lineEnd && isBlank(*s))
+            s++;
+          if(!parseFloat(s, lineEnd, values[n]))
+            break;
+          n++;
+        }
+        if(n < nColumns)
+        {
+          failed++;
+          break;
+        }
+        points.x[row] = values[columns[0]];
+        points.y[row] = values[columns[1]];
+        points.z[row] = values[columns[2]];
+        if(withNormals)
+        {
+          normals->x[row] = values[columns[3]];
+          normals->y[row] = values[columns[4]];
+          normals->z[row] = values[columns[5]];
+        }
+        row++;
+      }
+      p = lineEnd + 1;
+    }
+  }
+  if(failed > 0)
+    throw std::runtime_error("parseAsciiRows : malformed row");
+  return total;
+}
+
+// Subset of a PLY header : the vertex element and its float properties
+struct PlyHeader
+{
+  bool ascii;
+  size_t headerSize;   // Offset of the first element
+  size_t vertexOffset; // Offset of the vertex data, binary files only
+  size_t vertexCount;
+  size_t vertexStride; // Bytes per binary vertex, or values per ASCII vertex
+  int columns[6];      // Byte offsets (binary) or columns (ASCII) of x..nz
+};
+
+inline size_t plyTypeSize(const std::string &type)
+{
+  if(type == "char" || type == "uchar" || type == "int8" || type == "uint8")
+    return 1;
+  if(type == "short" || type == "ushort" || type == "int16"
+     || type == "uint16")
+    return 2;
+  if(type == "int" || type == "uint" || type == "int32" || type == "uint32"
+     || type == "float" || type == "float32")
+    return 4;
+  if(type == "double" || type == "float64")
+    return 8;
+  throw std::runtime_error("readPlyHeader : unknown property type " + type);
+}
+
+inline PlyHeader readPlyHeader(const uint8_t *data, const size_t size)
+{
+  static const char *names[6] = {"x", "y", "z", "nx", "ny", "nz"};
+  const char *text = reinterpret_cast<const char *>(data);
+  const char *end = text + size;
+  if(size < 4 || memcmp(text, "ply", 3) != 0)
+    throw std::runtime_error("readPlyHeader : not a PLY file");
+
+  PlyHeader h;
+  h.ascii = false;
+  h.headerSize = 0;
+  h.vertexOffset = 0;
+  h.vertexCount = 0;
+  h.vertexStride = 0;
+  for(int c = 0; c < 6; c++)
+    h.columns[c] = -1;
+
+  bool inVertex = false, vertexSeen = false, format = false;
+  size_t before = 0; // Bytes of the fixed size elements before the vertices
+  size_t elementCount = 0, elementSize = 0;
+  bool elementHasList = false;
+  for(const char *p = text; p < end;)
+  {
+    const char *lineEnd
+        = static_cast<const char *>(memchr(p, '\n', size_t(end - p)));
+    if(lineEnd == NULL)
+      break;
+    std::istringstream line(std::string(p, lineEnd));
+    p = lineEnd + 1;
+
+    std::string keyword;
+    line >> keyword;
+    if(keyword == "format")
+    {
+      std::string fmt;
+      line >> fmt;
+      if(fmt == "ascii")
+        h.ascii = true;
+      else if(fmt != "binary_little_endian")
+        throw std::runtime_error("readPlyHeader : unsupported format " + fmt);
+      format = true;
+    }
+    else if(keyword == "element" || keyword == "end_header")
+    {
+      if(!vertexSeen && !inVertex && elementCount > 0)
+      {
+        if(elementHasList && !h.ascii)
+          throw std::runtime_error(
+              "readPlyHeader : list element before the vertices");
+        // Counts come from the file : compare them to the remaining bytes
+        // rather than computing a product that may wrap around
+        if(h.ascii)
+          before++;
+        else if(elementSize > 0 && elementCount > (size - before) / elementSize)
+          throw std::runtime_error("readPlyHeader : truncated element data");
+        else
+          before += elementCount * elementSize;
+      }
+      inVertex = false;
+      if(keyword == "end_header")
+      {
+        h.headerSize = size_t(p - text);
+        break;
+      }
+      std::string name;
+      line >> name >> elementCount;
+      elementSize = 0;
+      elementHasList = false;
+      if(name == "vertex")
+      {
+        if(h.ascii && before > 0)
+          throw std::runtime_error(
+              "readPlyHeader : ASCII vertices must be the first element");
+        inVertex = true;
+        vertexSeen = true;
+        h.vertexCount = elementCount;
+      }
+    }
+    else if(keyword == "property")
+    {
+      std::string type, name;
+      line >> type;
+      if(type == "list")
+      {
+        elementHasList = true;
+        if(inVertex)
+          throw std::runtime_error("readPlyHeader : list vertex property");
+        continue;
+      }
+      line >> name;
+      const size_t bytes = plyTypeSize(type);
+      if(inVertex)
+      {
+        for(int c = 0; c < 6; c++)
+        {
+          if(name != names[c])
+            continue;
+          if(!h.ascii && bytes != 4)
+            throw std::runtime_error(
+                "readPlyHeader : binary coordinates must be float32");
+          h.columns[c] = int(h.vertexStride);
+        }
+        h.vertexStride += h.ascii ? 1 : bytes;
+      }
+      else
+        elementSize += bytes;
+    }
+  }
+
+  if(h.headerSize == 0 || !format)
+    throw std::runtime_error("readPlyHeader : truncated header");
+  if(h.columns[0] < 0 || h.columns[1] < 0 || h.columns[2] < 0)
+    throw std::runtime_error("readPlyHeader : missing vertex coordinates");
+  if(h.columns[3] < 0 || h.columns[4] < 0 || h.columns[5] < 0)
+    h.columns[3] = h.columns[4] = h.columns[5] = -1;
+  h.vertexOffset = h.headerSize + before;
+  if(!h.ascii
+     && (h.vertexOffset > size
+         || h.vertexCount > (size - h.vertexOffset) / h.vertexStride))
+    throw std::runtime_error("readPlyHeader : truncated vertex data");
+  return h;
+}
+
+// View of the vertices of a binary PLY file mapped at data
+inline PointView plyView(const uint8_t *data, const PlyHeader &h)
+{
+  if(h.ascii)
+    throw std::runtime_error("plyView : ASCII PLY, use loadPly");
+
+  const uint8_t *base = data + h.vertexOffset;
+  PointView view;
+  view.size = h.vertexCount;
+  view.stride = h.vertexStride;
+  view.x = base + h.columns[0];
+  view.y = base + h.columns[1];
+  view.z = base + h.columns[2];
+  if(h.columns[3] >= 0)
+  {
+    view.nx = base + h.columns[3];
+    view.ny = base + h.columns[4];
+    view.nz = base + h.columns[5];
+  }
+  return view;
+}
+} // namespace io
+
+// Point cloud backed by a memory mapping. Binary formats are exposed as a
+// PointView without any copy : interleaved for binary PLY and raw XYZ files,
+// contiguous for the native format.
+class MappedPointCloud
+{
+public:
+  MappedPointCloud() {}
+
+  inline const PointView &view() const { return view_; }
+
+  inline size_t size() const { return view_.size; }
+
+  // Binary little endian PLY with float32 coordinates
+  void openPly(const std::string &path)
+  {
+    file_.open(path);
+    const io::PlyHeader h = io::readPlyHeader(file_.data(), file_.size());
+    if(h.ascii)
+      throw std::runtime_error("MappedPointCloud : ASCII PLY, use loadPly");
+    view_ = io::plyView(file_.data(), h);
+  }
+
+  // Raw interleaved float32 records of 3 (x y z) or 6 (x y z nx ny nz) values
+  void openXyz(const std::string &path, const bool withNormals = false)
+  {
+    file_.open(path);
+    const size_t stride = (withNormals ? 6 : 3) * sizeof(float);
+    if(file_.size() % stride != 0)
+      throw std::runtime_error("MappedPointCloud : bad raw XYZ file size");
+
+    const uint8_t *base = file_.data();
+    view_ = PointView();
+    view_.size = file_.size() / stride;
+    view_.stride = stride;
+    view_.x = base;
+    view_.y = base + 4;
+    view_.z = base + 8;
+    if(withNormals)
+    {
+      view_.nx = base + 12;
+      view_.ny = base + 16;
+      view_.nz = base + 20;
+    }
+  }
+
+  void openNative(const std::string &path)
+  {
+    file_.open(path);
+    io::NativeHeader h;
+    if(file_.size() < sizeof(h))
+      throw std::runtime_error("MappedPointCloud : truncated native file");
+    memcpy(&h, file_.data(), sizeof(h));
+    if(memcmp(h.magic, io::nativeMagic, sizeof(h.magic)) != 0)
+      throw std::runtime_error("MappedPointCloud : not a native point file");
+
+    // Checked by division first, the count being read from the file
+    const bool withNormals = (h.flags & io::nativeHasNormals) != 0;
+    const size_t nArrays = withNormals ? 6 : 3;
+    if(h.count > (file_.size() - sizeof(h)) / (nArrays * sizeof(float)))
+      throw std::runtime_error("MappedPointCloud : truncated native file");
+    const size_t arrayBytes = io::nativeArrayBytes(h.count);
+    if(sizeof(h) + nArrays * arrayBytes > file_.size())
+      throw std::runtime_error("MappedPointCloud : truncated native file");
+
+    const uint8_t *base = file_.data() + sizeof(h);
+    view_ = PointView();
+    view_.size = size_t(h.count);
+    view_.stride = sizeof(float);
+    view_.x = base;
+    view_.y = base + arrayBytes;
+    view_.z = base + 2 * arrayBytes;
+    if(withNormals)
+    {
+      view_.nx = base + 3 * arrayBytes;
+      view_.ny = base + 4 * arrayBytes;
+      view_.nz = base + 5 * arrayBytes;
+    }
+  }
+
+  void close()
+  {
+    file_.close();
+    view_ = PointView();
+  }
+
+private:
+  MappedFile file_;
+  PointView view_;
+};
+
+// Loads a binary or ASCII PLY file, ASCII ones being parsed in parallel
+inline void loadPly(
+    const std::string &path, Vec3SoA<float> &points,
+    Vec3SoA<float> *normals = NULL)
+{
+  MappedFile file(path);
+  const io::PlyHeader h = io::readPlyHeader(file.data(), file.size());
+  if(!h.ascii)
+  {
+    io::plyView(file.data(), h).copyTo(points, normals);
+    return;
+  }
+
+  const char *text = reinterpret_cast<const char *>(file.data());
+  const size_t rows = io::parseAsciiRows(
+      text + h.headerSize, text + file.size(), h.vertexCount, h.columns,
+      points, normals);
+  if(rows != h.vertexCount)
+    throw std::runtime_error("loadPly : truncated vertex data");
+}
+
+// Loads an ASCII table with one point per line (x y z [nx ny nz ...]). Blank
+// lines and lines starting with '#' are skipped. Normals are read from
+// columns 3 to 5 if requested.
+inline void loadAsciiXyz(
+    const std::string &path, Vec3SoA<float> &points,
+    Vec3SoA<float> *normals = NULL)
+{
+  MappedFile file(path);
+  const int columns[6] = {0, 1, 2, 3, 4, 5};
+  const char *text = reinterpret_cast<const char *>(file.data());
+  io::parseAsciiRows(
+      text, text + file.size(), SIZE_MAX, columns, points, normals);
+}
+
+inline void writeNative(
+    const std::string &path, const Vec3SoA<float> &points,
+    const Vec3SoA<float> *normals = NULL)
+{
+  const bool withNormals = normals != NULL && normals->size() == points.size();
+  io::NativeHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, io::nativeMagic, sizeof(h.magic));
+  h.flags = withNormals ? io::nativeHasNormals : 0;
+  h.count = points.size();
+
+  FILE *fp = fopen(path.c_str(), "wb");
+  if(fp == NULL)
+    throw std::runtime_error("writeNative : cannot open " + path);
+
+  const size_t bytes = points.size() * sizeof(float);
+  const size_t padding = io::nativeArrayBytes(h.count) - bytes;
+  const uint8_t zeros[io::nativeAlignment] = {0};
+  const std::vector<float> *arrays[6]
+      = {&points.x, &points.y, &points.z, NULL, NULL, NULL};
+  if(withNormals)
+  {
+    arrays[3] = &normals->x;
+    arrays[4] = &normals->y;
+    arrays[5] = &normals->z;
+  }
+
+  bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+  for(int c = 0; c < (withNormals ? 6 : 3) && ok; c++)
+  {
+    ok = bytes == 0 || fwrite(arrays[c]->data(), 1, bytes, fp) == bytes;
+    ok = ok && (padding == 0 || fwrite(zeros, 1, padding, fp) == padding);
+  }
+  ok = fclose(fp) == 0 && ok;
+  if(!ok)
+    throw std::runtime_error("writeNative : cannot write " + path);
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_POINT_CLOUD_IO_HPP__
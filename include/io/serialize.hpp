@@ -0,0 +1,442 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_SERIALIZE_HPP__
+#define __GEOMETRY_SERIALIZE_HPP__
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#  include <charconv>
+#endif
+
+#include "io/mapped_file.hpp"
+#include "mat4/mat4.hpp"
+#include "mat4/rigid_transform.hpp"
+#include "parallel/parallel.hpp"
+#include "vec3/vec3.hpp"
+#include "vec4/vec4.hpp"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#  error "serialize.hpp assumes a little endian host"
+#endif
+
+namespace geometry
+{
+// Binary records of Vec3<float>, quaternions stored as Vec4<float> (w, x, y,
+// z), RigidTransform and Mat4<float> arrays. A record is a 32 byte header
+// followed by the float32 components of each element, little endian :
+//   char magic[8] = "GEOSER01", uint32 type, uint32 flags, uint64 count,
+//   uint32 components, uint32 reserved
+// With SERIAL_DELTA, the bits of each component are XORed with the same
+// component of the previous element. The encoding is lossless, and slowly
+// varying sequences such as pose logs turn into mostly zero high bytes that
+// general purpose compressors shrink well.
+enum SerialType
+{
+  SERIAL_VEC3 = 1,
+  SERIAL_QUAT = 2,
+  SERIAL_RIGID = 3,
+  SERIAL_MAT4 = 4
+};
+
+enum SerialFlags
+{
+  SERIAL_DELTA = 1
+};
+
+namespace io
+{
+static const size_t serialHeaderSize = 32;
+static const char serialMagic[8] = {'G', 'E', 'O', 'S', 'E', 'R', '0', '1'};
+
+// Component access of the serializable types
+template <typename T>
+struct SerialTraits
+{};
+
+template <>
+struct SerialTraits<Vec3<float>>
+{
+  static const uint32_t type = SERIAL_VEC3;
+  static const int components = 3;
+  static inline void load(const Vec3<float> &v, float *c)
+  {
+    memcpy(c, v.data.data, 3 * sizeof(float));
+  }
+  static inline void store(const float *c, Vec3<float> &v)
+  {
+    memcpy(v.data.data, c, 3 * sizeof(float));
+  }
+};
+
+template <>
+struct SerialTraits<Vec4<float>>
+{
+  static const uint32_t type = SERIAL_QUAT;
+  static const int components = 4;
+  static inline void load(const Vec4<float> &v, float *c)
+  {
+    memcpy(c, v.data.data, 4 * sizeof(float));
+  }
+  static inline void store(const float *c, Vec4<float> &v)
+  {
+    memcpy(v.data.data, c, 4 * sizeof(float));
+  }
+};
+
+// Rows of the rotation then the translation
+template <>
+struct SerialTraits<RigidTransform>
+{
+  static const uint32_t type = SERIAL_RIGID;
+  static const int components = 12;
+  static inline void load(const RigidTransform &v, float *c)
+  {
+    memcpy(c, v.r, 9 * sizeof(float));
+    memcpy(c + 9, v.t, 3 * sizeof(float));
+  }
+  static inline void store(const float *c, RigidTransform &v)
+  {
+    memcpy(v.r, c, 9 * sizeof(float));
+    memcpy(v.t, c + 9, 3 * sizeof(float));
+  }
+};
+
+// Row major coefficients
+template <>
+struct SerialTraits<Mat4<float>>
+{
+  static const uint32_t type = SERIAL_MAT4;
+  static const int components = 16;
+  static inline void load(const Mat4<float> &v, float *c)
+  {
+    memcpy(c, v.data.data, 16 * sizeof(float));
+  }
+  static inline void store(const float *c, Mat4<float> &v)
+  {
+    memcpy(v.data.data, c, 16 * sizeof(float));
+  }
+};
+
+inline void storeU32(uint8_t *dst, const uint32_t v) { memcpy(dst, &v, 4); }
+inline void storeU64(uint8_t *dst, const uint64_t v) { memcpy(dst, &v, 8); }
+
+inline uint32_t loadU32(const uint8_t *src)
+{
+  uint32_t v;
+  memcpy(&v, src, 4);
+  return v;
+}
+
+inline uint64_t loadU64(const uint8_t *src)
+{
+  uint64_t v;
+  memcpy(&v, src, 8);
+  return v;
+}
+
+// Undoes the delta encoding of count elements of nc words in place : each
+// component is a running XOR. Every thread scans its own chunk, then the
+// chunks are corrected with the XOR of all the chunk ends before them.
+inline void xorPrefix(uint32_t *words, const size_t count, const int nc)
+{
+  const int nChunks = count > 4096 ? parallel::maxThreads() : 1;
+  std::vector<uint32_t> carry(size_t(nChunks) * size_t(nc), 0);
+
+#pragma omp parallel for num_threads(nChunks)
+  for(int c = 0; c < nChunks; c++)
+  {
+    size_t begin, end;
+    parallel::chunkRange(count, nChunks, c, begin, end);
+    for(size_t i = begin + 1; i < end; i++)
+      for(int k = 0; k < nc; k++)
+        words[i * nc + k] ^= words[(i - 1) * nc + k];
+    if(end > begin)
+      for(int k = 0; k < nc; k++)
+        carry[size_t(c) * nc + k] = words[(end - 1) * nc + k];
+  }
+  if(nChunks == 1)
+    return;
+
+  // Exclusive XOR scan of the chunk ends
+  std::vector<uint32_t> acc(size_t(nc), 0);
+  for(int c = 0; c < nChunks; c++)
+  {
+    for(int k = 0; k < nc; k++)
+    {
+      const uint32_t v = carry[size_t(c) * nc + k];
+      carry[size_t(c) * nc + k] = acc[k];
+      acc[k] ^= v;
+    }
+  }
+
+#pragma omp parallel for num_threads(nChunks)
+  for(int c = 1; c < nChunks; c++)
+  {
+    size_t begin, end;
+    parallel::chunkRange(count, nChunks, c, begin, end);
+    const uint32_t *cc = carry.data() + size_t(c) * nc;
+    for(size_t i = begin; i < end; i++)
+      for(int k = 0; k < nc; k++)
+        words[i * nc + k] ^= cc[k];
+  }
+}
+
+// Decimal representation that reads back to the same float : the shortest
+// one through std::to_chars when available (C++17), otherwise 9 significant
+// digits with trailing zeros removed. Writes at most 16 characters and
+// returns the end of the output.
+inline char *formatFloat(char *dst, const float v)
+{
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  return std::to_chars(dst, dst + 16, v).ptr;
+#else
+  if(!(v == v) || v - v != v - v)
+    return dst + snprintf(dst, 17, "%g", double(v));
+  if(signbit(v))
+    *dst++ = '-';
+  const double a = fabs(double(v));
+  if(a == 0.0)
+  {
+    *dst++ = '0';
+    return dst;
+  }
+
+  // 9 digit mantissa m and decimal exponent e, a ~ m * 10^(e - 8). Doubles
+  // carry enough precision for the rounding to stay within half a float ulp.
+  int e = int(floor(log10(a)));
+  uint64_t m = uint64_t(a * pow(10.0, 8 - e) + 0.5);
+  if(m >= 1000000000ULL)
+    m = uint64_t(a * pow(10.0, 8 - (++e)) + 0.5);
+  else if(m < 100000000ULL)
+    m = uint64_t(a * pow(10.0, 8 - (--e)) + 0.5);
+
+  char d[9];
+  for(int i = 8; i >= 0; i--, m /= 10)
+    d[i] = char('0' + m % 10);
+  int nd = 9;
+  while(nd > 1 && d[nd - 1] == '0')
+    nd--;
+
+  if(e >= 0 && e < 9)
+  {
+    for(int i = 0; i <= e; i++)
+      *dst++ = i < nd ? d[i] : '0';
+    if(nd > e + 1)
+      *dst++ = '.';
+    for(int i = e + 1; i < nd; i++)
+      *dst++ = d[i];
+  }
+  else if(e < 0 && e >= -5)
+  {
+    *dst++ = '0';
+    *dst++ = '.';
+    for(int i = -1; i > e; i--)
+      *dst++ = '0';
+    for(int i = 0; i < nd; i++)
+      *dst++ = d[i];
+  }
+  else
+  {
+    *dst++ = d[0];
+    if(nd > 1)
+      *dst++ = '.';
+    for(int i = 1; i < nd; i++)
+      *dst++ = d[i];
+    *dst++ = 'e';
+    if(e < 0)
+      *dst++ = '-';
+    const int ae = e < 0 ? -e : e;
+    if(ae >= 10)
+      *dst++ = char('0' + ae / 10);
+    *dst++ = char('0' + ae % 10);
+  }
+  return dst;
+#endif
+}
+} // namespace io
+
+// Appends a record holding the count elements of items to out
+template <typename T>
+inline void encodeBinary(
+    const T *items, const size_t count, std::vector<uint8_t> &out,
+    const uint32_t flags = 0)
+{
+  typedef io::SerialTraits<T> Traits;
+  const int nc = Traits::components;
+  const size_t offset = out.size();
+  out.resize(offset + io::serialHeaderSize + count * nc * sizeof(float));
+
+  uint8_t *header = out.data() + offset;
+  memcpy(header, io::serialMagic, 8);
+  io::storeU32(header + 8, Traits::type);
+  io::storeU32(header + 12, flags);
+  io::storeU64(header + 16, uint64_t(count));
+  io::storeU32(header + 24, uint32_t(nc));
+  io::storeU32(header + 28, 0);
+
+  uint8_t *payload = header + io::serialHeaderSize;
+  const bool delta = (flags & SERIAL_DELTA) != 0;
+#pragma omp parallel for if(count > 4096)
+  for(int64_t i = 0; i < int64_t(count); i++)
+  {
+    uint32_t cur[16], prev[16];
+    Traits::load(items[i], reinterpret_cast<float *>(cur));
+    if(delta && i > 0)
+    {
+      Traits::load(items[i - 1], reinterpret_cast<float *>(prev));
+      for(int k = 0; k < nc; k++)
+        cur[k] ^= prev[k];
+    }
+    memcpy(payload + size_t(i) * nc * sizeof(float), cur, nc * sizeof(float));
+  }
+}
+
+// Decodes the record at the start of [data, data + size), appending its
+// elements to out. Returns the size of the record so that concatenated
+// records can be read in sequence. Throws std::runtime_error on a malformed
+// record or if it holds another element type.
+template <typename T>
+inline size_t
+decodeBinary(const uint8_t *data, const size_t size, std::vector<T> &out)
+{
+  typedef io::SerialTraits<T> Traits;
+  const int nc = Traits::components;
+  if(size < io::serialHeaderSize || memcmp(data, io::serialMagic, 8) != 0)
+    throw std::runtime_error("decodeBinary : invalid record header");
+  if(io::loadU32(data + 8) != Traits::type
+     || io::loadU32(data + 24) != uint32_t(nc))
+    throw std::runtime_error("decodeBinary : unexpected element type");
+
+  const uint32_t flags = io::loadU32(data + 12);
+  const uint64_t count = io::loadU64(data + 16);
+  const size_t bytes = nc * sizeof(float);
+  if(count > (size - io::serialHeaderSize) / bytes)
+    throw std::runtime_error("decodeBinary : truncated record");
+
+  const uint8_t *payload = data + io::serialHeaderSize;
+  std::vector<uint32_t> words;
+  if((flags & SERIAL_DELTA) && count > 0)
+  {
+    words.resize(size_t(count) * nc);
+    memcpy(words.data(), payload, size_t(count) * bytes);
+    io::xorPrefix(words.data(), size_t(count), nc);
+    payload = reinterpret_cast<const uint8_t *>(words.data());
+  }
+
+  const size_t offset = out.size();
+  out.resize(offset + size_t(count));
+  T *dst = out.data() + offset;
+#pragma omp parallel for if(count > 4096)
+  for(int64_t i = 0; i < int64_t(count); i++)
+  {
+    float c[16];
+    memcpy(c, payload + size_t(i) * bytes, bytes);
+    Traits::store(c, dst[i]);
+  }
+  return io::serialHeaderSize + size_t(count) * bytes;
+}
+
+template <typename T>
+inline void writeBinary(
+    const std::string &path, const T *items, const size_t count,
+    const uint32_t flags = 0)
+{
+  std::vector<uint8_t> buf;
+  encodeBinary(items, count, buf, flags);
+  FILE *fp = fopen(path.c_str(), "wb");
+  if(fp == NULL)
+    throw std::runtime_error("writeBinary : cannot open " + path);
+  const bool ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+  if(fclose(fp) != 0 || !ok)
+    throw std::runtime_error("writeBinary : cannot write " + path);
+}
+
+// Reads every record of the file, e.g. a log appended to in batches
+template <typename T>
+inline void readBinary(const std::string &path, std::vector<T> &out)
+{
+  out.clear();
+  MappedFile file(path);
+  size_t pos = 0;
+  while(pos < file.size())
+    pos += decodeBinary(file.data() + pos, file.size() - pos, out);
+}
+
+// Appends one line per element to out, its components separated by spaces.
+// Lines are formatted in parallel into per thread buffers.
+template <typename T>
+inline void formatText(const T *items, const size_t count, std::string &out)
+{
+  typedef io::SerialTraits<T> Traits;
+  const int nc = Traits::components;
+  const int nChunks = count > 1024 ? parallel::maxThreads() : 1;
+  std::vector<std::string> chunks(static_cast<size_t>(nChunks));
+
+#pragma omp parallel for num_threads(nChunks)
+  for(int c = 0; c < nChunks; c++)
+  {
+    size_t begin, end;
+    parallel::chunkRange(count, nChunks, c, begin, end);
+    std::string &s = chunks[c];
+    s.resize((end - begin) * nc * 17);
+    char *p = &s[0];
+    for(size_t i = begin; i < end; i++)
+    {
+      float v[16];
+      Traits::load(items[i], v);
+      for(int k = 0; k < nc; k++)
+      {
+        p = io::formatFloat(p, v[k]);
+        *p++ = k + 1 < nc ? ' ' : '\n';
+      }
+    }
+    s.resize(size_t(p - s.data()));
+  }
+
+  size_t total = out.size();
+  for(int c = 0; c < nChunks; c++)
+    total += chunks[c].size();
+  out.reserve(total);
+  for(int c = 0; c < nChunks; c++)
+    out += chunks[c];
+}
+
+template <typename T>
+inline void
+writeText(const std::string &path, const T *items, const size_t count)
+{
+  std::string buf;
+  formatText(items, count, buf);
+  FILE *fp = fopen(path.c_str(), "wb");
+  if(fp == NULL)
+    throw std::runtime_error("writeText : cannot open " + path);
+  const bool ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+  if(fclose(fp) != 0 || !ok)
+    throw std::runtime_error("writeText : cannot write " + path);
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_SERIALIZE_HPP__
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_KDTREE_HPP__
+#define __GEOMETRY_KDTREE_HPP__
+
+#include <float.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+// Static 3D kd-tree over a point cloud. Points are split at the median of the
+// axis of largest extent, and copied in leaf order after the build so that
+// leaf scans read contiguous SoA memory. Queries are const and can be run
+// concurrently from several threads.
+class KdTree
+{
+public:
+  KdTree() : leafSize_(16) {}
+
+  explicit KdTree(const Vec3SoA<float> &points, const int leafSize = 16)
+      : leafSize_(leafSize)
+  {
+    if(leafSize < 1)
+      throw std::invalid_argument("KdTree : leaf size must be positive");
+    build(points);
+  }
+
+  inline size_t size() const { return ids_.size(); }
+
+  inline bool empty() const { return ids_.empty(); }
+
+  // Input index of the points stored in leaf order
+  inline const std::vector<uint32_t> &ids() const { return ids_; }
+
+  void build(const Vec3SoA<float> &points)
+  {
+    const size_t n = points.size();
+    ids_.resize(n);
+    for(size_t i = 0; i < n; i++)
+      ids_[i] = uint32_t(i);
+
+    nodes_.clear();
+    nodes_.reserve(2 * (n / size_t(leafSize_) + 1));
+    if(n > 0)
+      buildNode(points, 0, uint32_t(n));
+
+    points_.resize(n);
+    for(size_t i = 0; i < n; i++)
+      points_.set(i, points.x[ids_[i]], points.y[ids_[i]], points.z[ids_[i]]);
+  }
+
+  // Returns the input index of the closest point within sqrt(maxDist2), or -1
+  inline int64_t nearest(
+      const float x, const float y, const float z, const float maxDist2,
+      float &dist2) const
+  {
+    int64_t best = -1;
+    float bestDist2 = maxDist2;
+    if(!nodes_.empty())
+    {
+      const float q[3] = {x, y, z};
+      searchNearest(0, q, best, bestDist2);
+    }
+    dist2 = bestDist2;
+    return best < 0 ? -1 : int64_t(ids_[best]);
+  }
+
+  // Finds up to k closest points within sqrt(maxDist2), sorted by increasing
+  // distance. Returns the number of neighbours found.
+  inline size_t knn(
+      const float x, const float y, const float z, const size_t k,
+      uint32_t *ids, float *dists2, const float maxDist2 = FLT_MAX) const
+  {
+    if(nodes_.empty() || k == 0)
+      return 0;
+
+    const float q[3] = {x, y, z};
+    size_t count = 0;
+    searchKnn(0, q, k, maxDist2, ids, dists2, count);
+    for(size_t i = 0; i < count; i++)
+      ids[i] = ids_[ids[i]];
+    return count;
+  }
+
+private:
+  struct Node
+  {
+    uint32_t begin;
+    uint32_t end;
+    int32_t left; // Children, -1 for leaves
+    int32_t right;
+    int32_t axis;
+    float split;
+  };
+
+  int leafSize_;
+  Vec3SoA<float> points_;
+  std::vector<uint32_t> ids_;
+  std::vector<Node> nodes_;
+
+  static inline const std::vector<float> &
+  coords(const Vec3SoA<float> &points, const int axis)
+  {
+    return axis == 0 ? points.x : (axis == 1 ? points.y : points.z);
+  }
+
+  struct AxisLess
+  {
+    const float *c;
+    inline bool operator()(const uint32_t a, const uint32_t b) const
+    {
+      return c[a] < c[b];
+    }
+  };
+
+  int32_t buildNode(
+      const Vec3SoA<float> &points, const uint32_t begin, const uint32_t end)
+  {
+    const int32_t id = int32_t(nodes_.size());
+    Node node;
+    node.begin = begin;
+    node.end = end;
+    node.left = -1;
+    node.right = -1;
+    node.axis = 0;
+    node.split = 0.0f;
+    nodes_.push_back(node);
+
+    if(end - begin <= uint32_t(leafSize_))
+      return id;
+
+    float minC[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float maxC[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for(uint32_t i = begin; i < end; i++)
+    {
+      for(int a = 0; a < 3; a++)
+      {
+        const float v = coords(points, a)[ids_[i]];
+        minC[a] = std::min(minC[a], v);
+        maxC[a] = std::max(maxC[a], v);
+      }
+    }
+    int axis = 0;
+    for(int a = 1; a < 3; a++)
+      axis = (maxC[a] - minC[a] > maxC[axis] - minC[axis]) ? a : axis;
+
+    const uint32_t mid = begin + (end - begin) / 2;
+    AxisLess less;
+    less.c = coords(points, axis).data();
+    std::nth_element(
+        ids_.begin() + begin, ids_.begin() + mid, ids_.begin() + end, less);
+
+    nodes_[id].axis = axis;
+    nodes_[id].split = less.c[ids_[mid]];
+    const int32_t left = buildNode(points, begin, mid);
+    const int32_t right = buildNode(points, mid, end);
+    nodes_[id].left = left;
+    nodes_[id].right = right;
+    return id;
+  }
+
+  inline void searchNearest(
+      const int32_t id, const float *q, int64_t &best, float &bestDist2) const
+  {
+    const Node &node = nodes_[id];
+    if(node.left < 0)
+    {
+      const float *px = points_.x.data();
+      const float *py = points_.y.data();
+      const float *pz = points_.z.data();
+      for(uint32_t i = node.begin; i < node.end; i++)
+      {
+        const float dx = px[i] - q[0];
+        const float dy = py[i] - q[1];
+        const float dz = pz[i] - q[2];
+        const float d2 = dx * dx + dy * dy + dz * dz;
+        if(d2 < bestDist2)
+        {
+          bestDist2 = d2;
+          best = int64_t(i);
+        }
+      }
+      return;
+    }
+
+    const float diff = q[node.axis] - node.split;
+    const int32_t nearChild = diff < 0.0f ? node.left : node.right;
+    const int32_t farChild = diff < 0.0f ? node.right : node.left;
+    searchNearest(nearChild, q, best, bestDist2);
+    if(diff * diff < bestDist2)
+      searchNearest(farChild, q, best, bestDist2);
+  }
+
+  inline void searchKnn(
+      const int32_t id, const float *q, const size_t k, const float maxDist2,
+      uint32_t *ids, float *dists2, size_t &count) const
+  {
+    const Node &node = nodes_[id];
+    if(node.left < 0)
+    {
+      for(uint32_t i = node.begin; i < node.end; i++)
+      {
+        const float dx = points_.x[i] - q[0];
+        const float dy = points_.y[i] - q[1];
+        const float dz = points_.z[i] - q[2];
+        const float d2 = dx * dx + dy * dy + dz * dz;
+        const float bound = count == k ? dists2[k - 1] : maxDist2;
+        if(d2 >= bound)
+          continue;
+
+        // Sorted insertion, k is small
+        size_t pos = count < k ? count++ : k - 1;
+        while(pos > 0 && dists2[pos - 1] > d2)
+        {
+          dists2[pos] = dists2[pos - 1];
+          ids[pos] = ids[pos - 1];
+          pos--;
+        }
+        dists2[pos] = d2;
+        ids[pos] = i;
+      }
+      return;
+    }
+
+    const float diff = q[node.axis] - node.split;
+    const int32_t nearChild = diff < 0.0f ? node.left : node.right;
+    const int32_t farChild = diff < 0.0f ? node.right : node.left;
+    searchKnn(nearChild, q, k, maxDist2, ids, dists2, count);
+    const float bound = count == k ? dists2[k - 1] : maxDist2;
+    if(diff * diff < bound)
+      searchKnn(farChild, q, k, maxDist2, ids, dists2, count);
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_KDTREE_HPP__
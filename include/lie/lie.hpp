@@ -0,0 +1,601 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_LIE_HPP__
+#define __GEOMETRY_LIE_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "mat4/mat4.hpp"
+
+namespace geometry
+{
+namespace lie
+{
+// Below this squared angle the coefficients of exp, log and the Jacobians are
+// evaluated with their Taylor series, the closed forms losing all precision
+// to cancellation.
+template <typename T>
+inline T smallAngle2();
+template <>
+inline float smallAngle2<float>()
+{
+  return 1e-2f;
+}
+template <>
+inline double smallAngle2<double>()
+{
+  return 1e-6;
+}
+
+// a = sin(t) / t, b = (1 - cos(t)) / t^2 and c = (t - sin(t)) / t^3 for
+// t^2 = theta2. Branch free so that batch loops vectorize.
+template <typename T>
+inline void expCoefficients(const T theta2, T &a, T &b, T &c)
+{
+  const bool small = theta2 < smallAngle2<T>();
+  const T t2 = small ? T(1) : theta2;
+  const T t = sqrt(t2);
+  const T s = sin(t);
+  const T cs = cos(t);
+  const T a0 = T(1) - theta2 / T(6) * (T(1) - theta2 / T(20));
+  const T b0 = T(0.5) - theta2 / T(24) * (T(1) - theta2 / T(30));
+  const T c0 = T(1) / T(6) - theta2 / T(120) * (T(1) - theta2 / T(42));
+  a = small ? a0 : s / t;
+  b = small ? b0 : (T(1) - cs) / t2;
+  c = small ? c0 : (t - s) / (t2 * t);
+}
+
+// m = [w]x
+template <typename T>
+inline void hat(const T *w, T m[3][3])
+{
+  m[0][0] = T(0);
+  m[0][1] = -w[2];
+  m[0][2] = w[1];
+  m[1][0] = w[2];
+  m[1][1] = T(0);
+  m[1][2] = -w[0];
+  m[2][0] = -w[1];
+  m[2][1] = w[0];
+  m[2][2] = T(0);
+}
+
+// m = I + a * [w]x + b * [w]x^2, the shape of exp(w) and of the Jacobians
+template <typename T>
+inline void rodrigues(const T *w, const T a, const T b, T m[3][3])
+{
+  const T xx = w[0] * w[0], yy = w[1] * w[1], zz = w[2] * w[2];
+  const T xy = w[0] * w[1], xz = w[0] * w[2], yz = w[1] * w[2];
+  m[0][0] = T(1) - b * (yy + zz);
+  m[0][1] = b * xy - a * w[2];
+  m[0][2] = b * xz + a * w[1];
+  m[1][0] = b * xy + a * w[2];
+  m[1][1] = T(1) - b * (xx + zz);
+  m[1][2] = b * yz - a * w[0];
+  m[2][0] = b * xz - a * w[1];
+  m[2][1] = b * yz + a * w[0];
+  m[2][2] = T(1) - b * (xx + yy);
+}
+
+template <typename T>
+inline void mul3(const T a[3][3], const T b[3][3], T res[3][3])
+{
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      res[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j];
+}
+
+template <typename T>
+inline void mul3(const T a[3][3], const T *v, T *res)
+{
+  for(int i = 0; i < 3; i++)
+    res[i] = a[i][0] * v[0] + a[i][1] * v[1] + a[i][2] * v[2];
+}
+
+// d = (1 - a / (2 * b)) / t^2, the [w]x^2 coefficient of the inverse left
+// Jacobian of SO3
+template <typename T>
+inline T jacobianInverseCoefficient(const T theta2, const T a, const T b)
+{
+  const bool small = theta2 < smallAngle2<T>();
+  const T d0 = T(1) / T(12) + theta2 / T(720) * (T(1) + theta2 / T(42));
+  return small ? d0 : (T(1) - a / (T(2) * b)) / (small ? T(1) : theta2);
+}
+} // namespace lie
+
+// Rotation group, as a 3x3 matrix. Tangent vectors are rotation vectors
+// (axis times angle).
+template <typename T>
+struct SO3
+{
+  T r[3][3];
+
+  static inline SO3<T> identity()
+  {
+    SO3<T> ret;
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++)
+        ret.r[i][j] = i == j ? T(1) : T(0);
+    return ret;
+  }
+
+  static inline SO3<T> exp(const T *w)
+  {
+    SO3<T> ret;
+    T a, b, c;
+    lie::expCoefficients(w[0] * w[0] + w[1] * w[1] + w[2] * w[2], a, b, c);
+    lie::rodrigues(w, a, b, ret.r);
+    return ret;
+  }
+
+  inline void log(T *w) const
+  {
+    const T v[3] = {r[2][1] - r[1][2], r[0][2] - r[2][0], r[1][0] - r[0][1]};
+    T cs = T(0.5) * (r[0][0] + r[1][1] + r[2][2] - T(1));
+    cs = cs > T(1) ? T(1) : (cs < T(-1) ? T(-1) : cs);
+    const T theta = acos(cs);
+
+    if(cs > T(-0.99))
+    {
+      // theta / (2 sin(theta)) from its series near 0
+      const T theta2 = theta * theta;
+      const T k = theta2 < lie::smallAngle2<T>()
+                      ? T(0.5) + theta2 / T(12)
+                      : T(0.5) * theta / sin(theta);
+      for(int i = 0; i < 3; i++)
+        w[i] = k * v[i];
+      return;
+    }
+
+    // Near pi, the axis is read from the symmetric part R + R^T, which is
+    // 2 * (1 - cos) * a a^T + 2 * cos * I
+    int m = 0;
+    for(int i = 1; i < 3; i++)
+      m = r[i][i] > r[m][m] ? i : m;
+    T axis[3];
+    axis[m] = sqrt((r[m][m] - cs) / (T(1) - cs));
+    for(int i = 0; i < 3; i++)
+      if(i != m)
+        axis[i] = (r[i][m] + r[m][i]) / (T(2) * (T(1) - cs) * axis[m]);
+    const T sign = axis[0] * v[0] + axis[1] * v[1] + axis[2] * v[2] < T(0)
+                       ? T(-1)
+                       : T(1);
+    for(int i = 0; i < 3; i++)
+      w[i] = sign * theta * axis[i];
+  }
+
+  inline SO3<T> inverse() const
+  {
+    SO3<T> ret;
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++)
+        ret.r[i][j] = r[j][i];
+    return ret;
+  }
+
+  inline SO3<T> operator*(const SO3<T> &m) const
+  {
+    SO3<T> ret;
+    lie::mul3(r, m.r, ret.r);
+    return ret;
+  }
+
+  inline void apply(const T *p, T *res) const { lie::mul3(r, p, res); }
+
+  // Ad(R) = R : R * exp(w) = exp(R * w) * R
+  inline void adjoint(T a[3][3]) const
+  {
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++)
+        a[i][j] = r[i][j];
+  }
+
+  // Left Jacobian : exp(w + dw) ~ exp(J(w) * dw) * exp(w). The right Jacobian
+  // is leftJacobian(-w).
+  static inline void leftJacobian(const T *w, T j[3][3])
+  {
+    T a, b, c;
+    lie::expCoefficients(w[0] * w[0] + w[1] * w[1] + w[2] * w[2], a, b, c);
+    lie::rodrigues(w, b, c, j);
+  }
+
+  static inline void leftJacobianInverse(const T *w, T j[3][3])
+  {
+    const T theta2 = w[0] * w[0] + w[1] * w[1] + w[2] * w[2];
+    T a, b, c;
+    lie::expCoefficients(theta2, a, b, c);
+    const T d = lie::jacobianInverseCoefficient(theta2, a, b);
+    lie::rodrigues(w, T(-0.5), d, j);
+  }
+};
+
+// Rigid transform group : p' = r * p + t. Tangent vectors are (rho, phi),
+// translation part first, with exp(rho, phi) = (exp(phi), J(phi) * rho).
+template <typename T>
+struct SE3
+{
+  T r[3][3];
+  T t[3];
+
+  static inline SE3<T> identity()
+  {
+    SE3<T> ret;
+    for(int i = 0; i < 3; i++)
+    {
+      for(int j = 0; j < 3; j++)
+        ret.r[i][j] = i == j ? T(1) : T(0);
+      ret.t[i] = T(0);
+    }
+    return ret;
+  }
+
+  static inline SE3<T> fromParts(const SO3<T> &rot, const T *t)
+  {
+    SE3<T> ret;
+    for(int i = 0; i < 3; i++)
+    {
+      for(int j = 0; j < 3; j++)
+        ret.r[i][j] = rot.r[i][j];
+      ret.t[i] = t[i];
+    }
+    return ret;
+  }
+
+  static inline SE3<T> fromMat4(const Mat4<float> &m)
+  {
+    SE3<T> ret;
+    for(int i = 0; i < 3; i++)
+    {
+      for(int j = 0; j < 3; j++)
+        ret.r[i][j] = T(m.data.array[i][j]);
+      ret.t[i] = T(m.data.array[i][3]);
+    }
+    return ret;
+  }
+
+  inline Mat4<float> toMat4() const
+  {
+    Mat4<float> ret;
+    ret.data = mat4f_identity();
+    for(int i = 0; i < 3; i++)
+    {
+      for(int j = 0; j < 3; j++)
+        ret.data.array[i][j] = float(r[i][j]);
+      ret.data.array[i][3] = float(t[i]);
+    }
+    return ret;
+  }
+
+  inline SO3<T> rotation() const
+  {
+    SO3<T> ret;
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++)
+        ret.r[i][j] = r[i][j];
+    return ret;
+  }
+
+  static inline SE3<T> exp(const T *xi)
+  {
+    SE3<T> ret;
+    const T *phi = xi + 3;
+    T a, b, c, j[3][3];
+    lie::expCoefficients(
+        phi[0] * phi[0] + phi[1] * phi[1] + phi[2] * phi[2], a, b, c);
+    lie::rodrigues(phi, a, b, ret.r);
+    lie::rodrigues(phi, b, c, j);
+    lie::mul3(j, xi, ret.t);
+    return ret;
+  }
+
+  inline void log(T *xi) const
+  {
+    T *phi = xi + 3;
+    rotation().log(phi);
+    T j[3][3];
+    SO3<T>::leftJacobianInverse(phi, j);
+    lie::mul3(j, t, xi);
+  }
+
+  inline SE3<T> inverse() const
+  {
+    SE3<T> ret;
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++)
+        ret.r[i][j] = r[j][i];
+    for(int i = 0; i < 3; i++)
+    {
+      ret.t[i] =
+          -(ret.r[i][0] * t[0] + ret.r[i][1] * t[1] + ret.r[i][2] * t[2]);
+    }
+    return ret;
+  }
+
+  // Returns this * m
+  inline SE3<T> compose(const SE3<T> &m) const
+  {
+    SE3<T> ret;
+    lie::mul3(r, m.r, ret.r);
+    lie::mul3(r, m.t, ret.t);
+    for(int i = 0; i < 3; i++)
+      ret.t[i] += t[i];
+    return ret;
+  }
+
+  inline SE3<T> operator*(const SE3<T> &m) const { return compose(m); }
+
+  inline void apply(const T *p, T *res) const
+  {
+    lie::mul3(r, p, res);
+    for(int i = 0; i < 3; i++)
+      res[i] += t[i];
+  }
+
+  // Ad(T) = [R, [t]x R; 0, R] in the (rho, phi) ordering
+  inline void adjoint(T a[6][6]) const
+  {
+    T tx[3][3], txr[3][3];
+    lie::hat(t, tx);
+    lie::mul3(tx, r, txr);
+    for(int i = 0; i < 3; i++)
+    {
+      for(int j = 0; j < 3; j++)
+      {
+        a[i][j] = r[i][j];
+        a[i][j + 3] = txr[i][j];
+        a[i + 3][j] = T(0);
+        a[i + 3][j + 3] = r[i][j];
+      }
+    }
+  }
+
+  // Left Jacobian [J, Q; 0, J] with J the SO3 left Jacobian of phi and Q the
+  // coupling block of Barfoot, "State Estimation for Robotics", eq. 7.86
+  static inline void leftJacobian(const T *xi, T j[6][6])
+  {
+    T jr[3][3], q[3][3];
+    SO3<T>::leftJacobian(xi + 3, jr);
+    couplingBlock(xi, q);
+    for(int a = 0; a < 3; a++)
+    {
+      for(int b = 0; b < 3; b++)
+      {
+        j[a][b] = jr[a][b];
+        j[a][b + 3] = q[a][b];
+        j[a + 3][b] = T(0);
+        j[a + 3][b + 3] = jr[a][b];
+      }
+    }
+  }
+
+  // [J^-1, -J^-1 Q J^-1; 0, J^-1]
+  static inline void leftJacobianInverse(const T *xi, T j[6][6])
+  {
+    T ji[3][3], q[3][3], tmp[3][3], c[3][3];
+    SO3<T>::leftJacobianInverse(xi + 3, ji);
+    couplingBlock(xi, q);
+    lie::mul3(ji, q, tmp);
+    lie::mul3(tmp, ji, c);
+    for(int a = 0; a < 3; a++)
+    {
+      for(int b = 0; b < 3; b++)
+      {
+        j[a][b] = ji[a][b];
+        j[a][b + 3] = -c[a][b];
+        j[a + 3][b] = T(0);
+        j[a + 3][b + 3] = ji[a][b];
+      }
+    }
+  }
+
+private:
+  static inline void couplingBlock(const T *xi, T q[3][3])
+  {
+    const T *phi = xi + 3;
+    const T theta2 = phi[0] * phi[0] + phi[1] * phi[1] + phi[2] * phi[2];
+    const bool small = theta2 < lie::smallAngle2<T>();
+    const T t2 = small ? T(1) : theta2;
+    const T t = sqrt(t2);
+    const T s = sin(t);
+    const T cs = cos(t);
+    const T c1 = small ? T(1) / T(6) - theta2 / T(120) : (t - s) / (t2 * t);
+    const T c2 = small ? T(1) / T(24) - theta2 / T(720)
+                       : (t2 + T(2) * cs - T(2)) / (T(2) * t2 * t2);
+    const T c3 = small ? T(1) / T(120) - theta2 / T(2520)
+                       : (T(2) * t - T(3) * s + t * cs) / (T(2) * t2 * t2 * t);
+
+    T pr[3][3], pp[3][3], rp[3][3], prp[3][3], ppr[3][3], rpp[3][3];
+    T prpp[3][3], pprp[3][3], rx[3][3], px[3][3];
+    lie::hat(xi, rx);
+    lie::hat(phi, px);
+    lie::mul3(px, rx, pr);
+    lie::mul3(rx, px, rp);
+    lie::mul3(px, px, pp);
+    lie::mul3(pr, px, prp);
+    lie::mul3(pp, rx, ppr);
+    lie::mul3(rp, px, rpp);
+    lie::mul3(prp, px, prpp);
+    lie::mul3(pp, rp, pprp);
+    for(int i = 0; i < 3; i++)
+    {
+      for(int j = 0; j < 3; j++)
+      {
+        q[i][j] = T(0.5) * rx[i][j] + c1 * (pr[i][j] + rp[i][j] + prp[i][j])
+                  + c2 * (ppr[i][j] + rpp[i][j] - T(3) * prp[i][j])
+                  + c3 * (prpp[i][j] + pprp[i][j]);
+      }
+    }
+  }
+};
+
+// -----------------------------------------------------------------------------
+
+// Batch of SE3 poses as 12 component arrays (3x4 row-major), and batch of
+// tangent vectors as 6 component arrays, so that batch kernels vectorize
+// across poses
+template <typename T>
+struct SE3SoA
+{
+  std::vector<T> m[12];
+
+  inline size_t size() const { return m[0].size(); }
+
+  inline void resize(const size_t n)
+  {
+    for(int c = 0; c < 12; c++)
+      m[c].resize(n);
+  }
+
+  inline SE3<T> get(const size_t i) const
+  {
+    SE3<T> ret;
+    for(int a = 0; a < 3; a++)
+    {
+      for(int b = 0; b < 3; b++)
+        ret.r[a][b] = m[4 * a + b][i];
+      ret.t[a] = m[4 * a + 3][i];
+    }
+    return ret;
+  }
+
+  inline void set(const size_t i, const SE3<T> &p)
+  {
+    for(int a = 0; a < 3; a++)
+    {
+      for(int b = 0; b < 3; b++)
+        m[4 * a + b][i] = p.r[a][b];
+      m[4 * a + 3][i] = p.t[a];
+    }
+  }
+};
+
+template <typename T>
+struct TangentSoA
+{
+  std::vector<T> v[6];
+
+  inline size_t size() const { return v[0].size(); }
+
+  inline void resize(const size_t n)
+  {
+    for(int c = 0; c < 6; c++)
+      v[c].resize(n);
+  }
+};
+
+template <typename T>
+inline void expBatch(const TangentSoA<T> &xi, SE3SoA<T> &poses)
+{
+  const size_t n = xi.size();
+  poses.resize(n);
+  const T *v[6];
+  T *m[12];
+  for(int c = 0; c < 6; c++)
+    v[c] = xi.v[c].data();
+  for(int c = 0; c < 12; c++)
+    m[c] = poses.m[c].data();
+
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    const T rho[3] = {v[0][i], v[1][i], v[2][i]};
+    const T phi[3] = {v[3][i], v[4][i], v[5][i]};
+    T a, b, c, r[3][3], j[3][3], t[3];
+    lie::expCoefficients(
+        phi[0] * phi[0] + phi[1] * phi[1] + phi[2] * phi[2], a, b, c);
+    lie::rodrigues(phi, a, b, r);
+    lie::rodrigues(phi, b, c, j);
+    lie::mul3(j, rho, t);
+    for(int k = 0; k < 3; k++)
+    {
+      m[4 * k][i] = r[k][0];
+      m[4 * k + 1][i] = r[k][1];
+      m[4 * k + 2][i] = r[k][2];
+      m[4 * k + 3][i] = t[k];
+    }
+  }
+}
+
+// Threaded only : the near pi branch of the rotation log does not vectorize
+template <typename T>
+inline void logBatch(const SE3SoA<T> &poses, TangentSoA<T> &xi)
+{
+  const size_t n = poses.size();
+  xi.resize(n);
+
+#pragma omp parallel for
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    T v[6];
+    poses.get(size_t(i)).log(v);
+    for(int c = 0; c < 6; c++)
+      xi.v[c][i] = v[c];
+  }
+}
+
+// res[i] = a[i] * b[i]. res must not alias a or b.
+template <typename T>
+inline void
+composeBatch(const SE3SoA<T> &a, const SE3SoA<T> &b, SE3SoA<T> &res)
+{
+  const size_t n = a.size();
+  res.resize(n);
+  const T *ma[12];
+  const T *mb[12];
+  T *mr[12];
+  for(int c = 0; c < 12; c++)
+  {
+    ma[c] = a.m[c].data();
+    mb[c] = b.m[c].data();
+    mr[c] = res.m[c].data();
+  }
+
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    for(int r = 0; r < 3; r++)
+    {
+      for(int c = 0; c < 4; c++)
+      {
+        T s = ma[4 * r][i] * mb[c][i] + ma[4 * r + 1][i] * mb[4 + c][i]
+              + ma[4 * r + 2][i] * mb[8 + c][i];
+        if(c == 3)
+          s += ma[4 * r + 3][i];
+        mr[4 * r + c][i] = s;
+      }
+    }
+  }
+}
+
+// Left-multiplicative update poses[i] = exp(xi[i]) * poses[i], the retraction
+// used by Gauss-Newton pose solvers
+template <typename T>
+inline void retractBatch(const TangentSoA<T> &xi, SE3SoA<T> &poses)
+{
+  SE3SoA<T> delta, res;
+  expBatch(xi, delta);
+  composeBatch(delta, poses, res);
+  for(int c = 0; c < 12; c++)
+    poses.m[c].swap(res.m[c]);
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_LIE_HPP__
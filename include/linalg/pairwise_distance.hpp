@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_PAIRWISE_DISTANCE_HPP__
+#define __GEOMETRY_PAIRWISE_DISTANCE_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "parallel/parallel.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+// Pairwise distance matrices between two sets of vectors, for clustering and
+// descriptor matching. The general kernel uses ||a||^2 + ||b||^2 - 2 a.b so
+// that the bulk of the work is a blocked matrix product : b is packed into
+// panels of a few columns, the output is computed by tiles sized for L1/L2,
+// and each tile is split over a register resident micro kernel. Both sets are
+// first translated by the mean of b, which leaves the distances unchanged but
+// keeps the norms, and so the cancellation in the expanded form, small.
+namespace pairwise
+{
+static const size_t panelWidth = 8;
+static const size_t microRows = 4;
+static const size_t blockRows = 64;
+static const size_t blockCols = 128;
+static const size_t blockDepth = 256;
+
+// Copies the m rows of b into panels of panelWidth rows stored dimension
+// major, so that the micro kernel reads each panel contiguously. Rows past m
+// are zero.
+template <typename T>
+inline void packPanels(
+    const T *b, const size_t m, const size_t dim, std::vector<T> &packed)
+{
+  const size_t nPanels = (m + panelWidth - 1) / panelWidth;
+  packed.resize(nPanels * dim * panelWidth);
+#pragma omp parallel for
+  for(int64_t p = 0; p < int64_t(nPanels); p++)
+  {
+    T *dst = packed.data() + size_t(p) * dim * panelWidth;
+    for(size_t c = 0; c < panelWidth; c++)
+    {
+      const size_t j = size_t(p) * panelWidth + c;
+      for(size_t k = 0; k < dim; k++)
+        dst[k * panelWidth + c] = j < m ? b[j * dim + k] : T(0);
+    }
+  }
+}
+
+template <typename T>
+inline void meanRow(const T *b, const size_t m, const size_t dim, T *mean)
+{
+  for(size_t k = 0; k < dim; k++)
+    mean[k] = T(0);
+  for(size_t j = 0; j < m; j++)
+  {
+    const T *row = b + j * dim;
+#pragma omp simd
+    for(size_t k = 0; k < dim; k++)
+      mean[k] += row[k];
+  }
+  for(size_t k = 0; k < dim; k++)
+    mean[k] /= T(m);
+}
+
+// Writes the rows of a minus shift to shifted, and their squared norms. The
+// norms are summed by blocks of blockDepth, as the dot products of the
+// kernel, so that both have the same error bound.
+template <typename T>
+inline void shiftRows(
+    const T *a, const size_t n, const size_t dim, const T *shift, T *shifted,
+    T *norms)
+{
+#pragma omp parallel for
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    const T *row = a + size_t(i) * dim;
+    T *dst = shifted + size_t(i) * dim;
+    T s = T(0);
+    for(size_t k0 = 0; k0 < dim; k0 += blockDepth)
+    {
+      const size_t k1 = std::min(k0 + blockDepth, dim);
+      T p = T(0);
+#pragma omp simd reduction(+ : p)
+      for(size_t k = k0; k < k1; k++)
+      {
+        dst[k] = row[k] - shift[k];
+        p += dst[k] * dst[k];
+      }
+      s += p;
+    }
+    norms[i] = s;
+  }
+}
+
+// Entries of the expanded form below tol * (||a||^2 + ||b||^2) are
+// recomputed from differences. Sums run over at most blockDepth terms, then
+// over one partial sum per block, so the rounding of the expanded form is
+// about (min(dim, blockDepth) + dim / blockDepth) * eps * (||a||^2 + ||b||^2)
+// and the entries that are kept have a relative error of a few sqrt(eps).
+// The tolerance is capped, so that for very long vectors the distant pairs
+// still use the expanded form, at a relative error of 4 * terms * eps.
+template <typename T>
+inline T cancellationTolerance(const size_t dim)
+{
+  const size_t blocks = (dim + blockDepth - 1) / blockDepth;
+  const T terms = T(std::min(dim, blockDepth) + blocks + 3);
+  const T tol = terms * sqrt(std::numeric_limits<T>::epsilon());
+  return std::min(tol, T(0.25));
+}
+
+template <typename T>
+inline T exactDist2(const T *a, const T *b, const size_t dim)
+{
+  T s = T(0);
+#pragma omp simd reduction(+ : s)
+  for(size_t k = 0; k < dim; k++)
+  {
+    const T d = a[k] - b[k];
+    s += d * d;
+  }
+  return s;
+}
+
+// Accumulates over [k0, k1) either the dot products (Exact = false) or the
+// squared differences (Exact = true) between 4 rows and one panel. c is small
+// enough to stay in registers once the loops are unrolled.
+template <bool Exact, typename T>
+inline void microKernel(
+    const T *const rows[microRows], const T *panel, const size_t k0,
+    const size_t k1, T c[microRows][panelWidth])
+{
+  T acc[microRows][panelWidth];
+  for(size_t r = 0; r < microRows; r++)
+    for(size_t j = 0; j < panelWidth; j++)
+      acc[r][j] = T(0);
+
+  for(size_t k = k0; k < k1; k++)
+  {
+    const T *bk = panel + k * panelWidth;
+    for(size_t r = 0; r < microRows; r++)
+    {
+      const T ar = rows[r][k];
+#pragma omp simd
+      for(size_t j = 0; j < panelWidth; j++)
+      {
+        if(Exact)
+        {
+          const T d = ar - bk[j];
+          acc[r][j] += d * d;
+        }
+        else
+          acc[r][j] += ar * bk[j];
+      }
+    }
+  }
+
+  for(size_t r = 0; r < microRows; r++)
+    for(size_t j = 0; j < panelWidth; j++)
+      c[r][j] = acc[r][j];
+}
+
+// Fills out (n x m) with the dot products or squared differences between the
+// rows of a and b, b being given as packed panels
+template <bool Exact, typename T>
+inline void computeTile(
+    const T *a, const size_t dim, const T *packed, const size_t i0,
+    const size_t i1, const size_t j0, const size_t j1, T *out,
+    const size_t m)
+{
+  size_t k0 = 0;
+  do
+  {
+    const size_t k1 = std::min(k0 + blockDepth, dim);
+    for(size_t i = i0; i < i1; i += microRows)
+    {
+      // Missing rows at the end of the tile repeat the last one and are not
+      // stored, which keeps a single kernel
+      const T *rows[microRows];
+      for(size_t r = 0; r < microRows; r++)
+        rows[r] = a + std::min(i + r, i1 - 1) * dim;
+      const size_t nr = std::min(microRows, i1 - i);
+
+      for(size_t j = j0; j < j1; j += panelWidth)
+      {
+        T c[microRows][panelWidth];
+        for(size_t r = 0; r < microRows; r++)
+          for(size_t l = 0; l < panelWidth; l++)
+            c[r][l] = T(0);
+        microKernel<Exact, T>(
+            rows, packed + (j / panelWidth) * dim * panelWidth, k0, k1, c);
+
+        const size_t nc = std::min(panelWidth, j1 - j);
+        for(size_t r = 0; r < nr; r++)
+        {
+          T *o = out + (i + r) * m + j;
+          for(size_t l = 0; l < nc; l++)
+            o[l] = k0 == 0 ? c[r][l] : o[l] + c[r][l];
+        }
+      }
+    }
+    k0 = k1;
+  } while(k0 < dim);
+}
+
+template <typename T>
+inline void pairwiseDist2(
+    const T *a, const size_t n, const T *b, const size_t m, const size_t dim,
+    T *out, const bool exact, const bool root)
+{
+  if(n == 0 || m == 0)
+    return;
+
+  // The exact kernel works on differences and needs no translation
+  std::vector<T> mean, shiftedA, shiftedB, normsA, normsB;
+  if(!exact)
+  {
+    mean.resize(dim);
+    shiftedA.resize(n * dim);
+    shiftedB.resize(m * dim);
+    normsA.resize(n);
+    normsB.resize(m);
+    meanRow(b, m, dim, mean.data());
+    shiftRows(a, n, dim, mean.data(), shiftedA.data(), normsA.data());
+    shiftRows(b, m, dim, mean.data(), shiftedB.data(), normsB.data());
+  }
+  const T *rowsA = exact ? a : shiftedA.data();
+  std::vector<T> packed;
+  packPanels(exact ? b : shiftedB.data(), m, dim, packed);
+
+  const T tol = cancellationTolerance<T>(dim);
+
+  const size_t nRowBlocks = (n + blockRows - 1) / blockRows;
+  const size_t nColBlocks = (m + blockCols - 1) / blockCols;
+#pragma omp parallel for schedule(dynamic, 1)
+  for(int64_t t = 0; t < int64_t(nRowBlocks * nColBlocks); t++)
+  {
+    const size_t i0 = (size_t(t) / nColBlocks) * blockRows;
+    const size_t j0 = (size_t(t) % nColBlocks) * blockCols;
+    const size_t i1 = std::min(i0 + blockRows, n);
+    const size_t j1 = std::min(j0 + blockCols, m);
+    if(exact)
+      computeTile<true, T>(rowsA, dim, packed.data(), i0, i1, j0, j1, out, m);
+    else
+      computeTile<false, T>(rowsA, dim, packed.data(), i0, i1, j0, j1, out, m);
+
+    // The tile is still in cache for the epilogue
+    for(size_t i = i0; i < i1; i++)
+    {
+      T *o = out + i * m;
+      if(!exact)
+      {
+        const T na = normsA[i];
+        const T *nb = normsB.data();
+#pragma omp simd
+        for(size_t j = j0; j < j1; j++)
+          o[j] = na + nb[j] - T(2) * o[j];
+        for(size_t j = j0; j < j1; j++)
+          if(o[j] <= tol * (na + nb[j]))
+            o[j] = exactDist2(a + i * dim, b + j * dim, dim);
+      }
+      if(root)
+      {
+#pragma omp simd
+        for(size_t j = j0; j < j1; j++)
+          o[j] = sqrt(o[j]);
+      }
+    }
+  }
+}
+
+template <typename T>
+inline void pairwiseDist2(
+    const Vec3SoA<T> &a, const Vec3SoA<T> &b, T *out, const bool root)
+{
+  static const size_t cols = 1024;
+  const size_t n = a.size();
+  const size_t m = b.size();
+  const size_t nRowBlocks = (n + blockRows - 1) / blockRows;
+  const size_t nColBlocks = (m + cols - 1) / cols;
+#pragma omp parallel for schedule(dynamic, 1)
+  for(int64_t t = 0; t < int64_t(nRowBlocks * nColBlocks); t++)
+  {
+    const size_t i0 = (size_t(t) / nColBlocks) * blockRows;
+    const size_t j0 = (size_t(t) % nColBlocks) * cols;
+    const size_t i1 = std::min(i0 + blockRows, n);
+    const size_t j1 = std::min(j0 + cols, m);
+    const T *bx = b.x.data();
+    const T *by = b.y.data();
+    const T *bz = b.z.data();
+    for(size_t i = i0; i < i1; i++)
+    {
+      const T ax = a.x[i], ay = a.y[i], az = a.z[i];
+      T *o = out + i * m;
+#pragma omp simd
+      for(size_t j = j0; j < j1; j++)
+      {
+        const T dx = ax - bx[j];
+        const T dy = ay - by[j];
+        const T dz = az - bz[j];
+        const T d2 = dx * dx + dy * dy + dz * dz;
+        o[j] = root ? sqrt(d2) : d2;
+      }
+    }
+  }
+}
+} // namespace pairwise
+
+// Squared euclidean distances between the n rows of a and the m rows of b,
+// both row major with dim columns. out is row major n x m. The expanded form
+// is used unless exact is set, entries hit by cancellation being recomputed
+// from differences in any case.
+template <typename T>
+inline void pairwiseDist2(
+    const T *a, const size_t n, const T *b, const size_t m, const size_t dim,
+    T *out, const bool exact = false)
+{
+  pairwise::pairwiseDist2(a, n, b, m, dim, out, exact, false);
+}
+
+// Euclidean distances, same layout as pairwiseDist2
+template <typename T>
+inline void pairwiseDist(
+    const T *a, const size_t n, const T *b, const size_t m, const size_t dim,
+    T *out, const bool exact = false)
+{
+  pairwise::pairwiseDist2(a, n, b, m, dim, out, exact, true);
+}
+
+// Squared distances between 3D points, out being a.size() x b.size(). With
+// three coordinates, differences cost as much as the expanded form, so these
+// are always exact.
+template <typename T>
+inline void pairwiseDist2(const Vec3SoA<T> &a, const Vec3SoA<T> &b, T *out)
+{
+  pairwise::pairwiseDist2(a, b, out, false);
+}
+
+template <typename T>
+inline void pairwiseDist(const Vec3SoA<T> &a, const Vec3SoA<T> &b, T *out)
+{
+  pairwise::pairwiseDist2(a, b, out, true);
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_PAIRWISE_DISTANCE_HPP__
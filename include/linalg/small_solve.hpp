@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_SMALL_SOLVE_HPP__
+#define __GEOMETRY_SMALL_SOLVE_HPP__
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <limits>
+
+namespace geometry
+{
+// Dense solvers for small systems whose size is known at compile time (the
+// 3x3, 6x6 and 7x7 normal equations of registration and calibration). All
+// loop bounds are template constants so the compiler unrolls them, and the
+// factorizations do not return early so that the batch versions below can
+// run them in SIMD lanes, one system per lane.
+
+// In place Cholesky factorization a = L L^T of a symmetric positive definite
+// matrix. Only the lower triangle is read, L overwrites it and invDiag holds
+// 1 / L(i, i). Returns false if a is not positive definite.
+template <int N, typename T>
+inline bool choleskyFactor(T a[N][N], T *invDiag)
+{
+  bool ok = true;
+  for(int j = 0; j < N; j++)
+  {
+    T d = a[j][j];
+    for(int k = 0; k < j; k++)
+      d -= a[j][k] * a[j][k];
+    ok = ok && d > T(0);
+    d = d > T(0) ? d : T(1);
+    const T l = sqrt(d);
+    a[j][j] = l;
+    invDiag[j] = T(1) / l;
+    for(int i = j + 1; i < N; i++)
+    {
+      T s = a[i][j];
+      for(int k = 0; k < j; k++)
+        s -= a[i][k] * a[j][k];
+      a[i][j] = s * invDiag[j];
+    }
+  }
+  return ok;
+}
+
+// Solves L L^T x = b from the output of choleskyFactor. x may alias b.
+template <int N, typename T>
+inline void choleskySolve(const T l[N][N], const T *invDiag, const T *b, T *x)
+{
+  T y[N];
+  for(int i = 0; i < N; i++)
+  {
+    T s = b[i];
+    for(int k = 0; k < i; k++)
+      s -= l[i][k] * y[k];
+    y[i] = s * invDiag[i];
+  }
+  for(int i = N - 1; i >= 0; i--)
+  {
+    T s = y[i];
+    for(int k = i + 1; k < N; k++)
+      s -= l[k][i] * x[k];
+    x[i] = s * invDiag[i];
+  }
+}
+
+// Solves a * x = b for a symmetric positive definite a, which is overwritten
+template <int N, typename T>
+inline bool solveCholesky(T a[N][N], const T *b, T *x)
+{
+  T invDiag[N];
+  const bool ok = choleskyFactor<N, T>(a, invDiag);
+  choleskySolve<N, T>(a, invDiag, b, x);
+  return ok;
+}
+
+// In place a = L D L^T factorization of a symmetric matrix, without square
+// roots. L (unit diagonal) overwrites the strict lower triangle and d holds D.
+// Returns false if a pivot vanishes; indefinite matrices are accepted.
+template <int N, typename T>
+inline bool ldltFactor(T a[N][N], T *d)
+{
+  const T eps = std::numeric_limits<T>::epsilon();
+  bool ok = true;
+  for(int j = 0; j < N; j++)
+  {
+    T v[N];
+    T dj = a[j][j];
+    for(int k = 0; k < j; k++)
+    {
+      v[k] = a[j][k] * d[k];
+      dj -= a[j][k] * v[k];
+    }
+    const bool pivot = fabs(dj) > eps * fabs(a[j][j]) && dj != T(0);
+    ok = ok && pivot;
+    dj = pivot ? dj : T(1);
+    d[j] = dj;
+    const T inv = T(1) / dj;
+    for(int i = j + 1; i < N; i++)
+    {
+      T s = a[i][j];
+      for(int k = 0; k < j; k++)
+        s -= a[i][k] * v[k];
+      a[i][j] = s * inv;
+    }
+  }
+  return ok;
+}
+
+// Solves L D L^T x = b from the output of ldltFactor. x may alias b.
+template <int N, typename T>
+inline void ldltSolve(const T l[N][N], const T *d, const T *b, T *x)
+{
+  T y[N];
+  for(int i = 0; i < N; i++)
+  {
+    T s = b[i];
+    for(int k = 0; k < i; k++)
+      s -= l[i][k] * y[k];
+    y[i] = s;
+  }
+  for(int i = 0; i < N; i++)
+    y[i] /= d[i];
+  for(int i = N - 1; i >= 0; i--)
+  {
+    T s = y[i];
+    for(int k = i + 1; k < N; k++)
+      s -= l[k][i] * x[k];
+    x[i] = s;
+  }
+}
+
+template <int N, typename T>
+inline bool solveLdlt(T a[N][N], const T *b, T *x)
+{
+  T d[N];
+  const bool ok = ldltFactor<N, T>(a, d);
+  ldltSolve<N, T>(a, d, b, x);
+  return ok;
+}
+
+// Solves a * x = b for a general square a with Householder QR, a being
+// overwritten. Slower than the symmetric solvers but does not square the
+// condition number. Returns false if a is numerically singular. x may alias b.
+template <int N, typename T>
+inline bool solveQr(T a[N][N], const T *b, T *x)
+{
+  const T eps = std::numeric_limits<T>::epsilon();
+  T y[N];
+  for(int i = 0; i < N; i++)
+    y[i] = b[i];
+
+  T scale = T(0);
+  for(int i = 0; i < N; i++)
+    for(int j = 0; j < N; j++)
+      scale = fabs(a[i][j]) > scale ? fabs(a[i][j]) : scale;
+
+  bool ok = scale > T(0);
+  for(int k = 0; k < N; k++)
+  {
+    // Reflector v = x - alpha e1 zeroing column k below the diagonal
+    T norm2 = T(0);
+    for(int i = k; i < N; i++)
+      norm2 += a[i][k] * a[i][k];
+    const T norm = sqrt(norm2);
+    const T alpha = a[k][k] > T(0) ? -norm : norm;
+    T v[N];
+    for(int i = 0; i < N; i++)
+      v[i] = i > k ? a[i][k] : T(0);
+    v[k] = a[k][k] - alpha;
+    const T vv = norm2 - a[k][k] * a[k][k] + v[k] * v[k];
+    const T beta = vv > T(0) ? T(2) / vv : T(0);
+
+    for(int j = k; j < N; j++)
+    {
+      T s = T(0);
+      for(int i = k; i < N; i++)
+        s += v[i] * a[i][j];
+      s *= beta;
+      for(int i = k; i < N; i++)
+        a[i][j] -= s * v[i];
+    }
+    T s = T(0);
+    for(int i = k; i < N; i++)
+      s += v[i] * y[i];
+    s *= beta;
+    for(int i = k; i < N; i++)
+      y[i] -= s * v[i];
+
+    ok = ok && fabs(a[k][k]) > T(N) * eps * scale;
+  }
+
+  for(int i = N - 1; i >= 0; i--)
+  {
+    T s = y[i];
+    for(int k = i + 1; k < N; k++)
+      s -= a[i][k] * x[k];
+    x[i] = a[i][i] != T(0) ? s / a[i][i] : T(0);
+  }
+  return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+// Batch solvers for count independent systems, vectorized across systems.
+// Arrays are coefficient-major : coefficient (i, j) of system s is at
+// a[(i * N + j) * count + s] and b[i * count + s], x[i * count + s]. ok[s] is
+// set to 0 for systems that could not be solved, whose x is then meaningless.
+template <int N, typename T>
+inline void solveCholeskyBatch(
+    const T *a, const T *b, T *x, uint8_t *ok, const size_t count)
+{
+  const int64_t n = int64_t(count);
+#pragma omp parallel for simd
+  for(int64_t s = 0; s < n; s++)
+  {
+    T m[N][N], v[N], invDiag[N];
+    for(int i = 0; i < N; i++)
+    {
+      for(int j = 0; j <= i; j++)
+        m[i][j] = a[size_t(i * N + j) * count + size_t(s)];
+      v[i] = b[size_t(i) * count + size_t(s)];
+    }
+    ok[s] = choleskyFactor<N, T>(m, invDiag) ? 1 : 0;
+    choleskySolve<N, T>(m, invDiag, v, v);
+    for(int i = 0; i < N; i++)
+      x[size_t(i) * count + size_t(s)] = v[i];
+  }
+}
+
+template <int N, typename T>
+inline void solveLdltBatch(
+    const T *a, const T *b, T *x, uint8_t *ok, const size_t count)
+{
+  const int64_t n = int64_t(count);
+#pragma omp parallel for simd
+  for(int64_t s = 0; s < n; s++)
+  {
+    T m[N][N], v[N], d[N];
+    for(int i = 0; i < N; i++)
+    {
+      for(int j = 0; j <= i; j++)
+        m[i][j] = a[size_t(i * N + j) * count + size_t(s)];
+      v[i] = b[size_t(i) * count + size_t(s)];
+    }
+    ok[s] = ldltFactor<N, T>(m, d) ? 1 : 0;
+    ldltSolve<N, T>(m, d, v, v);
+    for(int i = 0; i < N; i++)
+      x[size_t(i) * count + size_t(s)] = v[i];
+  }
+}
+
+// General matrices : the full a is read, not only its lower triangle
+template <int N, typename T>
+inline void solveQrBatch(
+    const T *a, const T *b, T *x, uint8_t *ok, const size_t count)
+{
+  const int64_t n = int64_t(count);
+#pragma omp parallel for simd
+  for(int64_t s = 0; s < n; s++)
+  {
+    T m[N][N], v[N];
+    for(int i = 0; i < N; i++)
+    {
+      for(int j = 0; j < N; j++)
+        m[i][j] = a[size_t(i * N + j) * count + size_t(s)];
+      v[i] = b[size_t(i) * count + size_t(s)];
+    }
+    ok[s] = solveQr<N, T>(m, v, v) ? 1 : 0;
+    for(int i = 0; i < N; i++)
+      x[size_t(i) * count + size_t(s)] = v[i];
+  }
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_SMALL_SOLVE_HPP__
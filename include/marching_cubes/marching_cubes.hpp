@@ -0,0 +1,448 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_MARCHING_CUBES_HPP__
+#define __GEOMETRY_MARCHING_CUBES_HPP__
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "parallel/parallel.hpp"
+#include "soa/vec3_soa.hpp"
+#include "tsdf/tsdf_volume.hpp"
+
+namespace geometry
+{
+namespace mc
+{
+// Cube corner i is at offset (i & 1, (i >> 1) & 1, (i >> 2) & 1). Edge e joins
+// corners edgeCorners[e][0] and edgeCorners[e][1] along axis e / 4.
+static const int edgeCorners[12][2]
+    = {{0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3},
+       {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+// Corners of each face, counter clockwise seen from outside the cube
+static const int faceCorners[6][4]
+    = {{0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4},
+       {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6}};
+
+static const int maxTriangleEdges = 31;
+
+// Triangle table : for each of the 256 inside/outside corner configurations,
+// the list of edges of the triangles, terminated by -1
+struct Tables
+{
+  int8_t triangles[256][maxTriangleEdges + 1];
+
+  // The table is generated instead of hardcoded. The iso contour is traced on
+  // each face, ambiguous faces always separating the inside corners, then the
+  // closed loops are fanned into triangles. As every edge is walked in
+  // opposite directions by its two faces, the loops are consistently oriented
+  // and triangles face the outside (values above the iso level).
+  Tables()
+  {
+    for(int config = 0; config < 256; config++)
+    {
+      int next[12];
+      for(int e = 0; e < 12; e++)
+        next[e] = -1;
+
+      for(int f = 0; f < 6; f++)
+      {
+        for(int k = 0; k < 4; k++)
+        {
+          const int a = faceCorners[f][k];
+          const int b = faceCorners[f][(k + 1) % 4];
+          if(inside(config, a) || !inside(config, b))
+            continue;
+
+          // Out -> in crossing, paired with the next in -> out crossing
+          for(int j = 1; j < 4; j++)
+          {
+            const int c = faceCorners[f][(k + j) % 4];
+            const int d = faceCorners[f][(k + j + 1) % 4];
+            if(inside(config, c) && !inside(config, d))
+            {
+              next[edge(a, b)] = edge(c, d);
+              break;
+            }
+          }
+        }
+      }
+
+      int count = 0;
+      bool visited[12] = {false};
+      for(int e = 0; e < 12; e++)
+      {
+        if(next[e] < 0 || visited[e])
+          continue;
+
+        int loop[12];
+        int len = 0;
+        for(int cur = e; !visited[cur]; cur = next[cur])
+        {
+          visited[cur] = true;
+          loop[len++] = cur;
+        }
+        for(int i = 1; i + 1 < len; i++)
+        {
+          triangles[config][count++] = int8_t(loop[0]);
+          triangles[config][count++] = int8_t(loop[i]);
+          triangles[config][count++] = int8_t(loop[i + 1]);
+        }
+      }
+      triangles[config][count] = -1;
+    }
+  }
+
+  static inline bool inside(const int config, const int corner)
+  {
+    return (config >> corner) & 1;
+  }
+
+  static inline int edge(const int a, const int b)
+  {
+    for(int e = 0; e < 12; e++)
+    {
+      if((edgeCorners[e][0] == a && edgeCorners[e][1] == b)
+         || (edgeCorners[e][0] == b && edgeCorners[e][1] == a))
+        return e;
+    }
+    return -1;
+  }
+};
+
+inline const Tables &tables()
+{
+  static const Tables ret;
+  return ret;
+}
+
+// Cells are processed in blocks of blockSide^3. Grids expose their blocks
+// through fillBlock(), which copies the (blockSide + 1)^3 voxels covering the
+// cells of a block into local buffers, a weight <= 0 marking missing voxels.
+static const int blockSide = 8;
+static const int blockSamples = blockSide + 1;
+
+// Vertices are identified by the grid edge they lie on. Coordinates are stored
+// on 20 bits each, which is enough for +/- 2^19 voxels along each axis.
+inline uint64_t edgeKey(const int x, const int y, const int z, const int axis)
+{
+  static const uint64_t mask = (UINT64_C(1) << 20) - 1;
+  return uint64_t(axis) | ((uint64_t(x + (1 << 19)) & mask) << 2)
+         | ((uint64_t(y + (1 << 19)) & mask) << 22)
+         | ((uint64_t(z + (1 << 19)) & mask) << 42);
+}
+
+// Dense scalar field, optionally weighted
+struct DenseGrid
+{
+  const float *values;
+  const float *weights;
+  int nx, ny, nz;
+  float voxelSize;
+  float origin[3];
+
+  inline int blocksX() const { return (nx - 2) / blockSide + 1; }
+  inline int blocksY() const { return (ny - 2) / blockSide + 1; }
+  inline int blocksZ() const { return (nz - 2) / blockSide + 1; }
+
+  inline size_t numBlocks() const
+  {
+    if(nx < 2 || ny < 2 || nz < 2)
+      return 0;
+    return size_t(blocksX()) * size_t(blocksY()) * size_t(blocksZ());
+  }
+
+  inline void fillBlock(
+      const size_t id, int *base, float *vals, float *weightsOut) const
+  {
+    const size_t bx = size_t(blocksX());
+    const size_t by = size_t(blocksY());
+    base[0] = int(id % bx) * blockSide;
+    base[1] = int((id / bx) % by) * blockSide;
+    base[2] = int(id / (bx * by)) * blockSide;
+
+    for(int lz = 0; lz < blockSamples; lz++)
+    {
+      for(int ly = 0; ly < blockSamples; ly++)
+      {
+        const int z = base[2] + lz;
+        const int y = base[1] + ly;
+        const int dst = blockSamples * (ly + blockSamples * lz);
+        for(int lx = 0; lx < blockSamples; lx++)
+        {
+          const int x = base[0] + lx;
+          if(x >= nx || y >= ny || z >= nz)
+          {
+            vals[dst + lx] = 0.0f;
+            weightsOut[dst + lx] = 0.0f;
+            continue;
+          }
+          const size_t src
+              = size_t(x) + size_t(nx) * (size_t(y) + size_t(ny) * size_t(z));
+          vals[dst + lx] = values[src];
+          weightsOut[dst + lx] = weights == NULL ? 1.0f : weights[src];
+        }
+      }
+    }
+  }
+};
+
+// Adapter over the blocks of a SparseTsdfVolume. The voxel blocks of the
+// volume are the cell blocks, the extra layer of samples being read from the
+// 7 neighbouring blocks.
+struct SparseGrid
+{
+  const SparseTsdfVolume *volume;
+  float voxelSize;
+  float origin[3];
+
+  inline size_t numBlocks() const { return volume->numBlocks(); }
+
+  inline void fillBlock(
+      const size_t id, int *base, float *vals, float *weightsOut) const
+  {
+    static const int side = SparseTsdfVolume::blockSide;
+    int b[3];
+    volume->blockCoords(id, b[0], b[1], b[2]);
+    base[0] = b[0] * side;
+    base[1] = b[1] * side;
+    base[2] = b[2] * side;
+
+    int64_t neighbours[8];
+    for(int i = 0; i < 8; i++)
+    {
+      neighbours[i] = i == 0 ? int64_t(id)
+                             : volume->findBlock(
+                                 b[0] + (i & 1), b[1] + ((i >> 1) & 1),
+                                 b[2] + (i >> 2));
+    }
+
+    for(int lz = 0; lz < blockSamples; lz++)
+    {
+      for(int ly = 0; ly < blockSamples; ly++)
+      {
+        const int dst = blockSamples * (ly + blockSamples * lz);
+        for(int lx = 0; lx < blockSamples; lx++)
+        {
+          const int n
+              = (lx / side) | ((ly / side) << 1) | ((lz / side) << 2);
+          if(neighbours[n] < 0)
+          {
+            vals[dst + lx] = 0.0f;
+            weightsOut[dst + lx] = 0.0f;
+            continue;
+          }
+          const size_t src
+              = size_t(lx % side)
+                + side * (size_t(ly % side) + side * size_t(lz % side));
+          vals[dst + lx] = volume->blockTsdf(size_t(neighbours[n]))[src];
+          weightsOut[dst + lx]
+              = volume->blockWeights(size_t(neighbours[n]))[src];
+        }
+      }
+    }
+  }
+};
+
+// Generic extraction. Each thread polygonizes whole blocks and emits, for
+// every triangle corner, the key of its grid edge and its position. Vertices
+// shared between cells and blocks are then welded by sorting the keys with the
+// parallel radix sort, so that the output is a watertight indexed mesh.
+template <typename Grid>
+inline void extract(
+    const Grid &grid, const float iso, Vec3SoA<float> &vertices,
+    std::vector<uint32_t> &indices)
+{
+  const Tables &tabs = tables();
+  const int nThreads = parallel::maxThreads();
+  std::vector<std::vector<uint64_t>> threadKeys(nThreads);
+  std::vector<Vec3SoA<float>> threadPositions(nThreads);
+  const int64_t nBlocks = int64_t(grid.numBlocks());
+
+#pragma omp parallel num_threads(nThreads)
+  {
+    std::vector<uint64_t> &keys = threadKeys[parallel::threadId()];
+    Vec3SoA<float> &positions = threadPositions[parallel::threadId()];
+    float vals[blockSamples * blockSamples * blockSamples];
+    float weights[blockSamples * blockSamples * blockSamples];
+
+#pragma omp for schedule(static)
+    for(int64_t b = 0; b < nBlocks; b++)
+    {
+      int base[3];
+      grid.fillBlock(size_t(b), base, vals, weights);
+
+      // Most blocks are far from the surface : skip them before the per cell
+      // work if all their samples lie on the same side of the iso level
+      int below = 0;
+#pragma omp simd reduction(+ : below)
+      for(int i = 0; i < blockSamples * blockSamples * blockSamples; i++)
+        below += vals[i] < iso && weights[i] > 0.0f ? 1 : 0;
+      if(below == 0)
+        continue;
+      int above = 0;
+#pragma omp simd reduction(+ : above)
+      for(int i = 0; i < blockSamples * blockSamples * blockSamples; i++)
+        above += vals[i] >= iso && weights[i] > 0.0f ? 1 : 0;
+      if(above == 0)
+        continue;
+
+      for(int z = 0; z < blockSide; z++)
+      {
+        for(int y = 0; y < blockSide; y++)
+        {
+          for(int x = 0; x < blockSide; x++)
+          {
+            int ids[8];
+            int config = 0;
+            bool valid = true;
+            for(int c = 0; c < 8; c++)
+            {
+              ids[c] = (x + (c & 1))
+                       + blockSamples
+                             * ((y + ((c >> 1) & 1))
+                                + blockSamples * (z + (c >> 2)));
+              valid = valid && weights[ids[c]] > 0.0f;
+              config |= (vals[ids[c]] < iso ? 1 : 0) << c;
+            }
+            if(!valid || config == 0 || config == 255)
+              continue;
+
+            for(const int8_t *e = tabs.triangles[config]; *e >= 0; e++)
+            {
+              const int c0 = edgeCorners[*e][0];
+              const int c1 = edgeCorners[*e][1];
+              const int axis = *e / 4;
+              const float v0 = vals[ids[c0]];
+              const float v1 = vals[ids[c1]];
+              const float t = v1 != v0 ? (iso - v0) / (v1 - v0) : 0.5f;
+
+              const int gx = base[0] + x + (c0 & 1);
+              const int gy = base[1] + y + ((c0 >> 1) & 1);
+              const int gz = base[2] + z + (c0 >> 2);
+              keys.push_back(edgeKey(gx, gy, gz, axis));
+              positions.push_back(
+                  grid.origin[0]
+                      + (float(gx) + (axis == 0 ? t : 0.0f)) * grid.voxelSize,
+                  grid.origin[1]
+                      + (float(gy) + (axis == 1 ? t : 0.0f)) * grid.voxelSize,
+                  grid.origin[2]
+                      + (float(gz) + (axis == 2 ? t : 0.0f)) * grid.voxelSize);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Concatenate the per thread corners
+  std::vector<size_t> offsets(nThreads + 1, 0);
+  for(int t = 0; t < nThreads; t++)
+    offsets[t + 1] = offsets[t] + threadKeys[t].size();
+  const size_t nCorners = offsets[nThreads];
+
+  std::vector<uint64_t> keys(nCorners);
+  std::vector<uint32_t> corners(nCorners);
+  Vec3SoA<float> positions(nCorners);
+#pragma omp parallel for schedule(static, 1)
+  for(int t = 0; t < nThreads; t++)
+  {
+    const size_t off = offsets[t];
+    for(size_t i = 0; i < threadKeys[t].size(); i++)
+    {
+      keys[off + i] = threadKeys[t][i];
+      corners[off + i] = uint32_t(off + i);
+      positions.set(
+          off + i, threadPositions[t].x[i], threadPositions[t].y[i],
+          threadPositions[t].z[i]);
+    }
+    std::vector<uint64_t>().swap(threadKeys[t]);
+    Vec3SoA<float>().swap(threadPositions[t]);
+  }
+
+  // Weld
+  std::vector<uint64_t> tmpKeys;
+  std::vector<uint32_t> tmpCorners;
+  parallel::radixSortPairs(keys, corners, tmpKeys, tmpCorners, 62);
+
+  std::vector<size_t> starts, counts;
+  const size_t nVertices = parallel::segmentStarts(keys, starts, counts);
+
+  vertices.resize(nVertices);
+  indices.resize(nCorners);
+#pragma omp parallel for schedule(static)
+  for(int64_t v = 0; v < int64_t(nVertices); v++)
+  {
+    const uint32_t first = corners[starts[v]];
+    vertices.set(
+        size_t(v), positions.x[first], positions.y[first], positions.z[first]);
+    for(size_t i = starts[v]; i < starts[v + 1]; i++)
+      indices[corners[i]] = uint32_t(v);
+  }
+}
+} // namespace mc
+
+// -----------------------------------------------------------------------------
+
+// Extracts the iso surface of a dense scalar field of nx * ny * nz samples
+// stored x major. Cells having a sample with a null weight are skipped, the
+// weights being optional.
+inline void marchingCubes(
+    const float *values, const float *weights, const int nx, const int ny,
+    const int nz, const float voxelSize, const Vec3<float> &origin,
+    const float iso, Vec3SoA<float> &vertices, std::vector<uint32_t> &indices)
+{
+  mc::DenseGrid grid;
+  grid.values = values;
+  grid.weights = weights;
+  grid.nx = nx;
+  grid.ny = ny;
+  grid.nz = nz;
+  grid.voxelSize = voxelSize;
+  grid.origin[0] = origin.data.coords.x;
+  grid.origin[1] = origin.data.coords.y;
+  grid.origin[2] = origin.data.coords.z;
+  mc::extract(grid, iso, vertices, indices);
+}
+
+inline void marchingCubes(
+    const TsdfVolume &volume, Vec3SoA<float> &vertices,
+    std::vector<uint32_t> &indices)
+{
+  marchingCubes(
+      volume.tsdf(), volume.weights(), volume.nx(), volume.ny(), volume.nz(),
+      volume.voxelSize(),
+      Vec3<float>(volume.origin()[0], volume.origin()[1], volume.origin()[2]),
+      0.0f, vertices, indices);
+}
+
+inline void marchingCubes(
+    const SparseTsdfVolume &volume, Vec3SoA<float> &vertices,
+    std::vector<uint32_t> &indices)
+{
+  mc::SparseGrid grid;
+  grid.volume = &volume;
+  grid.voxelSize = volume.voxelSize();
+  grid.origin[0] = grid.origin[1] = grid.origin[2] = 0.0f;
+  mc::extract(grid, 0.0f, vertices, indices);
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_MARCHING_CUBES_HPP__
@@ -459,6 +459,7 @@ inline mat4f_t mat4f_create_perspective(
   res.array[2][2] = -(near + far) / range;
   res.array[3][2] = -1;
   res.array[2][3] = -2 * near * far / range;
+  res.array[3][3] = 0;
 
   return res;
 }
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_RIGID_TRANSFORM_HPP__
+#define __GEOMETRY_RIGID_TRANSFORM_HPP__
+
+#include "mat4/mat4.hpp"
+
+namespace geometry
+{
+// Rotation and translation of a rigid Mat4<float>, stored as plain arrays so
+// that batch kernels do not go through the mat4f_t union
+struct RigidTransform
+{
+  float r[3][3];
+  float t[3];
+
+  inline void apply(const float *p, float *res) const
+  {
+    for(int i = 0; i < 3; i++)
+      res[i] = r[i][0] * p[0] + r[i][1] * p[1] + r[i][2] * p[2] + t[i];
+  }
+
+  inline void rotate(const float *p, float *res) const
+  {
+    for(int i = 0; i < 3; i++)
+      res[i] = r[i][0] * p[0] + r[i][1] * p[1] + r[i][2] * p[2];
+  }
+};
+
+inline RigidTransform rigidFromMat4(const Mat4<float> &m)
+{
+  RigidTransform ret;
+  for(int i = 0; i < 3; i++)
+  {
+    for(int j = 0; j < 3; j++)
+      ret.r[i][j] = m.data.array[i][j];
+    ret.t[i] = m.data.array[i][3];
+  }
+  return ret;
+}
+
+// Inverse of a rigid transform : R^T and -R^T * t
+inline RigidTransform rigidInverseFromMat4(const Mat4<float> &m)
+{
+  RigidTransform ret;
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      ret.r[i][j] = m.data.array[j][i];
+  for(int i = 0; i < 3; i++)
+  {
+    ret.t[i] = -(ret.r[i][0] * m.data.array[0][3]
+                 + ret.r[i][1] * m.data.array[1][3]
+                 + ret.r[i][2] * m.data.array[2][3]);
+  }
+  return ret;
+}
+
+// res = a * b, unrolled so that each row is a 4-wide vector operation.
+// res must not alias a or b.
+inline void mat4Mul(const mat4f_t &a, const mat4f_t &b, mat4f_t &res)
+{
+  for(int i = 0; i < 4; i++)
+  {
+#pragma omp simd
+    for(int j = 0; j < 4; j++)
+    {
+      res.array[i][j] = a.array[i][0] * b.array[0][j]
+                        + a.array[i][1] * b.array[1][j]
+                        + a.array[i][2] * b.array[2][j]
+                        + a.array[i][3] * b.array[3][j];
+    }
+  }
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_RIGID_TRANSFORM_HPP__
@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_TRI_MESH_HPP__
+#define __GEOMETRY_TRI_MESH_HPP__
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "aabb/aabb.hpp"
+#include "mat4/mat4.hpp"
+#include "parallel/parallel.hpp"
+#include "simplify/simplify.hpp"
+#include "soa/transform_points.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+namespace mesh
+{
+// 64 bit mix (splitmix64 finalizer)
+inline uint64_t mix(uint64_t h)
+{
+  h ^= h >> 30;
+  h *= UINT64_C(0xbf58476d1ce4e5b9);
+  h ^= h >> 27;
+  h *= UINT64_C(0x94d049bb133111eb);
+  h ^= h >> 31;
+  return h;
+}
+
+// Welding cell of a position : its quantized coordinates, or the raw float
+// bits for exact deduplication
+inline void weldCell(
+    const float x, const float y, const float z, const float invCell,
+    int64_t *cell)
+{
+  if(invCell > 0.0f)
+  {
+    cell[0] = int64_t(floorf(x * invCell));
+    cell[1] = int64_t(floorf(y * invCell));
+    cell[2] = int64_t(floorf(z * invCell));
+  }
+  else
+  {
+    // +0 and -0 compare equal
+    const float p[3] = {x == 0.0f ? 0.0f : x, y == 0.0f ? 0.0f : y,
+                        z == 0.0f ? 0.0f : z};
+    for(int i = 0; i < 3; i++)
+    {
+      uint32_t bits;
+      memcpy(&bits, &p[i], sizeof(bits));
+      cell[i] = int64_t(bits);
+    }
+  }
+}
+
+// Faces around each vertex as CSR lists : the faces of vertex v are
+// faceList[faceStart[v]] to faceList[faceStart[v + 1] - 1], in increasing
+// order. The corners are grouped by vertex with a stable radix sort.
+inline void vertexFaces(
+    const std::vector<uint32_t> &indices, const size_t nv,
+    std::vector<size_t> &faceStart, std::vector<uint32_t> &faceList)
+{
+  const int64_t n = int64_t(indices.size());
+  std::vector<uint64_t> keys(indices.size()), tmpKeys;
+  std::vector<uint32_t> tmpValues;
+  faceList.resize(indices.size());
+#pragma omp parallel for
+  for(int64_t i = 0; i < n; i++)
+  {
+    keys[i] = indices[i];
+    faceList[i] = uint32_t(i / 3);
+  }
+  parallel::radixSortPairs(
+      keys, faceList, tmpKeys, tmpValues, parallel::bitWidth(nv));
+
+  // faceStart[v] is the first sorted corner whose vertex is >= v
+  faceStart.assign(nv + 1, 0);
+#pragma omp parallel for
+  for(int64_t i = 0; i < n; i++)
+  {
+    if(i > 0 && keys[i] == keys[i - 1])
+      continue;
+    const uint64_t first = i == 0 ? 0 : keys[i - 1] + 1;
+    for(uint64_t v = first; v <= keys[i]; v++)
+      faceStart[v] = size_t(i);
+  }
+  for(uint64_t v = n == 0 ? 0 : keys[n - 1] + 1; v <= nv; v++)
+    faceStart[v] = size_t(n);
+}
+} // namespace mesh
+
+// Indexed triangle mesh : SoA vertex attributes and a flat index buffer with
+// three indices per face. normals is either empty or has one normal per
+// vertex.
+struct TriMesh
+{
+  Vec3SoA<float> positions;
+  Vec3SoA<float> normals;
+  std::vector<uint32_t> indices;
+
+  inline size_t numVertices() const { return positions.size(); }
+
+  inline size_t numFaces() const { return indices.size() / 3; }
+
+  inline bool hasNormals() const
+  {
+    return !normals.empty() && normals.size() == positions.size();
+  }
+
+  inline void clear()
+  {
+    positions.clear();
+    normals.clear();
+    indices.clear();
+  }
+
+  inline Aabb<float> bounds() const { return computeAabb(positions); }
+
+  // Area weighted vertex normals. The unnormalized face normals are gathered
+  // per vertex through the vertex to face lists, so that no atomics nor per
+  // thread buffers are needed and the sums do not depend on the thread count.
+  void computeNormals()
+  {
+    const size_t nv = positions.size();
+    const size_t nf = numFaces();
+    normals.resize(nv);
+
+    std::vector<size_t> faceStart;
+    std::vector<uint32_t> faceList;
+    mesh::vertexFaces(indices, nv, faceStart, faceList);
+
+    const float *px = positions.x.data();
+    const float *py = positions.y.data();
+    const float *pz = positions.z.data();
+    const uint32_t *ids = indices.data();
+
+    // Twice the area times the unit normal
+    Vec3SoA<float> faceNormals(nf);
+    float *fx = faceNormals.x.data();
+    float *fy = faceNormals.y.data();
+    float *fz = faceNormals.z.data();
+#pragma omp parallel for
+    for(int64_t f = 0; f < int64_t(nf); f++)
+    {
+      const uint32_t i0 = ids[3 * f];
+      const uint32_t i1 = ids[3 * f + 1];
+      const uint32_t i2 = ids[3 * f + 2];
+      const float ux = px[i1] - px[i0], uy = py[i1] - py[i0],
+                  uz = pz[i1] - pz[i0];
+      const float vx = px[i2] - px[i0], vy = py[i2] - py[i0],
+                  vz = pz[i2] - pz[i0];
+      fx[f] = uy * vz - uz * vy;
+      fy[f] = uz * vx - ux * vz;
+      fz[f] = ux * vy - uy * vx;
+    }
+
+    float *nx = normals.x.data();
+    float *ny = normals.y.data();
+    float *nz = normals.z.data();
+#pragma omp parallel for
+    for(int64_t v = 0; v < int64_t(nv); v++)
+    {
+      float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+      for(size_t k = faceStart[v]; k < faceStart[v + 1]; k++)
+      {
+        const uint32_t f = faceList[k];
+        sx += fx[f];
+        sy += fy[f];
+        sz += fz[f];
+      }
+      const float len2 = sx * sx + sy * sy + sz * sz;
+      const float inv = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+      nx[v] = sx * inv;
+      ny[v] = sy * inv;
+      nz[v] = sz * inv;
+    }
+  }
+
+  // Merges vertices falling in the same cell of a grid of size cellSize, or
+  // with bitwise equal positions if cellSize is 0. Cells are hashed to 64 bit
+  // keys, grouped with a radix sort, and hash collisions are split by
+  // comparing the cells. Each group keeps its first vertex in input order,
+  // attributes included. Faces that become degenerate are removed. Returns
+  // the number of vertices removed.
+  size_t weld(const float cellSize = 0.0f)
+  {
+    const size_t nv = positions.size();
+    if(uint64_t(nv) > uint64_t(UINT32_MAX))
+      throw std::invalid_argument("TriMesh : too many vertices");
+    const float invCell = cellSize > 0.0f ? 1.0f / cellSize : 0.0f;
+
+    std::vector<uint64_t> keys(nv), tmpKeys;
+    std::vector<uint32_t> order(nv), tmpOrder;
+#pragma omp parallel for
+    for(int64_t v = 0; v < int64_t(nv); v++)
+    {
+      int64_t cell[3];
+      mesh::weldCell(
+          positions.x[v], positions.y[v], positions.z[v], invCell, cell);
+      keys[v] = mesh::mix(
+          uint64_t(cell[0])
+          ^ mesh::mix(uint64_t(cell[1]) ^ mesh::mix(uint64_t(cell[2]))));
+      order[v] = uint32_t(v);
+    }
+    parallel::radixSortPairs(keys, order, tmpKeys, tmpOrder);
+
+    std::vector<size_t> starts, counts;
+    const size_t nRuns = parallel::segmentStarts(keys, starts, counts);
+
+    // Representative of each vertex : the first vertex of its run having the
+    // same cell. Runs are sorted by input index, the radix sort being stable.
+    std::vector<uint32_t> rep(nv);
+#pragma omp parallel for
+    for(int64_t r = 0; r < int64_t(nRuns); r++)
+    {
+      for(size_t i = starts[r]; i < starts[r + 1]; i++)
+      {
+        const uint32_t v = order[i];
+        int64_t cell[3];
+        mesh::weldCell(
+            positions.x[v], positions.y[v], positions.z[v], invCell, cell);
+        rep[v] = v;
+        for(size_t j = starts[r]; j < i; j++)
+        {
+          const uint32_t u = order[j];
+          int64_t other[3];
+          mesh::weldCell(
+              positions.x[u], positions.y[u], positions.z[u], invCell, other);
+          if(cell[0] == other[0] && cell[1] == other[1] && cell[2] == other[2])
+          {
+            rep[v] = rep[u];
+            break;
+          }
+        }
+      }
+    }
+
+    // Compact the kept vertices, in input order
+    std::vector<uint32_t> remap(nv);
+    size_t count = 0;
+    for(size_t v = 0; v < nv; v++)
+      remap[v] = rep[v] == v ? uint32_t(count++) : remap[rep[v]];
+
+    const bool withNormals = hasNormals();
+    for(size_t v = 0; v < nv; v++)
+    {
+      if(rep[v] != v)
+        continue;
+      positions.set(remap[v], positions.x[v], positions.y[v], positions.z[v]);
+      if(withNormals)
+        normals.set(remap[v], normals.x[v], normals.y[v], normals.z[v]);
+    }
+    positions.resize(count);
+    if(withNormals)
+      normals.resize(count);
+
+    size_t nf = 0;
+    for(size_t f = 0; f < numFaces(); f++)
+    {
+      const uint32_t a = remap[indices[3 * f]];
+      const uint32_t b = remap[indices[3 * f + 1]];
+      const uint32_t c = remap[indices[3 * f + 2]];
+      if(a == b || b == c || a == c)
+        continue;
+      indices[3 * nf] = a;
+      indices[3 * nf + 1] = b;
+      indices[3 * nf + 2] = c;
+      nf++;
+    }
+    indices.resize(3 * nf);
+    return nv - count;
+  }
+
+  // Applies the affine transform m to the positions and its inverse transpose
+  // to the normals, which are renormalized
+  void transform(const Mat4<float> &m)
+  {
+    transformPoints(m, positions, hasNormals() ? &normals : NULL);
+  }
+};
+
+// Simplifies the mesh down to at most targetFaces triangles. Normals, if any,
+// are recomputed.
+inline size_t simplify(TriMesh &mesh, const size_t targetFaces)
+{
+  const bool withNormals = mesh.hasNormals();
+  const size_t ret = simplify(mesh.positions, mesh.indices, targetFaces);
+  mesh.normals.clear();
+  if(withNormals)
+    mesh.computeNormals();
+  return ret;
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_TRI_MESH_HPP__
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_NORMALS_HPP__
+#define __GEOMETRY_NORMALS_HPP__
+
+#include <float.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "knn/kdtree.hpp"
+#include "parallel/parallel.hpp"
+#include "soa/vec3_soa.hpp"
+#include "sym3/sym3.hpp"
+
+namespace geometry
+{
+// Neighbourhoods are stored as a flat index buffer with k slots per point.
+// counts[i] gives the number of valid slots of point i; when counts is NULL
+// every point has exactly k neighbours.
+
+// Covariance matrices of the neighbourhoods of points [begin, end), written
+// to cov at [0, end - begin). Two passes (centroid, then centered sums) keep
+// the float accumulation accurate; the loop is vectorized across points, the
+// neighbour coordinates being gathered.
+inline void neighbourhoodCovariances(
+    const Vec3SoA<float> &points, const uint32_t *neighbours, const size_t k,
+    const uint32_t *counts, const size_t begin, const size_t end,
+    Sym3SoA &cov)
+{
+  const float *px = points.x.data();
+  const float *py = points.y.data();
+  const float *pz = points.z.data();
+  const int64_t n = int64_t(end - begin);
+
+#pragma omp simd
+  for(int64_t i = 0; i < n; i++)
+  {
+    const size_t id = begin + size_t(i);
+    const uint32_t *nb = neighbours + id * k;
+    const size_t count = counts == NULL ? k : counts[id];
+
+    float mx = 0.0f, my = 0.0f, mz = 0.0f;
+    for(size_t j = 0; j < count; j++)
+    {
+      mx += px[nb[j]];
+      my += py[nb[j]];
+      mz += pz[nb[j]];
+    }
+    const float inv = count > 0 ? 1.0f / float(count) : 0.0f;
+    mx *= inv;
+    my *= inv;
+    mz *= inv;
+
+    float xx = 0.0f, xy = 0.0f, xz = 0.0f, yy = 0.0f, yz = 0.0f, zz = 0.0f;
+    for(size_t j = 0; j < count; j++)
+    {
+      const float dx = px[nb[j]] - mx;
+      const float dy = py[nb[j]] - my;
+      const float dz = pz[nb[j]] - mz;
+      xx += dx * dx;
+      xy += dx * dy;
+      xz += dx * dz;
+      yy += dy * dy;
+      yz += dy * dz;
+      zz += dz * dz;
+    }
+    cov.xx[i] = xx * inv;
+    cov.xy[i] = xy * inv;
+    cov.xz[i] = xz * inv;
+    cov.yy[i] = yy * inv;
+    cov.yz[i] = yz * inv;
+    cov.zz[i] = zz * inv;
+  }
+}
+
+// Estimates the normals of points [0, n) from their neighbourhoods : smallest
+// eigenvector of the neighbourhood covariance, flipped towards the viewpoint.
+// If curvature is not NULL it receives the surface variation
+// l3 / (l1 + l2 + l3). Points are processed in blocks so that the covariance
+// and eigen buffers stay in cache, blocks being spread over threads.
+inline void estimateNormals(
+    const Vec3SoA<float> &points, const uint32_t *neighbours, const size_t k,
+    const uint32_t *counts, const Vec3<float> &viewpoint,
+    Vec3SoA<float> &normals, float *curvature = NULL)
+{
+  static const size_t blockSize = 1024;
+  const size_t n = points.size();
+  const int64_t nBlocks = int64_t((n + blockSize - 1) / blockSize);
+  normals.resize(n);
+
+  const float vx = viewpoint.data.coords.x;
+  const float vy = viewpoint.data.coords.y;
+  const float vz = viewpoint.data.coords.z;
+
+#pragma omp parallel
+  {
+    Sym3SoA cov(blockSize);
+    std::vector<float> l1(blockSize), l2(blockSize), l3(blockSize);
+
+#pragma omp for schedule(dynamic, 1)
+    for(int64_t b = 0; b < nBlocks; b++)
+    {
+      const size_t begin = size_t(b) * blockSize;
+      const size_t end = std::min(n, begin + blockSize);
+      const size_t count = end - begin;
+      neighbourhoodCovariances(
+          points, neighbours, k, counts, begin, end, cov);
+
+      float *nx = normals.x.data() + begin;
+      float *ny = normals.y.data() + begin;
+      float *nz = normals.z.data() + begin;
+      sym3SmallestEigen(
+          cov.xx.data(), cov.xy.data(), cov.xz.data(), cov.yy.data(),
+          cov.yz.data(), cov.zz.data(), count, l1.data(), l2.data(),
+          l3.data(), nx, ny, nz);
+
+      const float *px = points.x.data() + begin;
+      const float *py = points.y.data() + begin;
+      const float *pz = points.z.data() + begin;
+#pragma omp simd
+      for(size_t i = 0; i < count; i++)
+      {
+        const float d
+            = nx[i] * (vx - px[i]) + ny[i] * (vy - py[i]) + nz[i] * (vz - pz[i]);
+        const float s = d < 0.0f ? -1.0f : 1.0f;
+        nx[i] *= s;
+        ny[i] *= s;
+        nz[i] *= s;
+      }
+
+      if(curvature != NULL)
+      {
+#pragma omp simd
+        for(size_t i = 0; i < count; i++)
+        {
+          const float sum = l1[i] + l2[i] + l3[i];
+          curvature[begin + i] = sum > 0.0f ? fmaxf(l3[i], 0.0f) / sum : 0.0f;
+        }
+      }
+    }
+  }
+}
+
+// Same, with the k nearest neighbours (within maxDistance) of every point
+// searched in a kd-tree built on the points.
+inline void estimateNormals(
+    const Vec3SoA<float> &points, const KdTree &tree, const size_t k,
+    const Vec3<float> &viewpoint, Vec3SoA<float> &normals,
+    float *curvature = NULL, const float maxDistance = FLT_MAX)
+{
+  const size_t n = points.size();
+  std::vector<uint32_t> neighbours(n * k);
+  std::vector<uint32_t> counts(n);
+  const float maxDist2
+      = maxDistance < sqrtf(FLT_MAX) ? maxDistance * maxDistance : FLT_MAX;
+
+#pragma omp parallel
+  {
+    std::vector<float> dists2(k);
+
+#pragma omp for schedule(dynamic, 256)
+    for(int64_t i = 0; i < int64_t(n); i++)
+    {
+      counts[i] = uint32_t(tree.knn(
+          points.x[i], points.y[i], points.z[i], k,
+          neighbours.data() + size_t(i) * k, dists2.data(), maxDist2));
+    }
+  }
+
+  estimateNormals(
+      points, neighbours.data(), k, counts.data(), viewpoint, normals,
+      curvature);
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_NORMALS_HPP__
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_PARALLEL_HPP__
+#define __GEOMETRY_PARALLEL_HPP__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+// Threading is done with OpenMP. When the library is compiled without
+// -fopenmp, the pragmas are ignored and every kernel runs on a single thread.
+
+namespace geometry
+{
+namespace parallel
+{
+inline int maxThreads()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// Team size of the parallel regions started by the calling thread from now on
+inline void setMaxThreads(const int n)
+{
+#ifdef _OPENMP
+  omp_set_num_threads(n);
+#else
+  (void) n;
+#endif
+}
+
+inline int numThreads()
+{
+#ifdef _OPENMP
+  return omp_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
+inline int threadId()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+// Splits [0, n) into nChunks contiguous ranges and returns the one at index id
+inline void
+chunkRange(const size_t n, const int nChunks, const int id, size_t &begin,
+           size_t &end)
+{
+  const size_t chunk = (n + size_t(nChunks) - 1) / size_t(nChunks);
+  begin = chunk * size_t(id);
+  end = begin + chunk;
+  begin = begin > n ? n : begin;
+  end = end > n ? n : end;
+}
+
+// -----------------------------------------------------------------------------
+
+// Parallel LSD radix sort of (key, value) pairs on the low maxBits bits of the
+// keys. The sort is stable and works in place : tmpKeys and tmpValues are
+// scratch buffers that are resized if needed, so that callers running at a
+// fixed rate can keep them alive between calls.
+template <typename V>
+inline void radixSortPairs(
+    std::vector<uint64_t> &keys, std::vector<V> &values,
+    std::vector<uint64_t> &tmpKeys, std::vector<V> &tmpValues,
+    const int maxBits = 64)
+{
+  static const int radixBits = 11;
+  static const size_t radixSize = size_t(1) << radixBits;
+  static const uint64_t radixMask = radixSize - 1;
+
+  const size_t n = keys.size();
+  tmpKeys.resize(n);
+  tmpValues.resize(n);
+
+  const int nThreads = maxThreads();
+  std::vector<size_t> histograms(size_t(nThreads) * radixSize);
+
+  uint64_t *src = keys.data();
+  uint64_t *dst = tmpKeys.data();
+  V *srcValues = values.data();
+  V *dstValues = tmpValues.data();
+
+  const int nPasses = (maxBits + radixBits - 1) / radixBits;
+  for(int pass = 0; pass < nPasses; pass++)
+  {
+    const int shift = pass * radixBits;
+    int nt = 1;
+
+#pragma omp parallel num_threads(nThreads)
+    {
+#pragma omp single
+      nt = numThreads();
+
+      const int tid = threadId();
+      size_t begin, end;
+      chunkRange(n, nt, tid, begin, end);
+
+      size_t *hist = histograms.data() + size_t(tid) * radixSize;
+      memset(hist, 0, radixSize * sizeof(size_t));
+      for(size_t i = begin; i < end; i++)
+        hist[(src[i] >> shift) & radixMask]++;
+
+#pragma omp barrier
+#pragma omp single
+      {
+        // Exclusive prefix sum, digit major then thread major, so that the
+        // scatter below keeps the relative order of equal keys
+        size_t offset = 0;
+        for(size_t d = 0; d < radixSize; d++)
+        {
+          for(int t = 0; t < nt; t++)
+          {
+            const size_t count = histograms[size_t(t) * radixSize + d];
+            histograms[size_t(t) * radixSize + d] = offset;
+            offset += count;
+          }
+        }
+      }
+
+      for(size_t i = begin; i < end; i++)
+      {
+        const size_t pos = hist[(src[i] >> shift) & radixMask]++;
+        dst[pos] = src[i];
+        dstValues[pos] = srcValues[i];
+      }
+    }
+
+    uint64_t *swapKeys = src;
+    src = dst;
+    dst = swapKeys;
+    V *swapValues = srcValues;
+    srcValues = dstValues;
+    dstValues = swapValues;
+  }
+
+  if(nPasses % 2 == 1)
+  {
+    keys.swap(tmpKeys);
+    values.swap(tmpValues);
+  }
+}
+
+// Fills starts with the index of the first element of each run of equal
+// values in sortedKeys, followed by sortedKeys.size(). counts is a scratch
+// buffer. Returns the number of runs.
+inline size_t segmentStarts(
+    const std::vector<uint64_t> &sortedKeys, std::vector<size_t> &starts,
+    std::vector<size_t> &counts)
+{
+  const size_t n = sortedKeys.size();
+  const uint64_t *keys = sortedKeys.data();
+  const int nThreads = maxThreads();
+  counts.assign(size_t(nThreads) + 1, 0);
+  int nt = 1;
+
+#pragma omp parallel num_threads(nThreads)
+  {
+#pragma omp single
+    nt = numThreads();
+
+    const int tid = threadId();
+    size_t begin, end;
+    chunkRange(n, nt, tid, begin, end);
+
+    size_t count = 0;
+    for(size_t i = begin; i < end; i++)
+      count += (i == 0 || keys[i] != keys[i - 1]) ? 1 : 0;
+    counts[tid + 1] = count;
+
+#pragma omp barrier
+#pragma omp single
+    {
+      for(int t = 0; t < nt; t++)
+        counts[t + 1] += counts[t];
+      starts.resize(counts[nt] + 1);
+      starts[counts[nt]] = n;
+    }
+
+    size_t pos = counts[tid];
+    for(size_t i = begin; i < end; i++)
+    {
+      if(i == 0 || keys[i] != keys[i - 1])
+        starts[pos++] = i;
+    }
+  }
+
+  return starts.size() - 1;
+}
+
+inline int bitWidth(uint64_t v)
+{
+  int ret = 0;
+  while(v != 0)
+  {
+    ret++;
+    v >>= 1;
+  }
+  return ret;
+}
+} // namespace parallel
+} // namespace geometry
+
+#endif // __GEOMETRY_PARALLEL_HPP__
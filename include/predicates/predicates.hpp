@@ -0,0 +1,584 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_PREDICATES_HPP__
+#define __GEOMETRY_PREDICATES_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "soa/vec3_soa.hpp"
+#include "vec3/vec3.hpp"
+
+// Robust orientation and in-circle / in-sphere tests, following Shewchuk's
+// "Adaptive Precision Floating-Point Arithmetic and Fast Robust Geometric
+// Predicates". Each predicate first evaluates the determinant in double and
+// compares it with a forward error bound computed from the same terms. Only
+// when the sign is not certain is the determinant evaluated exactly with
+// floating point expansions. The returned value always has the sign of the
+// exact determinant.
+// The bounds assume no overflow or underflow, which holds for any input
+// representable as a float.
+
+namespace geometry
+{
+namespace predicates
+{
+static const double epsilon = 1.1102230246251565e-16; // 2^-53
+static const double splitter = 134217729.0;           // 2^27 + 1
+static const double orient2dBound = (3.0 + 16.0 * epsilon) * epsilon;
+static const double orient3dBound = (7.0 + 56.0 * epsilon) * epsilon;
+static const double incircleBound = (10.0 + 96.0 * epsilon) * epsilon;
+static const double insphereBound = (16.0 + 224.0 * epsilon) * epsilon;
+
+// Error free transformations : x + y equals the exact result
+inline void twoSum(const double a, const double b, double &x, double &y)
+{
+  x = a + b;
+  const double bv = x - a;
+  const double av = x - bv;
+  y = (a - av) + (b - bv);
+}
+
+inline void fastTwoSum(const double a, const double b, double &x, double &y)
+{
+  x = a + b;
+  y = b - (x - a);
+}
+
+inline void twoDiff(const double a, const double b, double &x, double &y)
+{
+  x = a - b;
+  const double bv = a - x;
+  const double av = x + bv;
+  y = (a - av) + (bv - b);
+}
+
+inline void twoProduct(const double a, const double b, double &x, double &y)
+{
+  x = a * b;
+#ifdef __FMA__
+  y = fma(a, b, -x);
+#else
+  // Dekker's split, which must not be contracted into FMAs : without __FMA__
+  // the compiler cannot emit them
+  double c = splitter * a;
+  const double ahi = c - (c - a);
+  const double alo = a - ahi;
+  c = splitter * b;
+  const double bhi = c - (c - b);
+  const double blo = b - bhi;
+  y = alo * blo - (((x - ahi * bhi) - alo * bhi) - ahi * blo);
+#endif
+}
+
+// Nonoverlapping expansion, components sorted by increasing magnitude with
+// zeros removed. The value is the exact sum of the components.
+struct Expansion
+{
+  std::vector<double> c;
+
+  Expansion() : c(1, 0.0) {}
+
+  explicit Expansion(const double v) : c(1, v) {}
+
+  static inline Expansion diff(const double a, const double b)
+  {
+    double x, y;
+    twoDiff(a, b, x, y);
+    Expansion ret(x);
+    if(y != 0.0)
+      ret.c.insert(ret.c.begin(), y);
+    return ret;
+  }
+
+  // Sum of the components, rounded but with the exact sign
+  inline double estimate() const
+  {
+    double s = 0.0;
+    for(size_t i = 0; i < c.size(); i++)
+      s += c[i];
+    return s;
+  }
+
+  inline Expansion operator-() const
+  {
+    Expansion ret(*this);
+    for(size_t i = 0; i < ret.c.size(); i++)
+      ret.c[i] = -ret.c[i];
+    return ret;
+  }
+
+  // Shewchuk's fast_expansion_sum_zeroelim
+  inline Expansion operator+(const Expansion &f) const
+  {
+    const std::vector<double> &e = c;
+    const size_t elen = e.size(), flen = f.c.size();
+    Expansion ret;
+    std::vector<double> &h = ret.c;
+    h.clear();
+    h.reserve(elen + flen);
+
+    size_t ei = 0, fi = 0;
+    double q, qn, hh;
+    // Next component by increasing magnitude
+    const auto takeE = [&]() {
+      return fi >= flen
+             || (ei < elen && (f.c[fi] > e[ei]) == (f.c[fi] > -e[ei]));
+    };
+    if(takeE())
+      q = e[ei++];
+    else
+      q = f.c[fi++];
+    if(ei < elen && fi < flen)
+    {
+      if(takeE())
+        fastTwoSum(e[ei++], q, qn, hh);
+      else
+        fastTwoSum(f.c[fi++], q, qn, hh);
+      q = qn;
+      if(hh != 0.0)
+        h.push_back(hh);
+    }
+    while(ei < elen || fi < flen)
+    {
+      if(takeE())
+        twoSum(q, e[ei++], qn, hh);
+      else
+        twoSum(q, f.c[fi++], qn, hh);
+      q = qn;
+      if(hh != 0.0)
+        h.push_back(hh);
+    }
+    if(q != 0.0 || h.empty())
+      h.push_back(q);
+    return ret;
+  }
+
+  inline Expansion operator-(const Expansion &f) const { return *this + (-f); }
+
+  // Shewchuk's scale_expansion_zeroelim
+  inline Expansion operator*(const double b) const
+  {
+    Expansion ret;
+    std::vector<double> &h = ret.c;
+    h.clear();
+    h.reserve(2 * c.size());
+    double q, hh;
+    twoProduct(c[0], b, q, hh);
+    if(hh != 0.0)
+      h.push_back(hh);
+    for(size_t i = 1; i < c.size(); i++)
+    {
+      double p1, p0, sum;
+      twoProduct(c[i], b, p1, p0);
+      twoSum(q, p0, sum, hh);
+      if(hh != 0.0)
+        h.push_back(hh);
+      fastTwoSum(p1, sum, q, hh);
+      if(hh != 0.0)
+        h.push_back(hh);
+    }
+    if(q != 0.0 || h.empty())
+      h.push_back(q);
+    return ret;
+  }
+
+  inline Expansion operator*(const Expansion &f) const
+  {
+    Expansion ret = *this * f.c[0];
+    for(size_t i = 1; i < f.c.size(); i++)
+      ret = ret + *this * f.c[i];
+    return ret;
+  }
+};
+
+inline double orient2dExact(const double *a, const double *b, const double *c)
+{
+  const Expansion acx = Expansion::diff(a[0], c[0]);
+  const Expansion acy = Expansion::diff(a[1], c[1]);
+  const Expansion bcx = Expansion::diff(b[0], c[0]);
+  const Expansion bcy = Expansion::diff(b[1], c[1]);
+  return (acx * bcy - acy * bcx).estimate();
+}
+
+inline double orient3dExact(
+    const double *a, const double *b, const double *c, const double *d)
+{
+  const Expansion adx = Expansion::diff(a[0], d[0]);
+  const Expansion ady = Expansion::diff(a[1], d[1]);
+  const Expansion adz = Expansion::diff(a[2], d[2]);
+  const Expansion bdx = Expansion::diff(b[0], d[0]);
+  const Expansion bdy = Expansion::diff(b[1], d[1]);
+  const Expansion bdz = Expansion::diff(b[2], d[2]);
+  const Expansion cdx = Expansion::diff(c[0], d[0]);
+  const Expansion cdy = Expansion::diff(c[1], d[1]);
+  const Expansion cdz = Expansion::diff(c[2], d[2]);
+  return (adz * (bdx * cdy - cdx * bdy) + bdz * (cdx * ady - adx * cdy)
+          + cdz * (adx * bdy - bdx * ady))
+      .estimate();
+}
+
+inline double incircleExact(
+    const double *a, const double *b, const double *c, const double *d)
+{
+  const Expansion adx = Expansion::diff(a[0], d[0]);
+  const Expansion ady = Expansion::diff(a[1], d[1]);
+  const Expansion bdx = Expansion::diff(b[0], d[0]);
+  const Expansion bdy = Expansion::diff(b[1], d[1]);
+  const Expansion cdx = Expansion::diff(c[0], d[0]);
+  const Expansion cdy = Expansion::diff(c[1], d[1]);
+  const Expansion alift = adx * adx + ady * ady;
+  const Expansion blift = bdx * bdx + bdy * bdy;
+  const Expansion clift = cdx * cdx + cdy * cdy;
+  return (alift * (bdx * cdy - cdx * bdy) + blift * (cdx * ady - adx * cdy)
+          + clift * (adx * bdy - bdx * ady))
+      .estimate();
+}
+
+inline double insphereExact(
+    const double *a, const double *b, const double *c, const double *d,
+    const double *e)
+{
+  const double *p[4] = {a, b, c, d};
+  Expansion x[4], y[4], z[4], lift[4];
+  for(int i = 0; i < 4; i++)
+  {
+    x[i] = Expansion::diff(p[i][0], e[0]);
+    y[i] = Expansion::diff(p[i][1], e[1]);
+    z[i] = Expansion::diff(p[i][2], e[2]);
+    lift[i] = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+  }
+  const Expansion ab = x[0] * y[1] - x[1] * y[0];
+  const Expansion bc = x[1] * y[2] - x[2] * y[1];
+  const Expansion cd = x[2] * y[3] - x[3] * y[2];
+  const Expansion da = x[3] * y[0] - x[0] * y[3];
+  const Expansion ac = x[0] * y[2] - x[2] * y[0];
+  const Expansion bd = x[1] * y[3] - x[3] * y[1];
+  const Expansion abc = z[0] * bc - z[1] * ac + z[2] * ab;
+  const Expansion bcd = z[1] * cd - z[2] * bd + z[3] * bc;
+  const Expansion cda = z[2] * da + z[3] * ac + z[0] * cd;
+  const Expansion dab = z[3] * ab + z[0] * bd + z[1] * da;
+  return ((lift[3] * abc - lift[2] * dab) + (lift[1] * cda - lift[0] * bcd))
+      .estimate();
+}
+
+// Filtered evaluations : set det and its error bound
+inline void orient2dFilter(
+    const double *a, const double *b, const double *c, double &det,
+    double &bound)
+{
+  const double l = (a[0] - c[0]) * (b[1] - c[1]);
+  const double r = (a[1] - c[1]) * (b[0] - c[0]);
+  det = l - r;
+  bound = orient2dBound * (fabs(l) + fabs(r));
+}
+
+inline void orient3dFilter(
+    const double *a, const double *b, const double *c, const double *d,
+    double &det, double &bound)
+{
+  const double adx = a[0] - d[0], ady = a[1] - d[1], adz = a[2] - d[2];
+  const double bdx = b[0] - d[0], bdy = b[1] - d[1], bdz = b[2] - d[2];
+  const double cdx = c[0] - d[0], cdy = c[1] - d[1], cdz = c[2] - d[2];
+  const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+  const double cdxady = cdx * ady, adxcdy = adx * cdy;
+  const double adxbdy = adx * bdy, bdxady = bdx * ady;
+  det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy)
+        + cdz * (adxbdy - bdxady);
+  bound = orient3dBound
+          * ((fabs(bdxcdy) + fabs(cdxbdy)) * fabs(adz)
+             + (fabs(cdxady) + fabs(adxcdy)) * fabs(bdz)
+             + (fabs(adxbdy) + fabs(bdxady)) * fabs(cdz));
+}
+
+inline void incircleFilter(
+    const double *a, const double *b, const double *c, const double *d,
+    double &det, double &bound)
+{
+  const double adx = a[0] - d[0], ady = a[1] - d[1];
+  const double bdx = b[0] - d[0], bdy = b[1] - d[1];
+  const double cdx = c[0] - d[0], cdy = c[1] - d[1];
+  const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+  const double cdxady = cdx * ady, adxcdy = adx * cdy;
+  const double adxbdy = adx * bdy, bdxady = bdx * ady;
+  const double alift = adx * adx + ady * ady;
+  const double blift = bdx * bdx + bdy * bdy;
+  const double clift = cdx * cdx + cdy * cdy;
+  det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy)
+        + clift * (adxbdy - bdxady);
+  bound = incircleBound
+          * ((fabs(bdxcdy) + fabs(cdxbdy)) * alift
+             + (fabs(cdxady) + fabs(adxcdy)) * blift
+             + (fabs(adxbdy) + fabs(bdxady)) * clift);
+}
+
+inline void insphereFilter(
+    const double *a, const double *b, const double *c, const double *d,
+    const double *e, double &det, double &bound)
+{
+  const double aex = a[0] - e[0], aey = a[1] - e[1], aez = a[2] - e[2];
+  const double bex = b[0] - e[0], bey = b[1] - e[1], bez = b[2] - e[2];
+  const double cex = c[0] - e[0], cey = c[1] - e[1], cez = c[2] - e[2];
+  const double dex = d[0] - e[0], dey = d[1] - e[1], dez = d[2] - e[2];
+
+  const double aexbey = aex * bey, bexaey = bex * aey;
+  const double bexcey = bex * cey, cexbey = cex * bey;
+  const double cexdey = cex * dey, dexcey = dex * cey;
+  const double dexaey = dex * aey, aexdey = aex * dey;
+  const double aexcey = aex * cey, cexaey = cex * aey;
+  const double bexdey = bex * dey, dexbey = dex * bey;
+  const double ab = aexbey - bexaey, bc = bexcey - cexbey;
+  const double cd = cexdey - dexcey, da = dexaey - aexdey;
+  const double ac = aexcey - cexaey, bd = bexdey - dexbey;
+
+  const double abc = aez * bc - bez * ac + cez * ab;
+  const double bcd = bez * cd - cez * bd + dez * bc;
+  const double cda = cez * da + dez * ac + aez * cd;
+  const double dab = dez * ab + aez * bd + bez * da;
+
+  const double alift = aex * aex + aey * aey + aez * aez;
+  const double blift = bex * bex + bey * bey + bez * bez;
+  const double clift = cex * cex + cey * cey + cez * cez;
+  const double dlift = dex * dex + dey * dey + dez * dez;
+  det = (dlift * abc - clift * dab) + (blift * cda - alift * bcd);
+
+  const double aezp = fabs(aez), bezp = fabs(bez);
+  const double cezp = fabs(cez), dezp = fabs(dez);
+  const double abp = fabs(aexbey) + fabs(bexaey);
+  const double bcp = fabs(bexcey) + fabs(cexbey);
+  const double cdp = fabs(cexdey) + fabs(dexcey);
+  const double dap = fabs(dexaey) + fabs(aexdey);
+  const double acp = fabs(aexcey) + fabs(cexaey);
+  const double bdp = fabs(bexdey) + fabs(dexbey);
+  bound = insphereBound
+          * ((cdp * bezp + bdp * cezp + bcp * dezp) * alift
+             + (dap * cezp + acp * dezp + cdp * aezp) * blift
+             + (abp * dezp + bdp * aezp + dap * bezp) * clift
+             + (bcp * aezp + acp * bezp + abp * cezp) * dlift);
+}
+
+inline int8_t filteredSign(const double det, const double bound)
+{
+  return det > bound ? int8_t(1) : (-det > bound ? int8_t(-1) : int8_t(0));
+}
+
+inline int8_t sign(const double v)
+{
+  return v > 0.0 ? int8_t(1) : (v < 0.0 ? int8_t(-1) : int8_t(0));
+}
+
+inline void toDouble(const Vec3<float> &v, double *d)
+{
+  d[0] = v.data.coords.x;
+  d[1] = v.data.coords.y;
+  d[2] = v.data.coords.z;
+}
+} // namespace predicates
+
+// Positive if a, b, c are in counterclockwise order, negative if clockwise,
+// zero if collinear
+inline double orient2d(const double *a, const double *b, const double *c)
+{
+  double det, bound;
+  predicates::orient2dFilter(a, b, c, det, bound);
+  if(det > bound || -det > bound)
+    return det;
+  return predicates::orient2dExact(a, b, c);
+}
+
+// Positive if d lies below the plane of a, b, c, these appearing
+// counterclockwise when seen from above the plane; negative if d is above,
+// zero if the four points are coplanar
+inline double
+orient3d(const double *a, const double *b, const double *c, const double *d)
+{
+  double det, bound;
+  predicates::orient3dFilter(a, b, c, d, det, bound);
+  if(det > bound || -det > bound)
+    return det;
+  return predicates::orient3dExact(a, b, c, d);
+}
+
+// Positive if d lies inside the circle through a, b, c (in counterclockwise
+// order), negative if outside, zero if the four points are cocircular
+inline double
+incircle(const double *a, const double *b, const double *c, const double *d)
+{
+  double det, bound;
+  predicates::incircleFilter(a, b, c, d, det, bound);
+  if(det > bound || -det > bound)
+    return det;
+  return predicates::incircleExact(a, b, c, d);
+}
+
+// Positive if e lies inside the sphere through a, b, c, d, these having a
+// positive orientation3d; negative if outside, zero if cospherical
+inline double insphere(
+    const double *a, const double *b, const double *c, const double *d,
+    const double *e)
+{
+  double det, bound;
+  predicates::insphereFilter(a, b, c, d, e, det, bound);
+  if(det > bound || -det > bound)
+    return det;
+  return predicates::insphereExact(a, b, c, d, e);
+}
+
+inline double orient3d(
+    const Vec3<float> &a, const Vec3<float> &b, const Vec3<float> &c,
+    const Vec3<float> &d)
+{
+  double p[4][3];
+  predicates::toDouble(a, p[0]);
+  predicates::toDouble(b, p[1]);
+  predicates::toDouble(c, p[2]);
+  predicates::toDouble(d, p[3]);
+  return orient3d(p[0], p[1], p[2], p[3]);
+}
+
+inline double insphere(
+    const Vec3<float> &a, const Vec3<float> &b, const Vec3<float> &c,
+    const Vec3<float> &d, const Vec3<float> &e)
+{
+  double p[5][3];
+  predicates::toDouble(a, p[0]);
+  predicates::toDouble(b, p[1]);
+  predicates::toDouble(c, p[2]);
+  predicates::toDouble(d, p[3]);
+  predicates::toDouble(e, p[4]);
+  return insphere(p[0], p[1], p[2], p[3], p[4]);
+}
+
+// -----------------------------------------------------------------------------
+
+// Batched predicates : one fixed simplex against n query points, the sign of
+// each determinant (-1, 0 or 1) being written to signs. The filter runs as a
+// vectorized pass over all queries; the few uncertain ones are then resolved
+// exactly in a second pass.
+
+inline void orient2dBatch(
+    const double *a, const double *b, const float *cx, const float *cy,
+    const size_t n, int8_t *signs)
+{
+#pragma omp parallel for simd if(n > 16384)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    const double c[2] = {cx[i], cy[i]};
+    double det, bound;
+    predicates::orient2dFilter(a, b, c, det, bound);
+    signs[i] = predicates::filteredSign(det, bound);
+  }
+#pragma omp parallel for schedule(dynamic, 1024) if(n > 16384)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    if(signs[i] != 0)
+      continue;
+    const double c[2] = {cx[i], cy[i]};
+    signs[i] = predicates::sign(predicates::orient2dExact(a, b, c));
+  }
+}
+
+inline void incircleBatch(
+    const double *a, const double *b, const double *c, const float *dx,
+    const float *dy, const size_t n, int8_t *signs)
+{
+#pragma omp parallel for simd if(n > 16384)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    const double d[2] = {dx[i], dy[i]};
+    double det, bound;
+    predicates::incircleFilter(a, b, c, d, det, bound);
+    signs[i] = predicates::filteredSign(det, bound);
+  }
+#pragma omp parallel for schedule(dynamic, 1024) if(n > 16384)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    if(signs[i] != 0)
+      continue;
+    const double d[2] = {dx[i], dy[i]};
+    signs[i] = predicates::sign(predicates::incircleExact(a, b, c, d));
+  }
+}
+
+inline void orient3dBatch(
+    const Vec3<float> &a, const Vec3<float> &b, const Vec3<float> &c,
+    const Vec3SoA<float> &d, int8_t *signs)
+{
+  double p[3][3];
+  predicates::toDouble(a, p[0]);
+  predicates::toDouble(b, p[1]);
+  predicates::toDouble(c, p[2]);
+  const size_t n = d.size();
+  const float *x = d.x.data();
+  const float *y = d.y.data();
+  const float *z = d.z.data();
+#pragma omp parallel for simd if(n > 16384)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    const double q[3] = {x[i], y[i], z[i]};
+    double det, bound;
+    predicates::orient3dFilter(p[0], p[1], p[2], q, det, bound);
+    signs[i] = predicates::filteredSign(det, bound);
+  }
+#pragma omp parallel for schedule(dynamic, 1024) if(n > 16384)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    if(signs[i] != 0)
+      continue;
+    const double q[3] = {x[i], y[i], z[i]};
+    signs[i]
+        = predicates::sign(predicates::orient3dExact(p[0], p[1], p[2], q));
+  }
+}
+
+inline void insphereBatch(
+    const Vec3<float> &a, const Vec3<float> &b, const Vec3<float> &c,
+    const Vec3<float> &d, const Vec3SoA<float> &e, int8_t *signs)
+{
+  double p[4][3];
+  predicates::toDouble(a, p[0]);
+  predicates::toDouble(b, p[1]);
+  predicates::toDouble(c, p[2]);
+  predicates::toDouble(d, p[3]);
+  const size_t n = e.size();
+  const float *x = e.x.data();
+  const float *y = e.y.data();
+  const float *z = e.z.data();
+#pragma omp parallel for simd if(n > 16384)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    const double q[3] = {x[i], y[i], z[i]};
+    double det, bound;
+    predicates::insphereFilter(p[0], p[1], p[2], p[3], q, det, bound);
+    signs[i] = predicates::filteredSign(det, bound);
+  }
+#pragma omp parallel for schedule(dynamic, 1024) if(n > 16384)
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    if(signs[i] != 0)
+      continue;
+    const double q[3] = {x[i], y[i], z[i]};
+    signs[i] = predicates::sign(
+        predicates::insphereExact(p[0], p[1], p[2], p[3], q));
+  }
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_PREDICATES_HPP__
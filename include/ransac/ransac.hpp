@@ -0,0 +1,660 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_RANSAC_HPP__
+#define __GEOMETRY_RANSAC_HPP__
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "linalg/small_solve.hpp"
+#include "parallel/parallel.hpp"
+#include "soa/vec3_soa.hpp"
+#include "sym3/sym3.hpp"
+
+namespace geometry
+{
+// Models fitted by Ransac. Each model provides its minimal sample size, a fit
+// from a minimal sample, a vectorized inlier test over a SoA range and a
+// least squares refinement on the final inliers.
+
+// Plane n.p + d = 0, with |n| = 1
+struct PlaneModel
+{
+  static const int sampleSize = 3;
+  static const bool needsNormals = false;
+
+  float n[3];
+  float d;
+
+  inline bool fit(
+      const Vec3SoA<float> &points, const Vec3SoA<float> * /*normals*/,
+      const uint32_t *ids)
+  {
+    const float ux = points.x[ids[1]] - points.x[ids[0]];
+    const float uy = points.y[ids[1]] - points.y[ids[0]];
+    const float uz = points.z[ids[1]] - points.z[ids[0]];
+    const float vx = points.x[ids[2]] - points.x[ids[0]];
+    const float vy = points.y[ids[2]] - points.y[ids[0]];
+    const float vz = points.z[ids[2]] - points.z[ids[0]];
+    n[0] = uy * vz - uz * vy;
+    n[1] = uz * vx - ux * vz;
+    n[2] = ux * vy - uy * vx;
+    const float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if(!(len > 1e-12f))
+      return false;
+    n[0] /= len;
+    n[1] /= len;
+    n[2] /= len;
+    d = -(n[0] * points.x[ids[0]] + n[1] * points.y[ids[0]]
+          + n[2] * points.z[ids[0]]);
+    return true;
+  }
+
+  inline size_t countInliers(
+      const float *x, const float *y, const float *z, const float * /*nx*/,
+      const float * /*ny*/, const float * /*nz*/, const size_t count,
+      const float threshold) const
+  {
+    size_t ret = 0;
+#pragma omp simd reduction(+ : ret)
+    for(size_t i = 0; i < count; i++)
+    {
+      const float dist = n[0] * x[i] + n[1] * y[i] + n[2] * z[i] + d;
+      ret += fabsf(dist) < threshold ? 1 : 0;
+    }
+    return ret;
+  }
+
+  inline float distance(const float x, const float y, const float z) const
+  {
+    return fabsf(n[0] * x + n[1] * y + n[2] * z + d);
+  }
+
+  // Total least squares plane through the inliers
+  inline void refine(
+      const Vec3SoA<float> &points, const Vec3SoA<float> * /*normals*/,
+      const std::vector<uint32_t> &inliers)
+  {
+    if(inliers.size() < 3)
+      return;
+
+    double m[3] = {0.0, 0.0, 0.0};
+    for(size_t i = 0; i < inliers.size(); i++)
+    {
+      m[0] += points.x[inliers[i]];
+      m[1] += points.y[inliers[i]];
+      m[2] += points.z[inliers[i]];
+    }
+    for(int a = 0; a < 3; a++)
+      m[a] /= double(inliers.size());
+
+    double c[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    for(size_t i = 0; i < inliers.size(); i++)
+    {
+      const double dx = points.x[inliers[i]] - m[0];
+      const double dy = points.y[inliers[i]] - m[1];
+      const double dz = points.z[inliers[i]] - m[2];
+      c[0] += dx * dx;
+      c[1] += dx * dy;
+      c[2] += dx * dz;
+      c[3] += dy * dy;
+      c[4] += dy * dz;
+      c[5] += dz * dz;
+    }
+
+    const float cxx = float(c[0]), cxy = float(c[1]), cxz = float(c[2]);
+    const float cyy = float(c[3]), cyz = float(c[4]), czz = float(c[5]);
+    float l1, l2, l3, v[3];
+    sym3SmallestEigen(
+        &cxx, &cxy, &cxz, &cyy, &cyz, &czz, 1, &l1, &l2, &l3, v, v + 1, v + 2);
+
+    const float s = v[0] * n[0] + v[1] * n[1] + v[2] * n[2] < 0.0f ? -1.0f
+                                                                   : 1.0f;
+    n[0] = s * v[0];
+    n[1] = s * v[1];
+    n[2] = s * v[2];
+    d = -float(n[0] * m[0] + n[1] * m[1] + n[2] * m[2]);
+  }
+};
+
+// Sphere |p - c| = r, with r in [minRadius, maxRadius]
+struct SphereModel
+{
+  static const int sampleSize = 4;
+  static const bool needsNormals = false;
+
+  float c[3];
+  float r;
+  float minRadius;
+  float maxRadius;
+
+  SphereModel() : r(0.0f), minRadius(0.0f), maxRadius(FLT_MAX) {}
+
+  // Circumscribed sphere : subtracting the equation of the first point from
+  // the others gives the linear system 2 (p_i - p_0).c = |p_i|^2 - |p_0|^2
+  inline bool fit(
+      const Vec3SoA<float> &points, const Vec3SoA<float> * /*normals*/,
+      const uint32_t *ids)
+  {
+    double a[3][3], b[3];
+    const double x0 = points.x[ids[0]];
+    const double y0 = points.y[ids[0]];
+    const double z0 = points.z[ids[0]];
+    for(int i = 0; i < 3; i++)
+    {
+      const double x = points.x[ids[i + 1]];
+      const double y = points.y[ids[i + 1]];
+      const double z = points.z[ids[i + 1]];
+      a[i][0] = 2.0 * (x - x0);
+      a[i][1] = 2.0 * (y - y0);
+      a[i][2] = 2.0 * (z - z0);
+      b[i] = (x * x + y * y + z * z) - (x0 * x0 + y0 * y0 + z0 * z0);
+    }
+
+    const double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1])
+                       - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0])
+                       + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    if(!(fabs(det) > 1e-12))
+      return false;
+
+    // Cramer's rule
+    for(int k = 0; k < 3; k++)
+    {
+      double m[3][3];
+      for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+          m[i][j] = j == k ? b[i] : a[i][j];
+      c[k] = float(
+          (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+           - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+           + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]))
+          / det);
+    }
+    r = sqrtf(
+        (float(x0) - c[0]) * (float(x0) - c[0])
+        + (float(y0) - c[1]) * (float(y0) - c[1])
+        + (float(z0) - c[2]) * (float(z0) - c[2]));
+    return r >= minRadius && r <= maxRadius;
+  }
+
+  inline size_t countInliers(
+      const float *x, const float *y, const float *z, const float * /*nx*/,
+      const float * /*ny*/, const float * /*nz*/, const size_t count,
+      const float threshold) const
+  {
+    size_t ret = 0;
+#pragma omp simd reduction(+ : ret)
+    for(size_t i = 0; i < count; i++)
+    {
+      const float dx = x[i] - c[0];
+      const float dy = y[i] - c[1];
+      const float dz = z[i] - c[2];
+      ret += fabsf(sqrtf(dx * dx + dy * dy + dz * dz) - r) < threshold ? 1 : 0;
+    }
+    return ret;
+  }
+
+  inline float distance(const float x, const float y, const float z) const
+  {
+    const float dx = x - c[0];
+    const float dy = y - c[1];
+    const float dz = z - c[2];
+    return fabsf(sqrtf(dx * dx + dy * dy + dz * dz) - r);
+  }
+
+  // Algebraic least squares sphere : |p|^2 = 2 c.p + k with k = r^2 - |c|^2
+  // is linear in (c, k). Points are centered on their mean for conditioning.
+  // The model is kept if the refined radius leaves the bounds.
+  inline void refine(
+      const Vec3SoA<float> &points, const Vec3SoA<float> * /*normals*/,
+      const std::vector<uint32_t> &inliers)
+  {
+    if(inliers.size() < 4)
+      return;
+
+    double m[3] = {0.0, 0.0, 0.0};
+    for(size_t i = 0; i < inliers.size(); i++)
+    {
+      m[0] += points.x[inliers[i]];
+      m[1] += points.y[inliers[i]];
+      m[2] += points.z[inliers[i]];
+    }
+    for(int k = 0; k < 3; k++)
+      m[k] /= double(inliers.size());
+
+    double a[4][4] = {{0.0}}, b[4] = {0.0, 0.0, 0.0, 0.0};
+    for(size_t i = 0; i < inliers.size(); i++)
+    {
+      const double row[4]
+          = {2.0 * (points.x[inliers[i]] - m[0]),
+             2.0 * (points.y[inliers[i]] - m[1]),
+             2.0 * (points.z[inliers[i]] - m[2]), 1.0};
+      const double rhs
+          = 0.25 * (row[0] * row[0] + row[1] * row[1] + row[2] * row[2]);
+      for(int j = 0; j < 4; j++)
+      {
+        for(int k = 0; k <= j; k++)
+          a[j][k] += row[j] * row[k];
+        b[j] += row[j] * rhs;
+      }
+    }
+
+    double x[4];
+    if(!solveCholesky<4, double>(a, b, x))
+      return;
+    const double r2 = x[3] + x[0] * x[0] + x[1] * x[1] + x[2] * x[2];
+    const float radius = float(sqrt(r2 > 0.0 ? r2 : 0.0));
+    if(!(radius >= minRadius && radius <= maxRadius))
+      return;
+    for(int k = 0; k < 3; k++)
+      c[k] = float(m[k] + x[k]);
+    r = radius;
+  }
+};
+
+// Infinite cylinder of axis (p, a), |a| = 1, and radius r in [minRadius,
+// maxRadius]. Fitted from two oriented points : the axis direction is n0 x n1
+// and goes through the closest points of the two normal lines.
+struct CylinderModel
+{
+  static const int sampleSize = 2;
+  static const bool needsNormals = true;
+
+  float p[3];
+  float a[3];
+  float r;
+  float minRadius;
+  float maxRadius;
+
+  CylinderModel() : r(0.0f), minRadius(0.0f), maxRadius(FLT_MAX) {}
+
+  inline bool fit(
+      const Vec3SoA<float> &points, const Vec3SoA<float> *normals,
+      const uint32_t *ids)
+  {
+    const float p0[3]
+        = {points.x[ids[0]], points.y[ids[0]], points.z[ids[0]]};
+    const float p1[3]
+        = {points.x[ids[1]], points.y[ids[1]], points.z[ids[1]]};
+    const float n0[3]
+        = {normals->x[ids[0]], normals->y[ids[0]], normals->z[ids[0]]};
+    const float n1[3]
+        = {normals->x[ids[1]], normals->y[ids[1]], normals->z[ids[1]]};
+
+    a[0] = n0[1] * n1[2] - n0[2] * n1[1];
+    a[1] = n0[2] * n1[0] - n0[0] * n1[2];
+    a[2] = n0[0] * n1[1] - n0[1] * n1[0];
+    const float len = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    if(!(len > 1e-6f))
+      return false;
+    a[0] /= len;
+    a[1] /= len;
+    a[2] /= len;
+
+    // Closest points of the lines p0 + s n0 and p1 + t n1
+    const float w[3] = {p0[0] - p1[0], p0[1] - p1[1], p0[2] - p1[2]};
+    const float b = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+    const float aa = n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2];
+    const float cc = n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2];
+    const float d = n0[0] * w[0] + n0[1] * w[1] + n0[2] * w[2];
+    const float e = n1[0] * w[0] + n1[1] * w[1] + n1[2] * w[2];
+    const float den = aa * cc - b * b;
+    if(!(den > 1e-12f))
+      return false;
+    const float s = (b * e - cc * d) / den;
+    for(int i = 0; i < 3; i++)
+      p[i] = p0[i] + s * n0[i];
+
+    r = axisDistance(p0[0], p0[1], p0[2]);
+    return r >= minRadius && r <= maxRadius;
+  }
+
+  inline float axisDistance(const float x, const float y, const float z) const
+  {
+    const float dx = x - p[0];
+    const float dy = y - p[1];
+    const float dz = z - p[2];
+    const float t = dx * a[0] + dy * a[1] + dz * a[2];
+    const float ex = dx - t * a[0];
+    const float ey = dy - t * a[1];
+    const float ez = dz - t * a[2];
+    return sqrtf(ex * ex + ey * ey + ez * ez);
+  }
+
+  inline size_t countInliers(
+      const float *x, const float *y, const float *z, const float * /*nx*/,
+      const float * /*ny*/, const float * /*nz*/, const size_t count,
+      const float threshold) const
+  {
+    size_t ret = 0;
+#pragma omp simd reduction(+ : ret)
+    for(size_t i = 0; i < count; i++)
+      ret += fabsf(axisDistance(x[i], y[i], z[i]) - r) < threshold ? 1 : 0;
+    return ret;
+  }
+
+  inline float distance(const float x, const float y, const float z) const
+  {
+    return fabsf(axisDistance(x, y, z) - r);
+  }
+
+  // The axis is refitted as the direction most orthogonal to the inlier
+  // normals (smallest eigenvector of sum(n n^T)), then the inliers projected
+  // on the orthogonal plane give the axis position and the radius with an
+  // algebraic circle fit. The model is kept if the radius leaves the bounds.
+  inline void refine(
+      const Vec3SoA<float> &points, const Vec3SoA<float> *normals,
+      const std::vector<uint32_t> &inliers)
+  {
+    if(inliers.size() < 3 || normals == NULL)
+      return;
+
+    double nn[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    double m[3] = {0.0, 0.0, 0.0};
+    for(size_t i = 0; i < inliers.size(); i++)
+    {
+      const uint32_t id = inliers[i];
+      const double x = normals->x[id], y = normals->y[id], z = normals->z[id];
+      nn[0] += x * x;
+      nn[1] += x * y;
+      nn[2] += x * z;
+      nn[3] += y * y;
+      nn[4] += y * z;
+      nn[5] += z * z;
+      m[0] += points.x[id];
+      m[1] += points.y[id];
+      m[2] += points.z[id];
+    }
+    for(int k = 0; k < 3; k++)
+      m[k] /= double(inliers.size());
+
+    const float cxx = float(nn[0]), cxy = float(nn[1]), cxz = float(nn[2]);
+    const float cyy = float(nn[3]), cyz = float(nn[4]), czz = float(nn[5]);
+    float l1, l2, l3, axis[3];
+    sym3SmallestEigen(
+        &cxx, &cxy, &cxz, &cyy, &cyz, &czz, 1, &l1, &l2, &l3, axis, axis + 1,
+        axis + 2);
+
+    // Orthonormal basis (u, v) of the plane orthogonal to the axis
+    double u[3];
+    if(fabsf(axis[0]) < 0.9f)
+    {
+      u[0] = 0.0;
+      u[1] = axis[2];
+      u[2] = -axis[1];
+    }
+    else
+    {
+      u[0] = -axis[2];
+      u[1] = 0.0;
+      u[2] = axis[0];
+    }
+    const double len = sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+    for(int k = 0; k < 3; k++)
+      u[k] /= len;
+    const double v[3]
+        = {axis[1] * u[2] - axis[2] * u[1], axis[2] * u[0] - axis[0] * u[2],
+           axis[0] * u[1] - axis[1] * u[0]};
+
+    // Circle s^2 + t^2 = 2 (cs s + ct t) + k, k = r^2 - cs^2 - ct^2
+    double ata[3][3] = {{0.0}}, atb[3] = {0.0, 0.0, 0.0};
+    for(size_t i = 0; i < inliers.size(); i++)
+    {
+      const uint32_t id = inliers[i];
+      const double d[3]
+          = {points.x[id] - m[0], points.y[id] - m[1], points.z[id] - m[2]};
+      const double row[3]
+          = {2.0 * (d[0] * u[0] + d[1] * u[1] + d[2] * u[2]),
+             2.0 * (d[0] * v[0] + d[1] * v[1] + d[2] * v[2]), 1.0};
+      const double rhs = 0.25 * (row[0] * row[0] + row[1] * row[1]);
+      for(int j = 0; j < 3; j++)
+      {
+        for(int k = 0; k <= j; k++)
+          ata[j][k] += row[j] * row[k];
+        atb[j] += row[j] * rhs;
+      }
+    }
+
+    double x[3];
+    if(!solveCholesky<3, double>(ata, atb, x))
+      return;
+    const double r2 = x[2] + x[0] * x[0] + x[1] * x[1];
+    const float radius = float(sqrt(r2 > 0.0 ? r2 : 0.0));
+    if(!(radius >= minRadius && radius <= maxRadius))
+      return;
+    for(int k = 0; k < 3; k++)
+    {
+      p[k] = float(m[k] + x[0] * u[k] + x[1] * v[k]);
+      a[k] = axis[k];
+    }
+    r = radius;
+  }
+};
+
+// -----------------------------------------------------------------------------
+
+template <typename Model>
+struct RansacResult
+{
+  Model model;
+  size_t inlierCount;
+  size_t iterations;
+  bool found;
+  std::vector<uint32_t> inliers;
+};
+
+// Parallel RANSAC. Hypotheses are drawn in rounds; each thread takes a batch
+// of hypotheses and scores them together, one cache-sized block of points at
+// a time, so that the points are read once per batch instead of once per
+// hypothesis. A hypothesis is dropped as soon as it can no longer beat the
+// best score of the previous rounds, and the number of rounds adapts to the
+// inlier ratio found so far (early termination at the requested confidence).
+// Samples are drawn from a per hypothesis seed and rounds have a fixed size,
+// so results do not depend on the number of threads.
+template <typename Model>
+class Ransac
+{
+public:
+  Ransac(const float threshold, const size_t maxIterations = 1000,
+         const double confidence = 0.99, const uint64_t seed = 0)
+      : threshold_(threshold), maxIterations_(maxIterations),
+        confidence_(confidence), seed_(seed)
+  {}
+
+  inline void setThreshold(const float threshold) { threshold_ = threshold; }
+  inline void setMaxIterations(const size_t n) { maxIterations_ = n; }
+  inline void setConfidence(const double p) { confidence_ = p; }
+  inline void setSeed(const uint64_t seed) { seed_ = seed; }
+
+  // Every hypothesis starts as a copy of the prototype before being fitted,
+  // which is how model constraints (e.g. radius bounds) are passed
+  inline void setPrototype(const Model &prototype) { prototype_ = prototype; }
+
+  RansacResult<Model>
+  fit(const Vec3SoA<float> &points, const Vec3SoA<float> *normals = NULL)
+  {
+    if(Model::needsNormals && normals == NULL)
+      throw std::invalid_argument("Ransac : this model requires normals");
+
+    RansacResult<Model> ret;
+    ret.inlierCount = 0;
+    ret.iterations = 0;
+    ret.found = false;
+
+    const size_t n = points.size();
+    if(n < size_t(Model::sampleSize))
+      return ret;
+
+    std::vector<Model> models(roundSize);
+    std::vector<size_t> scores(roundSize);
+
+    size_t required = maxIterations_;
+    while(ret.iterations < required)
+    {
+      // By value : std::min() takes references, which would need an out of
+      // class definition of the constant
+      const size_t count
+          = std::min(size_t(roundSize), required - ret.iterations);
+      const size_t nBatches = (count + batchSize - 1) / batchSize;
+      const size_t best = ret.inlierCount;
+      const uint64_t first = ret.iterations;
+
+#pragma omp parallel for schedule(dynamic, 1)
+      for(int64_t b = 0; b < int64_t(nBatches); b++)
+      {
+        const size_t begin = size_t(b) * batchSize;
+        const size_t end
+            = begin + batchSize < count ? begin + batchSize : count;
+        scoreBatch(
+            points, normals, first + begin, end - begin, best,
+            models.data() + begin, scores.data() + begin);
+      }
+
+      for(size_t h = 0; h < count; h++)
+      {
+        if(scores[h] > ret.inlierCount)
+        {
+          ret.inlierCount = scores[h];
+          ret.model = models[h];
+          ret.found = true;
+        }
+      }
+      ret.iterations += count;
+
+      if(ret.found)
+        required = std::min(required, requiredIterations(ret.inlierCount, n));
+    }
+
+    if(ret.found)
+    {
+      collectInliers(points, ret.model, ret.inliers);
+      ret.model.refine(points, normals, ret.inliers);
+      collectInliers(points, ret.model, ret.inliers);
+      ret.inlierCount = ret.inliers.size();
+    }
+    return ret;
+  }
+
+private:
+  float threshold_;
+  size_t maxIterations_;
+  double confidence_;
+  uint64_t seed_;
+  Model prototype_;
+
+  static const size_t batchSize = 8;
+  static const size_t roundSize = 64 * batchSize;
+  static const size_t blockSize = 2048;
+
+  static inline uint64_t splitmix(uint64_t &state)
+  {
+    uint64_t z = (state += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+  }
+
+  inline size_t requiredIterations(const size_t inliers, const size_t n) const
+  {
+    const double w = double(inliers) / double(n);
+    const double ws = pow(w, double(Model::sampleSize));
+    if(ws >= 1.0)
+      return 0;
+    if(ws <= 0.0)
+      return maxIterations_;
+    const double k = log(1.0 - confidence_) / log(1.0 - ws);
+    return k >= double(maxIterations_) ? maxIterations_ : size_t(ceil(k));
+  }
+
+  void scoreBatch(
+      const Vec3SoA<float> &points, const Vec3SoA<float> *normals,
+      const uint64_t firstHypothesis, const size_t count, const size_t best,
+      Model *models, size_t *scores) const
+  {
+    const size_t n = points.size();
+    bool alive[batchSize];
+    for(size_t h = 0; h < count; h++)
+    {
+      uint64_t state
+          = seed_ ^ ((firstHypothesis + h) * UINT64_C(0xd1b54a32d192ed03));
+      uint32_t ids[Model::sampleSize];
+      for(int i = 0; i < Model::sampleSize; i++)
+      {
+        bool unique;
+        do
+        {
+          ids[i] = uint32_t(splitmix(state) % n);
+          unique = true;
+          for(int j = 0; j < i; j++)
+            unique = unique && ids[j] != ids[i];
+        } while(!unique);
+      }
+      models[h] = prototype_;
+      alive[h] = models[h].fit(points, normals, ids);
+      scores[h] = 0;
+    }
+
+    const float *nx = normals != NULL ? normals->x.data() : NULL;
+    const float *ny = normals != NULL ? normals->y.data() : NULL;
+    const float *nz = normals != NULL ? normals->z.data() : NULL;
+    for(size_t begin = 0; begin < n; begin += blockSize)
+    {
+      const size_t len = n - begin < blockSize ? n - begin : blockSize;
+      bool any = false;
+      for(size_t h = 0; h < count; h++)
+      {
+        if(!alive[h])
+          continue;
+        scores[h] += models[h].countInliers(
+            points.x.data() + begin, points.y.data() + begin,
+            points.z.data() + begin, nx == NULL ? NULL : nx + begin,
+            ny == NULL ? NULL : ny + begin, nz == NULL ? NULL : nz + begin,
+            len, threshold_);
+
+        // Cannot beat the best model anymore
+        alive[h] = scores[h] + (n - begin - len) > best;
+        any = any || alive[h];
+      }
+      if(!any)
+        break;
+    }
+
+    for(size_t h = 0; h < count; h++)
+      scores[h] = alive[h] ? scores[h] : 0;
+  }
+
+  void collectInliers(
+      const Vec3SoA<float> &points, const Model &model,
+      std::vector<uint32_t> &inliers) const
+  {
+    inliers.clear();
+    for(size_t i = 0; i < points.size(); i++)
+    {
+      if(model.distance(points.x[i], points.y[i], points.z[i]) < threshold_)
+        inliers.push_back(uint32_t(i));
+    }
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_RANSAC_HPP__
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_QUADRIC_HPP__
+#define __GEOMETRY_QUADRIC_HPP__
+
+#include <math.h>
+
+#include "linalg/small_solve.hpp"
+#include "mat4/mat4.hpp"
+
+namespace geometry
+{
+// Symmetric 4x4 error quadric Q, with Q(p) = [p 1] Q [p 1]^T the sum of the
+// weighted squared distances of p to a set of planes. Only the upper triangle
+// is stored :
+//   q[0] q[1] q[2] q[3]
+//        q[4] q[5] q[6]
+//             q[7] q[8]
+//                  q[9]
+template <typename T>
+struct Quadric
+{
+  T q[10];
+
+  Quadric()
+  {
+    for(int i = 0; i < 10; i++)
+      q[i] = T(0);
+  }
+
+  // Quadric of the plane a * x + b * y + c * z + d = 0, scaled by w
+  static inline Quadric<T>
+  fromPlane(const T a, const T b, const T c, const T d, const T w)
+  {
+    Quadric<T> ret;
+    ret.q[0] = w * a * a;
+    ret.q[1] = w * a * b;
+    ret.q[2] = w * a * c;
+    ret.q[3] = w * a * d;
+    ret.q[4] = w * b * b;
+    ret.q[5] = w * b * c;
+    ret.q[6] = w * b * d;
+    ret.q[7] = w * c * c;
+    ret.q[8] = w * c * d;
+    ret.q[9] = w * d * d;
+    return ret;
+  }
+
+  inline Quadric<T> &operator+=(const Quadric<T> &m)
+  {
+    for(int i = 0; i < 10; i++)
+      q[i] += m.q[i];
+    return *this;
+  }
+
+  inline Quadric<T> operator+(const Quadric<T> &m) const
+  {
+    Quadric<T> ret = *this;
+    ret += m;
+    return ret;
+  }
+
+  inline T evaluate(const T x, const T y, const T z) const
+  {
+    return q[0] * x * x + q[4] * y * y + q[7] * z * z
+           + T(2) * (q[1] * x * y + q[2] * x * z + q[5] * y * z)
+           + T(2) * (q[3] * x + q[6] * y + q[8] * z) + q[9];
+  }
+
+  // Point minimizing the quadric. Returns false if the 3x3 part is close to
+  // singular (planar or linear neighbourhoods), in which case the minimum is
+  // not unique.
+  inline bool optimum(T &x, T &y, T &z) const
+  {
+    const T det = q[0] * (q[4] * q[7] - q[5] * q[5])
+                  - q[1] * (q[1] * q[7] - q[5] * q[2])
+                  + q[2] * (q[1] * q[5] - q[4] * q[2]);
+    const T trace = q[0] + q[4] + q[7];
+    if(!(det > T(1e-9) * trace * trace * trace))
+      return false;
+
+    T a[3][3] = {{q[0], q[1], q[2]}, {q[1], q[4], q[5]}, {q[2], q[5], q[7]}};
+    const T b[3] = {-q[3], -q[6], -q[8]};
+    T p[3];
+    if(!solveCholesky<3, T>(a, b, p))
+      return false;
+    x = p[0];
+    y = p[1];
+    z = p[2];
+    return true;
+  }
+
+  inline Mat4<float> toMat4() const
+  {
+    static const int ids[4][4]
+        = {{0, 1, 2, 3}, {1, 4, 5, 6}, {2, 5, 7, 8}, {3, 6, 8, 9}};
+    Mat4<float> ret;
+    for(int i = 0; i < 4; i++)
+      for(int j = 0; j < 4; j++)
+        ret.data.array[i][j] = float(q[ids[i][j]]);
+    return ret;
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_QUADRIC_HPP__
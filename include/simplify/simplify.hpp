@@ -0,0 +1,1009 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_SIMPLIFY_HPP__
+#define __GEOMETRY_SIMPLIFY_HPP__
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "parallel/parallel.hpp"
+#include "simplify/quadric.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+namespace qem
+{
+static const uint32_t none = UINT32_MAX;
+
+// Region of the vertices shared by several regions
+static const uint32_t shared = UINT32_MAX - 1;
+
+// Weight of the planes orthogonal to boundary edges, relative to the area
+// weight of the face planes
+static const double boundaryWeight = 10.0;
+
+// Edge collapse candidate. The queue is lazy : candidates carry the version of
+// both vertices at creation and are dropped when popped if either vertex
+// changed since, instead of being updated in place.
+struct Candidate
+{
+  float cost;
+  uint32_t a, b;
+  uint32_t stampA, stampB;
+  float x, y, z;
+};
+
+// Queue entries only hold the cost and the candidate index, so that the heap
+// moves 8 bytes per swap. Equal costs pop the oldest candidate first : on flat
+// regions, where every cost is 0, popping the newest ones collapses edges of
+// the same vertex over and over into fans of quadratic cost.
+struct QueueEntry
+{
+  float cost;
+  uint32_t id;
+
+  inline bool operator>(const QueueEntry &e) const
+  {
+    return cost > e.cost || (cost == e.cost && id > e.id);
+  }
+
+  static inline bool older(const QueueEntry &e0, const QueueEntry &e1)
+  {
+    return e0.id < e1.id;
+  }
+};
+
+// Boundary constraint of an edge between two locked vertices, which may be
+// the border of a region rather than a boundary of the mesh
+struct BorderPlane
+{
+  uint64_t key;
+  Quadric<double> quadric;
+
+  inline bool operator<(const BorderPlane &p) const { return key < p.key; }
+};
+
+inline void checkInputs(const size_t nv, const std::vector<uint32_t> &indices)
+{
+  if(indices.size() % 3 != 0)
+    throw std::invalid_argument("simplify : index count not a multiple of 3");
+  for(size_t i = 0; i < indices.size(); i++)
+    if(indices[i] >= nv)
+      throw std::invalid_argument("simplify : vertex index out of range");
+}
+
+// Greedy edge collapse driven by quadric errors (Garland and Heckbert, 1997).
+// Faces are a flat index array, rewritten in place at each collapse. The
+// faces around each vertex are a range of a single pool, initially the CSR
+// lists of the input : after a collapse the surviving faces of both vertices
+// are written back in the range of the kept vertex if they fit, or appended
+// at the end of the pool.
+class Simplifier
+{
+public:
+  size_t run(
+      Vec3SoA<float> &vertices, std::vector<uint32_t> &indices,
+      const size_t targetFaces)
+  {
+    checkInputs(vertices.size(), indices);
+    if(indices.size() / 3 <= targetFaces)
+      return indices.size() / 3;
+
+    std::vector<float> x = vertices.x, y = vertices.y, z = vertices.z;
+    std::vector<uint32_t> idx = indices;
+    std::vector<uint8_t> locked;
+    std::vector<BorderPlane> borders;
+    load(x, y, z, idx, locked);
+    computeQuadrics(borders);
+
+    // Nothing collapsed : the input is already the output
+    if(reduce(targetFaces) == nf_)
+      return nf_;
+    compact(vertices, indices);
+    return indices.size() / 3;
+  }
+
+  // Swaps in the mesh. Edges of the locked vertices are never collapsed,
+  // locked may be empty.
+  void load(
+      std::vector<float> &x, std::vector<float> &y, std::vector<float> &z,
+      std::vector<uint32_t> &indices, std::vector<uint8_t> &locked)
+  {
+    nv_ = x.size();
+    nf_ = indices.size() / 3;
+    px_.swap(x);
+    py_.swap(y);
+    pz_.swap(z);
+    idx_.swap(indices);
+    locked_.swap(locked);
+    faceAlive_.assign(nf_, 1);
+    vertexAlive_.assign(nv_, 1);
+    stamps_.assign(nv_, 0);
+    buildAdjacency();
+  }
+
+  // Area weighted face quadrics, gathered per vertex through the CSR lists
+  // so that the accumulation needs no atomics, then the boundary constraints.
+  // The constraints of edges between two locked vertices are returned in
+  // borders, with the keys of their vertices, instead of being added.
+  void computeQuadrics(std::vector<BorderPlane> &borders)
+  {
+    std::vector<Quadric<double>> faceQuadrics(nf_);
+#pragma omp parallel for
+    for(int64_t f = 0; f < int64_t(nf_); f++)
+    {
+      double n[3], area;
+      faceNormal(uint32_t(f), n, area);
+      const uint32_t i0 = idx_[3 * f];
+      const double d = -(n[0] * px_[i0] + n[1] * py_[i0] + n[2] * pz_[i0]);
+      faceQuadrics[f] = Quadric<double>::fromPlane(n[0], n[1], n[2], d, area);
+    }
+
+    quadrics_.resize(nv_);
+#pragma omp parallel for
+    for(int64_t v = 0; v < int64_t(nv_); v++)
+    {
+      Quadric<double> q;
+      for(size_t k = faceStart_[v]; k < faceStart_[v + 1]; k++)
+        q += faceQuadrics[faceList_[k]];
+      quadrics_[v] = q;
+    }
+
+    borders.clear();
+    const size_t ne = edges_.size();
+    for(size_t i = 0; i < ne; i++)
+    {
+      const bool single = (i == 0 || edges_[i] != edges_[i - 1])
+                          && (i + 1 == ne || edges_[i] != edges_[i + 1]);
+      if(!single)
+        continue;
+      const uint32_t a = uint32_t(edges_[i] >> 32);
+      const uint32_t b = uint32_t(edges_[i] & 0xffffffff);
+      double n[3], area;
+      faceNormal(edgeFaces_[i], n, area);
+      const double ex = px_[b] - px_[a], ey = py_[b] - py_[a],
+                   ez = pz_[b] - pz_[a];
+      double m[3] = {ey * n[2] - ez * n[1], ez * n[0] - ex * n[2],
+                     ex * n[1] - ey * n[0]};
+      const double len = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+      if(!(len > 0.0))
+        continue;
+      m[0] /= len;
+      m[1] /= len;
+      m[2] /= len;
+      const double d = -(m[0] * px_[a] + m[1] * py_[a] + m[2] * pz_[a]);
+      const Quadric<double> q = Quadric<double>::fromPlane(
+          m[0], m[1], m[2], d, boundaryWeight * (ex * ex + ey * ey + ez * ez));
+      if(locked(a) && locked(b))
+      {
+        BorderPlane border;
+        border.key = edges_[i];
+        border.quadric = q;
+        borders.push_back(border);
+        continue;
+      }
+      quadrics_[a] += q;
+      quadrics_[b] += q;
+    }
+  }
+
+  // Quadrics computed elsewhere, swapped in
+  void setQuadrics(std::vector<Quadric<double>> &quadrics)
+  {
+    quadrics_.swap(quadrics);
+  }
+
+  // Collapses edges down to targetFaces, returns the number of faces left
+  size_t reduce(const size_t targetFaces)
+  {
+    buildQueue();
+    size_t faces = nf_;
+    while(faces > targetFaces && !heap_.empty())
+    {
+      std::pop_heap(heap_.begin(), heap_.end(), std::greater<QueueEntry>());
+      const Candidate c = candidates_[heap_.back().id];
+      heap_.pop_back();
+      if(!valid(c))
+        continue;
+      if(breaksLink(c) || flips(c))
+        continue;
+      faces -= collapse(c);
+      pushNeighbours(c.a);
+      if(heap_.size() > 4 * faces + 1024)
+        compactQueue();
+    }
+    return faces;
+  }
+
+  size_t vertexCount() const { return nv_; }
+  size_t faceCount() const { return nf_; }
+  inline bool faceAlive(const size_t f) const { return faceAlive_[f] != 0; }
+  inline const uint32_t *face(const size_t f) const { return &idx_[3 * f]; }
+
+  inline void point(const uint32_t v, float &x, float &y, float &z) const
+  {
+    x = px_[v];
+    y = py_[v];
+    z = pz_[v];
+  }
+
+  inline const Quadric<double> &quadric(const uint32_t v) const
+  {
+    return quadrics_[v];
+  }
+
+  // Drops dead faces and unreferenced vertices, keeping the input order
+  void compact(Vec3SoA<float> &vertices, std::vector<uint32_t> &indices) const
+  {
+    std::vector<uint32_t> remap(nv_, none);
+    indices.clear();
+    for(size_t f = 0; f < nf_; f++)
+    {
+      if(!faceAlive_[f])
+        continue;
+      for(int i = 0; i < 3; i++)
+        remap[idx_[3 * f + i]] = 0;
+    }
+
+    size_t count = 0;
+    for(size_t v = 0; v < nv_; v++)
+      if(remap[v] != none)
+        remap[v] = uint32_t(count++);
+
+    vertices.resize(count);
+    for(size_t v = 0; v < nv_; v++)
+      if(remap[v] != none)
+        vertices.set(remap[v], px_[v], py_[v], pz_[v]);
+
+    for(size_t f = 0; f < nf_; f++)
+    {
+      if(!faceAlive_[f])
+        continue;
+      for(int i = 0; i < 3; i++)
+        indices.push_back(remap[idx_[3 * f + i]]);
+    }
+  }
+
+private:
+  size_t nv_;
+  size_t nf_;
+  std::vector<float> px_, py_, pz_;
+  std::vector<uint32_t> idx_;
+  std::vector<uint8_t> locked_;
+  std::vector<uint8_t> faceAlive_;
+  std::vector<uint8_t> vertexAlive_;
+  std::vector<uint32_t> stamps_;
+  std::vector<size_t> faceStart_;
+  std::vector<uint32_t> faceCount_;
+  std::vector<uint32_t> faceCapacity_;
+  std::vector<uint32_t> faceList_;
+  std::vector<Quadric<double>> quadrics_;
+  std::vector<Candidate> candidates_;
+  std::vector<QueueEntry> heap_;
+  std::vector<uint64_t> edges_;
+  std::vector<uint32_t> edgeFaces_;
+  std::vector<uint32_t> neighbours_;
+  std::vector<uint32_t> ring_;
+  std::vector<uint64_t> linkA_;
+  std::vector<uint64_t> linkB_;
+  std::vector<uint32_t> faces_;
+
+  // Vertex to face CSR, and the sorted list of undirected edges with the
+  // face they come from
+  void buildAdjacency()
+  {
+    std::vector<uint64_t> keys(3 * nf_), tmpKeys;
+    std::vector<uint32_t> tmpValues;
+    faceList_.resize(3 * nf_);
+#pragma omp parallel for
+    for(int64_t i = 0; i < int64_t(3 * nf_); i++)
+    {
+      keys[i] = idx_[i];
+      faceList_[i] = uint32_t(i / 3);
+    }
+    parallel::radixSortPairs(
+        keys, faceList_, tmpKeys, tmpValues, parallel::bitWidth(nv_));
+
+    // faceStart_[v] is the first sorted corner whose vertex is >= v
+    faceStart_.assign(nv_ + 1, 0);
+    const int64_t n = int64_t(keys.size());
+#pragma omp parallel for
+    for(int64_t i = 0; i < n; i++)
+    {
+      if(i > 0 && keys[i] == keys[i - 1])
+        continue;
+      const uint64_t first = i == 0 ? 0 : keys[i - 1] + 1;
+      for(uint64_t v = first; v <= keys[i]; v++)
+        faceStart_[v] = size_t(i);
+    }
+    for(uint64_t v = n == 0 ? 0 : keys[n - 1] + 1; v <= nv_; v++)
+      faceStart_[v] = size_t(n);
+    faceCount_.resize(nv_);
+    for(size_t v = 0; v < nv_; v++)
+      faceCount_[v] = uint32_t(faceStart_[v + 1] - faceStart_[v]);
+    faceCapacity_ = faceCount_;
+
+    edges_.resize(3 * nf_);
+    edgeFaces_.resize(3 * nf_);
+#pragma omp parallel for
+    for(int64_t f = 0; f < int64_t(nf_); f++)
+    {
+      for(int k = 0; k < 3; k++)
+      {
+        const uint64_t a = idx_[3 * f + k];
+        const uint64_t b = idx_[3 * f + (k + 1) % 3];
+        edges_[3 * f + k] = a < b ? (a << 32) | b : (b << 32) | a;
+        edgeFaces_[3 * f + k] = uint32_t(f);
+      }
+    }
+    parallel::radixSortPairs(
+        edges_, edgeFaces_, tmpKeys, tmpValues,
+        32 + parallel::bitWidth(nv_));
+  }
+
+  inline void faceNormal(const uint32_t f, double *n, double &area) const
+  {
+    const uint32_t i0 = idx_[3 * f], i1 = idx_[3 * f + 1], i2 = idx_[3 * f + 2];
+    const double ux = px_[i1] - px_[i0], uy = py_[i1] - py_[i0],
+                 uz = pz_[i1] - pz_[i0];
+    const double vx = px_[i2] - px_[i0], vy = py_[i2] - py_[i0],
+                 vz = pz_[i2] - pz_[i0];
+    n[0] = uy * vz - uz * vy;
+    n[1] = uz * vx - ux * vz;
+    n[2] = ux * vy - uy * vx;
+    const double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    area = 0.5 * len;
+    const double inv = len > 0.0 ? 1.0 / len : 0.0;
+    n[0] *= inv;
+    n[1] *= inv;
+    n[2] *= inv;
+  }
+
+  inline Candidate makeCandidate(const uint32_t a, const uint32_t b) const
+  {
+    const Quadric<double> q = quadrics_[a] + quadrics_[b];
+    Candidate c;
+    c.a = a;
+    c.b = b;
+    c.stampA = stamps_[a];
+    c.stampB = stamps_[b];
+
+    double x, y, z;
+    double cost;
+    if(q.optimum(x, y, z))
+    {
+      cost = q.evaluate(x, y, z);
+    }
+    else
+    {
+      // Best of the endpoints and the midpoint
+      const double cand[3][3] = {
+          {px_[a], py_[a], pz_[a]},
+          {px_[b], py_[b], pz_[b]},
+          {0.5 * (double(px_[a]) + px_[b]), 0.5 * (double(py_[a]) + py_[b]),
+           0.5 * (double(pz_[a]) + pz_[b])}};
+      int best = 0;
+      double bestCost = q.evaluate(cand[0][0], cand[0][1], cand[0][2]);
+      for(int i = 1; i < 3; i++)
+      {
+        const double e = q.evaluate(cand[i][0], cand[i][1], cand[i][2]);
+        if(e < bestCost)
+        {
+          best = i;
+          bestCost = e;
+        }
+      }
+      x = cand[best][0];
+      y = cand[best][1];
+      z = cand[best][2];
+      cost = bestCost;
+    }
+    c.cost = float(cost > 0.0 ? cost : 0.0);
+    c.x = float(x);
+    c.y = float(y);
+    c.z = float(z);
+    return c;
+  }
+
+  void buildQueue()
+  {
+    std::vector<size_t> starts, counts;
+    const size_t nEdges = parallel::segmentStarts(edges_, starts, counts);
+    candidates_.resize(nEdges);
+#pragma omp parallel for
+    for(int64_t e = 0; e < int64_t(nEdges); e++)
+    {
+      const uint64_t key = edges_[starts[e]];
+      candidates_[e]
+          = makeCandidate(uint32_t(key >> 32), uint32_t(key & 0xffffffff));
+    }
+    heap_.clear();
+    heap_.reserve(nEdges);
+    for(size_t e = 0; e < nEdges; e++)
+    {
+      if(locked(candidates_[e].a) || locked(candidates_[e].b))
+        continue;
+      QueueEntry entry;
+      entry.cost = candidates_[e].cost;
+      entry.id = uint32_t(e);
+      heap_.push_back(entry);
+    }
+    std::make_heap(heap_.begin(), heap_.end(), std::greater<QueueEntry>());
+
+    std::vector<uint64_t>().swap(edges_);
+    std::vector<uint32_t>().swap(edgeFaces_);
+  }
+
+  inline bool locked(const uint32_t v) const
+  {
+    return !locked_.empty() && locked_[v];
+  }
+
+  inline bool valid(const Candidate &c) const
+  {
+    return vertexAlive_[c.a] && vertexAlive_[c.b] && stamps_[c.a] == c.stampA
+           && stamps_[c.b] == c.stampB;
+  }
+
+  // Drops the outdated candidates once they dominate the queue. Candidates
+  // are moved down in the order of their ids, which keeps their age order and
+  // never overwrites one that is still to be read.
+  void compactQueue()
+  {
+    std::sort(heap_.begin(), heap_.end(), QueueEntry::older);
+    size_t count = 0;
+    for(size_t i = 0; i < heap_.size(); i++)
+    {
+      const Candidate &c = candidates_[heap_[i].id];
+      if(!valid(c))
+        continue;
+      candidates_[count] = c;
+      heap_[count].cost = c.cost;
+      heap_[count].id = uint32_t(count);
+      count++;
+    }
+    candidates_.resize(count);
+    heap_.resize(count);
+    std::make_heap(heap_.begin(), heap_.end(), std::greater<QueueEntry>());
+  }
+
+  // Link of v : its neighbours, sorted, with one entry per alive face they
+  // share with v, and the sorted keys of the edges opposite to v
+  void link(
+      const uint32_t v, std::vector<uint32_t> &ring,
+      std::vector<uint64_t> &edges) const
+  {
+    ring.clear();
+    edges.clear();
+    const uint32_t *list = &faceList_[faceStart_[v]];
+    for(uint32_t k = 0; k < faceCount_[v]; k++)
+    {
+      const uint32_t f = list[k];
+      if(!faceAlive_[f])
+        continue;
+      const uint32_t *t = &idx_[3 * f];
+      const int i = t[0] == v ? 0 : (t[1] == v ? 1 : 2);
+      const uint64_t x = t[(i + 1) % 3], y = t[(i + 2) % 3];
+      ring.push_back(uint32_t(x));
+      ring.push_back(uint32_t(y));
+      edges.push_back(x < y ? (x << 32) | y : (y << 32) | x);
+    }
+    std::sort(ring.begin(), ring.end());
+    std::sort(edges.begin(), edges.end());
+  }
+
+  // A vertex is on the boundary if it shares a single face with a neighbour
+  static inline bool onBoundary(const std::vector<uint32_t> &ring)
+  {
+    for(size_t i = 0; i < ring.size(); i++)
+    {
+      if((i == 0 || ring[i - 1] != ring[i])
+         && (i + 1 == ring.size() || ring[i + 1] != ring[i]))
+        return true;
+    }
+    return false;
+  }
+
+  // Link condition (Dey et al., 1999) : the links of a and b may only share
+  // the apexes of the faces of the edge, boundaries being closed by a virtual
+  // vertex. Collapses that fail it make the mesh non-manifold, as when
+  // collapsing an edge of a tetrahedron or closing a tunnel.
+  bool breaksLink(const Candidate &c)
+  {
+    std::vector<uint32_t> &ringA = neighbours_;
+    std::vector<uint32_t> &ringB = ring_;
+    link(c.a, ringA, linkA_);
+    link(c.b, ringB, linkB_);
+
+    // Number of faces of the edge, 1 for a boundary edge
+    const size_t shared = size_t(std::count(ringA.begin(), ringA.end(), c.b));
+
+    // Common neighbours other than the apexes, or joined to both a and b by
+    // boundary edges
+    size_t common = 0;
+    for(size_t i = 0, j = 0; i < ringA.size() && j < ringB.size();)
+    {
+      const uint32_t x = ringA[i];
+      if(x < ringB[j])
+      {
+        i++;
+        continue;
+      }
+      if(ringB[j] < x)
+      {
+        j++;
+        continue;
+      }
+      size_t na = 0, nb = 0;
+      for(; i < ringA.size() && ringA[i] == x; i++)
+        na++;
+      for(; j < ringB.size() && ringB[j] == x; j++)
+        nb++;
+      if(na == 1 && nb == 1)
+        return true;
+      common++;
+    }
+    if(common != shared)
+      return true;
+
+    // Two boundary vertices may only be merged along a boundary edge
+    if(shared != 1 && onBoundary(ringA) && onBoundary(ringB))
+      return true;
+
+    // Common edges
+    for(size_t i = 0, j = 0; i < linkA_.size() && j < linkB_.size();)
+    {
+      if(linkA_[i] == linkB_[j])
+        return true;
+      if(linkA_[i] < linkB_[j])
+        i++;
+      else
+        j++;
+    }
+    return false;
+  }
+
+  // Rejects collapses that turn a surviving face around a or b upside down,
+  // or make it degenerate. Faces that already are degenerate are ignored.
+  bool flips(const Candidate &c) const
+  {
+    const uint32_t ends[2] = {c.a, c.b};
+    for(int e = 0; e < 2; e++)
+    {
+      const uint32_t *list = &faceList_[faceStart_[ends[e]]];
+      for(uint32_t k = 0; k < faceCount_[ends[e]]; k++)
+      {
+        const uint32_t f = list[k];
+        if(!faceAlive_[f])
+          continue;
+        const uint32_t *t = &idx_[3 * f];
+        const bool hasA = t[0] == c.a || t[1] == c.a || t[2] == c.a;
+        const bool hasB = t[0] == c.b || t[1] == c.b || t[2] == c.b;
+        if(hasA && hasB)
+          continue;
+
+        double p[3][3], q[3][3];
+        for(int i = 0; i < 3; i++)
+        {
+          p[i][0] = px_[t[i]];
+          p[i][1] = py_[t[i]];
+          p[i][2] = pz_[t[i]];
+          const bool moved = t[i] == c.a || t[i] == c.b;
+          q[i][0] = moved ? c.x : p[i][0];
+          q[i][1] = moved ? c.y : p[i][1];
+          q[i][2] = moved ? c.z : p[i][2];
+        }
+        double n0[3], n1[3];
+        triangleNormal(p, n0);
+        triangleNormal(q, n1);
+        const double len0 = n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2];
+        if(len0 > 0.0 && n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0)
+          return true;
+      }
+    }
+    return false;
+  }
+
+  static inline void triangleNormal(const double p[3][3], double *n)
+  {
+    const double u[3]
+        = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+    const double v[3]
+        = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+    n[0] = u[1] * v[2] - u[2] * v[1];
+    n[1] = u[2] * v[0] - u[0] * v[2];
+    n[2] = u[0] * v[1] - u[1] * v[0];
+  }
+
+  // Merges b into a, returns the number of faces removed
+  size_t collapse(const Candidate &c)
+  {
+    size_t removed = 0;
+    faces_.clear();
+    const uint32_t ends[2] = {c.a, c.b};
+    for(int e = 0; e < 2; e++)
+    {
+      const uint32_t *list = &faceList_[faceStart_[ends[e]]];
+      for(uint32_t k = 0; k < faceCount_[ends[e]]; k++)
+      {
+        const uint32_t f = list[k];
+        if(!faceAlive_[f])
+          continue;
+        uint32_t *t = &idx_[3 * f];
+        const bool hasA = t[0] == c.a || t[1] == c.a || t[2] == c.a;
+        const bool hasB = t[0] == c.b || t[1] == c.b || t[2] == c.b;
+        if(hasA && hasB)
+        {
+          // Shared by both lists, removed on the first visit
+          faceAlive_[f] = 0;
+          removed++;
+          continue;
+        }
+        for(int i = 0; i < 3; i++)
+          t[i] = t[i] == c.b ? c.a : t[i];
+        faces_.push_back(f);
+      }
+    }
+
+    const uint32_t count = uint32_t(faces_.size());
+    if(count > faceCapacity_[c.a])
+    {
+      faceStart_[c.a] = faceList_.size();
+      faceCapacity_[c.a] = count + count / 2;
+      faceList_.resize(faceList_.size() + faceCapacity_[c.a]);
+    }
+    for(uint32_t k = 0; k < count; k++)
+      faceList_[faceStart_[c.a] + k] = faces_[k];
+    faceCount_[c.a] = count;
+    faceCount_[c.b] = 0;
+
+    quadrics_[c.a] += quadrics_[c.b];
+    px_[c.a] = c.x;
+    py_[c.a] = c.y;
+    pz_[c.a] = c.z;
+    vertexAlive_[c.b] = 0;
+    stamps_[c.a]++;
+    return removed;
+  }
+
+  void pushNeighbours(const uint32_t a)
+  {
+    std::vector<uint32_t> &neighbours = neighbours_;
+    neighbours.clear();
+    const uint32_t *list = &faceList_[faceStart_[a]];
+    for(uint32_t k = 0; k < faceCount_[a]; k++)
+    {
+      const uint32_t f = list[k];
+      if(!faceAlive_[f])
+        continue;
+      for(int i = 0; i < 3; i++)
+        if(idx_[3 * f + i] != a)
+          neighbours.push_back(idx_[3 * f + i]);
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(
+        std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+    for(size_t i = 0; i < neighbours.size(); i++)
+    {
+      const uint32_t b = neighbours[i];
+      if(locked(b))
+        continue;
+      QueueEntry entry;
+      entry.id = uint32_t(candidates_.size());
+      candidates_.push_back(makeCandidate(a < b ? a : b, a < b ? b : a));
+      entry.cost = candidates_.back().cost;
+      heap_.push_back(entry);
+      std::push_heap(heap_.begin(), heap_.end(), std::greater<QueueEntry>());
+    }
+  }
+};
+
+// Faces per region of the parallel pass
+static const size_t regionFaces = size_t(1) << 16;
+
+// Regions are simplified down to this multiple of the target face ratio, the
+// global pass then spreads the remaining collapses by cost
+static const double regionSlack = 2.0;
+
+// Spreads the 10 low bits of v to every third bit
+inline uint64_t spreadBits(uint64_t v)
+{
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x30000ff;
+  v = (v | (v << 8)) & 0x300f00f;
+  v = (v | (v << 4)) & 0x30c30c3;
+  v = (v | (v << 2)) & 0x9249249;
+  return v;
+}
+
+// Surviving part of a region, with the input ids of its vertices and faces
+struct Region
+{
+  std::vector<uint32_t> vertices;
+  std::vector<float> points;
+  std::vector<Quadric<double>> quadrics;
+  std::vector<uint32_t> faces;
+  std::vector<uint32_t> indices;
+  std::vector<BorderPlane> borders;
+};
+
+// Simplifies the faces order[begin, end) with their shared vertices locked.
+// local maps input vertices to the region and is left full of none.
+inline void simplifyRegion(
+    const Vec3SoA<float> &vertices, const std::vector<uint32_t> &indices,
+    const std::vector<uint32_t> &order, const size_t begin, const size_t end,
+    const std::vector<uint32_t> &vertexRegion, const double ratio,
+    std::vector<uint32_t> &local, Region &ret)
+{
+  std::vector<uint32_t> ids;
+  std::vector<float> x, y, z;
+  std::vector<uint32_t> idx;
+  std::vector<uint8_t> locked;
+  for(size_t i = begin; i < end; i++)
+  {
+    for(int k = 0; k < 3; k++)
+    {
+      const uint32_t v = indices[3 * order[i] + k];
+      if(local[v] == none)
+      {
+        local[v] = uint32_t(ids.size());
+        ids.push_back(v);
+        x.push_back(vertices.x[v]);
+        y.push_back(vertices.y[v]);
+        z.push_back(vertices.z[v]);
+        locked.push_back(vertexRegion[v] == shared ? 1 : 0);
+      }
+      idx.push_back(local[v]);
+    }
+  }
+  size_t nLocked = 0;
+  for(size_t i = 0; i < ids.size(); i++)
+  {
+    local[ids[i]] = none;
+    nLocked += locked[i];
+  }
+
+  // The strip of faces along the locked vertices is left to the global pass
+  Simplifier simplifier;
+  simplifier.load(x, y, z, idx, locked);
+  simplifier.computeQuadrics(ret.borders);
+  simplifier.reduce(size_t(ratio * double(end - begin)) + 2 * nLocked);
+
+  for(size_t i = 0; i < ret.borders.size(); i++)
+  {
+    const uint64_t a = ids[ret.borders[i].key >> 32];
+    const uint64_t b = ids[ret.borders[i].key & 0xffffffff];
+    ret.borders[i].key = a < b ? (a << 32) | b : (b << 32) | a;
+  }
+
+  std::vector<uint8_t> used(simplifier.vertexCount(), 0);
+  for(size_t f = 0; f < simplifier.faceCount(); f++)
+  {
+    if(!simplifier.faceAlive(f))
+      continue;
+    const uint32_t *t = simplifier.face(f);
+    ret.faces.push_back(order[begin + f]);
+    for(int k = 0; k < 3; k++)
+    {
+      used[t[k]] = 1;
+      ret.indices.push_back(ids[t[k]]);
+    }
+  }
+  for(uint32_t v = 0; v < simplifier.vertexCount(); v++)
+  {
+    if(!used[v])
+      continue;
+    float p[3];
+    simplifier.point(v, p[0], p[1], p[2]);
+    ret.vertices.push_back(ids[v]);
+    ret.points.insert(ret.points.end(), p, p + 3);
+    ret.quadrics.push_back(simplifier.quadric(v));
+  }
+}
+
+// Simplification of large meshes : faces are cut in regions of neighbouring
+// faces along the Morton order of their centroids, which are simplified in
+// parallel with the vertices they share locked. The regions fit in cache,
+// which makes each collapse several times cheaper than on the whole mesh.
+// The global pass then collapses the rest from the merged quadrics : the
+// locked vertices sum the quadrics of all their regions, and the boundary
+// constraints of edges between locked vertices are only added for the edges
+// met by a single region. Vertices and faces keep the input order.
+inline size_t simplifyRegions(
+    Vec3SoA<float> &vertices, std::vector<uint32_t> &indices,
+    const size_t targetFaces)
+{
+  const size_t nv = vertices.size();
+  const size_t nf = indices.size() / 3;
+
+  float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+  float hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for(size_t i = 0; i < indices.size(); i++)
+  {
+    const uint32_t v = indices[i];
+    const float p[3] = {vertices.x[v], vertices.y[v], vertices.z[v]};
+    for(int k = 0; k < 3; k++)
+    {
+      lo[k] = std::min(lo[k], p[k]);
+      hi[k] = std::max(hi[k], p[k]);
+    }
+  }
+  const float extent
+      = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+  const float scale = extent > 0.0f ? 1023.0f / extent : 0.0f;
+
+  const float *coords[3]
+      = {vertices.x.data(), vertices.y.data(), vertices.z.data()};
+  std::vector<uint64_t> keys(nf), tmpKeys;
+  std::vector<uint32_t> order(nf), tmpValues;
+#pragma omp parallel for
+  for(int64_t f = 0; f < int64_t(nf); f++)
+  {
+    const uint32_t *t = &indices[3 * f];
+    uint64_t key = 0;
+    for(int k = 0; k < 3; k++)
+    {
+      const float *p = coords[k];
+      const float c = (p[t[0]] + p[t[1]] + p[t[2]]) / 3.0f;
+      key |= spreadBits(uint64_t((c - lo[k]) * scale)) << k;
+    }
+    keys[f] = key;
+    order[f] = uint32_t(f);
+  }
+  parallel::radixSortPairs(keys, order, tmpKeys, tmpValues, 30);
+  std::vector<uint64_t>().swap(keys);
+  std::vector<uint64_t>().swap(tmpKeys);
+  std::vector<uint32_t>().swap(tmpValues);
+
+  // Region of each vertex, those of faces in several regions stay locked
+  const size_t nRegions = (nf + regionFaces - 1) / regionFaces;
+  std::vector<uint32_t> vertexRegion(nv, none);
+  for(size_t r = 0; r < nRegions; r++)
+  {
+    for(size_t i = r * nf / nRegions; i < (r + 1) * nf / nRegions; i++)
+    {
+      for(int k = 0; k < 3; k++)
+      {
+        uint32_t &region = vertexRegion[indices[3 * order[i] + k]];
+        region = region == none || region == uint32_t(r) ? uint32_t(r)
+                                                         : shared;
+      }
+    }
+  }
+
+  std::vector<Region> regions(nRegions);
+  const double ratio = regionSlack * double(targetFaces) / double(nf);
+#pragma omp parallel
+  {
+    std::vector<uint32_t> local(nv, none);
+#pragma omp for schedule(dynamic)
+    for(int64_t r = 0; r < int64_t(nRegions); r++)
+      simplifyRegion(
+          vertices, indices, order, size_t(r) * nf / nRegions,
+          size_t(r + 1) * nf / nRegions, vertexRegion, ratio, local,
+          regions[r]);
+  }
+
+  // Merged mesh, vertices and faces sorted back to the input order
+  std::vector<uint32_t> remap(nv, none);
+  std::vector<uint32_t> faceRegion(nf, none);
+  std::vector<BorderPlane> borders;
+  for(size_t r = 0; r < nRegions; r++)
+  {
+    for(size_t i = 0; i < regions[r].vertices.size(); i++)
+      remap[regions[r].vertices[i]] = 0;
+    for(size_t i = 0; i < regions[r].faces.size(); i++)
+      faceRegion[regions[r].faces[i]] = uint32_t(r);
+    borders.insert(
+        borders.end(), regions[r].borders.begin(), regions[r].borders.end());
+  }
+  size_t count = 0;
+  for(size_t v = 0; v < nv; v++)
+    if(remap[v] != none)
+      remap[v] = uint32_t(count++);
+
+  std::vector<float> x(count), y(count), z(count);
+  std::vector<Quadric<double>> quadrics(count);
+  for(size_t r = 0; r < nRegions; r++)
+  {
+    const Region &region = regions[r];
+    for(size_t i = 0; i < region.vertices.size(); i++)
+    {
+      const uint32_t v = remap[region.vertices[i]];
+      x[v] = region.points[3 * i];
+      y[v] = region.points[3 * i + 1];
+      z[v] = region.points[3 * i + 2];
+      quadrics[v] += region.quadrics[i];
+    }
+  }
+
+  // Constraints met twice are on the border between two regions
+  std::sort(borders.begin(), borders.end());
+  for(size_t i = 0; i < borders.size(); i++)
+  {
+    const bool single = (i == 0 || borders[i].key != borders[i - 1].key)
+                        && (i + 1 == borders.size()
+                            || borders[i].key != borders[i + 1].key);
+    if(!single)
+      continue;
+    quadrics[remap[borders[i].key >> 32]] += borders[i].quadric;
+    quadrics[remap[borders[i].key & 0xffffffff]] += borders[i].quadric;
+  }
+
+  // Position of each surviving face in its region
+  std::vector<uint32_t> faceSlot(nf, none);
+  for(size_t r = 0; r < nRegions; r++)
+    for(size_t i = 0; i < regions[r].faces.size(); i++)
+      faceSlot[regions[r].faces[i]] = uint32_t(i);
+  std::vector<uint32_t> idx;
+  for(size_t f = 0; f < nf; f++)
+  {
+    if(faceRegion[f] == none)
+      continue;
+    const uint32_t *t = &regions[faceRegion[f]].indices[3 * faceSlot[f]];
+    for(int k = 0; k < 3; k++)
+      idx.push_back(remap[t[k]]);
+  }
+  std::vector<Region>().swap(regions);
+
+  const size_t merged = idx.size() / 3;
+  std::vector<uint8_t> locked;
+  Simplifier simplifier;
+  simplifier.load(x, y, z, idx, locked);
+  simplifier.setQuadrics(quadrics);
+
+  // Nothing collapsed : the input is already the output
+  if(simplifier.reduce(targetFaces) == nf && merged == nf)
+    return nf;
+  simplifier.compact(vertices, indices);
+  return indices.size() / 3;
+}
+} // namespace qem
+
+// Simplifies the triangle mesh (vertices, indices) in place down to at most
+// targetFaces triangles, stopping above it if no valid collapse is left.
+// Returns the final number of faces, the mesh being left untouched when
+// nothing could be collapsed. Quadrics are accumulated in double precision :
+// the float version of the cost cancels badly on large, flat regions.
+// Meshes of more than two regions that are reduced by more than regionSlack
+// are first simplified per region, see qem::simplifyRegions().
+inline size_t simplify(
+    Vec3SoA<float> &vertices, std::vector<uint32_t> &indices,
+    const size_t targetFaces)
+{
+  qem::checkInputs(vertices.size(), indices);
+  const size_t nf = indices.size() / 3;
+  if(nf <= targetFaces)
+    return nf;
+  if(nf >= 2 * qem::regionFaces
+     && qem::regionSlack * double(targetFaces) < double(nf))
+    return qem::simplifyRegions(vertices, indices, targetFaces);
+  qem::Simplifier simplifier;
+  return simplifier.run(vertices, indices, targetFaces);
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_SIMPLIFY_HPP__
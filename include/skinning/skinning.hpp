@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_SKINNING_HPP__
+#define __GEOMETRY_SKINNING_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "mat4/mat4.hpp"
+#include "mat4/rigid_transform.hpp"
+#include "soa/vec3_soa.hpp"
+#include "transform_tree/transform_tree.hpp"
+
+namespace geometry
+{
+// Bone influences of a vertex buffer, with a fixed number of influences per
+// vertex. Arrays are influence-major : the k-th influence of vertex i is at
+// k * size + i, so that skinning loops read them with unit stride. Unused
+// influences have a weight of 0, and skinning needs at least one influence.
+struct SkinWeights
+{
+  size_t size;
+  int influences;
+  std::vector<uint32_t> bones;
+  std::vector<float> weights;
+
+  SkinWeights() : size(0), influences(0) {}
+
+  inline void resize(const size_t n, const int k)
+  {
+    size = n;
+    influences = k;
+    bones.assign(n * size_t(k), 0);
+    weights.assign(n * size_t(k), 0.0f);
+  }
+
+  inline void
+  set(const size_t i, const int k, const uint32_t bone, const float w)
+  {
+    bones[size_t(k) * size + i] = bone;
+    weights[size_t(k) * size + i] = w;
+  }
+};
+
+namespace skinning
+{
+// Affine palette as a flat array of 12 floats per bone (3x4, row-major)
+inline void flattenPalette(
+    const std::vector<Mat4<float>> &palette, std::vector<float> &flat)
+{
+  flat.resize(palette.size() * 12);
+  for(size_t b = 0; b < palette.size(); b++)
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 4; j++)
+        flat[b * 12 + size_t(i) * 4 + size_t(j)] = palette[b].data.array[i][j];
+}
+
+// Unit quaternion (w, x, y, z) of a rotation matrix
+inline void rotationToQuat(const float r[4][4], float *q)
+{
+  const float trace = r[0][0] + r[1][1] + r[2][2];
+  if(trace > 0.0f)
+  {
+    const float s = 0.5f / sqrtf(trace + 1.0f);
+    q[0] = 0.25f / s;
+    q[1] = (r[2][1] - r[1][2]) * s;
+    q[2] = (r[0][2] - r[2][0]) * s;
+    q[3] = (r[1][0] - r[0][1]) * s;
+  }
+  else if(r[0][0] > r[1][1] && r[0][0] > r[2][2])
+  {
+    const float s = 2.0f * sqrtf(1.0f + r[0][0] - r[1][1] - r[2][2]);
+    q[0] = (r[2][1] - r[1][2]) / s;
+    q[1] = 0.25f * s;
+    q[2] = (r[0][1] + r[1][0]) / s;
+    q[3] = (r[0][2] + r[2][0]) / s;
+  }
+  else if(r[1][1] > r[2][2])
+  {
+    const float s = 2.0f * sqrtf(1.0f + r[1][1] - r[0][0] - r[2][2]);
+    q[0] = (r[0][2] - r[2][0]) / s;
+    q[1] = (r[0][1] + r[1][0]) / s;
+    q[2] = 0.25f * s;
+    q[3] = (r[1][2] + r[2][1]) / s;
+  }
+  else
+  {
+    const float s = 2.0f * sqrtf(1.0f + r[2][2] - r[0][0] - r[1][1]);
+    q[0] = (r[1][0] - r[0][1]) / s;
+    q[1] = (r[0][2] + r[2][0]) / s;
+    q[2] = (r[1][2] + r[2][1]) / s;
+    q[3] = 0.25f * s;
+  }
+}
+
+// Dual quaternions of a rigid palette, as 8 floats per bone : the rotation
+// (w, x, y, z) followed by the dual part 0.5 * (0, t) * rotation.
+inline void dualQuatPalette(
+    const std::vector<Mat4<float>> &palette, std::vector<float> &dq)
+{
+  dq.resize(palette.size() * 8);
+  for(size_t b = 0; b < palette.size(); b++)
+  {
+    float *q = &dq[b * 8];
+    rotationToQuat(palette[b].data.array, q);
+    const float tx = palette[b].data.array[0][3];
+    const float ty = palette[b].data.array[1][3];
+    const float tz = palette[b].data.array[2][3];
+    q[4] = -0.5f * (tx * q[1] + ty * q[2] + tz * q[3]);
+    q[5] = 0.5f * (tx * q[0] + ty * q[3] - tz * q[2]);
+    q[6] = 0.5f * (-tx * q[3] + ty * q[0] + tz * q[1]);
+    q[7] = 0.5f * (tx * q[2] - ty * q[1] + tz * q[0]);
+  }
+}
+
+inline void checkInputs(
+    const Vec3SoA<float> &restPositions, const Vec3SoA<float> *restNormals,
+    const SkinWeights &weights, const size_t nBones)
+{
+  if(weights.size != restPositions.size())
+    throw std::invalid_argument("Skinning : weights do not match vertices");
+  if(restNormals != NULL && restNormals->size() != restPositions.size())
+    throw std::invalid_argument("Skinning : normals do not match vertices");
+  if(weights.size > 0 && weights.influences < 1)
+    throw std::invalid_argument("Skinning : no influence per vertex");
+  for(size_t i = 0; i < weights.bones.size(); i++)
+    if(weights.bones[i] >= nBones)
+      throw std::invalid_argument("Skinning : bone index out of range");
+}
+} // namespace skinning
+
+// Skinning matrices of a skeleton : the global pose of every bone times its
+// inverse bind pose. Bones must be sorted so that parents come before their
+// children (parents[b] < b, or -1 for a root).
+inline void computeSkinningPalette(
+    const std::vector<int32_t> &parents, const std::vector<Mat4<float>> &local,
+    const std::vector<Mat4<float>> &inverseBind,
+    std::vector<Mat4<float>> &palette)
+{
+  const size_t n = parents.size();
+  if(local.size() != n || inverseBind.size() != n)
+    throw std::invalid_argument("computeSkinningPalette : size mismatch");
+
+  // Global poses, sequential along the parent chains
+  std::vector<mat4f_t> global(n);
+  for(size_t b = 0; b < n; b++)
+  {
+    const int32_t p = parents[b];
+    if(p >= int32_t(b))
+      throw std::invalid_argument("computeSkinningPalette : unsorted bones");
+    if(p < 0)
+      global[b] = local[b].data;
+    else
+      mat4Mul(global[p], local[b].data, global[b]);
+  }
+
+  palette.resize(n);
+#pragma omp parallel for
+  for(int64_t b = 0; b < int64_t(n); b++)
+    mat4Mul(global[b], inverseBind[b].data, palette[b].data);
+}
+
+// Same with the bone poses taken from the world matrices of a TransformTree,
+// bone b being the node nodes[b]
+inline void computeSkinningPalette(
+    TransformTree &tree, const std::vector<int32_t> &nodes,
+    const std::vector<Mat4<float>> &inverseBind,
+    std::vector<Mat4<float>> &palette)
+{
+  const size_t n = nodes.size();
+  if(inverseBind.size() != n)
+    throw std::invalid_argument("computeSkinningPalette : size mismatch");
+
+  tree.update();
+  const mat4f_t *world = tree.worldMatrices();
+
+  palette.resize(n);
+#pragma omp parallel for
+  for(int64_t b = 0; b < int64_t(n); b++)
+    mat4Mul(world[tree.slot(nodes[b])], inverseBind[b].data, palette[b].data);
+}
+
+// Linear blend skinning : every vertex is transformed by the weighted sum of
+// its bone matrices. Normals are transformed by the blended 3x3 part and
+// renormalized.
+inline void linearBlendSkinning(
+    const Vec3SoA<float> &restPositions, const Vec3SoA<float> *restNormals,
+    const SkinWeights &weights, const std::vector<Mat4<float>> &palette,
+    Vec3SoA<float> &positions, Vec3SoA<float> *normals = NULL)
+{
+  skinning::checkInputs(restPositions, restNormals, weights, palette.size());
+
+  std::vector<float> flat;
+  skinning::flattenPalette(palette, flat);
+
+  const size_t n = restPositions.size();
+  const int nk = weights.influences;
+  positions.resize(n);
+  const bool doNormals = restNormals != NULL && normals != NULL;
+  if(doNormals)
+    normals->resize(n);
+
+  const float *m = flat.data();
+  const uint32_t *bones = weights.bones.data();
+  const float *w = weights.weights.data();
+  const float *px = restPositions.x.data();
+  const float *py = restPositions.y.data();
+  const float *pz = restPositions.z.data();
+  const float *nx = doNormals ? restNormals->x.data() : NULL;
+  const float *ny = doNormals ? restNormals->y.data() : NULL;
+  const float *nz = doNormals ? restNormals->z.data() : NULL;
+  float *ox = positions.x.data();
+  float *oy = positions.y.data();
+  float *oz = positions.z.data();
+  float *onx = doNormals ? normals->x.data() : NULL;
+  float *ony = doNormals ? normals->y.data() : NULL;
+  float *onz = doNormals ? normals->z.data() : NULL;
+
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    float a[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    for(int k = 0; k < nk; k++)
+    {
+      const size_t off = size_t(k) * n + size_t(i);
+      const float wk = w[off];
+      const float *mk = m + size_t(bones[off]) * 12;
+      for(int c = 0; c < 12; c++)
+        a[c] += wk * mk[c];
+    }
+
+    const float x = px[i], y = py[i], z = pz[i];
+    ox[i] = a[0] * x + a[1] * y + a[2] * z + a[3];
+    oy[i] = a[4] * x + a[5] * y + a[6] * z + a[7];
+    oz[i] = a[8] * x + a[9] * y + a[10] * z + a[11];
+
+    if(doNormals)
+    {
+      const float x = nx[i], y = ny[i], z = nz[i];
+      const float rx = a[0] * x + a[1] * y + a[2] * z;
+      const float ry = a[4] * x + a[5] * y + a[6] * z;
+      const float rz = a[8] * x + a[9] * y + a[10] * z;
+      const float len2 = rx * rx + ry * ry + rz * rz;
+      const float inv = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+      onx[i] = rx * inv;
+      ony[i] = ry * inv;
+      onz[i] = rz * inv;
+    }
+  }
+}
+
+// Dual quaternion skinning : the bone transforms are blended as unit dual
+// quaternions, which avoids the volume loss of linear blending around twisted
+// joints. The palette must be rigid (rotation and translation only).
+inline void dualQuaternionSkinning(
+    const Vec3SoA<float> &restPositions, const Vec3SoA<float> *restNormals,
+    const SkinWeights &weights, const std::vector<Mat4<float>> &palette,
+    Vec3SoA<float> &positions, Vec3SoA<float> *normals = NULL)
+{
+  skinning::checkInputs(restPositions, restNormals, weights, palette.size());
+
+  std::vector<float> dq;
+  skinning::dualQuatPalette(palette, dq);
+
+  const size_t n = restPositions.size();
+  const int nk = weights.influences;
+  positions.resize(n);
+  const bool doNormals = restNormals != NULL && normals != NULL;
+  if(doNormals)
+    normals->resize(n);
+
+  const float *q = dq.data();
+  const uint32_t *bones = weights.bones.data();
+  const float *w = weights.weights.data();
+  const float *px = restPositions.x.data();
+  const float *py = restPositions.y.data();
+  const float *pz = restPositions.z.data();
+  const float *nx = doNormals ? restNormals->x.data() : NULL;
+  const float *ny = doNormals ? restNormals->y.data() : NULL;
+  const float *nz = doNormals ? restNormals->z.data() : NULL;
+  float *ox = positions.x.data();
+  float *oy = positions.y.data();
+  float *oz = positions.z.data();
+  float *onx = doNormals ? normals->x.data() : NULL;
+  float *ony = doNormals ? normals->y.data() : NULL;
+  float *onz = doNormals ? normals->z.data() : NULL;
+
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    // Blend with every rotation taken in the hemisphere of the first one
+    float b[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    const float *q0 = q + size_t(bones[i]) * 8;
+    for(int k = 0; k < nk; k++)
+    {
+      const size_t off = size_t(k) * n + size_t(i);
+      const float *qk = q + size_t(bones[off]) * 8;
+      const float dot =
+          q0[0] * qk[0] + q0[1] * qk[1] + q0[2] * qk[2] + q0[3] * qk[3];
+      const float wk = dot < 0.0f ? -w[off] : w[off];
+      for(int c = 0; c < 8; c++)
+        b[c] += wk * qk[c];
+    }
+
+    const float len2 = b[0] * b[0] + b[1] * b[1] + b[2] * b[2] + b[3] * b[3];
+    const float inv = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+    for(int c = 0; c < 8; c++)
+      b[c] *= inv;
+
+    // Translation 2 * (w0 * ve - we * v0 + v0 x ve)
+    const float tx =
+        2.0f * (b[0] * b[5] - b[4] * b[1] + b[2] * b[7] - b[3] * b[6]);
+    const float ty =
+        2.0f * (b[0] * b[6] - b[4] * b[2] + b[3] * b[5] - b[1] * b[7]);
+    const float tz =
+        2.0f * (b[0] * b[7] - b[4] * b[3] + b[1] * b[6] - b[2] * b[5]);
+
+    // Rotation p + 2 * v0 x (v0 x p + w0 * p)
+    {
+      const float x = px[i], y = py[i], z = pz[i];
+      const float cx = b[2] * z - b[3] * y + b[0] * x;
+      const float cy = b[3] * x - b[1] * z + b[0] * y;
+      const float cz = b[1] * y - b[2] * x + b[0] * z;
+      ox[i] = x + 2.0f * (b[2] * cz - b[3] * cy) + tx;
+      oy[i] = y + 2.0f * (b[3] * cx - b[1] * cz) + ty;
+      oz[i] = z + 2.0f * (b[1] * cy - b[2] * cx) + tz;
+    }
+
+    if(doNormals)
+    {
+      const float x = nx[i], y = ny[i], z = nz[i];
+      const float cx = b[2] * z - b[3] * y + b[0] * x;
+      const float cy = b[3] * x - b[1] * z + b[0] * y;
+      const float cz = b[1] * y - b[2] * x + b[0] * z;
+      onx[i] = x + 2.0f * (b[2] * cz - b[3] * cy);
+      ony[i] = y + 2.0f * (b[3] * cx - b[1] * cz);
+      onz[i] = z + 2.0f * (b[1] * cy - b[2] * cx);
+    }
+  }
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_SKINNING_HPP__
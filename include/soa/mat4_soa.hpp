@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_MAT4_SOA_HPP__
+#define __GEOMETRY_MAT4_SOA_HPP__
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "mat4/mat4.hpp"
+
+namespace geometry
+{
+// Batch of 4x4 float matrices as 16 coefficient arrays (row-major), so that
+// batch kernels vectorize across matrices
+struct Mat4SoA
+{
+  std::vector<float> m[16];
+
+  inline size_t size() const { return m[0].size(); }
+
+  inline void resize(const size_t n)
+  {
+    for(int c = 0; c < 16; c++)
+      m[c].resize(n);
+  }
+
+  inline Mat4<float> get(const size_t i) const
+  {
+    Mat4<float> ret;
+    for(int c = 0; c < 16; c++)
+      ret.data.data[c] = m[c][i];
+    return ret;
+  }
+
+  inline void set(const size_t i, const Mat4<float> &mat)
+  {
+    for(int c = 0; c < 16; c++)
+      m[c][i] = mat.data.data[c];
+  }
+};
+
+// res[i] = a[i] * b[i]. res must not alias a or b.
+inline void mulBatch(const Mat4SoA &a, const Mat4SoA &b, Mat4SoA &res)
+{
+  const size_t n = a.size();
+  res.resize(n);
+  const float *ma[16];
+  const float *mb[16];
+  float *mr[16];
+  for(int c = 0; c < 16; c++)
+  {
+    ma[c] = a.m[c].data();
+    mb[c] = b.m[c].data();
+    mr[c] = res.m[c].data();
+  }
+
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    for(int r = 0; r < 4; r++)
+    {
+      for(int c = 0; c < 4; c++)
+      {
+        mr[4 * r + c][i] =
+            ma[4 * r][i] * mb[c][i] + ma[4 * r + 1][i] * mb[4 + c][i]
+            + ma[4 * r + 2][i] * mb[8 + c][i]
+            + ma[4 * r + 3][i] * mb[12 + c][i];
+      }
+    }
+  }
+}
+
+// res[i] = a * b[i], for a matrix shared by the whole batch. res must not
+// alias b.
+inline void mulBatch(const Mat4<float> &a, const Mat4SoA &b, Mat4SoA &res)
+{
+  const size_t n = b.size();
+  res.resize(n);
+  float ma[4][4];
+  const float *mb[16];
+  float *mr[16];
+  for(int c = 0; c < 16; c++)
+  {
+    ma[c / 4][c % 4] = a.data.data[c];
+    mb[c] = b.m[c].data();
+    mr[c] = res.m[c].data();
+  }
+
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    for(int r = 0; r < 4; r++)
+    {
+      for(int c = 0; c < 4; c++)
+      {
+        mr[4 * r + c][i] = ma[r][0] * mb[c][i] + ma[r][1] * mb[4 + c][i]
+                           + ma[r][2] * mb[8 + c][i]
+                           + ma[r][3] * mb[12 + c][i];
+      }
+    }
+  }
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_MAT4_SOA_HPP__
@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_QUANTIZED_HPP__
+#define __GEOMETRY_QUANTIZED_HPP__
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __F16C__
+#  include <immintrin.h>
+#endif
+
+#include "soa/vec3_soa.hpp"
+#include "vec3/vec3.hpp"
+
+// Compressed storage of point clouds : IEEE half floats (6 bytes per point),
+// 16 or 32 bit fixed point with a scale and offset per block of points (6 or
+// 12 bytes per point) and octahedral unit normals (4 bytes per normal).
+// Half conversions use F16C when the library is compiled with it (-mf16c or
+// -march=native), a branchless scalar conversion otherwise.
+
+namespace geometry
+{
+namespace quant
+{
+inline uint32_t floatBits(const float v)
+{
+  uint32_t b;
+  memcpy(&b, &v, sizeof(float));
+  return b;
+}
+
+inline float bitsFloat(const uint32_t b)
+{
+  float v;
+  memcpy(&v, &b, sizeof(float));
+  return v;
+}
+
+// Round to nearest even, overflow to infinity, NaNs stay NaNs
+inline uint16_t halfFromFloat(const float v)
+{
+  uint32_t f = floatBits(v);
+  const uint32_t sign = f & 0x80000000u;
+  f ^= sign;
+
+  uint32_t o;
+  if(f >= (143u << 23)) // Beyond the half range, inf or NaN
+    o = f > (255u << 23) ? 0x7e00u : 0x7c00u;
+  else if(f < (113u << 23)) // Half subnormals and zero
+  {
+    // Adding 0.5 aligns the mantissa so that the FPU does the rounding
+    const uint32_t magic = 126u << 23;
+    o = floatBits(bitsFloat(f) + bitsFloat(magic)) - magic;
+  }
+  else
+  {
+    const uint32_t odd = (f >> 13) & 1u;
+    f += (uint32_t(15 - 127) << 23) + 0xfffu + odd;
+    o = f >> 13;
+  }
+  return uint16_t(o | (sign >> 16));
+}
+
+inline float floatFromHalf(const uint16_t h)
+{
+  const uint32_t expMask = 0x7c00u << 13;
+  uint32_t o = uint32_t(h & 0x7fffu) << 13;
+  const uint32_t e = o & expMask;
+  o += uint32_t(127 - 15) << 23;
+  if(e == expMask) // inf or NaN
+    o += uint32_t(128 - 16) << 23;
+  else if(e == 0) // Subnormal : renormalize through the FPU
+  {
+    o += 1u << 23;
+    o = floatBits(bitsFloat(o) - bitsFloat(113u << 23));
+  }
+  return bitsFloat(o | (uint32_t(h & 0x8000u) << 16));
+}
+
+inline void encodeHalf(const float *src, uint16_t *dst, const size_t n)
+{
+#ifdef __F16C__
+  const int64_t nv = int64_t(n / 8);
+#  pragma omp parallel for if(nv > 4096)
+  for(int64_t i = 0; i < nv; i++)
+  {
+    const __m256 v = _mm256_loadu_ps(src + 8 * i);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dst + 8 * i),
+        _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+  for(size_t i = size_t(nv) * 8; i < n; i++)
+    dst[i] = halfFromFloat(src[i]);
+#else
+#  pragma omp parallel for simd if(n > 32768)
+  for(int64_t i = 0; i < int64_t(n); i++)
+    dst[i] = halfFromFloat(src[i]);
+#endif
+}
+
+inline void decodeHalf(const uint16_t *src, float *dst, const size_t n)
+{
+#ifdef __F16C__
+  const int64_t nv = int64_t(n / 8);
+#  pragma omp parallel for if(nv > 4096)
+  for(int64_t i = 0; i < nv; i++)
+  {
+    const __m128i h
+        = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 8 * i));
+    _mm256_storeu_ps(dst + 8 * i, _mm256_cvtph_ps(h));
+  }
+  for(size_t i = size_t(nv) * 8; i < n; i++)
+    dst[i] = floatFromHalf(src[i]);
+#else
+#  pragma omp parallel for simd if(n > 32768)
+  for(int64_t i = 0; i < int64_t(n); i++)
+    dst[i] = floatFromHalf(src[i]);
+#endif
+}
+
+// Octahedral projection of a unit vector in 2 x 16 bit snorm, x in the low
+// half. The zero vector encodes as +z.
+inline uint32_t octEncode(const float x, const float y, const float z)
+{
+  const float l1 = fabsf(x) + fabsf(y) + fabsf(z);
+  const float s = l1 > 0.0f ? 1.0f / l1 : 0.0f;
+  float u = x * s;
+  float v = y * s;
+  if(z < 0.0f)
+  {
+    const float fu = (1.0f - fabsf(v)) * copysignf(1.0f, u);
+    const float fv = (1.0f - fabsf(u)) * copysignf(1.0f, v);
+    u = fu;
+    v = fv;
+  }
+  const int32_t qu = int32_t(lrintf(fminf(fmaxf(u, -1.0f), 1.0f) * 32767.0f));
+  const int32_t qv = int32_t(lrintf(fminf(fmaxf(v, -1.0f), 1.0f) * 32767.0f));
+  return uint32_t(uint16_t(int16_t(qu)))
+         | (uint32_t(uint16_t(int16_t(qv))) << 16);
+}
+
+inline void octDecode(const uint32_t code, float &x, float &y, float &z)
+{
+  float u = fmaxf(float(int16_t(uint16_t(code & 0xffffu))) / 32767.0f, -1.0f);
+  float v = fmaxf(float(int16_t(uint16_t(code >> 16))) / 32767.0f, -1.0f);
+  z = 1.0f - fabsf(u) - fabsf(v);
+  const float t = fmaxf(-z, 0.0f);
+  u += u >= 0.0f ? -t : t;
+  v += v >= 0.0f ? -t : t;
+  const float inv = 1.0f / sqrtf(u * u + v * v + z * z);
+  x = u * inv;
+  y = v * inv;
+  z *= inv;
+}
+} // namespace quant
+
+// Half precision point, 6 bytes
+struct Vec3h
+{
+  uint16_t x, y, z;
+};
+
+inline Vec3h toHalf(const Vec3<float> &v)
+{
+  Vec3h ret;
+  ret.x = quant::halfFromFloat(v.data.coords.x);
+  ret.y = quant::halfFromFloat(v.data.coords.y);
+  ret.z = quant::halfFromFloat(v.data.coords.z);
+  return ret;
+}
+
+inline Vec3<float> fromHalf(const Vec3h &v)
+{
+  return Vec3<float>(
+      quant::floatFromHalf(v.x), quant::floatFromHalf(v.y),
+      quant::floatFromHalf(v.z));
+}
+
+// Half precision SoA storage, holding the binary16 bit patterns
+typedef Vec3SoA<uint16_t> Vec3hSoA;
+
+inline void encodeHalf(const Vec3SoA<float> &src, Vec3hSoA &dst)
+{
+  const size_t n = src.size();
+  dst.resize(n);
+  quant::encodeHalf(src.x.data(), dst.x.data(), n);
+  quant::encodeHalf(src.y.data(), dst.y.data(), n);
+  quant::encodeHalf(src.z.data(), dst.z.data(), n);
+}
+
+inline void decodeHalf(const Vec3hSoA &src, Vec3SoA<float> &dst)
+{
+  const size_t n = src.size();
+  dst.resize(n);
+  quant::decodeHalf(src.x.data(), dst.x.data(), n);
+  quant::decodeHalf(src.y.data(), dst.y.data(), n);
+  quant::decodeHalf(src.z.data(), dst.z.data(), n);
+}
+
+// Fixed point coordinates (int16_t or int32_t). Points are split in blocks of
+// blockSize; in each block and along each axis, v = q * scale + offset with
+// the offset at the middle of the block extent, so that the quantization
+// error is about scale / 2 = extent / (2 * (2^(bits - 1) - 1)). Spatially
+// coherent orderings (scan lines, voxel or Morton order) give small blocks
+// and thus a better precision.
+template <typename I>
+struct FixedPointSoA
+{
+  Vec3SoA<I> q;
+  std::vector<float> offset; // 3 per block
+  std::vector<float> scale;  // 3 per block
+  size_t blockSize;
+
+  FixedPointSoA() : blockSize(1024) {}
+
+  inline size_t size() const { return q.size(); }
+
+  inline size_t numBlocks() const
+  {
+    return (q.size() + blockSize - 1) / blockSize;
+  }
+
+  inline void clear()
+  {
+    q.clear();
+    offset.clear();
+    scale.clear();
+  }
+};
+
+namespace quant
+{
+template <typename I>
+inline void encodeFixedBlock(
+    const float *src, I *dst, const size_t n, float &offset, float &scale)
+{
+  const double qMax = double(std::numeric_limits<I>::max());
+  float lo = src[0], hi = src[0];
+#pragma omp simd reduction(min : lo) reduction(max : hi)
+  for(size_t i = 0; i < n; i++)
+  {
+    lo = fminf(lo, src[i]);
+    hi = fmaxf(hi, src[i]);
+  }
+  const double center = 0.5 * (double(lo) + double(hi));
+  const double s = (double(hi) - double(lo)) / (2.0 * qMax);
+  offset = float(center);
+  scale = float(s);
+  // The scale is rounded to float, the codes are computed against the
+  // rounded values and clamped to stay in range
+  const double inv = scale > 0.0f ? 1.0 / double(scale) : 0.0;
+  const double c = double(offset);
+#pragma omp simd
+  for(size_t i = 0; i < n; i++)
+  {
+    const double v = nearbyint((double(src[i]) - c) * inv);
+    dst[i] = I(fmin(fmax(v, -qMax), qMax));
+  }
+}
+
+template <typename I>
+inline void decodeFixedBlock(
+    const I *src, float *dst, const size_t n, const float offset,
+    const float scale)
+{
+#pragma omp simd
+  for(size_t i = 0; i < n; i++)
+    dst[i] = float(src[i]) * scale + offset;
+}
+} // namespace quant
+
+// Input coordinates must be finite
+template <typename I>
+inline void encodeFixed(
+    const Vec3SoA<float> &src, FixedPointSoA<I> &dst,
+    const size_t blockSize = 1024)
+{
+  if(blockSize == 0)
+    throw std::invalid_argument("encodeFixed : block size must be positive");
+  const size_t n = src.size();
+  dst.blockSize = blockSize;
+  dst.q.resize(n);
+  const size_t nb = dst.numBlocks();
+  dst.offset.resize(3 * nb);
+  dst.scale.resize(3 * nb);
+
+  const float *s[3] = {src.x.data(), src.y.data(), src.z.data()};
+  I *d[3] = {dst.q.x.data(), dst.q.y.data(), dst.q.z.data()};
+#pragma omp parallel for
+  for(int64_t b = 0; b < int64_t(nb); b++)
+  {
+    const size_t begin = size_t(b) * blockSize;
+    const size_t count = n - begin < blockSize ? n - begin : blockSize;
+    for(int k = 0; k < 3; k++)
+      quant::encodeFixedBlock(
+          s[k] + begin, d[k] + begin, count, dst.offset[3 * b + k],
+          dst.scale[3 * b + k]);
+  }
+}
+
+template <typename I>
+inline void decodeFixed(const FixedPointSoA<I> &src, Vec3SoA<float> &dst)
+{
+  const size_t n = src.size();
+  const size_t nb = src.numBlocks();
+  const size_t blockSize = src.blockSize;
+  dst.resize(n);
+
+  const I *s[3] = {src.q.x.data(), src.q.y.data(), src.q.z.data()};
+  float *d[3] = {dst.x.data(), dst.y.data(), dst.z.data()};
+#pragma omp parallel for
+  for(int64_t b = 0; b < int64_t(nb); b++)
+  {
+    const size_t begin = size_t(b) * blockSize;
+    const size_t count = n - begin < blockSize ? n - begin : blockSize;
+    for(int k = 0; k < 3; k++)
+      quant::decodeFixedBlock(
+          s[k] + begin, d[k] + begin, count, src.offset[3 * b + k],
+          src.scale[3 * b + k]);
+  }
+}
+
+// Unit normals as 32 bit octahedral codes. The angular error is below 1e-3
+// radians.
+inline void
+encodeOctahedral(const Vec3SoA<float> &normals, std::vector<uint32_t> &codes)
+{
+  const size_t n = normals.size();
+  codes.resize(n);
+  const float *x = normals.x.data();
+  const float *y = normals.y.data();
+  const float *z = normals.z.data();
+  uint32_t *c = codes.data();
+#pragma omp parallel for simd if(n > 32768)
+  for(int64_t i = 0; i < int64_t(n); i++)
+    c[i] = quant::octEncode(x[i], y[i], z[i]);
+}
+
+inline void
+decodeOctahedral(const std::vector<uint32_t> &codes, Vec3SoA<float> &normals)
+{
+  const size_t n = codes.size();
+  normals.resize(n);
+  float *x = normals.x.data();
+  float *y = normals.y.data();
+  float *z = normals.z.data();
+  const uint32_t *c = codes.data();
+#pragma omp parallel for simd if(n > 32768)
+  for(int64_t i = 0; i < int64_t(n); i++)
+    quant::octDecode(c[i], x[i], y[i], z[i]);
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_QUANTIZED_HPP__
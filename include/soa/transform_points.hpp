@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_TRANSFORM_POINTS_HPP__
+#define __GEOMETRY_TRANSFORM_POINTS_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include <stdexcept>
+
+#include "mat4/mat4.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+// Applies the affine transform m to SoA points, and its inverse transpose to
+// the normals if given, which are renormalized
+inline void transformPoints(
+    const Mat4<float> &m, Vec3SoA<float> &points,
+    Vec3SoA<float> *normals = NULL)
+{
+  float a[3][4];
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 4; j++)
+      a[i][j] = m.data.array[i][j];
+
+  // Inverse transpose of the 3x3 part, up to a positive factor : the
+  // cofactor matrix, with the sign of the determinant
+  float c[3][3];
+  c[0][0] = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+  c[0][1] = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+  c[0][2] = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+  c[1][0] = a[0][2] * a[2][1] - a[0][1] * a[2][2];
+  c[1][1] = a[0][0] * a[2][2] - a[0][2] * a[2][0];
+  c[1][2] = a[0][1] * a[2][0] - a[0][0] * a[2][1];
+  c[2][0] = a[0][1] * a[1][2] - a[0][2] * a[1][1];
+  c[2][1] = a[0][2] * a[1][0] - a[0][0] * a[1][2];
+  c[2][2] = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+  const float det = a[0][0] * c[0][0] + a[0][1] * c[0][1] + a[0][2] * c[0][2];
+  if(det < 0.0f)
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++)
+        c[i][j] = -c[i][j];
+
+  const size_t n = points.size();
+  float *px = points.x.data();
+  float *py = points.y.data();
+  float *pz = points.z.data();
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    const float x = px[i], y = py[i], z = pz[i];
+    px[i] = a[0][0] * x + a[0][1] * y + a[0][2] * z + a[0][3];
+    py[i] = a[1][0] * x + a[1][1] * y + a[1][2] * z + a[1][3];
+    pz[i] = a[2][0] * x + a[2][1] * y + a[2][2] * z + a[2][3];
+  }
+
+  if(normals == NULL)
+    return;
+  if(normals->size() != n)
+    throw std::invalid_argument("transformPoints : normals size mismatch");
+  float *nx = normals->x.data();
+  float *ny = normals->y.data();
+  float *nz = normals->z.data();
+#pragma omp parallel for simd
+  for(int64_t i = 0; i < int64_t(n); i++)
+  {
+    const float x = nx[i], y = ny[i], z = nz[i];
+    const float rx = c[0][0] * x + c[0][1] * y + c[0][2] * z;
+    const float ry = c[1][0] * x + c[1][1] * y + c[1][2] * z;
+    const float rz = c[2][0] * x + c[2][1] * y + c[2][2] * z;
+    const float len2 = rx * rx + ry * ry + rz * rz;
+    const float inv = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+    nx[i] = rx * inv;
+    ny[i] = ry * inv;
+    nz[i] = rz * inv;
+  }
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_TRANSFORM_POINTS_HPP__
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_VEC3_SOA_HPP__
+#define __GEOMETRY_VEC3_SOA_HPP__
+
+#include <vector>
+
+#include "vec3/vec3.hpp"
+
+namespace geometry
+{
+// Structure of arrays storage for 3D points, normals or colours. Batch kernels
+// work on this layout so that the inner loops vectorize.
+template <typename T>
+struct Vec3SoA
+{
+  std::vector<T> x;
+  std::vector<T> y;
+  std::vector<T> z;
+
+  Vec3SoA() {}
+
+  explicit Vec3SoA(const size_t n) : x(n), y(n), z(n) {}
+
+  inline size_t size() const { return x.size(); }
+
+  inline bool empty() const { return x.empty(); }
+
+  inline void resize(const size_t n)
+  {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+  }
+
+  inline void reserve(const size_t n)
+  {
+    x.reserve(n);
+    y.reserve(n);
+    z.reserve(n);
+  }
+
+  inline void clear()
+  {
+    x.clear();
+    y.clear();
+    z.clear();
+  }
+
+  inline void swap(Vec3SoA<T> &other)
+  {
+    x.swap(other.x);
+    y.swap(other.y);
+    z.swap(other.z);
+  }
+
+  inline void push_back(const T vx, const T vy, const T vz)
+  {
+    x.push_back(vx);
+    y.push_back(vy);
+    z.push_back(vz);
+  }
+
+  inline void push_back(const Vec3<T> &v)
+  {
+    push_back(v.data.coords.x, v.data.coords.y, v.data.coords.z);
+  }
+
+  inline Vec3<T> get(const size_t id) const
+  {
+    return Vec3<T>(x[id], y[id], z[id]);
+  }
+
+  inline void set(const size_t id, const T vx, const T vy, const T vz)
+  {
+    x[id] = vx;
+    y[id] = vy;
+    z[id] = vz;
+  }
+
+  inline void set(const size_t id, const Vec3<T> &v)
+  {
+    set(id, v.data.coords.x, v.data.coords.y, v.data.coords.z);
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_VEC3_SOA_HPP__
@@ -0,0 +1,508 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_STREAM_PIPELINE_HPP__
+#define __GEOMETRY_STREAM_PIPELINE_HPP__
+
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "io/point_cloud_io.hpp"
+#include "knn/kdtree.hpp"
+#include "mat4/mat4.hpp"
+#include "normals/normals.hpp"
+#include "parallel/parallel.hpp"
+#include "soa/transform_points.hpp"
+#include "soa/vec3_soa.hpp"
+#include "voxel_grid/voxel_grid.hpp"
+
+namespace geometry
+{
+// Fixed capacity chunk of a point cloud flowing through a StreamPipeline.
+// normals is empty when the data has no normals.
+struct PointBlock
+{
+  Vec3SoA<float> points;
+  Vec3SoA<float> normals;
+  size_t index; // Position of the block in the stream
+
+  PointBlock() : index(0) {}
+
+  inline bool hasNormals() const
+  {
+    return !normals.empty() && normals.size() == points.size();
+  }
+};
+
+// Produces the blocks of the stream, returns false once exhausted
+class PointSource
+{
+public:
+  virtual ~PointSource() {}
+  virtual bool read(PointBlock &block, const size_t maxPoints) = 0;
+};
+
+// Transforms a block in place. Stages only see one block at a time : filters
+// and neighbourhood queries are local to the block.
+class PointStage
+{
+public:
+  virtual ~PointStage() {}
+  virtual void process(PointBlock &block) = 0;
+};
+
+// Consumes the blocks in stream order. finish() is called once after the last
+// block.
+class PointSink
+{
+public:
+  virtual ~PointSink() {}
+  virtual void write(const PointBlock &block) = 0;
+  virtual void finish() {}
+};
+
+namespace stream
+{
+// Unbounded blocking FIFO; the pipeline bounds memory by circulating a fixed
+// set of blocks through its queues
+template <typename T>
+class BlockingQueue
+{
+public:
+  BlockingQueue() : closed_(false) {}
+
+  void push(const T &v)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      items_.push_back(v);
+    }
+    cond_.notify_one();
+  }
+
+  // Returns false once the queue is closed and empty
+  bool pop(T &v)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(items_.empty() && !closed_)
+      cond_.wait(lock);
+    if(items_.empty())
+      return false;
+    v = items_.front();
+    items_.pop_front();
+    return true;
+  }
+
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    cond_.notify_all();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<T> items_;
+  bool closed_;
+};
+} // namespace stream
+
+// Source over a PointView, typically the view of a MappedPointCloud which
+// must outlive the source
+class ViewSource : public PointSource
+{
+public:
+  explicit ViewSource(const PointView &view) : view_(view), pos_(0) {}
+
+  bool read(PointBlock &block, const size_t maxPoints)
+  {
+    if(pos_ >= view_.size)
+      return false;
+    const size_t count
+        = view_.size - pos_ < maxPoints ? view_.size - pos_ : maxPoints;
+    view_.copyRange(
+        pos_, count, block.points,
+        view_.hasNormals() ? &block.normals : NULL);
+    if(!view_.hasNormals())
+      block.normals.clear();
+    pos_ += count;
+    return true;
+  }
+
+private:
+  PointView view_;
+  size_t pos_;
+};
+
+// Source over in-memory SoA data
+class SoASource : public PointSource
+{
+public:
+  explicit SoASource(
+      const Vec3SoA<float> &points, const Vec3SoA<float> *normals = NULL)
+      : points_(points), normals_(normals), pos_(0)
+  {}
+
+  bool read(PointBlock &block, const size_t maxPoints)
+  {
+    const size_t n = points_.size();
+    if(pos_ >= n)
+      return false;
+    const size_t count = n - pos_ < maxPoints ? n - pos_ : maxPoints;
+    copy(points_, block.points, count);
+    if(normals_ != NULL)
+      copy(*normals_, block.normals, count);
+    else
+      block.normals.clear();
+    pos_ += count;
+    return true;
+  }
+
+private:
+  const Vec3SoA<float> &points_;
+  const Vec3SoA<float> *normals_;
+  size_t pos_;
+
+  inline void
+  copy(const Vec3SoA<float> &src, Vec3SoA<float> &dst, const size_t count)
+  {
+    dst.x.assign(src.x.begin() + pos_, src.x.begin() + pos_ + count);
+    dst.y.assign(src.y.begin() + pos_, src.y.begin() + pos_ + count);
+    dst.z.assign(src.z.begin() + pos_, src.z.begin() + pos_ + count);
+  }
+};
+
+class TransformStage : public PointStage
+{
+public:
+  explicit TransformStage(const Mat4<float> &m) : m_(m) {}
+
+  void process(PointBlock &block)
+  {
+    transformPoints(
+        m_, block.points, block.hasNormals() ? &block.normals : NULL);
+  }
+
+private:
+  Mat4<float> m_;
+};
+
+// Voxel grid filter applied to each block independently : voxels spanning
+// two blocks give one output point per block
+class VoxelFilterStage : public PointStage
+{
+public:
+  explicit VoxelFilterStage(
+      const float leafSize, const VoxelReduction mode = VOXEL_CENTROID)
+      : grid_(leafSize, mode)
+  {}
+
+  void process(PointBlock &block)
+  {
+    if(block.points.empty())
+      return;
+    const bool withNormals = block.hasNormals();
+    grid_.filter(
+        block.points, withNormals ? &block.normals : NULL, NULL, points_,
+        withNormals ? &normals_ : NULL, NULL);
+    block.points.swap(points_);
+    if(withNormals)
+      block.normals.swap(normals_);
+  }
+
+private:
+  VoxelGrid<float> grid_;
+  Vec3SoA<float> points_;
+  Vec3SoA<float> normals_;
+};
+
+// Normals from the k nearest neighbours within the block
+class NormalEstimationStage : public PointStage
+{
+public:
+  NormalEstimationStage(
+      const size_t k, const Vec3<float> &viewpoint,
+      const float maxDistance = FLT_MAX)
+      : k_(k), viewpoint_(viewpoint), maxDistance_(maxDistance)
+  {}
+
+  void process(PointBlock &block)
+  {
+    tree_.build(block.points);
+    estimateNormals(
+        block.points, tree_, k_, viewpoint_, block.normals, NULL,
+        maxDistance_);
+  }
+
+private:
+  size_t k_;
+  Vec3<float> viewpoint_;
+  float maxDistance_;
+  KdTree tree_;
+};
+
+// Appends the stream to in-memory SoA storage
+class SoASink : public PointSink
+{
+public:
+  explicit SoASink(Vec3SoA<float> &points, Vec3SoA<float> *normals = NULL)
+      : points_(points), normals_(normals)
+  {}
+
+  void write(const PointBlock &block)
+  {
+    append(block.points, points_);
+    if(normals_ != NULL && block.hasNormals())
+      append(block.normals, *normals_);
+  }
+
+private:
+  Vec3SoA<float> &points_;
+  Vec3SoA<float> *normals_;
+
+  static inline void append(const Vec3SoA<float> &src, Vec3SoA<float> &dst)
+  {
+    dst.x.insert(dst.x.end(), src.x.begin(), src.x.end());
+    dst.y.insert(dst.y.end(), src.y.begin(), src.y.end());
+    dst.z.insert(dst.z.end(), src.z.begin(), src.z.end());
+  }
+};
+
+// Streams the blocks to a binary little endian PLY file. The vertex count is
+// written as a fixed width field, patched by finish().
+class PlySink : public PointSink
+{
+public:
+  explicit PlySink(const std::string &path)
+      : path_(path), fp_(NULL), count_(0), countPos_(0), normals_(false)
+  {}
+
+  ~PlySink()
+  {
+    if(fp_ != NULL)
+      fclose(fp_);
+  }
+
+  void write(const PointBlock &block)
+  {
+    if(fp_ == NULL)
+      open(block.hasNormals());
+    else if(block.hasNormals() != normals_)
+      throw std::runtime_error("PlySink : inconsistent normals between blocks");
+
+    const size_t n = block.points.size();
+    const size_t nc = normals_ ? 6 : 3;
+    buffer_.resize(n * nc);
+    float *buf = buffer_.data();
+    const Vec3SoA<float> &p = block.points;
+    const Vec3SoA<float> &nr = block.normals;
+    const bool withNormals = normals_;
+#pragma omp parallel for
+    for(int64_t i = 0; i < int64_t(n); i++)
+    {
+      float *r = buf + size_t(i) * nc;
+      r[0] = p.x[i];
+      r[1] = p.y[i];
+      r[2] = p.z[i];
+      if(withNormals)
+      {
+        r[3] = nr.x[i];
+        r[4] = nr.y[i];
+        r[5] = nr.z[i];
+      }
+    }
+    if(n > 0 && fwrite(buf, sizeof(float) * nc, n, fp_) != n)
+      throw std::runtime_error("PlySink : cannot write " + path_);
+    count_ += n;
+  }
+
+  void finish()
+  {
+    if(fp_ == NULL)
+      open(false);
+    bool ok = fseek(fp_, long(countPos_), SEEK_SET) == 0;
+    ok = ok && fprintf(fp_, "%-20llu", (unsigned long long) count_) == 20;
+    ok = fclose(fp_) == 0 && ok;
+    fp_ = NULL;
+    if(!ok)
+      throw std::runtime_error("PlySink : cannot write " + path_);
+  }
+
+private:
+  std::string path_;
+  FILE *fp_;
+  size_t count_;
+  size_t countPos_;
+  bool normals_;
+  std::vector<float> buffer_;
+
+  void open(const bool withNormals)
+  {
+    fp_ = fopen(path_.c_str(), "wb");
+    if(fp_ == NULL)
+      throw std::runtime_error("PlySink : cannot open " + path_);
+    normals_ = withNormals;
+    fprintf(fp_, "ply\nformat binary_little_endian 1.0\nelement vertex ");
+    countPos_ = size_t(ftell(fp_));
+    fprintf(fp_, "%-20llu\n", 0ULL);
+    fprintf(fp_, "property float x\nproperty float y\nproperty float z\n");
+    if(withNormals)
+      fprintf(fp_, "property float nx\nproperty float ny\nproperty float nz\n");
+    fprintf(fp_, "end_header\n");
+  }
+};
+
+// Out-of-core processing of a point stream : the source is read in blocks of
+// at most blockSize points, every block goes through the stages in order and
+// is handed to the sink. Reading, computing and writing run on three threads
+// and overlap; numBuffers blocks circulate between them, which bounds the
+// memory use to numBuffers blocks whatever the size of the stream. The stages
+// are parallelized with OpenMP on the calling thread, while the source and
+// the sink run serially.
+class StreamPipeline
+{
+public:
+  explicit StreamPipeline(
+      const size_t blockSize = size_t(1) << 20, const int numBuffers = 3)
+      : blockSize_(blockSize), numBuffers_(numBuffers), source_(NULL),
+        sink_(NULL)
+  {
+    if(blockSize == 0 || numBuffers < 1)
+      throw std::invalid_argument("StreamPipeline : invalid block settings");
+  }
+
+  // Source, stages and sink are not owned by the pipeline
+  inline void setSource(PointSource *source) { source_ = source; }
+  inline void addStage(PointStage *stage) { stages_.push_back(stage); }
+  inline void setSink(PointSink *sink) { sink_ = sink; }
+
+  // Processes the whole stream, returns the number of blocks
+  size_t run()
+  {
+    if(source_ == NULL || sink_ == NULL)
+      throw std::logic_error("StreamPipeline : source or sink missing");
+
+    std::vector<PointBlock> blocks(static_cast<size_t>(numBuffers_));
+    stream::BlockingQueue<PointBlock *> freeBlocks, readBlocks, doneBlocks;
+    for(size_t i = 0; i < blocks.size(); i++)
+      freeBlocks.push(&blocks[i]);
+
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    size_t count = 0;
+    // Records the first error and unblocks every thread
+    auto fail = [&](std::exception_ptr e) {
+      {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if(!error)
+          error = e;
+      }
+      freeBlocks.close();
+      readBlocks.close();
+      doneBlocks.close();
+    };
+
+    // The reader and writer run their OpenMP loops (copies, repacking) on a
+    // single thread, leaving the cores to the teams of the stages
+    std::thread reader([&]() {
+      parallel::setMaxThreads(1);
+      try
+      {
+        PointBlock *block;
+        size_t index = 0;
+        while(freeBlocks.pop(block))
+        {
+          if(!source_->read(*block, blockSize_))
+            break;
+          block->index = index++;
+          readBlocks.push(block);
+        }
+        readBlocks.close();
+      }
+      catch(...)
+      {
+        fail(std::current_exception());
+      }
+    });
+
+    std::thread writer([&]() {
+      parallel::setMaxThreads(1);
+      try
+      {
+        PointBlock *block;
+        while(doneBlocks.pop(block))
+        {
+          sink_->write(*block);
+          freeBlocks.push(block);
+        }
+      }
+      catch(...)
+      {
+        fail(std::current_exception());
+      }
+    });
+
+    try
+    {
+      PointBlock *block;
+      while(readBlocks.pop(block))
+      {
+        for(size_t s = 0; s < stages_.size(); s++)
+          stages_[s]->process(*block);
+        doneBlocks.push(block);
+        count++;
+      }
+      doneBlocks.close();
+    }
+    catch(...)
+    {
+      fail(std::current_exception());
+    }
+
+    writer.join();
+    freeBlocks.close();
+    reader.join();
+
+    if(error)
+      std::rethrow_exception(error);
+    sink_->finish();
+    return count;
+  }
+
+private:
+  size_t blockSize_;
+  int numBuffers_;
+  PointSource *source_;
+  std::vector<PointStage *> stages_;
+  PointSink *sink_;
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_STREAM_PIPELINE_HPP__
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_SYM3_HPP__
+#define __GEOMETRY_SYM3_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+// Batch of symmetric 3x3 matrices stored as 6 SoA arrays (upper triangle)
+struct Sym3SoA
+{
+  std::vector<float> xx, xy, xz, yy, yz, zz;
+
+  Sym3SoA() {}
+
+  explicit Sym3SoA(const size_t n) { resize(n); }
+
+  inline size_t size() const { return xx.size(); }
+
+  inline void resize(const size_t n)
+  {
+    xx.resize(n);
+    xy.resize(n);
+    xz.resize(n);
+    yy.resize(n);
+    yz.resize(n);
+    zz.resize(n);
+  }
+};
+
+namespace sym3
+{
+// Unit vector orthogonal to (x, y, z), built from the axis the least aligned
+// with it. Branch free so that it can be inlined in vectorized loops.
+inline void orthogonal(
+    const float x, const float y, const float z, float &ox, float &oy,
+    float &oz)
+{
+  const float ax = fabsf(x);
+  const float ay = fabsf(y);
+  const float az = fabsf(z);
+  // cross((x, y, z), e) with e the axis of smallest component
+  const bool useX = ax <= ay && ax <= az;
+  const bool useY = !useX && ay <= az;
+  const float cx = useX ? 0.0f : (useY ? -z : y);
+  const float cy = useX ? z : (useY ? 0.0f : -x);
+  const float cz = useX ? -y : (useY ? x : 0.0f);
+  const float len = sqrtf(cx * cx + cy * cy + cz * cz);
+  const float inv = len > 0.0f ? 1.0f / len : 0.0f;
+  ox = len > 0.0f ? cx * inv : 0.0f;
+  oy = len > 0.0f ? cy * inv : 0.0f;
+  oz = len > 0.0f ? cz * inv : 1.0f;
+}
+} // namespace sym3
+
+// Closed form eigen decomposition of symmetric 3x3 matrices (trigonometric
+// solution of the characteristic cubic). For each matrix, writes the three
+// eigenvalues in decreasing order and the unit eigenvector of the smallest
+// one, computed as the largest cross product of two rows of A - l3 * I.
+// Matrices are normalized by their largest coefficient first so that the
+// float computation keeps its precision for badly scaled inputs. The loop
+// body is branch free and the batch is vectorized across matrices.
+inline void sym3SmallestEigen(
+    const float *axx, const float *axy, const float *axz, const float *ayy,
+    const float *ayz, const float *azz, const size_t n, float *l1, float *l2,
+    float *l3, float *vx, float *vy, float *vz)
+{
+  static const float twoPiOver3 = 2.0943951023931953f;
+  const int64_t sn = int64_t(n);
+
+#pragma omp simd
+  for(int64_t i = 0; i < sn; i++)
+  {
+    float scale = fmaxf(
+        fmaxf(fmaxf(fabsf(axx[i]), fabsf(axy[i])), fabsf(axz[i])),
+        fmaxf(fmaxf(fabsf(ayy[i]), fabsf(ayz[i])), fabsf(azz[i])));
+    scale = scale > 0.0f ? scale : 1.0f;
+    const float inv = 1.0f / scale;
+    const float a00 = axx[i] * inv;
+    const float a01 = axy[i] * inv;
+    const float a02 = axz[i] * inv;
+    const float a11 = ayy[i] * inv;
+    const float a12 = ayz[i] * inv;
+    const float a22 = azz[i] * inv;
+
+    const float q = (a00 + a11 + a22) / 3.0f;
+    const float p1 = a01 * a01 + a02 * a02 + a12 * a12;
+    const float d0 = a00 - q;
+    const float d1 = a11 - q;
+    const float d2 = a22 - q;
+    const float p2 = d0 * d0 + d1 * d1 + d2 * d2 + 2.0f * p1;
+    const float p = sqrtf(p2 / 6.0f);
+    const float invP = p > 0.0f ? 1.0f / p : 0.0f;
+
+    // r = det((A - q * I) / p) / 2
+    const float b00 = d0 * invP, b11 = d1 * invP, b22 = d2 * invP;
+    const float b01 = a01 * invP, b02 = a02 * invP, b12 = a12 * invP;
+    float r = 0.5f
+              * (b00 * (b11 * b22 - b12 * b12) - b01 * (b01 * b22 - b12 * b02)
+                 + b02 * (b01 * b12 - b11 * b02));
+    r = fminf(1.0f, fmaxf(-1.0f, r));
+    const float phi = acosf(r) / 3.0f;
+
+    const float e1 = q + 2.0f * p * cosf(phi);
+    const float e3 = q + 2.0f * p * cosf(phi + twoPiOver3);
+    const float e2 = 3.0f * q - e1 - e3;
+    l1[i] = e1 * scale;
+    l2[i] = e2 * scale;
+    l3[i] = e3 * scale;
+
+    // Rows of A - e3 * I
+    const float r0x = a00 - e3, r0y = a01, r0z = a02;
+    const float r1x = a01, r1y = a11 - e3, r1z = a12;
+    const float r2x = a02, r2y = a12, r2z = a22 - e3;
+
+    const float c01x = r0y * r1z - r0z * r1y;
+    const float c01y = r0z * r1x - r0x * r1z;
+    const float c01z = r0x * r1y - r0y * r1x;
+    const float c02x = r0y * r2z - r0z * r2y;
+    const float c02y = r0z * r2x - r0x * r2z;
+    const float c02z = r0x * r2y - r0y * r2x;
+    const float c12x = r1y * r2z - r1z * r2y;
+    const float c12y = r1z * r2x - r1x * r2z;
+    const float c12z = r1x * r2y - r1y * r2x;
+    const float n01 = c01x * c01x + c01y * c01y + c01z * c01z;
+    const float n02 = c02x * c02x + c02y * c02y + c02z * c02z;
+    const float n12 = c12x * c12x + c12y * c12y + c12z * c12z;
+
+    float cx = c01x, cy = c01y, cz = c01z, cn = n01;
+    cx = n02 > cn ? c02x : cx;
+    cy = n02 > cn ? c02y : cy;
+    cz = n02 > cn ? c02z : cz;
+    cn = n02 > cn ? n02 : cn;
+    cx = n12 > cn ? c12x : cx;
+    cy = n12 > cn ? c12y : cy;
+    cz = n12 > cn ? c12z : cz;
+    cn = n12 > cn ? n12 : cn;
+
+    // If the two smallest eigenvalues are equal, A - e3 * I has rank 1 and any
+    // vector orthogonal to its largest row is an eigenvector
+    const float m0 = r0x * r0x + r0y * r0y + r0z * r0z;
+    const float m1 = r1x * r1x + r1y * r1y + r1z * r1z;
+    const float m2 = r2x * r2x + r2y * r2y + r2z * r2z;
+    float rx = r0x, ry = r0y, rz = r0z, rm = m0;
+    rx = m1 > rm ? r1x : rx;
+    ry = m1 > rm ? r1y : ry;
+    rz = m1 > rm ? r1z : rz;
+    rm = m1 > rm ? m1 : rm;
+    rx = m2 > rm ? r2x : rx;
+    ry = m2 > rm ? r2y : ry;
+    rz = m2 > rm ? r2z : rz;
+    float ox, oy, oz;
+    sym3::orthogonal(rx, ry, rz, ox, oy, oz);
+
+    const bool degenerate = !(cn > 1e-12f);
+    const float invLen = degenerate ? 0.0f : 1.0f / sqrtf(cn);
+    vx[i] = degenerate ? ox : cx * invLen;
+    vy[i] = degenerate ? oy : cy * invLen;
+    vz[i] = degenerate ? oz : cz * invLen;
+  }
+}
+
+inline void sym3SmallestEigen(
+    const Sym3SoA &m, std::vector<float> &l1, std::vector<float> &l2,
+    std::vector<float> &l3, Vec3SoA<float> &v)
+{
+  const size_t n = m.size();
+  l1.resize(n);
+  l2.resize(n);
+  l3.resize(n);
+  v.resize(n);
+  sym3SmallestEigen(
+      m.xx.data(), m.xy.data(), m.xz.data(), m.yy.data(), m.yz.data(),
+      m.zz.data(), n, l1.data(), l2.data(), l3.data(), v.x.data(), v.y.data(),
+      v.z.data());
+}
+} // namespace geometry
+
+#endif // __GEOMETRY_SYM3_HPP__
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_TRANSFORM_TREE_HPP__
+#define __GEOMETRY_TRANSFORM_TREE_HPP__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "mat4/mat4.hpp"
+#include "mat4/rigid_transform.hpp"
+
+namespace geometry
+{
+// Hierarchy of local transforms. Nodes are stored breadth-first in contiguous
+// arrays, so that every level is a contiguous range whose parents all live in
+// the previous one. setLocal() only flags the node, and update() recomputes the
+// world matrix of flagged nodes and of their descendants, one level at a time
+// with the nodes of a level processed in parallel.
+//
+// Node ids returned by addNode() are stable, the storage order is not.
+class TransformTree
+{
+public:
+  TransformTree() : minDirtyLevel_(0), anyDirty_(false), layoutDirty_(false) {}
+
+  inline size_t size() const { return local_.size(); }
+
+  inline bool empty() const { return local_.empty(); }
+
+  // Adds a node under parent (-1 for a root) and returns its id
+  int32_t addNode(const int32_t parent, const Mat4<float> &local)
+  {
+    if(parent >= int32_t(slotOf_.size()))
+      throw std::invalid_argument("TransformTree : invalid parent id");
+
+    const int32_t id = int32_t(slotOf_.size());
+    const int32_t slot = int32_t(local_.size());
+    const int32_t parentSlot = parent < 0 ? -1 : slotOf_[parent];
+
+    slotOf_.push_back(slot);
+    idOf_.push_back(id);
+    parent_.push_back(parentSlot);
+    depth_.push_back(parentSlot < 0 ? 0 : depth_[parentSlot] + 1);
+    local_.push_back(local.data);
+    world_.push_back(local.data);
+    dirty_.push_back(1);
+
+    anyDirty_ = true;
+    layoutDirty_ = true;
+    return id;
+  }
+
+  inline void setLocal(const int32_t id, const Mat4<float> &local)
+  {
+    const int32_t slot = slotOf_[id];
+    local_[slot] = local.data;
+    dirty_[slot] = 1;
+    if(!anyDirty_ || depth_[slot] < minDirtyLevel_)
+      minDirtyLevel_ = depth_[slot];
+    anyDirty_ = true;
+  }
+
+  inline Mat4<float> local(const int32_t id) const
+  {
+    Mat4<float> ret;
+    ret.data = local_[slotOf_[id]];
+    return ret;
+  }
+
+  // World matrix of a node, recomputing pending changes first
+  inline Mat4<float> world(const int32_t id)
+  {
+    update();
+    Mat4<float> ret;
+    ret.data = world_[slotOf_[id]];
+    return ret;
+  }
+
+  inline int32_t parent(const int32_t id) const
+  {
+    const int32_t p = parent_[slotOf_[id]];
+    return p < 0 ? -1 : idOf_[p];
+  }
+
+  // Raw storage, in breadth-first order, valid after update()
+  inline size_t slot(const int32_t id) const { return size_t(slotOf_[id]); }
+  inline const mat4f_t *worldMatrices() const { return world_.data(); }
+  inline size_t numLevels() const
+  {
+    return levelStarts_.empty() ? 0 : levelStarts_.size() - 1;
+  }
+
+  void update()
+  {
+    if(layoutDirty_)
+      buildLayout();
+    if(!anyDirty_)
+      return;
+
+    const int32_t *parent = parent_.data();
+    const mat4f_t *local = local_.data();
+    mat4f_t *world = world_.data();
+    uint8_t *dirty = dirty_.data();
+
+    for(size_t l = size_t(minDirtyLevel_); l < numLevels(); l++)
+    {
+      const int64_t begin = int64_t(levelStarts_[l]);
+      const int64_t end = int64_t(levelStarts_[l + 1]);
+
+#pragma omp parallel for if(end - begin > 256)
+      for(int64_t i = begin; i < end; i++)
+      {
+        const int32_t p = parent[i];
+        if(p >= 0 && dirty[p])
+          dirty[i] = 1;
+        if(!dirty[i])
+          continue;
+        if(p < 0)
+          world[i] = local[i];
+        else
+          mat4Mul(world[p], local[i], world[i]);
+      }
+    }
+
+    const size_t first = levelStarts_[minDirtyLevel_];
+    memset(dirty + first, 0, dirty_.size() - first);
+    anyDirty_ = false;
+    minDirtyLevel_ = 0;
+  }
+
+  void clear()
+  {
+    slotOf_.clear();
+    idOf_.clear();
+    parent_.clear();
+    depth_.clear();
+    local_.clear();
+    world_.clear();
+    dirty_.clear();
+    levelStarts_.clear();
+    minDirtyLevel_ = 0;
+    anyDirty_ = false;
+    layoutDirty_ = false;
+  }
+
+private:
+  std::vector<int32_t> slotOf_;
+  std::vector<int32_t> idOf_;
+  std::vector<int32_t> parent_;
+  std::vector<int32_t> depth_;
+  std::vector<mat4f_t> local_;
+  std::vector<mat4f_t> world_;
+  std::vector<uint8_t> dirty_;
+  std::vector<size_t> levelStarts_;
+  int32_t minDirtyLevel_;
+  bool anyDirty_;
+  bool layoutDirty_;
+
+  // Stable counting sort of the nodes by depth
+  void buildLayout()
+  {
+    const size_t n = local_.size();
+    int32_t maxDepth = -1;
+    for(size_t i = 0; i < n; i++)
+      maxDepth = depth_[i] > maxDepth ? depth_[i] : maxDepth;
+
+    levelStarts_.assign(size_t(maxDepth + 2), 0);
+    for(size_t i = 0; i < n; i++)
+      levelStarts_[depth_[i] + 1]++;
+    for(size_t l = 1; l < levelStarts_.size(); l++)
+      levelStarts_[l] += levelStarts_[l - 1];
+
+    std::vector<size_t> next(levelStarts_.begin(), levelStarts_.end() - 1);
+    std::vector<int32_t> newSlot(n);
+    for(size_t i = 0; i < n; i++)
+      newSlot[i] = int32_t(next[depth_[i]]++);
+
+    std::vector<int32_t> idOf(n), parent(n), depth(n);
+    std::vector<mat4f_t> local(n), world(n);
+    std::vector<uint8_t> dirty(n);
+    for(size_t i = 0; i < n; i++)
+    {
+      const int32_t s = newSlot[i];
+      idOf[s] = idOf_[i];
+      parent[s] = parent_[i] < 0 ? -1 : newSlot[parent_[i]];
+      depth[s] = depth_[i];
+      local[s] = local_[i];
+      world[s] = world_[i];
+      dirty[s] = dirty_[i];
+      slotOf_[idOf_[i]] = s;
+    }
+    idOf_.swap(idOf);
+    parent_.swap(parent);
+    depth_.swap(depth);
+    local_.swap(local);
+    world_.swap(world);
+    dirty_.swap(dirty);
+
+    // New nodes can be anywhere in the tree
+    minDirtyLevel_ = 0;
+    layoutDirty_ = false;
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_TRANSFORM_TREE_HPP__
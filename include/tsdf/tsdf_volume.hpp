@@ -0,0 +1,560 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_TSDF_VOLUME_HPP__
+#define __GEOMETRY_TSDF_VOLUME_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "camera/intrinsics.hpp"
+#include "mat4/mat4.hpp"
+#include "mat4/rigid_transform.hpp"
+#include "parallel/parallel.hpp"
+
+namespace geometry
+{
+namespace tsdf
+{
+// Fuses one depth frame into a row of n voxels. (px, py, pz) is the position
+// of the first voxel in camera space and (dx, dy, dz) the camera space offset
+// between two consecutive voxels of the row. The loop has no dependency
+// between voxels and is vectorized, the depth lookup becoming a gather.
+inline void integrateRow(
+    float *tsdf, float *weight, const int n, const float px, const float py,
+    const float pz, const float dx, const float dy, const float dz,
+    const float *depth, const int width, const int height,
+    const Intrinsics &K, const float truncation, const float maxWeight)
+{
+  const float invTruncation = 1.0f / truncation;
+  const float maxU = float(width) - 0.5f;
+  const float maxV = float(height) - 0.5f;
+
+#pragma omp simd
+  for(int i = 0; i < n; i++)
+  {
+    const float x = px + float(i) * dx;
+    const float y = py + float(i) * dy;
+    const float z = pz + float(i) * dz;
+    if(z <= 0.0f)
+      continue;
+
+    const float invZ = 1.0f / z;
+    const float u = K.fx * x * invZ + K.cx;
+    const float v = K.fy * y * invZ + K.cy;
+    if(u < -0.5f || v < -0.5f || u >= maxU || v >= maxV)
+      continue;
+
+    const float d = depth[int(v + 0.5f) * width + int(u + 0.5f)];
+    if(!(d > 0.0f))
+      continue;
+
+    const float sdf = d - z;
+    if(sdf < -truncation)
+      continue;
+
+    const float val = std::min(1.0f, sdf * invTruncation);
+    const float w = weight[i];
+    tsdf[i] = (tsdf[i] * w + val) / (w + 1.0f);
+    weight[i] = std::min(w + 1.0f, maxWeight);
+  }
+}
+
+// Trilinear interpolation of the TSDF at grid coordinates (gx, gy, gz). Fails
+// if one of the 8 neighbouring voxels has never been observed.
+template <typename Volume>
+inline bool
+trilinear(const Volume &vol, const float gx, const float gy, const float gz,
+          float &res)
+{
+  const float fx = floorf(gx);
+  const float fy = floorf(gy);
+  const float fz = floorf(gz);
+  const int ix = int(fx);
+  const int iy = int(fy);
+  const int iz = int(fz);
+  const float ax = gx - fx;
+  const float ay = gy - fy;
+  const float az = gz - fz;
+
+  float vals[8];
+  for(int i = 0; i < 8; i++)
+  {
+    float w;
+    if(!vol.voxel(ix + (i & 1), iy + ((i >> 1) & 1), iz + (i >> 2), vals[i], w)
+       || w <= 0.0f)
+      return false;
+  }
+
+  const float x00 = vals[0] + ax * (vals[1] - vals[0]);
+  const float x10 = vals[2] + ax * (vals[3] - vals[2]);
+  const float x01 = vals[4] + ax * (vals[5] - vals[4]);
+  const float x11 = vals[6] + ax * (vals[7] - vals[6]);
+  const float y0 = x00 + ay * (x10 - x00);
+  const float y1 = x01 + ay * (x11 - x01);
+  res = y0 + az * (y1 - y0);
+  return true;
+}
+
+// Renders the depth of the zero crossing seen from a camera. Rays march with a
+// step proportional to the TSDF value, which is a lower bound of the distance
+// to the surface, and the crossing is refined by linear interpolation.
+template <typename Volume>
+inline void raycast(
+    const Volume &vol, const Intrinsics &K, const Mat4<float> &pose,
+    const int width, const int height, const float near, const float far,
+    float *depth)
+{
+  const RigidTransform c2w = rigidFromMat4(pose);
+  const float voxelSize = vol.voxelSize();
+  const float truncation = vol.truncation();
+
+#pragma omp parallel for schedule(dynamic, 4)
+  for(int v = 0; v < height; v++)
+  {
+    for(int u = 0; u < width; u++)
+    {
+      const float dirCam[3]
+          = {(float(u) - K.cx) / K.fx, (float(v) - K.cy) / K.fy, 1.0f};
+      float dir[3];
+      c2w.rotate(dirCam, dir);
+      const float invLen
+          = 1.0f / sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+
+      float res = 0.0f;
+      float prevVal = 0.0f;
+      float prevZ = 0.0f;
+      bool hasPrev = false;
+      float z = near;
+      while(z < far)
+      {
+        float gx, gy, gz, val;
+        vol.toGrid(
+            c2w.t[0] + z * dir[0], c2w.t[1] + z * dir[1],
+            c2w.t[2] + z * dir[2], gx, gy, gz);
+        float step;
+        if(trilinear(vol, gx, gy, gz, val))
+        {
+          if(hasPrev && prevVal > 0.0f && val <= 0.0f)
+          {
+            res = prevZ + (z - prevZ) * prevVal / (prevVal - val);
+            break;
+          }
+          if(hasPrev && prevVal < 0.0f && val > 0.0f)
+            break;
+          prevVal = val;
+          prevZ = z;
+          hasPrev = true;
+          step = std::max(voxelSize, 0.8f * fabsf(val) * truncation);
+        }
+        else
+        {
+          hasPrev = false;
+          step = 0.5f * truncation;
+        }
+        z += step * invLen;
+      }
+      depth[v * width + u] = res;
+    }
+  }
+}
+} // namespace tsdf
+
+// -----------------------------------------------------------------------------
+
+// Dense truncated signed distance volume. Voxels are stored x major in two
+// flat arrays (TSDF and weight) and a depth frame is fused one x row at a
+// time, rows being distributed over threads.
+// Depth maps are in metric units, 0 marking invalid pixels, and poses map
+// camera space to world space.
+class TsdfVolume
+{
+public:
+  TsdfVolume(
+      const int nx, const int ny, const int nz, const float voxelSize,
+      const Vec3<float> &origin, const float truncation,
+      const float maxWeight = 64.0f)
+      : nx_(nx), ny_(ny), nz_(nz), voxelSize_(voxelSize),
+        truncation_(truncation), maxWeight_(maxWeight),
+        tsdf_(size_t(nx) * size_t(ny) * size_t(nz), 1.0f),
+        weight_(size_t(nx) * size_t(ny) * size_t(nz), 0.0f)
+  {
+    if(nx <= 0 || ny <= 0 || nz <= 0 || !(voxelSize > 0.0f)
+       || !(truncation > 0.0f))
+      throw std::invalid_argument("TsdfVolume : invalid volume parameters");
+    origin_[0] = origin.data.coords.x;
+    origin_[1] = origin.data.coords.y;
+    origin_[2] = origin.data.coords.z;
+  }
+
+  inline int nx() const { return nx_; }
+  inline int ny() const { return ny_; }
+  inline int nz() const { return nz_; }
+  inline float voxelSize() const { return voxelSize_; }
+  inline float truncation() const { return truncation_; }
+  inline const float *origin() const { return origin_; }
+  inline const float *tsdf() const { return tsdf_.data(); }
+  inline const float *weights() const { return weight_.data(); }
+
+  inline void reset()
+  {
+    std::fill(tsdf_.begin(), tsdf_.end(), 1.0f);
+    std::fill(weight_.begin(), weight_.end(), 0.0f);
+  }
+
+  inline bool voxel(
+      const int x, const int y, const int z, float &tsdf, float &weight) const
+  {
+    if(x < 0 || y < 0 || z < 0 || x >= nx_ || y >= ny_ || z >= nz_)
+      return false;
+    const size_t id = index(x, y, z);
+    tsdf = tsdf_[id];
+    weight = weight_[id];
+    return true;
+  }
+
+  inline void toGrid(
+      const float x, const float y, const float z, float &gx, float &gy,
+      float &gz) const
+  {
+    gx = (x - origin_[0]) / voxelSize_;
+    gy = (y - origin_[1]) / voxelSize_;
+    gz = (z - origin_[2]) / voxelSize_;
+  }
+
+  void integrate(
+      const float *depth, const int width, const int height,
+      const Intrinsics &K, const Mat4<float> &pose)
+  {
+    const RigidTransform w2c = rigidInverseFromMat4(pose);
+    const float dx = w2c.r[0][0] * voxelSize_;
+    const float dy = w2c.r[1][0] * voxelSize_;
+    const float dz = w2c.r[2][0] * voxelSize_;
+
+#pragma omp parallel for collapse(2) schedule(static)
+    for(int z = 0; z < nz_; z++)
+    {
+      for(int y = 0; y < ny_; y++)
+      {
+        const float p[3]
+            = {origin_[0], origin_[1] + float(y) * voxelSize_,
+               origin_[2] + float(z) * voxelSize_};
+        float c[3];
+        w2c.apply(p, c);
+
+        const size_t id = index(0, y, z);
+        tsdf::integrateRow(
+            tsdf_.data() + id, weight_.data() + id, nx_, c[0], c[1], c[2], dx,
+            dy, dz, depth, width, height, K, truncation_, maxWeight_);
+      }
+    }
+  }
+
+  inline void raycast(
+      const Intrinsics &K, const Mat4<float> &pose, const int width,
+      const int height, const float near, const float far, float *depth) const
+  {
+    tsdf::raycast(*this, K, pose, width, height, near, far, depth);
+  }
+
+private:
+  int nx_, ny_, nz_;
+  float voxelSize_;
+  float truncation_;
+  float maxWeight_;
+  float origin_[3];
+  std::vector<float> tsdf_;
+  std::vector<float> weight_;
+
+  inline size_t index(const int x, const int y, const int z) const
+  {
+    return size_t(x) + size_t(nx_) * (size_t(y) + size_t(ny_) * size_t(z));
+  }
+};
+
+// -----------------------------------------------------------------------------
+
+// Sparse TSDF volume using voxel hashing. Space is split into blocks of
+// blockSide^3 voxels that are allocated on demand around the observed surface.
+// Block allocation is gathered per thread and merged in the hash table, then
+// the blocks touched by the frame are integrated in parallel. Voxel (0, 0, 0)
+// is centered on the world origin. Depths beyond maxDepth are ignored.
+class SparseTsdfVolume
+{
+public:
+  static const int blockSide = 8;
+  static const int blockVoxels = blockSide * blockSide * blockSide;
+
+  SparseTsdfVolume(
+      const float voxelSize, const float truncation,
+      const float maxWeight = 64.0f, const float maxDepth = 10.0f)
+      : voxelSize_(voxelSize), truncation_(truncation), maxWeight_(maxWeight),
+        maxDepth_(maxDepth), frame_(0)
+  {
+    if(!(voxelSize > 0.0f) || !(truncation > 0.0f) || !(maxDepth > 0.0f)
+       || !isfinite(maxDepth))
+      throw std::invalid_argument("SparseTsdfVolume : invalid parameters");
+  }
+
+  inline float voxelSize() const { return voxelSize_; }
+  inline float truncation() const { return truncation_; }
+  inline float maxDepth() const { return maxDepth_; }
+  inline size_t numBlocks() const { return blockCoords_.size() / 3; }
+
+  inline void blockCoords(const size_t id, int &bx, int &by, int &bz) const
+  {
+    bx = blockCoords_[3 * id];
+    by = blockCoords_[3 * id + 1];
+    bz = blockCoords_[3 * id + 2];
+  }
+
+  inline const float *blockTsdf(const size_t id) const
+  {
+    return tsdf_.data() + id * blockVoxels;
+  }
+
+  inline const float *blockWeights(const size_t id) const
+  {
+    return weight_.data() + id * blockVoxels;
+  }
+
+  // Returns the index of a block, or -1 if it is not allocated
+  inline int64_t findBlock(const int bx, const int by, const int bz) const
+  {
+    std::unordered_map<uint64_t, uint32_t>::const_iterator it
+        = blocks_.find(blockKey(bx, by, bz));
+    return it == blocks_.end() ? -1 : int64_t(it->second);
+  }
+
+  inline void clear()
+  {
+    blocks_.clear();
+    blockCoords_.clear();
+    blockFrame_.clear();
+    tsdf_.clear();
+    weight_.clear();
+  }
+
+  inline bool voxel(
+      const int x, const int y, const int z, float &tsdf, float &weight) const
+  {
+    const int bx = floorDiv(x);
+    const int by = floorDiv(y);
+    const int bz = floorDiv(z);
+    const int64_t id = findBlock(bx, by, bz);
+    if(id < 0)
+      return false;
+    const size_t v = size_t(id) * blockVoxels
+                     + size_t(
+                         (x - bx * blockSide)
+                         + blockSide
+                               * ((y - by * blockSide)
+                                  + blockSide * (z - bz * blockSide)));
+    tsdf = tsdf_[v];
+    weight = weight_[v];
+    return true;
+  }
+
+  inline void toGrid(
+      const float x, const float y, const float z, float &gx, float &gy,
+      float &gz) const
+  {
+    gx = x / voxelSize_;
+    gy = y / voxelSize_;
+    gz = z / voxelSize_;
+  }
+
+  void integrate(
+      const float *depth, const int width, const int height,
+      const Intrinsics &K, const Mat4<float> &pose)
+  {
+    frame_++;
+    allocate(depth, width, height, K, pose);
+
+    const RigidTransform w2c = rigidInverseFromMat4(pose);
+    const float dx = w2c.r[0][0] * voxelSize_;
+    const float dy = w2c.r[1][0] * voxelSize_;
+    const float dz = w2c.r[2][0] * voxelSize_;
+
+    const int64_t nVisible = int64_t(visible_.size());
+#pragma omp parallel for schedule(dynamic, 16)
+    for(int64_t b = 0; b < nVisible; b++)
+    {
+      const uint32_t id = visible_[b];
+      float *tsdf = tsdf_.data() + size_t(id) * blockVoxels;
+      float *weight = weight_.data() + size_t(id) * blockVoxels;
+      const int *coords = blockCoords_.data() + 3 * size_t(id);
+      for(int z = 0; z < blockSide; z++)
+      {
+        for(int y = 0; y < blockSide; y++)
+        {
+          const float p[3]
+              = {float(coords[0] * blockSide) * voxelSize_,
+                 float(coords[1] * blockSide + y) * voxelSize_,
+                 float(coords[2] * blockSide + z) * voxelSize_};
+          float c[3];
+          w2c.apply(p, c);
+
+          const int off = blockSide * (y + blockSide * z);
+          tsdf::integrateRow(
+              tsdf + off, weight + off, blockSide, c[0], c[1], c[2], dx, dy,
+              dz, depth, width, height, K, truncation_, maxWeight_);
+        }
+      }
+    }
+  }
+
+  inline void raycast(
+      const Intrinsics &K, const Mat4<float> &pose, const int width,
+      const int height, const float near, const float far, float *depth) const
+  {
+    tsdf::raycast(*this, K, pose, width, height, near, far, depth);
+  }
+
+private:
+  float voxelSize_;
+  float truncation_;
+  float maxWeight_;
+  float maxDepth_;
+  uint32_t frame_;
+
+  std::unordered_map<uint64_t, uint32_t> blocks_;
+  std::vector<int> blockCoords_;
+  std::vector<uint32_t> blockFrame_;
+  std::vector<float> tsdf_;
+  std::vector<float> weight_;
+  std::vector<uint32_t> visible_;
+  std::vector<std::vector<uint64_t>> threadKeys_;
+
+  static inline int floorDiv(const int v)
+  {
+    return v >= 0 ? v / blockSide : -((-v + blockSide - 1) / blockSide);
+  }
+
+  static inline uint64_t blockKey(const int bx, const int by, const int bz)
+  {
+    static const uint64_t mask = (UINT64_C(1) << 21) - 1;
+    return (uint64_t(bx + (1 << 20)) & mask)
+           | ((uint64_t(by + (1 << 20)) & mask) << 21)
+           | ((uint64_t(bz + (1 << 20)) & mask) << 42);
+  }
+
+  static inline void
+  unpackKey(const uint64_t key, int &bx, int &by, int &bz)
+  {
+    static const uint64_t mask = (UINT64_C(1) << 21) - 1;
+    bx = int(key & mask) - (1 << 20);
+    by = int((key >> 21) & mask) - (1 << 20);
+    bz = int((key >> 42) & mask) - (1 << 20);
+  }
+
+  // Allocates the blocks crossed by the truncation band of every valid pixel
+  // and fills visible_ with the blocks to integrate for this frame
+  void allocate(
+      const float *depth, const int width, const int height,
+      const Intrinsics &K, const Mat4<float> &pose)
+  {
+    const RigidTransform c2w = rigidFromMat4(pose);
+    const float blockSize = float(blockSide) * voxelSize_;
+    const float invBlockSize = 1.0f / blockSize;
+    // Every slot is cleared here : the team may be smaller than maxThreads()
+    // and the merge below reads all of them
+    threadKeys_.resize(size_t(parallel::maxThreads()));
+    for(size_t t = 0; t < threadKeys_.size(); t++)
+      threadKeys_[t].clear();
+
+    // The band is sampled every half block along the ray, with a step count
+    // that does not depend on the depth
+    const int nSteps = int(ceilf(4.0f * truncation_ / blockSize));
+
+#pragma omp parallel
+    {
+      std::vector<uint64_t> &keys = threadKeys_[parallel::threadId()];
+
+#pragma omp for schedule(static)
+      for(int v = 0; v < height; v++)
+      {
+        uint64_t last = UINT64_MAX;
+        for(int u = 0; u < width; u++)
+        {
+          const float d = depth[v * width + u];
+          if(!(d > 0.0f) || !(d <= maxDepth_))
+            continue;
+
+          const float dirCam[3]
+              = {(float(u) - K.cx) / K.fx, (float(v) - K.cy) / K.fy, 1.0f};
+          float dir[3];
+          c2w.rotate(dirCam, dir);
+          const float len = sqrtf(
+              dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+          const float band = truncation_ / len;
+          const float step = 0.5f * blockSize / len;
+          for(int k = 0; k <= nSteps; k++)
+          {
+            const float zs = std::min(d - band + float(k) * step, d + band);
+            const uint64_t key = blockKey(
+                int(floorf((c2w.t[0] + zs * dir[0]) * invBlockSize)),
+                int(floorf((c2w.t[1] + zs * dir[1]) * invBlockSize)),
+                int(floorf((c2w.t[2] + zs * dir[2]) * invBlockSize)));
+            if(key != last)
+              keys.push_back(key);
+            last = key;
+          }
+        }
+      }
+
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+
+    visible_.clear();
+    for(size_t t = 0; t < threadKeys_.size(); t++)
+    {
+      const std::vector<uint64_t> &keys = threadKeys_[t];
+      for(size_t i = 0; i < keys.size(); i++)
+      {
+        std::pair<std::unordered_map<uint64_t, uint32_t>::iterator, bool> it
+            = blocks_.insert(std::make_pair(keys[i], uint32_t(numBlocks())));
+        const uint32_t id = it.first->second;
+        if(it.second)
+        {
+          int bx, by, bz;
+          unpackKey(keys[i], bx, by, bz);
+          blockCoords_.push_back(bx);
+          blockCoords_.push_back(by);
+          blockCoords_.push_back(bz);
+          blockFrame_.push_back(0);
+          tsdf_.resize(tsdf_.size() + blockVoxels, 1.0f);
+          weight_.resize(weight_.size() + blockVoxels, 0.0f);
+        }
+        if(blockFrame_[id] != frame_)
+        {
+          blockFrame_[id] = frame_;
+          visible_.push_back(id);
+        }
+      }
+    }
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_TSDF_VOLUME_HPP__
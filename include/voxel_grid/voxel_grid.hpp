@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRY_VOXEL_GRID_HPP__
+#define __GEOMETRY_VOXEL_GRID_HPP__
+
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "aabb/aabb.hpp"
+#include "parallel/parallel.hpp"
+#include "soa/vec3_soa.hpp"
+
+namespace geometry
+{
+enum VoxelReduction
+{
+  VOXEL_CENTROID, // Average of the points falling in the voxel
+  VOXEL_FIRST,    // Point with the lowest input index in the voxel
+  VOXEL_RANDOM    // Point drawn uniformly in the voxel (seeded, reproducible)
+};
+
+// Voxel grid downsampling filter.
+// Points are binned by sorting their linear voxel index with a parallel radix
+// sort, then each run of equal keys is reduced independently. The scratch
+// buffers are kept between calls so that filtering a stream of scans of
+// similar size does not allocate. Scratch memory is 32 bytes per input point
+// on top of the input and output clouds : 8 for the keys, 4 for the ids, 12
+// for their sort buffers and 8 for the voxel starts when every point is its
+// own voxel. Input coordinates must be finite.
+template <typename T>
+class VoxelGrid
+{
+public:
+  VoxelGrid(
+      const T leafSize, const VoxelReduction mode = VOXEL_CENTROID,
+      const uint64_t seed = 0)
+      : leafSize_(leafSize), mode_(mode), seed_(seed)
+  {
+    if(!(leafSize > T(0)))
+      throw std::invalid_argument("VoxelGrid : leaf size must be positive");
+  }
+
+  inline T leafSize() const { return leafSize_; }
+
+  inline VoxelReduction mode() const { return mode_; }
+
+  inline void setSeed(const uint64_t seed) { seed_ = seed; }
+
+  inline void filter(const Vec3SoA<T> &points, Vec3SoA<T> &out)
+  {
+    filter(points, NULL, NULL, out, NULL, NULL);
+  }
+
+  // Optional normal and colour attributes are reduced with the same mode as
+  // the positions. Averaged normals are renormalized.
+  void filter(
+      const Vec3SoA<T> &points, const Vec3SoA<T> *normals,
+      const Vec3SoA<T> *colors, Vec3SoA<T> &out, Vec3SoA<T> *outNormals,
+      Vec3SoA<T> *outColors)
+  {
+    const size_t n = points.size();
+    if(n == 0)
+    {
+      out.clear();
+      if(outNormals != NULL)
+        outNormals->clear();
+      if(outColors != NULL)
+        outColors->clear();
+      return;
+    }
+
+    const int maxBits = computeKeys(points);
+    parallel::radixSortPairs(keys_, ids_, tmpKeys_, tmpIds_, maxBits);
+    const size_t nVoxels = parallel::segmentStarts(keys_, starts_, counts_);
+
+    out.resize(nVoxels);
+    const bool hasNormals = normals != NULL && outNormals != NULL;
+    const bool hasColors = colors != NULL && outColors != NULL;
+    if(hasNormals)
+      outNormals->resize(nVoxels);
+    if(hasColors)
+      outColors->resize(nVoxels);
+
+    const int64_t nSegments = int64_t(nVoxels);
+#pragma omp parallel for schedule(static)
+    for(int64_t s = 0; s < nSegments; s++)
+    {
+      const size_t begin = starts_[s];
+      const size_t end = starts_[s + 1];
+      if(mode_ == VOXEL_CENTROID)
+      {
+        average(points, begin, end, out, s, false);
+        if(hasNormals)
+          average(*normals, begin, end, *outNormals, s, true);
+        if(hasColors)
+          average(*colors, begin, end, *outColors, s, false);
+      }
+      else
+      {
+        const uint32_t id = pick(begin, end);
+        out.set(s, points.x[id], points.y[id], points.z[id]);
+        if(hasNormals)
+          outNormals->set(s, normals->x[id], normals->y[id], normals->z[id]);
+        if(hasColors)
+          outColors->set(s, colors->x[id], colors->y[id], colors->z[id]);
+      }
+    }
+  }
+
+private:
+  T leafSize_;
+  VoxelReduction mode_;
+  uint64_t seed_;
+
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> ids_;
+  std::vector<uint64_t> tmpKeys_;
+  std::vector<uint32_t> tmpIds_;
+  std::vector<size_t> starts_;
+  std::vector<size_t> counts_;
+
+  // Returns the number of significant bits of the keys
+  int computeKeys(const Vec3SoA<T> &points)
+  {
+    const size_t n = points.size();
+    const int64_t sn = int64_t(n);
+    if(uint64_t(n) > uint64_t(UINT32_MAX))
+      throw std::invalid_argument("VoxelGrid : too many input points");
+
+    const T *px = points.x.data();
+    const T *py = points.y.data();
+    const T *pz = points.z.data();
+
+    // x - x is NaN for both infinities and NaN, whose conversion to a voxel
+    // index would be undefined
+    size_t nonFinite = 0;
+#pragma omp parallel for simd reduction(+ : nonFinite)
+    for(int64_t i = 0; i < sn; i++)
+    {
+      const T s = (px[i] - px[i]) + (py[i] - py[i]) + (pz[i] - pz[i]);
+      nonFinite += s == T(0) ? 0 : 1;
+    }
+    if(nonFinite > 0)
+      throw std::invalid_argument("VoxelGrid : non-finite input point");
+
+    const Aabb<T> bounds = computeAabb(points);
+    const T minX = bounds.min.data.coords.x;
+    const T minY = bounds.min.data.coords.y;
+    const T minZ = bounds.min.data.coords.z;
+    const T maxX = bounds.max.data.coords.x;
+    const T maxY = bounds.max.data.coords.y;
+    const T maxZ = bounds.max.data.coords.z;
+
+    const T invLeaf = T(1) / leafSize_;
+    const uint64_t nx = uint64_t(floor((maxX - minX) * invLeaf)) + 1;
+    const uint64_t ny = uint64_t(floor((maxY - minY) * invLeaf)) + 1;
+    const uint64_t nz = uint64_t(floor((maxZ - minZ) * invLeaf)) + 1;
+    if(double(nx) * double(ny) * double(nz) > double(UINT64_C(1) << 62))
+      throw std::invalid_argument("VoxelGrid : leaf size too small for input");
+    const uint64_t nxy = nx * ny;
+
+    keys_.resize(n);
+    ids_.resize(n);
+    uint64_t *keys = keys_.data();
+    uint32_t *ids = ids_.data();
+#pragma omp parallel for simd
+    for(int64_t i = 0; i < sn; i++)
+    {
+      const uint64_t ix = uint64_t((px[i] - minX) * invLeaf);
+      const uint64_t iy = uint64_t((py[i] - minY) * invLeaf);
+      const uint64_t iz = uint64_t((pz[i] - minZ) * invLeaf);
+      keys[i] = ix + nx * iy + nxy * iz;
+      ids[i] = uint32_t(i);
+    }
+
+    return parallel::bitWidth(nxy * nz - 1);
+  }
+
+  inline void average(
+      const Vec3SoA<T> &in, const size_t begin, const size_t end,
+      Vec3SoA<T> &out, const size_t dst, const bool normalize) const
+  {
+    double sx = 0.0, sy = 0.0, sz = 0.0;
+    for(size_t i = begin; i < end; i++)
+    {
+      const uint32_t id = ids_[i];
+      sx += in.x[id];
+      sy += in.y[id];
+      sz += in.z[id];
+    }
+
+    double k = 1.0 / double(end - begin);
+    if(normalize)
+    {
+      const double len = sqrt(sx * sx + sy * sy + sz * sz);
+      k = len > 0.0 ? 1.0 / len : 0.0;
+    }
+    out.set(dst, T(sx * k), T(sy * k), T(sz * k));
+  }
+
+  inline uint32_t pick(const size_t begin, const size_t end) const
+  {
+    if(mode_ == VOXEL_FIRST)
+      return ids_[begin];
+
+    // Stateless hash of the voxel key so that the draw does not depend on the
+    // thread layout
+    uint64_t h = keys_[begin] ^ seed_;
+    h += UINT64_C(0x9e3779b97f4a7c15);
+    h = (h ^ (h >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    h = (h ^ (h >> 27)) * UINT64_C(0x94d049bb133111eb);
+    h = h ^ (h >> 31);
+    return ids_[begin + size_t(h % uint64_t(end - begin))];
+  }
+};
+} // namespace geometry
+
+#endif // __GEOMETRY_VOXEL_GRID_HPP__
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// Box of the 8 transformed corners
+static geometry::Aabb<float> transform_corners(
+    const geometry::Aabb<float> &box, const geometry::Mat4<float> &m)
+{
+  geometry::Aabb<float> ret;
+  for(int c = 0; c < 8; c++)
+  {
+    const float p[3]
+        = {(c & 1) ? box.max.data.coords.x : box.min.data.coords.x,
+           (c & 2) ? box.max.data.coords.y : box.min.data.coords.y,
+           (c & 4) ? box.max.data.coords.z : box.min.data.coords.z};
+    float q[3];
+    for(int i = 0; i < 3; i++)
+    {
+      q[i] = m.data.array[i][0] * p[0] + m.data.array[i][1] * p[1]
+             + m.data.array[i][2] * p[2] + m.data.array[i][3];
+    }
+    ret.extend(q[0], q[1], q[2]);
+  }
+  return ret;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_aabb_transform()
+{
+  srand(0);
+  bool ok = true;
+  for(int t = 0; t < 1000 && ok; t++)
+  {
+    geometry::Aabb<float> box;
+    box.extend(
+        10.0f * _rand_val<float>(), 10.0f * _rand_val<float>(),
+        10.0f * _rand_val<float>());
+    box.extend(
+        10.0f * _rand_val<float>(), 10.0f * _rand_val<float>(),
+        10.0f * _rand_val<float>());
+
+    // Any affine matrix, not only rigid ones
+    geometry::Mat4<float> m;
+    for(int i = 0; i < 3; i++)
+    {
+      for(int j = 0; j < 4; j++)
+        m.data.array[i][j] = 3.0f * _rand_val<float>();
+    }
+    m.data.array[3][3] = 1.0f;
+
+    const geometry::Aabb<float> res = box.transform(m);
+    const geometry::Aabb<float> ref = transform_corners(box, m);
+    for(int i = 0; i < 3; i++)
+    {
+      ok = ok && fabsf(res.min.data.data[i] - ref.min.data.data[i]) < 1e-4f
+           && fabsf(res.max.data.data[i] - ref.max.data.data[i]) < 1e-4f;
+    }
+  }
+
+  // An empty box stays empty
+  geometry::Mat4<float> id;
+  for(int i = 0; i < 4; i++)
+    id.data.array[i][i] = 1.0f;
+  ok = ok && geometry::Aabb<float>().transform(id).empty();
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_aabb_transform() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_aabb_transform() : success\n");
+}
+
+void test_aabb_reductions()
+{
+  srand(1);
+  const size_t n = 100003;
+  geometry::Vec3SoA<float> points(n);
+  geometry::Aabb<float> ref;
+  double s[3] = {0.0, 0.0, 0.0};
+  for(size_t i = 0; i < n; i++)
+  {
+    points.x[i] = 5.0f * _rand_val<float>() + 1.0f;
+    points.y[i] = 2.0f * _rand_val<float>() - 3.0f;
+    points.z[i] = 7.0f * _rand_val<float>();
+    ref.extend(points.x[i], points.y[i], points.z[i]);
+    s[0] += points.x[i];
+    s[1] += points.y[i];
+    s[2] += points.z[i];
+  }
+
+  const geometry::Aabb<float> box = geometry::computeAabb(points);
+  const geometry::Vec3<double> sum = geometry::sumPoints(points);
+  const geometry::Vec3<float> c = geometry::centroid(points);
+
+  // Min / max are exact, sums only differ by the summation order
+  bool ok = true;
+  for(int i = 0; i < 3; i++)
+  {
+    ok = ok && box.min.data.data[i] == ref.min.data.data[i]
+         && box.max.data.data[i] == ref.max.data.data[i]
+         && fabs(sum.data.data[i] - s[i]) < 1e-6 * double(n)
+         && fabs(double(c.data.data[i]) - s[i] / double(n)) < 1e-5;
+  }
+  ok = ok && geometry::computeAabb(geometry::Vec3SoA<float>()).empty();
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_aabb_reductions() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_aabb_reductions() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_aabb_transform();
+
+  test_aabb_reductions();
+
+  return EXIT_SUCCESS;
+}
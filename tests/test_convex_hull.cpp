@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// Closed two-manifold with Euler characteristic 2, no input point strictly
+// outside a face, vertices matching the input points they come from
+static bool check_hull(const geometry::Vec3SoA<float> &points)
+{
+  geometry::TriMesh mesh;
+  std::vector<uint32_t> ids;
+  if(!geometry::convexHull(points, mesh, &ids))
+    return false;
+
+  const size_t nv = mesh.numVertices(), nf = mesh.numFaces();
+  bool ok = nf >= 4 && ids.size() == nv;
+  for(size_t i = 0; i < nv && ok; i++)
+  {
+    ok = ids[i] < points.size() && mesh.positions.x[i] == points.x[ids[i]]
+         && mesh.positions.y[i] == points.y[ids[i]]
+         && mesh.positions.z[i] == points.z[ids[i]];
+  }
+  if(!ok)
+    return false;
+
+  // Each directed edge once, its opposite once
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  for(size_t f = 0; f < nf; f++)
+  {
+    for(int j = 0; j < 3; j++)
+    {
+      const uint32_t a = mesh.indices[3 * f + j];
+      const uint32_t b = mesh.indices[3 * f + (j + 1) % 3];
+      if(a == b || a >= nv || b >= nv)
+        return false;
+      edges.push_back(std::make_pair(a, b));
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  for(size_t i = 0; i < edges.size(); i++)
+  {
+    if(i > 0 && edges[i] == edges[i - 1])
+      return false;
+    const std::pair<uint32_t, uint32_t> twin(edges[i].second, edges[i].first);
+    if(!std::binary_search(edges.begin(), edges.end(), twin))
+      return false;
+  }
+  const size_t ne = edges.size() / 2;
+  if(int64_t(nv) - int64_t(ne) + int64_t(nf) != 2)
+    return false;
+
+  for(size_t f = 0; f < nf; f++)
+  {
+    const uint32_t *v = &mesh.indices[3 * f];
+    const geometry::Vec3<float> a(
+        mesh.positions.x[v[0]], mesh.positions.y[v[0]], mesh.positions.z[v[0]]);
+    const geometry::Vec3<float> b(
+        mesh.positions.x[v[1]], mesh.positions.y[v[1]], mesh.positions.z[v[1]]);
+    const geometry::Vec3<float> c(
+        mesh.positions.x[v[2]], mesh.positions.y[v[2]], mesh.positions.z[v[2]]);
+    // No point above the face
+    for(size_t i = 0; i < points.size(); i++)
+    {
+      const geometry::Vec3<float> p(points.x[i], points.y[i], points.z[i]);
+      if(geometry::orient3d(a, b, c, p) < 0.0)
+        return false;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_convex_hull()
+{
+  srand(0);
+  bool ok = true;
+
+  // Random points in a cube
+  geometry::Vec3SoA<float> points;
+  for(size_t i = 0; i < 20000; i++)
+  {
+    const float x = _rand_val<float>(), y = _rand_val<float>();
+    points.push_back(x, y, _rand_val<float>());
+  }
+  ok = ok && check_hull(points);
+
+  // Random points on a sphere, nearly all on the hull
+  points.clear();
+  while(points.size() < 2000)
+  {
+    const float x = _rand_val<float>(), y = _rand_val<float>();
+    const float z = _rand_val<float>();
+    const float l = sqrtf(x * x + y * y + z * z);
+    if(l > 0.1f)
+      points.push_back(x / l, y / l, z / l);
+  }
+  ok = ok && check_hull(points);
+
+  // Integer grid : coplanar faces, collinear edges and duplicated points
+  points.clear();
+  for(int i = 0; i < 11; i++)
+    for(int j = 0; j < 11; j++)
+      for(int k = 0; k < 11; k++)
+        points.push_back(float(i), float(j), float(k));
+  for(size_t i = 0; i < 500; i++)
+    points.push_back(points.x[i], points.y[i], points.z[i]);
+  ok = ok && check_hull(points);
+
+  // The eight corners of the grid are hull vertices
+  geometry::TriMesh mesh;
+  std::vector<uint32_t> ids;
+  ok = ok && geometry::convexHull(points, mesh, &ids);
+  size_t corners = 0;
+  for(size_t i = 0; i < mesh.numVertices(); i++)
+  {
+    const float x = mesh.positions.x[i], y = mesh.positions.y[i];
+    const float z = mesh.positions.z[i];
+    corners += (x == 0 || x == 10) && (y == 0 || y == 10)
+               && (z == 0 || z == 10);
+  }
+  ok = ok && corners == 8;
+
+  // A thin slab a few ulps thick
+  points.clear();
+  for(size_t i = 0; i < 1000; i++)
+  {
+    const float x = _rand_val<float>(), y = _rand_val<float>();
+    points.push_back(x, y, i % 2 == 0 ? 1.0f : nextafterf(1.0f, 2.0f));
+  }
+  ok = ok && check_hull(points);
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_convex_hull() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_convex_hull() : success\n");
+}
+
+void test_convex_hull_degenerate()
+{
+  srand(1);
+  bool ok = true;
+  geometry::TriMesh mesh;
+  std::vector<uint32_t> ids;
+
+  // Coplanar points, exactly on z = x / 2 + y / 4 + 1
+  geometry::Vec3SoA<float> points;
+  for(size_t i = 0; i < 1000; i++)
+  {
+    const float x = float(rand() % 4096) / 64.0f;
+    const float y = float(rand() % 4096) / 64.0f;
+    points.push_back(x, y, 0.5f * x + 0.25f * y + 1.0f);
+  }
+  ok = ok && !geometry::convexHull(points, mesh, &ids)
+       && mesh.numFaces() == 0 && mesh.numVertices() == 0 && ids.empty();
+
+  // Collinear, repeated and too few points
+  points.clear();
+  for(size_t i = 0; i < 100; i++)
+    points.push_back(float(i), 2.0f * float(i), -float(i));
+  ok = ok && !geometry::convexHull(points, mesh, &ids) && mesh.numFaces() == 0;
+  points.clear();
+  for(size_t i = 0; i < 100; i++)
+    points.push_back(0.5f, 0.25f, 0.125f);
+  ok = ok && !geometry::convexHull(points, mesh, &ids) && mesh.numFaces() == 0;
+  points.clear();
+  points.push_back(0, 0, 0);
+  points.push_back(1, 0, 0);
+  points.push_back(0, 1, 0);
+  ok = ok && !geometry::convexHull(points, mesh, &ids) && mesh.numFaces() == 0;
+
+  // A fourth point off the plane gives a tetrahedron
+  points.push_back(0, 0, 1);
+  ok = ok && geometry::convexHull(points, mesh, &ids) && mesh.numFaces() == 4
+       && check_hull(points);
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_convex_hull_degenerate() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_convex_hull_degenerate() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_convex_hull();
+
+  test_convex_hull_degenerate();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// Cube [-1, 1]^3, faces counterclockwise seen from outside
+static geometry::TriMesh cube_mesh()
+{
+  geometry::TriMesh mesh;
+  for(int i = 0; i < 8; i++)
+  {
+    mesh.positions.push_back(
+        i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+  }
+  // Two triangles per face, oriented by the face center
+  const int quads[6][4] = {{0, 1, 3, 2}, {4, 5, 7, 6}, {0, 1, 5, 4},
+                           {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 3, 7, 5}};
+  for(int f = 0; f < 6; f++)
+  {
+    const int tris[2][3] = {{quads[f][0], quads[f][1], quads[f][2]},
+                            {quads[f][0], quads[f][2], quads[f][3]}};
+    for(int t = 0; t < 2; t++)
+    {
+      const int *v = tris[t];
+      float u[3], w[3], c[3];
+      for(int k = 0; k < 3; k++)
+      {
+        const float *p[3] = {mesh.positions.x.data(), mesh.positions.y.data(),
+                             mesh.positions.z.data()};
+        u[k] = p[k][v[1]] - p[k][v[0]];
+        w[k] = p[k][v[2]] - p[k][v[0]];
+        c[k] = p[k][v[0]] + p[k][v[1]] + p[k][v[2]];
+      }
+      const float n[3] = {u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2],
+                          u[0] * w[1] - u[1] * w[0]};
+      const bool flip = n[0] * c[0] + n[1] * c[1] + n[2] * c[2] < 0.0f;
+      mesh.indices.push_back(uint32_t(v[0]));
+      mesh.indices.push_back(uint32_t(flip ? v[2] : v[1]));
+      mesh.indices.push_back(uint32_t(flip ? v[1] : v[2]));
+    }
+  }
+  return mesh;
+}
+
+// Exact signed distance to the cube
+static double cube_sdf(const double x, const double y, const double z)
+{
+  const double q[3] = {fabs(x) - 1.0, fabs(y) - 1.0, fabs(z) - 1.0};
+  double out = 0.0, in = q[0];
+  for(int k = 0; k < 3; k++)
+  {
+    out += q[k] > 0.0 ? q[k] * q[k] : 0.0;
+    in = q[k] > in ? q[k] : in;
+  }
+  return sqrt(out) + (in < 0.0 ? in : 0.0);
+}
+
+// -----------------------------------------------------------------------------
+
+void test_distance_field_cube()
+{
+  const geometry::TriMesh mesh = cube_mesh();
+  const float voxel = 0.1f;
+  const geometry::DistanceField field
+      = geometry::DistanceField::fromMesh(mesh, voxel, 0.5f);
+  const geometry::DistanceField unsignedField
+      = geometry::DistanceField::fromMesh(mesh, voxel, 0.5f, false);
+
+  // Samples : right sign, never closer than the surface, close to exact
+  bool ok = field.nx() == 31 && field.ny() == 31 && field.nz() == 31;
+  const float *o = field.origin();
+  for(int z = 0; z < field.nz() && ok; z++)
+  {
+    for(int y = 0; y < field.ny() && ok; y++)
+    {
+      for(int x = 0; x < field.nx() && ok; x++)
+      {
+        const double ref = cube_sdf(
+            double(o[0] + voxel * float(x)), double(o[1] + voxel * float(y)),
+            double(o[2] + voxel * float(z)));
+        const double d = field.value(x, y, z);
+        const double u = unsignedField.value(x, y, z);
+        ok = fabs(d - ref) < 0.1 * voxel && fabs(u - fabs(ref)) < 0.1 * voxel
+             && fabs(d) >= fabs(ref) - 1e-5
+             && (fabs(ref) < 1e-5 || (d < 0.0) == (ref < 0.0));
+      }
+    }
+  }
+
+  // Points where the field is linear around them, with the face normal as
+  // gradient, then a corner and a point clamped to the grid
+  const float points[][3] = {{1.25f, 0.13f, -0.27f}, {-0.37f, -1.33f, 0.41f},
+                             {0.21f, -0.12f, 0.62f}, {-0.03f, 0.77f, 0.08f},
+                             {1.25f, 1.25f, 1.25f},  {5.0f, 0.0f, 0.0f}};
+  const double expected[][4]
+      = {{0.25, 1, 0, 0}, {0.33, 0, -1, 0}, {-0.38, 0, 0, 1},
+         {-0.23, 0, 1, 0}, {sqrt(3.0) * 0.25, 0, 0, 0}, {0.5, 0, 0, 0}};
+  for(int i = 0; i < 6 && ok; i++)
+  {
+    float grad[3];
+    const double d = field.distance(
+        geometry::Vec3<float>(points[i][0], points[i][1], points[i][2]), grad);
+    ok = fabs(d - expected[i][0]) < (i < 4 ? 1e-4 : 1e-2);
+    for(int k = 0; k < 3 && i < 4; k++)
+      ok = ok && fabs(grad[k] - expected[i][k + 1]) < 1e-3;
+  }
+
+  // A negative size is rejected before the grid is allocated
+  bool thrown = false;
+  try
+  {
+    geometry::DistanceField bad(
+        -1, 2, 2, voxel, geometry::Vec3<float>(0.0f, 0.0f, 0.0f));
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_distance_field_cube() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_distance_field_cube() : success\n");
+}
+
+void test_distance_field_gradient()
+{
+  srand(0);
+  const geometry::TriMesh mesh = cube_mesh();
+  const float voxel = 0.1f;
+  const geometry::DistanceField field
+      = geometry::DistanceField::fromMesh(mesh, voxel, 0.5f);
+  const float *o = field.origin();
+
+  geometry::Vec3SoA<float> points;
+  while(points.size() < 2000)
+  {
+    const float p[3]
+        = {1.4f * _rand_val<float>(), 1.4f * _rand_val<float>(),
+           1.4f * _rand_val<float>()};
+    // Away from cell faces, where the interpolant is not differentiable
+    bool inside = true;
+    for(int k = 0; k < 3; k++)
+    {
+      const float c = (p[k] - o[k]) / voxel;
+      const float f = c - floorf(c);
+      inside = inside && f > 0.05f && f < 0.95f;
+    }
+    if(inside)
+      points.push_back(p[0], p[1], p[2]);
+  }
+
+  std::vector<float> dist(points.size()), plain(points.size());
+  geometry::Vec3SoA<float> grads;
+  field.distances(points, dist.data(), grads);
+  field.distances(points, plain.data());
+
+  // Batch against scalar, gradient against central differences
+  bool ok = grads.size() == points.size();
+  const float h = 1e-3f;
+  for(size_t i = 0; i < points.size() && ok; i++)
+  {
+    const float x = points.x[i], y = points.y[i], z = points.z[i];
+    float grad[3];
+    const float d = field.distance(x, y, z, grad);
+    ok = fabsf(d - dist[i]) < 1e-6f && fabsf(d - plain[i]) < 1e-6f
+         && fabsf(grad[0] - grads.x[i]) < 1e-5f
+         && fabsf(grad[1] - grads.y[i]) < 1e-5f
+         && fabsf(grad[2] - grads.z[i]) < 1e-5f;
+
+    const float fd[3] = {
+        field.distance(x + h, y, z) - field.distance(x - h, y, z),
+        field.distance(x, y + h, z) - field.distance(x, y - h, z),
+        field.distance(x, y, z + h) - field.distance(x, y, z - h)};
+    for(int k = 0; k < 3; k++)
+      ok = ok && fabsf(fd[k] / (2.0f * h) - grad[k]) < 2e-3f;
+
+    // Finite differences of a 1-Lipschitz field along each axis
+    for(int k = 0; k < 3; k++)
+      ok = ok && fabsf(grad[k]) < 1.01f;
+  }
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_distance_field_gradient() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_distance_field_gradient() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_distance_field_cube();
+
+  test_distance_field_gradient();
+
+  return EXIT_SUCCESS;
+}
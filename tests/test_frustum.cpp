@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// Clip coordinates of a view space point
+static void clip(const mat4f_t &m, const float *p, float *res)
+{
+  for(int i = 0; i < 4; i++)
+  {
+    res[i] = m.array[i][0] * p[0] + m.array[i][1] * p[1]
+             + m.array[i][2] * p[2] + m.array[i][3];
+  }
+}
+
+// -----------------------------------------------------------------------------
+
+void test_perspective()
+{
+  const float near = 0.5f, far = 20.0f;
+  const mat4f_t m = mat4f_create_perspective(60.0f, 1.5f, near, far);
+  const float f = 1.0f / tanf(float(M_PI) / 6.0f);
+
+  // w = -z : the last row is (0, 0, -1, 0)
+  bool ok = m.array[3][0] == 0.0f && m.array[3][1] == 0.0f
+            && m.array[3][2] == -1.0f && m.array[3][3] == 0.0f
+            && fabsf(m.array[0][0] - f / 1.5f) < 1e-5f
+            && fabsf(m.array[1][1] - f) < 1e-5f;
+
+  // The near and far planes map to z / w = -1 and 1
+  const float pNear[3] = {0.1f, -0.2f, -near};
+  const float pFar[3] = {3.0f, 2.0f, -far};
+  float c[4];
+  clip(m, pNear, c);
+  ok = ok && fabsf(c[3] - near) < 1e-6f && fabsf(c[2] / c[3] + 1.0f) < 1e-5f;
+  clip(m, pFar, c);
+  ok = ok && fabsf(c[3] - far) < 1e-5f && fabsf(c[2] / c[3] - 1.0f) < 1e-5f;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_perspective() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_perspective() : success\n");
+}
+
+void test_frustum_planes()
+{
+  // 90 degrees field of view : the side planes are |x| = -z and |y| = -z
+  geometry::Mat4<float> proj
+      = geometry::Mat4<float>::perspective(90.0f, 1.0f, 1.0f, 10.0f);
+  const geometry::Frustum f = geometry::Frustum::fromMatrix(proj);
+
+  bool ok = true;
+  for(int p = 0; p < 6; p++)
+  {
+    const float len = sqrtf(
+        f.planes[p][0] * f.planes[p][0] + f.planes[p][1] * f.planes[p][1]
+        + f.planes[p][2] * f.planes[p][2]);
+    ok = ok && fabsf(len - 1.0f) < 1e-5f;
+  }
+
+  ok = ok && f.containsPoint(0.0f, 0.0f, -1.5f)
+       && !f.containsPoint(0.0f, 0.0f, -0.5f)
+       && f.containsPoint(0.0f, 0.0f, -9.5f)
+       && !f.containsPoint(0.0f, 0.0f, -10.5f)
+       && f.containsPoint(1.9f, 0.0f, -2.0f)
+       && !f.containsPoint(2.1f, 0.0f, -2.0f)
+       && f.containsPoint(0.0f, -1.9f, -2.0f)
+       && !f.containsPoint(0.0f, -2.1f, -2.0f);
+
+  // Far plane distance, and spheres straddling the near plane
+  ok = ok && fabsf(f.planes[5][3] - 10.0f) < 1e-3f
+       && fabsf(f.planes[5][2] - 1.0f) < 1e-5f
+       && f.testSphere(0.0f, 0.0f, -0.5f, 0.6f)
+       && !f.testSphere(0.0f, 0.0f, -0.5f, 0.4f);
+
+  // With a view matrix the planes are in world space : camera at (0, 0, 5)
+  // looking at the origin
+  geometry::Mat4<float> view = geometry::Mat4<float>::lookAt(
+      geometry::Vec3<float>(0.0f, 0.0f, 5.0f),
+      geometry::Vec3<float>(0.0f, 0.0f, 0.0f),
+      geometry::Vec3<float>(0.0f, 1.0f, 0.0f));
+  const geometry::Frustum fw = geometry::Frustum::fromMatrix(proj * view);
+  ok = ok && fw.containsPoint(0.0f, 0.0f, 0.0f)
+       && !fw.containsPoint(0.0f, 0.0f, 4.5f)
+       && !fw.containsPoint(0.0f, 0.0f, -5.5f)
+       && !fw.containsPoint(6.0f, 0.0f, 0.0f);
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_frustum_planes() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_frustum_planes() : success\n");
+}
+
+void test_frustum_cull()
+{
+  geometry::Mat4<float> proj
+      = geometry::Mat4<float>::perspective(70.0f, 1.3f, 0.5f, 8.0f);
+  const geometry::Frustum f = geometry::Frustum::fromMatrix(proj);
+
+  const size_t n = 1000;
+  std::vector<float> x(n), y(n), z(n), r(n);
+  std::vector<float> minX(n), minY(n), minZ(n), maxX(n), maxY(n), maxZ(n);
+  for(size_t i = 0; i < n; i++)
+  {
+    x[i] = 6.0f * _rand_val<float>();
+    y[i] = 6.0f * _rand_val<float>();
+    z[i] = -4.0f + 6.0f * _rand_val<float>();
+    r[i] = 0.5f + 0.5f * _rand_val<float>();
+    minX[i] = x[i] - r[i];
+    minY[i] = y[i] - 0.5f * r[i];
+    minZ[i] = z[i] - 2.0f * r[i];
+    maxX[i] = x[i] + r[i];
+    maxY[i] = y[i] + 0.5f * r[i];
+    maxZ[i] = z[i] + 2.0f * r[i];
+  }
+
+  std::vector<uint64_t> spheres((n + 63) / 64), boxes((n + 63) / 64);
+  geometry::cullSpheres(f, x.data(), y.data(), z.data(), r.data(), n,
+                        spheres.data());
+  geometry::cullAabbs(
+      f, minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(),
+      maxZ.data(), n, boxes.data());
+
+  size_t visible = 0;
+  for(size_t i = 0; i < n; i++)
+  {
+    const bool s = (spheres[i / 64] >> (i % 64)) & 1;
+    const bool b = (boxes[i / 64] >> (i % 64)) & 1;
+    const float bmin[3] = {minX[i], minY[i], minZ[i]};
+    const float bmax[3] = {maxX[i], maxY[i], maxZ[i]};
+    if(s != f.testSphere(x[i], y[i], z[i], r[i]) || b != f.testAabb(bmin, bmax)
+       || (f.containsPoint(x[i], y[i], z[i]) && !(s && b)))
+    {
+      fprintf(stderr, "test_frustum_cull() : failed\n");
+      return;
+    }
+    visible += s ? 1 : 0;
+  }
+  if(visible == 0 || visible == n)
+  {
+    fprintf(stderr, "test_frustum_cull() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_frustum_cull() : success\n");
+}
+
+int main(int argc, char** argv)
+{
+  test_perspective();
+
+  test_frustum_planes();
+
+  test_frustum_cull();
+
+  return EXIT_SUCCESS;
+}
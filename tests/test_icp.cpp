@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// Samples of the surface z = 0.3 * sin(2 x) * cos(3 y) and its normals
+static void make_surface(
+    const size_t n, geometry::Vec3SoA<float> &points,
+    geometry::Vec3SoA<float> &normals)
+{
+  for(size_t i = 0; i < n; i++)
+  {
+    const float x = _rand_val<float>();
+    const float y = _rand_val<float>();
+    points.push_back(x, y, 0.3f * sinf(2.0f * x) * cosf(3.0f * y));
+    const float nx = -0.6f * cosf(2.0f * x) * cosf(3.0f * y);
+    const float ny = 0.9f * sinf(2.0f * x) * sinf(3.0f * y);
+    const float len = sqrtf(nx * nx + ny * ny + 1.0f);
+    normals.push_back(nx / len, ny / len, 1.0f / len);
+  }
+}
+
+// Rotation of 0.1 rad around (1, 2, 3) and translation (0.05, -0.03, 0.02)
+static geometry::Mat4<float> make_motion()
+{
+  const float xi[6] = {0.05f, -0.03f, 0.02f, 0.0267f, 0.0535f, 0.0802f};
+  return geometry::SE3<float>::exp(xi).toMat4();
+}
+
+// -----------------------------------------------------------------------------
+
+void test_kdtree_knn()
+{
+  geometry::Vec3SoA<float> points;
+  for(size_t i = 0; i < 5000; i++)
+    points.push_back(_rand_val<float>(), _rand_val<float>(), _rand_val<float>());
+  geometry::KdTree tree(points, 8);
+
+  const size_t k = 8;
+  std::vector<float> all(points.size());
+  for(size_t q = 0; q < 200; q++)
+  {
+    const float x = _rand_val<float>();
+    const float y = _rand_val<float>();
+    const float z = _rand_val<float>();
+    for(size_t i = 0; i < points.size(); i++)
+    {
+      const float dx = points.x[i] - x;
+      const float dy = points.y[i] - y;
+      const float dz = points.z[i] - z;
+      all[i] = dx * dx + dy * dy + dz * dz;
+    }
+    std::vector<float> sorted(all);
+    std::sort(sorted.begin(), sorted.end());
+
+    uint32_t ids[k];
+    float dists2[k];
+    const size_t found = tree.knn(x, y, z, k, ids, dists2);
+    float nearest2;
+    const int64_t nearest = tree.nearest(x, y, z, 1.0f, nearest2);
+    bool ok = found == k && nearest >= 0 && nearest2 == sorted[0]
+              && all[nearest] == sorted[0];
+    for(size_t i = 0; ok && i < found; i++)
+      ok = dists2[i] == sorted[i] && all[ids[i]] == sorted[i];
+
+    // Radius limited search, the bound itself being excluded
+    const size_t inRadius = tree.knn(x, y, z, k, ids, dists2, sorted[3]);
+    ok = ok && inRadius == 3;
+    if(!ok)
+    {
+      fprintf(stderr, "test_kdtree_knn() : failed\n");
+      return;
+    }
+  }
+
+  bool thrown = false;
+  try
+  {
+    geometry::KdTree bad(points, 0);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  if(!thrown)
+  {
+    fprintf(stderr, "test_kdtree_knn() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_kdtree_knn() : success\n");
+}
+
+// Both clouds are translated by offset, as scans in world coordinates
+void test_icp(
+    const geometry::IcpMethod method, const char *name, const double offset)
+{
+  geometry::Vec3SoA<float> surface, normals;
+  make_surface(4000, surface, normals);
+
+  // The source is the target moved by the inverse of the motion about the
+  // offset point, which ICP must recover
+  const geometry::Mat4<float> motion = make_motion();
+  double m[3][4];
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 4; j++)
+      m[i][j] = motion.data.array[i][j];
+  geometry::Vec3SoA<float> target(surface.size()), source(surface.size());
+  for(size_t i = 0; i < surface.size(); i++)
+  {
+    const double p[3] = {surface.x[i], surface.y[i], surface.z[i]};
+    double q[3];
+    for(int k = 0; k < 3; k++)
+    {
+      q[k] = offset
+             + (m[0][k] * (p[0] - m[0][3]) + m[1][k] * (p[1] - m[1][3])
+                + m[2][k] * (p[2] - m[2][3]));
+    }
+    target.set(
+        i, float(p[0] + offset), float(p[1] + offset), float(p[2] + offset));
+    source.set(i, float(q[0]), float(q[1]), float(q[2]));
+  }
+
+  geometry::Icp icp(method);
+  icp.setMaxIterations(50);
+  icp.setTarget(target, &normals);
+  const geometry::IcpResult res = icp.align(source);
+
+  // Rounding of the coordinates far from the origin
+  const double ulp = offset * 1.2e-7;
+  bool ok = res.converged && res.rmse < 1e-3 + ulp;
+
+  // Every source point lands where the motion about the offset puts it
+  double maxError = 0.0;
+  for(size_t i = 0; i < source.size(); i++)
+  {
+    const double p[3] = {
+        source.x[i] - offset, source.y[i] - offset, source.z[i] - offset};
+    double error = 0.0;
+    for(int k = 0; k < 3; k++)
+    {
+      const float *e = res.transform.data.array[k];
+      const double found = double(e[0]) * source.x[i]
+                           + double(e[1]) * source.y[i]
+                           + double(e[2]) * source.z[i] + double(e[3]);
+      const double expected
+          = offset + m[k][0] * p[0] + m[k][1] * p[1] + m[k][2] * p[2]
+            + m[k][3];
+      error += (found - expected) * (found - expected);
+    }
+    maxError = std::max(maxError, sqrt(error));
+  }
+  ok = ok && maxError < 1e-3 + ulp;
+  if(!ok)
+  {
+    fprintf(stderr, "%s : failed\n", name);
+    return;
+  }
+
+  fprintf(stdout, "%s : success\n", name);
+}
+
+int main(int argc, char** argv)
+{
+  test_kdtree_knn();
+
+  test_icp(geometry::ICP_POINT_TO_POINT, "test_icp_point_to_point()", 0.0);
+
+  test_icp(geometry::ICP_POINT_TO_PLANE, "test_icp_point_to_plane()", 0.0);
+
+  test_icp(
+      geometry::ICP_POINT_TO_POINT, "test_icp_point_to_point_offset()",
+      5000.0);
+
+  test_icp(
+      geometry::ICP_POINT_TO_PLANE, "test_icp_point_to_plane_offset()",
+      5000.0);
+
+  return EXIT_SUCCESS;
+}
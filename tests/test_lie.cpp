@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// Random rotation vector of a given angle
+static void rand_rotation(const double angle, double *w)
+{
+  double n = 0.0;
+  while(n < 1e-3)
+  {
+    for(int i = 0; i < 3; i++)
+      w[i] = _rand_val<double>();
+    n = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+  }
+  for(int i = 0; i < 3; i++)
+    w[i] *= angle / n;
+}
+
+// Around the series threshold of the double path, and close to pi
+static const double angles[]
+    = {0.0, 1e-9, 0.999e-3, 1.001e-3, 0.05, 0.5, 1.5, 2.5, 3.0, M_PI - 1e-3,
+       M_PI - 1e-6};
+static const int nAngles = int(sizeof(angles) / sizeof(angles[0]));
+
+// -----------------------------------------------------------------------------
+
+void test_lie_exp_log()
+{
+  srand(0);
+  bool ok = true;
+  for(int t = 0; t < 20 * nAngles && ok; t++)
+  {
+    double w[3], v[3];
+    rand_rotation(angles[t % nAngles], w);
+    geometry::SO3<double>::exp(w).log(v);
+    for(int i = 0; i < 3; i++)
+      ok = ok && fabs(v[i] - w[i]) < 1e-6;
+
+    double xi[6], res[6];
+    for(int i = 0; i < 3; i++)
+      xi[i] = 2.0 * _rand_val<double>();
+    rand_rotation(angles[t % nAngles], xi + 3);
+    geometry::SE3<double>::exp(xi).log(res);
+    for(int i = 0; i < 6; i++)
+      ok = ok && fabs(res[i] - xi[i]) < 1e-6 * (1.0 + fabs(xi[i]));
+
+    // Exp of a rotation vector is a rotation
+    const geometry::SO3<double> r = geometry::SO3<double>::exp(w);
+    const geometry::SO3<double> rrt = r * r.inverse();
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++)
+        ok = ok && fabs(rrt.r[i][j] - (i == j ? 1.0 : 0.0)) < 1e-12;
+  }
+
+  // Float path around the series threshold
+  for(int t = 0; t < 100 && ok; t++)
+  {
+    float w[3], v[3];
+    for(int i = 0; i < 3; i++)
+      w[i] = 0.1f * _rand_val<float>();
+    geometry::SO3<float>::exp(w).log(v);
+    for(int i = 0; i < 3; i++)
+      ok = ok && fabsf(v[i] - w[i]) < 1e-5f;
+  }
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_lie_exp_log() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_lie_exp_log() : success\n");
+}
+
+void test_lie_so3_jacobian()
+{
+  srand(1);
+  const double h = 1e-6;
+  bool ok = true;
+  for(int t = 0; t < 5 * nAngles && ok; t++)
+  {
+    double w[3], j[3][3], ji[3][3], p[3][3];
+    rand_rotation(angles[t % nAngles], w);
+    if(angles[t % nAngles] > 3.0)
+      continue;
+    geometry::SO3<double>::leftJacobian(w, j);
+    geometry::SO3<double>::leftJacobianInverse(w, ji);
+
+    // Central differences of log(exp(w + dw) * exp(w)^-1)
+    const geometry::SO3<double> rInv = geometry::SO3<double>::exp(w).inverse();
+    for(int k = 0; k < 3; k++)
+    {
+      double wp[3] = {w[0], w[1], w[2]}, wm[3] = {w[0], w[1], w[2]};
+      wp[k] += h;
+      wm[k] -= h;
+      double dp[3], dm[3];
+      (geometry::SO3<double>::exp(wp) * rInv).log(dp);
+      (geometry::SO3<double>::exp(wm) * rInv).log(dm);
+      for(int i = 0; i < 3; i++)
+        ok = ok && fabs((dp[i] - dm[i]) / (2.0 * h) - j[i][k]) < 1e-6;
+    }
+
+    geometry::lie::mul3(ji, j, p);
+    for(int a = 0; a < 3; a++)
+      for(int b = 0; b < 3; b++)
+        ok = ok && fabs(p[a][b] - (a == b ? 1.0 : 0.0)) < 1e-9;
+  }
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_lie_so3_jacobian() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_lie_so3_jacobian() : success\n");
+}
+
+void test_lie_se3_jacobian()
+{
+  srand(2);
+  const double h = 1e-6;
+  bool ok = true;
+  for(int t = 0; t < 5 * nAngles && ok; t++)
+  {
+    double xi[6], j[6][6], ji[6][6];
+    for(int i = 0; i < 3; i++)
+      xi[i] = 2.0 * _rand_val<double>();
+    rand_rotation(angles[t % nAngles], xi + 3);
+    if(angles[t % nAngles] > 3.0)
+      continue;
+    geometry::SE3<double>::leftJacobian(xi, j);
+    geometry::SE3<double>::leftJacobianInverse(xi, ji);
+
+    // Central differences of log(exp(xi + dxi) * exp(xi)^-1)
+    const geometry::SE3<double> inv = geometry::SE3<double>::exp(xi).inverse();
+    for(int k = 0; k < 6; k++)
+    {
+      double xp[6], xm[6], dp[6], dm[6];
+      for(int i = 0; i < 6; i++)
+        xp[i] = xm[i] = xi[i];
+      xp[k] += h;
+      xm[k] -= h;
+      (geometry::SE3<double>::exp(xp) * inv).log(dp);
+      (geometry::SE3<double>::exp(xm) * inv).log(dm);
+      for(int i = 0; i < 6; i++)
+        ok = ok && fabs((dp[i] - dm[i]) / (2.0 * h) - j[i][k]) < 1e-6;
+    }
+
+    for(int a = 0; a < 6; a++)
+    {
+      for(int b = 0; b < 6; b++)
+      {
+        double s = 0.0;
+        for(int k = 0; k < 6; k++)
+          s += ji[a][k] * j[k][b];
+        ok = ok && fabs(s - (a == b ? 1.0 : 0.0)) < 1e-9;
+      }
+    }
+
+    // T * exp(v) * T^-1 = exp(Ad(T) * v)
+    const geometry::SE3<double> pose = geometry::SE3<double>::exp(xi);
+    double v[6], adv[6], ad[6][6], res[6];
+    for(int i = 0; i < 6; i++)
+      v[i] = 0.3 * _rand_val<double>();
+    pose.adjoint(ad);
+    for(int a = 0; a < 6; a++)
+    {
+      adv[a] = 0.0;
+      for(int b = 0; b < 6; b++)
+        adv[a] += ad[a][b] * v[b];
+    }
+    (pose * geometry::SE3<double>::exp(v) * pose.inverse()).log(res);
+    for(int i = 0; i < 6; i++)
+      ok = ok && fabs(res[i] - adv[i]) < 1e-9;
+  }
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_lie_se3_jacobian() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_lie_se3_jacobian() : success\n");
+}
+
+void test_lie_batch()
+{
+  srand(3);
+  const size_t n = 1001;
+  geometry::TangentSoA<float> xi, logs;
+  xi.resize(n);
+  for(size_t i = 0; i < n; i++)
+  {
+    for(int c = 0; c < 3; c++)
+      xi.v[c][i] = _rand_val<float>();
+    for(int c = 3; c < 6; c++)
+      xi.v[c][i] = (i % 4 == 0 ? 0.01f : 1.5f) * _rand_val<float>();
+  }
+
+  geometry::SE3SoA<float> poses, composed, retracted;
+  geometry::expBatch(xi, poses);
+  geometry::logBatch(poses, logs);
+  geometry::composeBatch(poses, poses, composed);
+  retracted = poses;
+  geometry::retractBatch(xi, retracted);
+
+  bool ok = true;
+  for(size_t i = 0; i < n && ok; i++)
+  {
+    float v[6];
+    for(int c = 0; c < 6; c++)
+      v[c] = xi.v[c][i];
+    const geometry::SE3<float> p = geometry::SE3<float>::exp(v);
+    const geometry::SE3<float> pp = p * p;
+    const geometry::SE3<float> q = poses.get(i);
+    const geometry::SE3<float> qq = composed.get(i);
+    const geometry::SE3<float> qr = retracted.get(i);
+    for(int a = 0; a < 3; a++)
+    {
+      for(int b = 0; b < 3; b++)
+      {
+        ok = ok && fabsf(q.r[a][b] - p.r[a][b]) < 1e-5f
+             && fabsf(qq.r[a][b] - pp.r[a][b]) < 1e-5f
+             && fabsf(qr.r[a][b] - pp.r[a][b]) < 1e-5f;
+      }
+      ok = ok && fabsf(q.t[a] - p.t[a]) < 1e-5f
+           && fabsf(qq.t[a] - pp.t[a]) < 1e-5f
+           && fabsf(qr.t[a] - pp.t[a]) < 1e-5f;
+    }
+    for(int c = 0; c < 6; c++)
+      ok = ok && fabsf(logs.v[c][i] - v[c]) < 1e-4f;
+  }
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_lie_batch() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_lie_batch() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_lie_exp_log();
+
+  test_lie_so3_jacobian();
+
+  test_lie_se3_jacobian();
+
+  test_lie_batch();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <utility>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+// Every directed edge is used once and its reverse once as well
+static bool is_closed(const std::vector<uint32_t> &indices)
+{
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  for(size_t f = 0; f < indices.size() / 3; f++)
+  {
+    for(int i = 0; i < 3; i++)
+    {
+      edges.push_back(
+          std::make_pair(indices[3 * f + i], indices[3 * f + (i + 1) % 3]));
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  for(size_t i = 0; i < edges.size(); i++)
+  {
+    if(edges[i].first == edges[i].second
+       || (i > 0 && edges[i] == edges[i - 1])
+       || !std::binary_search(
+           edges.begin(), edges.end(),
+           std::make_pair(edges[i].second, edges[i].first)))
+      return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_marching_cubes_sphere()
+{
+  const int n = 40;
+  const float voxelSize = 0.05f;
+  const float radius = 0.7f;
+  const geometry::Vec3<float> origin(-1.0f, -1.0f, -1.0f);
+
+  std::vector<float> sdf(n * n * n);
+  for(int z = 0; z < n; z++)
+  {
+    for(int y = 0; y < n; y++)
+    {
+      for(int x = 0; x < n; x++)
+      {
+        const float px = -1.0f + float(x) * voxelSize;
+        const float py = -1.0f + float(y) * voxelSize;
+        const float pz = -1.0f + float(z) * voxelSize;
+        sdf[x + n * (y + n * z)] = sqrtf(px * px + py * py + pz * pz) - radius;
+      }
+    }
+  }
+
+  geometry::Vec3SoA<float> vertices;
+  std::vector<uint32_t> indices;
+  geometry::marchingCubes(
+      sdf.data(), NULL, n, n, n, voxelSize, origin, 0.0f, vertices, indices);
+
+  const size_t nv = vertices.size();
+  const size_t nf = indices.size() / 3;
+  if(nf == 0 || !is_closed(indices) || nv + nf - 3 * nf / 2 != 2)
+  {
+    fprintf(stderr, "test_marching_cubes_sphere() : failed\n");
+    return;
+  }
+
+  for(size_t i = 0; i < nv; i++)
+  {
+    const float r = sqrtf(
+        vertices.x[i] * vertices.x[i] + vertices.y[i] * vertices.y[i]
+        + vertices.z[i] * vertices.z[i]);
+    if(fabsf(r - radius) > 0.01f)
+    {
+      fprintf(stderr, "test_marching_cubes_sphere() : failed\n");
+      return;
+    }
+  }
+
+  // Enclosed volume, whatever the orientation of the faces
+  double volume = 0.0;
+  for(size_t f = 0; f < nf; f++)
+  {
+    const geometry::Vec3<float> a = vertices.get(indices[3 * f]);
+    const geometry::Vec3<float> b = vertices.get(indices[3 * f + 1]);
+    const geometry::Vec3<float> c = vertices.get(indices[3 * f + 2]);
+    volume += geometry::dot(a, geometry::cross(b, c)) / 6.0;
+  }
+  const double expected = 4.0 / 3.0 * M_PI * radius * radius * radius;
+  if(fabs(fabs(volume) - expected) > 0.02 * expected)
+  {
+    fprintf(stderr, "test_marching_cubes_sphere() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_marching_cubes_sphere() : success\n");
+}
+
+int main(int argc, char** argv)
+{
+  test_marching_cubes_sphere();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+static bool close_matrices(
+    const geometry::Mat4SoA &batch, const size_t i, const mat4f_t &ref,
+    const float tol)
+{
+  for(int c = 0; c < 16; c++)
+  {
+    const float v = ref.data[c];
+    if(fabsf(batch.m[c][i] - v) > tol * (1.0f + fabsf(v)))
+      return false;
+  }
+  return true;
+}
+
+// Cameras looking from random positions at random targets, each with an up
+// vector orthogonal to its viewing direction
+static void make_cameras(
+    const size_t n, geometry::Vec3SoA<float> &positions,
+    geometry::Vec3SoA<float> &targets, geometry::Vec3SoA<float> &ups)
+{
+  positions.clear();
+  targets.clear();
+  ups.clear();
+  while(positions.size() < n)
+  {
+    const float p[3] = {10.0f * _rand_val<float>(), 10.0f * _rand_val<float>(),
+                        10.0f * _rand_val<float>()};
+    const float t[3] = {_rand_val<float>(), _rand_val<float>(),
+                        _rand_val<float>()};
+    float u[3] = {_rand_val<float>(), _rand_val<float>(), _rand_val<float>()};
+    float f[3] = {p[0] - t[0], p[1] - t[1], p[2] - t[2]};
+    const float lf = sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+    if(lf < 0.5f)
+      continue;
+    const float d = (u[0] * f[0] + u[1] * f[1] + u[2] * f[2]) / (lf * lf);
+    for(int k = 0; k < 3; k++)
+      u[k] -= d * f[k];
+    const float lu = sqrtf(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+    if(lu < 0.1f)
+      continue;
+    positions.push_back(p[0], p[1], p[2]);
+    targets.push_back(t[0], t[1], t[2]);
+    ups.push_back(u[0] / lu, u[1] / lu, u[2] / lu);
+  }
+}
+
+// -----------------------------------------------------------------------------
+
+void test_look_at_batch()
+{
+  srand(0);
+  bool ok = true;
+  const size_t n = 1000;
+  geometry::Vec3SoA<float> positions, targets, ups;
+  make_cameras(n, positions, targets, ups);
+
+  geometry::Mat4SoA views, poses;
+  geometry::lookAtBatch(positions, targets, ups, views, &poses);
+  ok = views.size() == n && poses.size() == n;
+  for(size_t i = 0; i < n && ok; i++)
+  {
+    const mat4f_t ref = mat4f_lookAt(
+        vec3f_create(positions.x[i], positions.y[i], positions.z[i]),
+        vec3f_create(targets.x[i], targets.y[i], targets.z[i]),
+        vec3f_create(ups.x[i], ups.y[i], ups.z[i]));
+    ok = close_matrices(views, i, ref, 1e-5f);
+
+    // The pose is the inverse of the view, on both sides
+    const mat4f_t view = views.get(i).data;
+    const mat4f_t pose = poses.get(i).data;
+    ok = ok && close_matrices(views, i, mat4f_inverse(pose), 1e-4f);
+    const mat4f_t pv = mat4f_mul(pose, view);
+    const mat4f_t vp = mat4f_mul(view, pose);
+    for(int c = 0; c < 16 && ok; c++)
+    {
+      const float id = c % 5 == 0 ? 1.0f : 0.0f;
+      ok = fabsf(pv.data[c] - id) < 1e-5f && fabsf(vp.data[c] - id) < 1e-5f;
+    }
+  }
+
+  // Shared up vector, orthogonal to cameras looking horizontally
+  for(size_t i = 0; i < n; i++)
+    targets.y[i] = positions.y[i];
+  const geometry::Vec3<float> up(0, 1, 0);
+  geometry::lookAtBatch(positions, targets, up, views);
+  for(size_t i = 0; i < n && ok; i++)
+  {
+    const mat4f_t ref = mat4f_lookAt(
+        vec3f_create(positions.x[i], positions.y[i], positions.z[i]),
+        vec3f_create(targets.x[i], targets.y[i], targets.z[i]), up.data);
+    ok = close_matrices(views, i, ref, 1e-5f);
+  }
+
+  bool thrown = false;
+  try
+  {
+    ups.resize(n - 1);
+    geometry::lookAtBatch(positions, targets, ups, views);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_look_at_batch() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_look_at_batch() : success\n");
+}
+
+void test_view_projection_batch()
+{
+  srand(1);
+  bool ok = true;
+  const size_t n = 1000;
+  geometry::Vec3SoA<float> positions, targets, ups;
+  make_cameras(n, positions, targets, ups);
+
+  std::vector<float> fovy(n), aspect(n), near(n), far(n);
+  for(size_t i = 0; i < n; i++)
+  {
+    fovy[i] = 60.0f + 50.0f * _rand_val<float>();
+    aspect[i] = 1.5f + _rand_val<float>();
+    near[i] = 0.1f + 0.05f * _rand_val<float>();
+    far[i] = 100.0f + 50.0f * _rand_val<float>();
+  }
+
+  geometry::Mat4SoA views, projections, viewProjections;
+  geometry::lookAtBatch(positions, targets, ups, views);
+  geometry::perspectiveBatch(
+      fovy.data(), aspect.data(), near.data(), far.data(), n, projections);
+  geometry::viewProjectionBatch(projections, views, viewProjections);
+  ok = projections.size() == n && viewProjections.size() == n;
+  for(size_t i = 0; i < n && ok; i++)
+  {
+    const mat4f_t proj
+        = mat4f_create_perspective(fovy[i], aspect[i], near[i], far[i]);
+    const mat4f_t vp = mat4f_mul(proj, views.get(i).data);
+    ok = close_matrices(projections, i, proj, 1e-6f)
+         && close_matrices(viewProjections, i, vp, 1e-5f);
+  }
+
+  // The target projects to the center of the image, at the depth of w
+  std::vector<float> x(n * n), y(n * n), z(n * n), w(n * n);
+  geometry::projectViews(
+      viewProjections, targets, x.data(), y.data(), z.data(), w.data());
+  for(size_t i = 0; i < n && ok; i++)
+  {
+    const size_t e = i * n + i;
+    const float dx = positions.x[i] - targets.x[i];
+    const float dy = positions.y[i] - targets.y[i];
+    const float dz = positions.z[i] - targets.z[i];
+    const float dist = sqrtf(dx * dx + dy * dy + dz * dz);
+    ok = fabsf(x[e]) < 1e-4f && fabsf(y[e]) < 1e-4f
+         && fabsf(w[e] - dist) < 1e-4f * dist && z[e] > -1.0f && z[e] < 1.0f;
+  }
+
+  bool thrown = false;
+  try
+  {
+    projections.resize(n + 1);
+    geometry::viewProjectionBatch(projections, views, viewProjections);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_view_projection_batch() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_view_projection_batch() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_look_at_batch();
+
+  test_view_projection_batch();
+
+  return EXIT_SUCCESS;
+}
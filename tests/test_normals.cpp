@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// -----------------------------------------------------------------------------
+
+void test_sym3_eigen()
+{
+  const size_t n = 1000;
+  geometry::Sym3SoA m(n);
+  for(size_t i = 0; i < n; i++)
+  {
+    m.xx[i] = _rand_val<float>();
+    m.xy[i] = _rand_val<float>();
+    m.xz[i] = _rand_val<float>();
+    m.yy[i] = _rand_val<float>();
+    m.yz[i] = _rand_val<float>();
+    m.zz[i] = _rand_val<float>();
+  }
+
+  std::vector<float> l1, l2, l3;
+  geometry::Vec3SoA<float> v;
+  geometry::sym3SmallestEigen(m, l1, l2, l3, v);
+
+  for(size_t i = 0; i < n; i++)
+  {
+    const float x = v.x[i], y = v.y[i], z = v.z[i];
+    const float rx = m.xx[i] * x + m.xy[i] * y + m.xz[i] * z - l3[i] * x;
+    const float ry = m.xy[i] * x + m.yy[i] * y + m.yz[i] * z - l3[i] * y;
+    const float rz = m.xz[i] * x + m.yz[i] * y + m.zz[i] * z - l3[i] * z;
+    if(l1[i] < l2[i] || l2[i] < l3[i]
+       || sqrtf(rx * rx + ry * ry + rz * rz) > 1e-3f
+       || fabsf(x * x + y * y + z * z - 1.0f) > 1e-4f)
+    {
+      fprintf(stderr, "test_sym3_eigen() : failed\n");
+      return;
+    }
+  }
+
+  fprintf(stdout, "test_sym3_eigen() : success\n");
+}
+
+void test_estimate_normals()
+{
+  // Exact samples of the plane x + y + z = 1, seen from the origin
+  geometry::Vec3SoA<float> points;
+  for(size_t i = 0; i < 5000; i++)
+  {
+    const float u = _rand_val<float>();
+    const float v = _rand_val<float>();
+    points.push_back(u, v, 1.0f - u - v);
+  }
+
+  geometry::KdTree tree(points);
+  geometry::Vec3SoA<float> normals;
+  geometry::estimateNormals(
+      points, tree, 10, geometry::Vec3<float>(0, 0, 0), normals);
+
+  const float k = -1.0f / sqrtf(3.0f);
+  for(size_t i = 0; i < normals.size(); i++)
+  {
+    if(fabsf(normals.x[i] - k) > 1e-3f || fabsf(normals.y[i] - k) > 1e-3f
+       || fabsf(normals.z[i] - k) > 1e-3f)
+    {
+      fprintf(stderr, "test_estimate_normals() : failed\n");
+      return;
+    }
+  }
+
+  fprintf(stdout, "test_estimate_normals() : success\n");
+}
+
+int main(int argc, char** argv)
+{
+  test_sym3_eigen();
+
+  test_estimate_normals();
+
+  return EXIT_SUCCESS;
+}
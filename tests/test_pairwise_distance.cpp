@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <limits>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+template <typename T>
+static long double ref_dist2(const T *a, const T *b, const size_t dim)
+{
+  long double s = 0.0L;
+  for(size_t k = 0; k < dim; k++)
+  {
+    const long double d = (long double)(a[k]) - (long double)(b[k]);
+    s += d * d;
+  }
+  return s;
+}
+
+// Rows of a far from b, close to a row of b and equal to a row of b, all
+// around a large offset. Every entry must be within a few sqrt(eps) of the
+// exact distance, and the equal rows at distance zero.
+template <typename T>
+static bool check_distances(const size_t dim)
+{
+  const size_t n = 67, m = 131;
+  std::vector<T> a(n * dim), b(m * dim);
+  for(size_t k = 0; k < m * dim; k++)
+    b[k] = T(100) + _rand_val<T>();
+  for(size_t i = 0; i < n; i++)
+  {
+    const T *src = b.data() + (i % m) * dim;
+    for(size_t k = 0; k < dim; k++)
+    {
+      T v = T(100) + _rand_val<T>();
+      if(i % 3 == 1)
+        v = src[k] + T(1e-3) * _rand_val<T>();
+      else if(i % 3 == 2)
+        v = src[k];
+      a[i * dim + k] = v;
+    }
+  }
+
+  std::vector<T> fast(n * m), exact(n * m), root(n * m);
+  geometry::pairwiseDist2(a.data(), n, b.data(), m, dim, fast.data());
+  geometry::pairwiseDist2(a.data(), n, b.data(), m, dim, exact.data(), true);
+  geometry::pairwiseDist(a.data(), n, b.data(), m, dim, root.data());
+
+  const long double tol = 8.0L * sqrt(std::numeric_limits<T>::epsilon());
+  for(size_t i = 0; i < n; i++)
+  {
+    for(size_t j = 0; j < m; j++)
+    {
+      const T *ra = a.data() + i * dim;
+      const T *rb = b.data() + j * dim;
+      const long double ref = ref_dist2(ra, rb, dim);
+      const size_t e = i * m + j;
+      if(ref == 0.0L)
+      {
+        if(fast[e] != T(0) || exact[e] != T(0) || root[e] != T(0))
+          return false;
+        continue;
+      }
+      if(fabsl(fast[e] - ref) > tol * ref || fabsl(exact[e] - ref) > tol * ref
+         || fabsl(root[e] - sqrtl(ref)) > tol * sqrtl(ref))
+        return false;
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_pairwise_distance()
+{
+  srand(0);
+  bool ok = true;
+  const size_t dims[] = {1, 3, 17, 300, 1000, 4096};
+  const int threads[] = {1, 3};
+  for(int t = 0; t < 2; t++)
+  {
+#ifdef _OPENMP
+    const int nThreads = omp_get_max_threads();
+    omp_set_num_threads(threads[t]);
+#endif
+    for(size_t d = 0; d < sizeof(dims) / sizeof(dims[0]); d++)
+      ok = ok && check_distances<float>(dims[d])
+           && check_distances<double>(dims[d]);
+#ifdef _OPENMP
+    omp_set_num_threads(nThreads);
+#endif
+  }
+
+  // 3D points
+  geometry::Vec3SoA<float> pa, pb;
+  for(size_t i = 0; i < 300; i++)
+  {
+    pa.push_back(_rand_val<float>(), _rand_val<float>(), _rand_val<float>());
+    pb.push_back(_rand_val<float>(), _rand_val<float>(), _rand_val<float>());
+  }
+  pb.resize(1100);
+  std::vector<float> d2(pa.size() * pb.size()), d(pa.size() * pb.size());
+  geometry::pairwiseDist2(pa, pb, d2.data());
+  geometry::pairwiseDist(pa, pb, d.data());
+  for(size_t i = 0; i < pa.size() && ok; i++)
+  {
+    for(size_t j = 0; j < pb.size() && ok; j++)
+    {
+      const float p[3] = {pa.x[i], pa.y[i], pa.z[i]};
+      const float q[3] = {pb.x[j], pb.y[j], pb.z[j]};
+      const double ref = double(ref_dist2(p, q, 3));
+      const size_t e = i * pb.size() + j;
+      ok = fabs(d2[e] - ref) <= 1e-6 * (ref + 1e-6)
+           && fabs(d[e] - sqrt(ref)) <= 1e-6 * (sqrt(ref) + 1e-6);
+    }
+  }
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_pairwise_distance() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_pairwise_distance() : success\n");
+}
+
+void test_cancellation_tolerance()
+{
+  // Below one for any dimension, so that distant pairs are never all
+  // recomputed, and growing with the dimension
+  bool ok = true;
+  float prevF = 0.0f;
+  double prevD = 0.0;
+  for(size_t dim = 1; dim < size_t(1) << 26; dim = dim * 3 / 2 + 1)
+  {
+    const float tf = geometry::pairwise::cancellationTolerance<float>(dim);
+    const double td = geometry::pairwise::cancellationTolerance<double>(dim);
+    ok = ok && tf > 0.0f && tf <= 0.25f && tf >= prevF && td > 0.0
+         && td <= 0.25 && td >= prevD;
+    prevF = tf;
+    prevD = td;
+  }
+  ok = ok && geometry::pairwise::cancellationTolerance<float>(3000) < 0.1f
+       && geometry::pairwise::cancellationTolerance<double>(3000) < 1e-5;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_cancellation_tolerance() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_cancellation_tolerance() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_pairwise_distance();
+
+  test_cancellation_tolerance();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+static const char *tmpPath = "test_pipeline.tmp";
+
+// Source recording the OpenMP team size available to the reader thread
+class ThreadCheckSource : public geometry::PointSource
+{
+public:
+  ThreadCheckSource(const geometry::Vec3SoA<float> &points)
+      : source_(points), maxThreads_(0)
+  {}
+
+  bool read(geometry::PointBlock &block, const size_t maxPoints)
+  {
+    const int n = geometry::parallel::maxThreads();
+    maxThreads_ = n > maxThreads_ ? n : maxThreads_;
+    return source_.read(block, maxPoints);
+  }
+
+  inline int maxThreads() const { return maxThreads_; }
+
+private:
+  geometry::SoASource source_;
+  int maxThreads_;
+};
+
+class ThrowingStage : public geometry::PointStage
+{
+public:
+  void process(geometry::PointBlock &block)
+  {
+    if(block.index == 2)
+      throw std::runtime_error("ThrowingStage");
+  }
+};
+
+// -----------------------------------------------------------------------------
+
+void test_pipeline_transform()
+{
+  srand(0);
+  const size_t n = 10007;
+  geometry::Vec3SoA<float> points(n), normals(n);
+  for(size_t i = 0; i < n; i++)
+  {
+    points.set(i, _rand_val<float>(), _rand_val<float>(), _rand_val<float>());
+    normals.set(i, 0.0f, 0.0f, 1.0f);
+  }
+  const float xi[6] = {0.5f, -1.0f, 2.0f, 0.3f, -0.2f, 0.1f};
+  const geometry::Mat4<float> m = geometry::SE3<float>::exp(xi).toMat4();
+
+  // Whole cloud transformed at once
+  geometry::Vec3SoA<float> refPoints = points, refNormals = normals;
+  geometry::transformPoints(m, refPoints, &refNormals);
+
+  bool ok = true;
+  const int numBuffers[2] = {1, 3};
+  for(int t = 0; t < 2; t++)
+  {
+    geometry::SoASource source(points, &normals);
+    geometry::TransformStage stage(m);
+    geometry::Vec3SoA<float> outPoints, outNormals;
+    geometry::SoASink sink(outPoints, &outNormals);
+
+    geometry::StreamPipeline pipeline(1000, numBuffers[t]);
+    pipeline.setSource(&source);
+    pipeline.addStage(&stage);
+    pipeline.setSink(&sink);
+    ok = ok && pipeline.run() == 11 && outPoints.x == refPoints.x
+         && outPoints.y == refPoints.y && outPoints.z == refPoints.z
+         && outNormals.x == refNormals.x && outNormals.y == refNormals.y
+         && outNormals.z == refNormals.z;
+  }
+
+  // Through a PLY file, and back through a mapped view
+  {
+    geometry::SoASource source(points, &normals);
+    geometry::TransformStage stage(m);
+    geometry::PlySink sink(tmpPath);
+    geometry::StreamPipeline pipeline(4096, 2);
+    pipeline.setSource(&source);
+    pipeline.addStage(&stage);
+    pipeline.setSink(&sink);
+    ok = ok && pipeline.run() == 3;
+  }
+  {
+    geometry::MappedPointCloud cloud;
+    cloud.openPly(tmpPath);
+    geometry::ViewSource source(cloud.view());
+    geometry::Vec3SoA<float> outPoints, outNormals;
+    geometry::SoASink sink(outPoints, &outNormals);
+    geometry::StreamPipeline pipeline(3000, 3);
+    pipeline.setSource(&source);
+    pipeline.setSink(&sink);
+    ok = ok && pipeline.run() == 4 && outPoints.x == refPoints.x
+         && outPoints.z == refPoints.z && outNormals.y == refNormals.y;
+  }
+  remove(tmpPath);
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_pipeline_transform() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_pipeline_transform() : success\n");
+}
+
+void test_pipeline_threads()
+{
+  srand(1);
+  const size_t n = 5000;
+  geometry::Vec3SoA<float> points(n), outPoints;
+  for(size_t i = 0; i < n; i++)
+    points.set(i, _rand_val<float>(), _rand_val<float>(), _rand_val<float>());
+
+  // The reader runs its loops on one thread
+  ThreadCheckSource source(points);
+  geometry::SoASink sink(outPoints);
+  geometry::StreamPipeline pipeline(512, 3);
+  pipeline.setSource(&source);
+  pipeline.setSink(&sink);
+  bool ok = pipeline.run() == 10 && source.maxThreads() == 1
+            && outPoints.x == points.x;
+
+  // Errors of a stage are rethrown by run()
+  geometry::SoASource source2(points);
+  ThrowingStage stage;
+  outPoints.clear();
+  geometry::StreamPipeline pipeline2(512, 1);
+  pipeline2.setSource(&source2);
+  pipeline2.addStage(&stage);
+  pipeline2.setSink(&sink);
+  bool thrown = false;
+  try
+  {
+    pipeline2.run();
+  }
+  catch(const std::runtime_error &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown && outPoints.size() == 2 * 512;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_pipeline_threads() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_pipeline_threads() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_pipeline_transform();
+
+  test_pipeline_threads();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+static const char *tmpPath = "test_point_cloud_io.tmp";
+
+static void write_file(const std::string &content)
+{
+  FILE *fp = fopen(tmpPath, "wb");
+  if(fp == NULL)
+    return;
+  fwrite(content.data(), 1, content.size(), fp);
+  fclose(fp);
+}
+
+static std::string to_bytes(const void *data, const size_t size)
+{
+  return std::string(static_cast<const char *>(data), size);
+}
+
+// True if loading throws a std::runtime_error
+template <typename F>
+static bool throws(F f)
+{
+  try
+  {
+    f();
+  }
+  catch(const std::runtime_error &)
+  {
+    return true;
+  }
+  return false;
+}
+
+static void open_native()
+{
+  geometry::MappedPointCloud cloud;
+  cloud.openNative(tmpPath);
+}
+
+static void open_ply()
+{
+  geometry::MappedPointCloud cloud;
+  cloud.openPly(tmpPath);
+}
+
+// -----------------------------------------------------------------------------
+
+void test_parse_float()
+{
+  const char *valid[] = {"0",
+                         "-0",
+                         "1",
+                         "+2.5",
+                         "-3.25e2",
+                         "1e-3",
+                         ".5",
+                         "5.",
+                         "1.5E+10",
+                         "3.4028235e38",
+                         "1e-40",
+                         "0.1",
+                         "123456789012345678901234",
+                         "0.000000000000000000000123456",
+                         "-9.87654321e-12",
+                         "42abc",
+                         "7e",
+                         "7e+"};
+  // Characters consumed by the parser
+  const size_t lengths[]
+      = {1, 2, 1, 4, 7, 4, 2, 2, 7, 12, 5, 3, 24, 29, 15, 2, 1, 1};
+
+  bool ok = true;
+  for(size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++)
+  {
+    const char *p = valid[i];
+    const char *end = p + strlen(p);
+    float v;
+    const float ref = float(strtod(valid[i], NULL));
+    ok = ok && geometry::io::parseFloat(p, end, v)
+         && size_t(p - valid[i]) == lengths[i]
+         && fabsf(v - ref) <= 1e-6f * fabsf(ref) + 1e-45f;
+  }
+
+  // Nothing to parse : false, p unchanged
+  const char *invalid[] = {"", "abc", "-", ".", "e5", "+.e1"};
+  for(size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+  {
+    const char *p = invalid[i];
+    float v;
+    ok = ok && !geometry::io::parseFloat(p, p + strlen(p), v)
+         && p == invalid[i];
+  }
+
+  // The end of the range is respected
+  const char *s = "12345";
+  const char *p = s;
+  float v;
+  ok = ok && geometry::io::parseFloat(p, s + 3, v) && v == 123.0f
+       && p == s + 3;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_parse_float() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_parse_float() : success\n");
+}
+
+void test_ascii_rows()
+{
+  srand(0);
+
+  // Rows with comments, blank lines, CRLF endings and extra columns, and no
+  // newline at the end of the file
+  const size_t n = 10007;
+  std::vector<float> ref(6 * n);
+  std::string text = "# header comment\n\n";
+  char line[256];
+  for(size_t i = 0; i < n; i++)
+  {
+    for(int c = 0; c < 6; c++)
+      ref[6 * i + c] = 100.0f * _rand_val<float>();
+    snprintf(
+        line, sizeof(line), "%s%.9g %.9g\t%.9g %.9g %.9g %.9g 7%s",
+        i % 7 == 0 ? "  " : "", ref[6 * i], ref[6 * i + 1], ref[6 * i + 2],
+        ref[6 * i + 3], ref[6 * i + 4], ref[6 * i + 5],
+        i % 3 == 0 ? "\r\n" : "\n");
+    text += line;
+    if(i % 100 == 0)
+      text += "# comment\n   \n";
+  }
+  text.resize(text.size() - 1);
+  write_file(text);
+
+  bool ok = true;
+  geometry::Vec3SoA<float> points, normals, firstPoints;
+  const int threads[5] = {1, 2, 3, 8, 13};
+  for(int t = 0; t < 5 && ok; t++)
+  {
+#ifdef _OPENMP
+    const int nThreads = omp_get_max_threads();
+    omp_set_num_threads(threads[t]);
+#endif
+    geometry::loadAsciiXyz(tmpPath, points, &normals);
+#ifdef _OPENMP
+    omp_set_num_threads(nThreads);
+#endif
+
+    ok = points.size() == n && normals.size() == n;
+    for(size_t i = 0; i < n && ok; i++)
+    {
+      const float v[6] = {points.x[i],  points.y[i],  points.z[i],
+                          normals.x[i], normals.y[i], normals.z[i]};
+      for(int c = 0; c < 6; c++)
+      {
+        const float r = ref[6 * i + c];
+        ok = ok && fabsf(v[c] - r) <= 1e-6f * fabsf(r);
+      }
+    }
+
+    // Identical whatever the number of chunks
+    if(t == 0)
+      firstPoints = points;
+    ok = ok && points.x == firstPoints.x && points.y == firstPoints.y
+         && points.z == firstPoints.z;
+  }
+
+  // Fewer rows than chunks, and an empty file
+  write_file("1 2 3\n4 5 6\n");
+  geometry::loadAsciiXyz(tmpPath, points);
+  ok = ok && points.size() == 2 && points.x[1] == 4.0f && points.z[1] == 6.0f;
+  write_file("");
+  geometry::loadAsciiXyz(tmpPath, points);
+  ok = ok && points.empty();
+
+  // Missing column
+  write_file("1 2 3\n4 5\n6 7 8\n");
+  ok = ok && throws([&] { geometry::loadAsciiXyz(tmpPath, points); });
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_ascii_rows() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_ascii_rows() : success\n");
+}
+
+void test_native_round_trip()
+{
+  srand(1);
+  bool ok = true;
+  const size_t sizes[3] = {1001, 16, 0};
+  for(int t = 0; t < 6; t++)
+  {
+    const size_t n = sizes[t % 3];
+    const bool withNormals = t >= 3;
+    geometry::Vec3SoA<float> points(n), normals(n);
+    for(size_t i = 0; i < n; i++)
+    {
+      points.set(i, _rand_val<float>(), _rand_val<float>(), _rand_val<float>());
+      normals.set(
+          i, _rand_val<float>(), _rand_val<float>(), _rand_val<float>());
+    }
+    geometry::writeNative(tmpPath, points, withNormals ? &normals : NULL);
+
+    geometry::MappedPointCloud cloud;
+    cloud.openNative(tmpPath);
+    const geometry::PointView &view = cloud.view();
+    ok = ok && cloud.size() == n && view.contiguous()
+         && view.hasNormals() == withNormals;
+    for(size_t i = 0; i < n && ok; i++)
+    {
+      ok = view.xData()[i] == points.x[i] && view.yData()[i] == points.y[i]
+           && view.zData()[i] == points.z[i];
+      if(withNormals)
+      {
+        ok = ok && view.nxData()[i] == normals.x[i]
+             && view.nyData()[i] == normals.y[i]
+             && view.nzData()[i] == normals.z[i];
+      }
+    }
+
+    // Arrays are 64 byte aligned in the file
+    ok = ok
+         && (size_t(view.yData()) - size_t(view.xData())) % 64 == 0
+         && (size_t(view.zData()) - size_t(view.xData())) % 64 == 0;
+
+    geometry::Vec3SoA<float> copy, copyNormals;
+    view.copyTo(copy, &copyNormals);
+    ok = ok && copy.x == points.x && copy.y == points.y && copy.z == points.z
+         && (!withNormals || copyNormals.z == normals.z);
+  }
+
+  // Truncated file, and a count whose byte size wraps around
+  geometry::io::NativeHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, geometry::io::nativeMagic, sizeof(h.magic));
+  h.count = 10;
+  write_file(to_bytes(&h, sizeof(h)) + std::string(64, '\0'));
+  ok = ok && throws(open_native);
+  h.count = UINT64_C(1) << 62;
+  write_file(to_bytes(&h, sizeof(h)) + std::string(64, '\0'));
+  ok = ok && throws(open_native);
+  write_file("GEOS");
+  ok = ok && throws(open_native);
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_native_round_trip() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_native_round_trip() : success\n");
+}
+
+void test_ply()
+{
+  // Binary, with a fixed size element before the vertices and an extra
+  // property in the vertices
+  const std::string header
+      = "ply\nformat binary_little_endian 1.0\n"
+        "element camera 1\nproperty float fx\nproperty double fy\n"
+        "element vertex 3\nproperty float x\nproperty float y\n"
+        "property float z\nproperty uchar red\nend_header\n";
+  std::string data = header + std::string(12, '\0');
+  for(int i = 0; i < 3; i++)
+  {
+    const float p[3] = {float(i), float(2 * i), float(3 * i)};
+    data += to_bytes(p, sizeof(p)) + std::string(1, char(i));
+  }
+  write_file(data);
+
+  geometry::Vec3SoA<float> points, normals;
+  geometry::loadPly(tmpPath, points, &normals);
+  bool ok = points.size() == 3 && normals.empty() && points.x[2] == 2.0f
+            && points.y[2] == 4.0f && points.z[2] == 6.0f;
+  {
+    geometry::MappedPointCloud cloud;
+    cloud.openPly(tmpPath);
+    ok = ok && cloud.size() == 3 && cloud.view().stride == 13
+         && cloud.view().getZ(1) == 3.0f;
+  }
+
+  // ASCII with normals
+  write_file(
+      "ply\nformat ascii 1.0\nelement vertex 2\nproperty float x\n"
+      "property float y\nproperty float z\nproperty float nx\n"
+      "property float ny\nproperty float nz\nend_header\n"
+      "1 2 3 0 0 1\n4 5 6 0 1 0\n");
+  geometry::loadPly(tmpPath, points, &normals);
+  ok = ok && points.size() == 2 && normals.size() == 2 && points.x[1] == 4.0f
+       && normals.z[0] == 1.0f && normals.y[1] == 1.0f;
+  ok = ok && throws(open_ply);
+
+  // Counts whose byte sizes wrap around, and truncated vertex data
+  write_file(
+      "ply\nformat binary_little_endian 1.0\n"
+      "element camera 4611686018427387904\nproperty float fx\n"
+      "element vertex 1\nproperty float x\nproperty float y\n"
+      "property float z\nend_header\n"
+      + std::string(12, '\0'));
+  ok = ok && throws(open_ply);
+  write_file(
+      "ply\nformat binary_little_endian 1.0\n"
+      "element vertex 1537228672809129302\nproperty float x\n"
+      "property float y\nproperty float z\nend_header\n"
+      + std::string(24, '\0'));
+  ok = ok && throws(open_ply);
+  write_file(header + std::string(30, '\0'));
+  ok = ok && throws(open_ply);
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_ply() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_ply() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_parse_float();
+
+  test_ascii_rows();
+
+  test_native_round_trip();
+
+  test_ply();
+
+  remove(tmpPath);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <vector>
+
+// Degenerate configurations with coordinates chosen so that they are exact in
+// float, then moved by a few ulps. The sign of every perturbed determinant is
+// known from the construction.
+
+// -----------------------------------------------------------------------------
+
+static const int maxSteps = 2;
+
+// v moved by k ulps
+static double step(double v, const int k)
+{
+  for(int i = 0; i < k; i++)
+    v = nextafter(v, HUGE_VAL);
+  for(int i = 0; i > k; i--)
+    v = nextafter(v, -HUGE_VAL);
+  return v;
+}
+
+static float step(float v, const int k)
+{
+  for(int i = 0; i < k; i++)
+    v = nextafterf(v, HUGE_VALF);
+  for(int i = 0; i > k; i--)
+    v = nextafterf(v, -HUGE_VALF);
+  return v;
+}
+
+static int sign_of(const double v) { return v > 0.0 ? 1 : (v < 0.0 ? -1 : 0); }
+
+// Point at center + offset moved by k ulps along the first axis with a non
+// zero offset. Moving away from the center leaves the circle or sphere.
+template <typename T>
+static int perturb_on_sphere(
+    const double *center, const double *offset, const int dim, const int k,
+    T *p)
+{
+  int axis = 0;
+  while(offset[axis] == 0.0)
+    axis++;
+  for(int i = 0; i < dim; i++)
+    p[i] = T(center[i] + offset[i]);
+  p[axis] = step(p[axis], k);
+  return -sign_of(double(k)) * sign_of(offset[axis]);
+}
+
+// -----------------------------------------------------------------------------
+
+void test_orient2d()
+{
+  bool ok = true;
+
+  // Points close to the line y = x : orient2d(p, b, c) = 12 (py - px)
+  const double b[2] = {12.0, 12.0};
+  const double c[2] = {24.0, 24.0};
+  std::vector<float> qx, qy;
+  std::vector<int8_t> expected;
+  for(int i = 0; i < 16; i++)
+  {
+    for(int j = 0; j < 16; j++)
+    {
+      const double p[2] = {step(0.5, i), step(0.5, j)};
+      ok = ok && sign_of(geometry::orient2d(p, b, c)) == sign_of(j - i)
+           && sign_of(geometry::orient2d(b, c, p)) == sign_of(j - i)
+           && sign_of(geometry::orient2d(c, p, b)) == sign_of(j - i);
+
+      qx.push_back(step(0.5f, i));
+      qy.push_back(step(0.5f, j));
+      expected.push_back(int8_t(sign_of(j - i)));
+    }
+  }
+  // Repeated points
+  const double p[2] = {0.1, 0.3};
+  ok = ok && geometry::orient2d(p, p, c) == 0.0
+       && geometry::orient2d(b, c, c) == 0.0;
+
+  // Batch, large enough to run in parallel
+  const size_t base = expected.size();
+  while(expected.size() < 20000)
+  {
+    qx.push_back(qx[expected.size() % base]);
+    qy.push_back(qy[expected.size() % base]);
+    expected.push_back(expected[expected.size() % base]);
+  }
+  std::vector<int8_t> signs(expected.size());
+  geometry::orient2dBatch(b, c, qx.data(), qy.data(), qx.size(), signs.data());
+  ok = ok && signs == expected;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_orient2d() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_orient2d() : success\n");
+}
+
+void test_orient3d()
+{
+  bool ok = true;
+
+  // Plane z = x / 2 + y / 4 + 1, a, b, c counterclockwise seen from above
+  const double a[3] = {0.0, 0.0, 1.0};
+  const double b[3] = {8.0, 0.0, 5.0};
+  const double c[3] = {0.0, 8.0, 3.0};
+  const geometry::Vec3<float> af(0, 0, 1), bf(8, 0, 5), cf(0, 8, 3);
+
+  const double coords[] = {1234.5625, -777.125, 0.0078125, 3.75, 4095.9375};
+  const int nc = int(sizeof(coords) / sizeof(coords[0]));
+  geometry::Vec3SoA<float> queries;
+  std::vector<int8_t> expected;
+  for(int i = 0; i < nc; i++)
+  {
+    for(int j = 0; j < nc; j++)
+    {
+      const double x = coords[i], y = coords[j];
+      const double z = 0.5 * x + 0.25 * y + 1.0;
+      ok = ok && double(float(z)) == z;
+      for(int k = -maxSteps; k <= maxSteps; k++)
+      {
+        // Raising d puts it above the plane, moving it along +x puts it
+        // below
+        const double dz[3] = {x, y, step(z, k)};
+        const double dx[3] = {step(x, k), y, z};
+        ok = ok && sign_of(geometry::orient3d(a, b, c, dz)) == -sign_of(k)
+             && sign_of(geometry::orient3d(b, c, a, dz)) == -sign_of(k)
+             && sign_of(geometry::orient3d(a, b, c, dx)) == sign_of(k);
+
+        const float xf = float(x), yf = float(y), zf = float(z);
+        const geometry::Vec3<float> fz(xf, yf, step(zf, k));
+        const geometry::Vec3<float> fx(step(xf, k), yf, zf);
+        ok = ok && sign_of(geometry::orient3d(af, bf, cf, fz)) == -sign_of(k)
+             && sign_of(geometry::orient3d(af, bf, cf, fx)) == sign_of(k);
+        queries.push_back(xf, yf, step(zf, k));
+        expected.push_back(int8_t(-sign_of(k)));
+        queries.push_back(step(xf, k), yf, zf);
+        expected.push_back(int8_t(sign_of(k)));
+      }
+    }
+  }
+  ok = ok && geometry::orient3d(a, b, b, c) == 0.0;
+
+  const size_t base = expected.size();
+  while(expected.size() < 20000)
+  {
+    const size_t i = expected.size() % base;
+    queries.push_back(queries.x[i], queries.y[i], queries.z[i]);
+    expected.push_back(expected[i]);
+  }
+  std::vector<int8_t> signs(expected.size());
+  geometry::orient3dBatch(af, bf, cf, queries, signs.data());
+  ok = ok && signs == expected;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_orient3d() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_orient3d() : success\n");
+}
+
+void test_incircle()
+{
+  bool ok = true;
+
+  // Circle of radius 65 * 1024 around a center off the float grid of the
+  // offsets, a, b, c counterclockwise
+  const double center[2] = {0.375, -0.625}, r = 1024.0;
+  const double a[2] = {center[0] + 63 * r, center[1] + 16 * r};
+  const double b[2] = {center[0] - 33 * r, center[1] + 56 * r};
+  const double c[2] = {center[0] - 52 * r, center[1] - 39 * r};
+  double offsets[][2] = {{16, 63},  {39, 52},  {-60, 25}, {25, -60},
+                         {56, -33}, {-63, -16}, {0, -65}, {65, 0}};
+  for(size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+    offsets[i][0] *= r, offsets[i][1] *= r;
+
+  std::vector<float> qx, qy;
+  std::vector<int8_t> expected;
+  for(size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+  {
+    for(int k = -maxSteps; k <= maxSteps; k++)
+    {
+      double d[2];
+      const int s = perturb_on_sphere(center, offsets[i], 2, k, d);
+      ok = ok && sign_of(geometry::incircle(a, b, c, d)) == s
+           && sign_of(geometry::incircle(b, c, a, d)) == s
+           && sign_of(geometry::incircle(b, a, c, d)) == -s;
+
+      float f[2];
+      expected.push_back(
+          int8_t(perturb_on_sphere(center, offsets[i], 2, k, f)));
+      qx.push_back(f[0]);
+      qy.push_back(f[1]);
+    }
+  }
+
+  const size_t base = expected.size();
+  while(expected.size() < 20000)
+  {
+    qx.push_back(qx[expected.size() % base]);
+    qy.push_back(qy[expected.size() % base]);
+    expected.push_back(expected[expected.size() % base]);
+  }
+  std::vector<int8_t> signs(expected.size());
+  geometry::incircleBatch(
+      a, b, c, qx.data(), qy.data(), qx.size(), signs.data());
+  ok = ok && signs == expected;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_incircle() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_incircle() : success\n");
+}
+
+void test_insphere()
+{
+  bool ok = true;
+
+  // Sphere of radius 9 * 4096 around a center off the float grid of the
+  // offsets, a, b, c, d positively oriented
+  const double center[3] = {0.375, -0.625, 0.8125}, r = 4096.0;
+  double p[4][3] = {{8, 4, 1}, {-4, 8, 1}, {1, -4, -8}, {-7, -4, -4}};
+  for(int i = 0; i < 4; i++)
+    for(int j = 0; j < 3; j++)
+      p[i][j] = center[j] + r * p[i][j];
+  if(geometry::orient3d(p[0], p[1], p[2], p[3]) < 0.0)
+  {
+    for(int j = 0; j < 3; j++)
+      std::swap(p[0][j], p[1][j]);
+  }
+  geometry::Vec3<float> pf[4];
+  for(int i = 0; i < 4; i++)
+    pf[i] = geometry::Vec3<float>(
+        float(p[i][0]), float(p[i][1]), float(p[i][2]));
+
+  double offsets[][3]
+      = {{4, 7, -4}, {-1, -8, 4}, {4, -4, 7},  {-8, 1, 4}, {7, -4, 4},
+         {-4, -7, -4}, {-1, 4, -8}, {0, 0, 9}, {6, -6, 3}};
+  for(size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+    for(int j = 0; j < 3; j++)
+      offsets[i][j] *= r;
+
+  geometry::Vec3SoA<float> queries;
+  std::vector<int8_t> expected;
+  for(size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+  {
+    for(int k = -maxSteps; k <= maxSteps; k++)
+    {
+      double e[3];
+      const int s = perturb_on_sphere(center, offsets[i], 3, k, e);
+      ok = ok && sign_of(geometry::insphere(p[0], p[1], p[2], p[3], e)) == s
+           && sign_of(geometry::insphere(p[1], p[0], p[3], p[2], e)) == s;
+
+      float f[3];
+      expected.push_back(
+          int8_t(perturb_on_sphere(center, offsets[i], 3, k, f)));
+      const geometry::Vec3<float> ef(f[0], f[1], f[2]);
+      ok = ok
+           && sign_of(geometry::insphere(pf[0], pf[1], pf[2], pf[3], ef))
+                  == expected.back();
+      queries.push_back(f[0], f[1], f[2]);
+    }
+  }
+
+  const size_t base = expected.size();
+  while(expected.size() < 20000)
+  {
+    const size_t i = expected.size() % base;
+    queries.push_back(queries.x[i], queries.y[i], queries.z[i]);
+    expected.push_back(expected[i]);
+  }
+  std::vector<int8_t> signs(expected.size());
+  geometry::insphereBatch(pf[0], pf[1], pf[2], pf[3], queries, signs.data());
+  ok = ok && signs == expected;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_insphere() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_insphere() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_orient2d();
+
+  test_orient3d();
+
+  test_incircle();
+
+  test_insphere();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+static const int width = 80;
+static const int height = 60;
+
+// Camera at (0.1, -0.2, 0.3) rotated by 90 degrees around y
+static geometry::Mat4<float> make_pose()
+{
+  geometry::Mat4<float> ret;
+  ret.data.array[0][2] = 1.0f;
+  ret.data.array[1][1] = 1.0f;
+  ret.data.array[2][0] = -1.0f;
+  ret.data.array[0][3] = 0.1f;
+  ret.data.array[1][3] = -0.2f;
+  ret.data.array[2][3] = 0.3f;
+  ret.data.array[3][3] = 1.0f;
+  return ret;
+}
+
+// Slanted plane in front of the camera, with a few invalid pixels
+static std::vector<float> make_depth()
+{
+  std::vector<float> depth(width * height);
+  for(int v = 0; v < height; v++)
+    for(int u = 0; u < width; u++)
+      depth[v * width + u] = 1.0f + 0.01f * float(u) + 0.005f * float(v);
+  for(int i = 0; i < width * height; i += 7)
+    depth[i] = 0.0f;
+  return depth;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_deproject_project()
+{
+  const geometry::Intrinsics K(60.0f, 60.0f, 40.0f, 30.0f);
+  const geometry::Mat4<float> pose = make_pose();
+  const std::vector<float> depth = make_depth();
+
+  geometry::Vec3SoA<float> points;
+  std::vector<uint32_t> pixels;
+  geometry::deproject(depth.data(), width, height, K, pose, points, &pixels);
+
+  const size_t n = points.size();
+  std::vector<float> u(n), v(n), z(n);
+  geometry::project(points, K, pose, u.data(), v.data(), z.data());
+  for(size_t i = 0; i < n; i++)
+  {
+    const int pu = int(pixels[i] % width);
+    const int pv = int(pixels[i] / width);
+    if(pixels[i] % 7 == 0 || fabsf(u[i] - float(pu)) > 1e-3f
+       || fabsf(v[i] - float(pv)) > 1e-3f
+       || fabsf(z[i] - depth[pixels[i]]) > 1e-5f)
+    {
+      fprintf(stderr, "test_deproject_project() : failed\n");
+      return;
+    }
+  }
+  if(n != size_t(width * height) - (width * height + 6) / 7)
+  {
+    fprintf(stderr, "test_deproject_project() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_deproject_project() : success\n");
+}
+
+void test_splat_depth()
+{
+  const geometry::Intrinsics K(60.0f, 60.0f, 40.0f, 30.0f);
+  const geometry::Mat4<float> pose = make_pose();
+  const std::vector<float> depth = make_depth();
+
+  geometry::Vec3SoA<float> points;
+  geometry::deproject(depth.data(), width, height, K, pose, points);
+
+  // Points further along the same rays are hidden by the plane
+  const size_t n = points.size();
+  for(size_t i = 0; i < n; i++)
+  {
+    points.push_back(
+        0.1f + 2.0f * (points.x[i] - 0.1f),
+        -0.2f + 2.0f * (points.y[i] + 0.2f),
+        0.3f + 2.0f * (points.z[i] - 0.3f));
+  }
+
+  std::vector<float> rendered(width * height);
+  geometry::splatDepth(points, K, pose, width, height, rendered.data());
+  for(int i = 0; i < width * height; i++)
+  {
+    if(fabsf(rendered[i] - depth[i]) > 1e-5f)
+    {
+      fprintf(stderr, "test_splat_depth() : failed\n");
+      return;
+    }
+  }
+
+  fprintf(stdout, "test_splat_depth() : success\n");
+}
+
+int main(int argc, char** argv)
+{
+  test_deproject_project();
+
+  test_splat_depth();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// Value of a binary16 bit pattern, computed independently
+static double half_value(const uint16_t h)
+{
+  const int e = (h >> 10) & 0x1f;
+  const int m = h & 0x3ff;
+  const double s = (h & 0x8000) ? -1.0 : 1.0;
+  if(e == 0)
+    return s * ldexp(double(m), -24);
+  return s * ldexp(double(m + 1024), e - 25);
+}
+
+// Fixed point round trip of random blocks, checked against scale / 2 plus
+// the float rounding of the decoding
+template <typename I>
+static bool check_fixed(const size_t n, const size_t blockSize)
+{
+  geometry::Vec3SoA<float> points(n), decoded;
+  for(size_t i = 0; i < n; i++)
+  {
+    // Extents and offsets differ per axis and per block
+    const float e = float(1 + (i / blockSize) % 7);
+    points.set(
+        i, 0.01f * e * _rand_val<float>() + 100.0f,
+        e * _rand_val<float>() - 3.0f, 1000.0f * e * _rand_val<float>());
+  }
+  // A constant block
+  for(size_t i = 0; i < n && i < blockSize; i++)
+    points.y[i] = 2.5f;
+
+  geometry::FixedPointSoA<I> fixed;
+  geometry::encodeFixed(points, fixed, blockSize);
+  geometry::decodeFixed(fixed, decoded);
+
+  const float *src[3] = {points.x.data(), points.y.data(), points.z.data()};
+  const float *dst[3] = {decoded.x.data(), decoded.y.data(), decoded.z.data()};
+  bool ok = decoded.size() == n
+            && fixed.numBlocks() == (n + blockSize - 1) / blockSize;
+  for(size_t b = 0; b < fixed.numBlocks() && ok; b++)
+  {
+    const size_t begin = b * blockSize;
+    const size_t end = begin + blockSize < n ? begin + blockSize : n;
+    for(int k = 0; k < 3; k++)
+    {
+      float lo = src[k][begin], hi = src[k][begin];
+      for(size_t i = begin; i < end; i++)
+      {
+        lo = fminf(lo, src[k][i]);
+        hi = fmaxf(hi, src[k][i]);
+      }
+      const double qMax = double(std::numeric_limits<I>::max());
+      const double scale = fixed.scale[3 * b + k];
+      ok = ok && fabs(scale - (double(hi) - double(lo)) / (2.0 * qMax))
+                     <= 1e-6 * scale;
+
+      const double slack
+          = 4.0 * FLT_EPSILON * (fabs(double(lo)) + fabs(double(hi)));
+      for(size_t i = begin; i < end; i++)
+      {
+        const double err = fabs(double(dst[k][i]) - double(src[k][i]));
+        ok = ok && err <= 0.5 * scale + slack;
+      }
+    }
+  }
+  return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_half()
+{
+  bool ok = true;
+
+  // Every bit pattern decodes to its value and encodes back to itself, NaNs
+  // staying NaNs with their sign
+  std::vector<float> values(65536);
+  for(uint32_t i = 0; i < 65536 && ok; i++)
+  {
+    const uint16_t h = uint16_t(i);
+    const float f = geometry::quant::floatFromHalf(h);
+    const uint16_t r = geometry::quant::halfFromFloat(f);
+    values[i] = f;
+    const bool nan = (h & 0x7c00) == 0x7c00 && (h & 0x3ff) != 0;
+    const bool inf = (h & 0x7fff) == 0x7c00;
+    if(nan)
+    {
+      ok = f != f && (r & 0x7c00) == 0x7c00 && (r & 0x3ff) != 0
+           && (r & 0x8000) == (h & 0x8000);
+    }
+    else
+    {
+      ok = r == h && signbit(f) == bool(h & 0x8000)
+           && (inf ? isinf(f) : double(f) == half_value(h));
+    }
+  }
+
+  // Ties between consecutive finite halves round to even, anything above
+  // the tie rounds up
+  for(uint32_t i = 0; i < 0x7bff && ok; i++)
+  {
+    const float a = geometry::quant::floatFromHalf(uint16_t(i));
+    const float b = geometry::quant::floatFromHalf(uint16_t(i + 1));
+    const float mid = 0.5f * (a + b);
+    const uint16_t even = uint16_t(i % 2 == 0 ? i : i + 1);
+    ok = geometry::quant::halfFromFloat(mid) == even
+         && geometry::quant::halfFromFloat(nextafterf(mid, b)) == i + 1
+         && geometry::quant::halfFromFloat(-mid) == (even | 0x8000);
+  }
+
+  // Overflow to infinity past the largest half
+  ok = ok && geometry::quant::halfFromFloat(65504.0f) == 0x7bff
+       && geometry::quant::halfFromFloat(65519.99f) == 0x7bff
+       && geometry::quant::halfFromFloat(65520.0f) == 0x7c00
+       && geometry::quant::halfFromFloat(-1e10f) == 0xfc00
+       && geometry::quant::halfFromFloat(1e-10f) == 0;
+
+  // Batch conversions agree with the scalar ones
+  geometry::Vec3SoA<float> points(65536), decoded;
+  for(size_t i = 0; i < 65536; i++)
+    points.set(i, values[i], -values[i], 0.5f * values[i]);
+  geometry::Vec3hSoA half;
+  geometry::encodeHalf(points, half);
+  geometry::decodeHalf(half, decoded);
+  for(size_t i = 0; i < 65536 && ok; i++)
+  {
+    ok = half.x[i] == geometry::quant::halfFromFloat(points.x[i])
+         && half.z[i] == geometry::quant::halfFromFloat(points.z[i])
+         && (decoded.y[i] == points.y[i] || decoded.y[i] != decoded.y[i]);
+  }
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_half() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_half() : success\n");
+}
+
+void test_octahedral()
+{
+  srand(0);
+  geometry::Vec3SoA<float> normals;
+
+  // Axes, octant edges, the equator and random directions
+  const float s = 1.0f / sqrtf(2.0f), t = 1.0f / sqrtf(3.0f);
+  const float special[][3]
+      = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},  {0, -1, 0}, {0, 0, 1},
+         {0, 0, -1}, {s, s, 0},  {-s, 0, -s}, {0, s, -s}, {t, -t, -t},
+         {-t, -t, -t}};
+  for(size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++)
+    normals.push_back(special[i][0], special[i][1], special[i][2]);
+  while(normals.size() < 100000)
+  {
+    float v[3] = {_rand_val<float>(), _rand_val<float>(), _rand_val<float>()};
+    if(normals.size() % 10 == 0)
+      v[2] = 1e-4f * v[2];
+    const float l = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if(l < 1e-3f)
+      continue;
+    normals.push_back(v[0] / l, v[1] / l, v[2] / l);
+  }
+
+  std::vector<uint32_t> codes;
+  geometry::Vec3SoA<float> decoded;
+  geometry::encodeOctahedral(normals, codes);
+  geometry::decodeOctahedral(codes, decoded);
+
+  // Documented bound of 1e-3 radians, unit outputs
+  bool ok = decoded.size() == normals.size();
+  double maxAngle = 0.0;
+  for(size_t i = 0; i < normals.size() && ok; i++)
+  {
+    const double d = double(normals.x[i]) * decoded.x[i]
+                     + double(normals.y[i]) * decoded.y[i]
+                     + double(normals.z[i]) * decoded.z[i];
+    const double c = double(normals.y[i]) * decoded.z[i]
+                     - double(normals.z[i]) * decoded.y[i];
+    const double e = double(normals.z[i]) * decoded.x[i]
+                     - double(normals.x[i]) * decoded.z[i];
+    const double f = double(normals.x[i]) * decoded.y[i]
+                     - double(normals.y[i]) * decoded.x[i];
+    const double angle = atan2(sqrt(c * c + e * e + f * f), d);
+    maxAngle = angle > maxAngle ? angle : maxAngle;
+    const double len2 = double(decoded.x[i]) * decoded.x[i]
+                        + double(decoded.y[i]) * decoded.y[i]
+                        + double(decoded.z[i]) * decoded.z[i];
+    ok = fabs(len2 - 1.0) < 1e-6
+         && codes[i]
+                == geometry::quant::octEncode(
+                    normals.x[i], normals.y[i], normals.z[i]);
+  }
+  ok = ok && maxAngle < 1e-3;
+
+  // The zero vector decodes as +z
+  float x, y, z;
+  geometry::quant::octDecode(geometry::quant::octEncode(0, 0, 0), x, y, z);
+  ok = ok && x == 0.0f && y == 0.0f && z == 1.0f;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_octahedral() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_octahedral() : success\n");
+}
+
+void test_fixed_point()
+{
+  srand(1);
+  bool ok = check_fixed<int16_t>(10000, 1024) && check_fixed<int16_t>(100, 7)
+            && check_fixed<int32_t>(10000, 1024)
+            && check_fixed<int32_t>(3000, 3000);
+
+  bool thrown = false;
+  try
+  {
+    geometry::FixedPointSoA<int16_t> fixed;
+    geometry::encodeFixed(geometry::Vec3SoA<float>(10), fixed, 0);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_fixed_point() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_fixed_point() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_half();
+
+  test_octahedral();
+
+  test_fixed_point();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+static void add_outliers(geometry::Vec3SoA<float> &points, const size_t n)
+{
+  for(size_t i = 0; i < n; i++)
+    points.push_back(_rand_val<float>(), _rand_val<float>(), _rand_val<float>());
+}
+
+// Noisy samples of the plane z = 0.2 x - 0.1 y + 0.5 and uniform outliers
+static geometry::Vec3SoA<float> make_plane()
+{
+  geometry::Vec3SoA<float> points;
+  for(size_t i = 0; i < 2000; i++)
+  {
+    const float x = _rand_val<float>();
+    const float y = _rand_val<float>();
+    points.push_back(
+        x, y, 0.2f * x - 0.1f * y + 0.5f + 0.005f * _rand_val<float>());
+  }
+  add_outliers(points, 1000);
+  return points;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_ransac_plane()
+{
+  const geometry::Vec3SoA<float> points = make_plane();
+  geometry::Ransac<geometry::PlaneModel> ransac(0.02f);
+  const geometry::RansacResult<geometry::PlaneModel> res = ransac.fit(points);
+
+  // Expected plane (-0.2, 0.1, 1) . p - 0.5 = 0, normalized
+  const float len = sqrtf(0.04f + 0.01f + 1.0f);
+  const float s = res.model.n[2] < 0.0f ? -1.0f : 1.0f;
+  if(!res.found || res.inlierCount < 1900
+     || fabsf(s * res.model.n[0] + 0.2f / len) > 5e-3f
+     || fabsf(s * res.model.n[1] - 0.1f / len) > 5e-3f
+     || fabsf(s * res.model.n[2] - 1.0f / len) > 5e-3f
+     || fabsf(s * res.model.d + 0.5f / len) > 5e-3f)
+  {
+    fprintf(stderr, "test_ransac_plane() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_ransac_plane() : success\n");
+}
+
+void test_ransac_sphere()
+{
+  geometry::Vec3SoA<float> points;
+  for(size_t i = 0; i < 2000; i++)
+  {
+    float d[3] = {_rand_val<float>(), _rand_val<float>(), _rand_val<float>()};
+    const float len = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    if(!(len > 1e-3f))
+      continue;
+    const float r = 0.8f + 0.005f * _rand_val<float>();
+    points.push_back(
+        0.3f + r * d[0] / len, -0.2f + r * d[1] / len, 0.1f + r * d[2] / len);
+  }
+  add_outliers(points, 500);
+
+  geometry::Ransac<geometry::SphereModel> ransac(0.02f);
+  geometry::SphereModel prototype;
+  prototype.maxRadius = 2.0f;
+  ransac.setPrototype(prototype);
+  const geometry::RansacResult<geometry::SphereModel> res = ransac.fit(points);
+
+  // The refined model is much closer than the threshold
+  if(!res.found || fabsf(res.model.c[0] - 0.3f) > 2e-3f
+     || fabsf(res.model.c[1] + 0.2f) > 2e-3f
+     || fabsf(res.model.c[2] - 0.1f) > 2e-3f
+     || fabsf(res.model.r - 0.8f) > 2e-3f)
+  {
+    fprintf(stderr, "test_ransac_sphere() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_ransac_sphere() : success\n");
+}
+
+void test_ransac_cylinder()
+{
+  // Axis (1, 1, 0) / sqrt(2) through (0, 0, 0.2), radius 0.5
+  const float k = 1.0f / sqrtf(2.0f);
+  const float a[3] = {k, k, 0.0f};
+  const float u[3] = {k, -k, 0.0f};
+  const float v[3] = {0.0f, 0.0f, 1.0f};
+  geometry::Vec3SoA<float> points, normals;
+  for(size_t i = 0; i < 2000; i++)
+  {
+    const float t = _rand_val<float>();
+    const float theta = 3.14159265f * _rand_val<float>();
+    const float r = 0.5f + 0.003f * _rand_val<float>();
+    const float c = cosf(theta), s = sinf(theta);
+    points.push_back(
+        t * a[0] + r * (c * u[0] + s * v[0]),
+        t * a[1] + r * (c * u[1] + s * v[1]),
+        0.2f + t * a[2] + r * (c * u[2] + s * v[2]));
+    normals.push_back(
+        c * u[0] + s * v[0], c * u[1] + s * v[1], c * u[2] + s * v[2]);
+  }
+
+  geometry::Ransac<geometry::CylinderModel> ransac(0.01f);
+  const geometry::RansacResult<geometry::CylinderModel> res
+      = ransac.fit(points, &normals);
+
+  const geometry::CylinderModel &m = res.model;
+  const float dot = m.a[0] * a[0] + m.a[1] * a[1] + m.a[2] * a[2];
+  if(!res.found || fabsf(fabsf(dot) - 1.0f) > 1e-4f
+     || m.axisDistance(0.0f, 0.0f, 0.2f) > 2e-3f
+     || fabsf(m.r - 0.5f) > 2e-3f || res.inlierCount < 1950)
+  {
+    fprintf(stderr, "test_ransac_cylinder() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_ransac_cylinder() : success\n");
+}
+
+void test_ransac_threads()
+{
+#ifdef _OPENMP
+  const geometry::Vec3SoA<float> points = make_plane();
+  geometry::Ransac<geometry::PlaneModel> ransac(0.02f, 5000, 0.999999);
+  const int nThreads = omp_get_max_threads();
+
+  omp_set_num_threads(1);
+  const geometry::RansacResult<geometry::PlaneModel> a = ransac.fit(points);
+  omp_set_num_threads(5);
+  const geometry::RansacResult<geometry::PlaneModel> b = ransac.fit(points);
+  omp_set_num_threads(nThreads);
+
+  if(a.iterations != b.iterations || a.inlierCount != b.inlierCount
+     || a.model.n[0] != b.model.n[0] || a.model.n[1] != b.model.n[1]
+     || a.model.n[2] != b.model.n[2] || a.model.d != b.model.d)
+  {
+    fprintf(stderr, "test_ransac_threads() : failed\n");
+    return;
+  }
+#endif
+
+  fprintf(stdout, "test_ransac_threads() : success\n");
+}
+
+int main(int argc, char** argv)
+{
+  test_ransac_plane();
+
+  test_ransac_sphere();
+
+  test_ransac_cylinder();
+
+  test_ransac_threads();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+static inline float bits_to_float(const uint32_t bits)
+{
+  float v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+static inline uint32_t float_to_bits(const float v)
+{
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+
+// Slowly varying sequence, as in a pose log, with a few special values
+template <typename T>
+static void make_items(const size_t count, std::vector<T> &items)
+{
+  const int nc = geometry::io::SerialTraits<T>::components;
+  items.resize(count);
+  float c[16];
+  for(int k = 0; k < nc; k++)
+    c[k] = _rand_val<float>();
+  for(size_t i = 0; i < count; i++)
+  {
+    for(int k = 0; k < nc; k++)
+      c[k] += 1e-3f * _rand_val<float>();
+    float v[16];
+    memcpy(v, c, sizeof(v));
+    if(i % 1000 == 1)
+    {
+      v[0] = bits_to_float(0x7fc00001u); // NaN with a payload
+      v[nc - 1] = -0.0f;
+    }
+    if(i % 1000 == 2)
+    {
+      v[0] = -INFINITY;
+      v[nc - 1] = bits_to_float(1u); // Smallest denormal
+    }
+    geometry::io::SerialTraits<T>::store(v, items[i]);
+  }
+}
+
+// Bitwise equality of the decoded items
+template <typename T>
+static bool same_items(const std::vector<T> &a, const T *b, const size_t n)
+{
+  const int nc = geometry::io::SerialTraits<T>::components;
+  for(size_t i = 0; i < n; i++)
+  {
+    float x[16], y[16];
+    geometry::io::SerialTraits<T>::load(a[i], x);
+    geometry::io::SerialTraits<T>::load(b[i], y);
+    if(memcmp(x, y, size_t(nc) * sizeof(float)) != 0)
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+static bool check_round_trip()
+{
+  const size_t counts[5] = {0, 1, 100, 4097, 20011};
+  bool ok = true;
+  for(int c = 0; c < 5; c++)
+  {
+    for(int delta = 0; delta < 2; delta++)
+    {
+      std::vector<T> items;
+      make_items(counts[c], items);
+      const uint32_t flags = delta ? uint32_t(geometry::SERIAL_DELTA) : 0;
+
+      // Two records back to back
+      std::vector<uint8_t> buf;
+      geometry::encodeBinary(items.data(), items.size(), buf, flags);
+      const size_t first = buf.size();
+      geometry::encodeBinary(items.data(), items.size() / 2, buf, flags);
+
+      std::vector<T> out;
+      const size_t n0 = geometry::decodeBinary(buf.data(), buf.size(), out);
+      const size_t n1 = geometry::decodeBinary(
+          buf.data() + n0, buf.size() - n0, out);
+      ok = ok && n0 == first && n0 + n1 == buf.size()
+           && out.size() == items.size() + items.size() / 2
+           && same_items(out, items.data(), items.size())
+           && same_items(
+               std::vector<T>(out.begin() + items.size(), out.end()),
+               items.data(), items.size() / 2);
+    }
+  }
+  return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_serialize_binary()
+{
+  srand(0);
+  bool ok = true;
+
+  // Large delta records take the parallel XOR scan, whose result must not
+  // depend on the number of chunks
+  const int threads[2] = {1, 3};
+  for(int t = 0; t < 2; t++)
+  {
+#ifdef _OPENMP
+    const int nThreads = omp_get_max_threads();
+    omp_set_num_threads(threads[t]);
+#endif
+    ok = ok && check_round_trip<geometry::Vec3<float>>()
+         && check_round_trip<geometry::Vec4<float>>()
+         && check_round_trip<geometry::RigidTransform>()
+         && check_round_trip<geometry::Mat4<float>>();
+#ifdef _OPENMP
+    omp_set_num_threads(nThreads);
+#endif
+  }
+
+  // Delta encoding stores the XOR with the previous element
+  std::vector<geometry::Vec3<float>> items;
+  make_items(10, items);
+  std::vector<uint8_t> buf;
+  geometry::encodeBinary(items.data(), 10, buf, geometry::SERIAL_DELTA);
+  uint32_t w;
+  memcpy(&w, buf.data() + geometry::io::serialHeaderSize + 12, sizeof(w));
+  ok = ok
+       && w
+              == (float_to_bits(items[1].data.data[0])
+                  ^ float_to_bits(items[0].data.data[0]));
+
+  // An empty delta record holds no payload to decode
+  std::vector<uint8_t> empty;
+  geometry::encodeBinary(items.data(), 0, empty, geometry::SERIAL_DELTA);
+  std::vector<geometry::Vec3<float>> none;
+  ok = ok && geometry::decodeBinary(empty.data(), empty.size(), none)
+                 == geometry::io::serialHeaderSize
+       && none.empty();
+
+  // Malformed records
+  std::vector<geometry::Vec4<float>> quats;
+  std::vector<geometry::Vec3<float>> out;
+  bool thrown[4] = {false, false, false, false};
+  try
+  {
+    geometry::decodeBinary(buf.data(), buf.size() - 1, out);
+  }
+  catch(const std::runtime_error &)
+  {
+    thrown[0] = true;
+  }
+  try
+  {
+    geometry::decodeBinary(buf.data(), buf.size(), quats);
+  }
+  catch(const std::runtime_error &)
+  {
+    thrown[1] = true;
+  }
+  std::vector<uint8_t> bad = buf;
+  geometry::io::storeU64(bad.data() + 16, UINT64_C(1) << 62);
+  try
+  {
+    geometry::decodeBinary(bad.data(), bad.size(), out);
+  }
+  catch(const std::runtime_error &)
+  {
+    thrown[2] = true;
+  }
+  bad[0] = 'X';
+  try
+  {
+    geometry::decodeBinary(bad.data(), bad.size(), out);
+  }
+  catch(const std::runtime_error &)
+  {
+    thrown[3] = true;
+  }
+  ok = ok && thrown[0] && thrown[1] && thrown[2] && thrown[3];
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_serialize_binary() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_serialize_binary() : success\n");
+}
+
+void test_format_float()
+{
+  srand(1);
+
+  // Every output must read back to the same float
+  std::vector<float> values;
+  const float special[] = {0.0f,        -0.0f,    1.0f,    -1.0f,
+                           0.1f,        0.3f,     1e-5f,   1.5e-5f,
+                           9.99e-6f,    1e-6f,    2.5e-7f, 999999.9f,
+                           12345678.0f, 1e8f,     1e9f,    123456789.0f,
+                           16777216.0f, FLT_MAX,  -FLT_MAX, FLT_MIN,
+                           3.0e-39f,    1e-45f};
+  values.assign(special, special + sizeof(special) / sizeof(special[0]));
+  for(int i = 0; i < 200000; i++)
+  {
+    const uint32_t bits = (uint32_t(rand()) << 16) ^ uint32_t(rand());
+    const float v = bits_to_float(bits);
+    if(v == v && v - v == 0.0f)
+      values.push_back(v);
+  }
+
+  bool ok = true;
+  for(size_t i = 0; i < values.size() && ok; i++)
+  {
+    char buf[32];
+    char *end = geometry::io::formatFloat(buf, values[i]);
+    *end = '\0';
+    const float r = strtof(buf, NULL);
+    ok = end - buf <= 16 && float_to_bits(r) == float_to_bits(values[i]);
+    if(!ok)
+      fprintf(stderr, "formatFloat(%.9g) = %s\n", double(values[i]), buf);
+  }
+
+  // Text lines parse back to the same elements
+  std::vector<geometry::Vec3<float>> items(3000);
+  for(size_t i = 0; i < items.size(); i++)
+  {
+    const float c[3]
+        = {1e3f * _rand_val<float>(), _rand_val<float>(),
+           1e-3f * _rand_val<float>()};
+    geometry::io::SerialTraits<geometry::Vec3<float>>::store(c, items[i]);
+  }
+  std::string text;
+  geometry::formatText(items.data(), items.size(), text);
+  const char *p = text.c_str();
+  for(size_t i = 0; i < items.size() && ok; i++)
+  {
+    for(int k = 0; k < 3; k++)
+    {
+      char *next;
+      const float v = strtof(p, &next);
+      ok = ok && next != p && v == items[i].data.data[k]
+           && *next == (k < 2 ? ' ' : '\n');
+      p = next + 1;
+    }
+  }
+  ok = ok && *p == '\0';
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_format_float() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_format_float() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_serialize_binary();
+
+  test_format_float();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// Torus of n x m quads split in two triangles, outward facing
+static void make_torus(
+    const int n, const int m, geometry::Vec3SoA<float> &vertices,
+    std::vector<uint32_t> &indices)
+{
+  vertices.clear();
+  indices.clear();
+  for(int i = 0; i < n; i++)
+  {
+    const float u = 2.0f * float(M_PI) * float(i) / float(n);
+    for(int j = 0; j < m; j++)
+    {
+      const float v = 2.0f * float(M_PI) * float(j) / float(m);
+      vertices.push_back(
+          (2.0f + 0.7f * cosf(v)) * cosf(u), (2.0f + 0.7f * cosf(v)) * sinf(u),
+          0.7f * sinf(v));
+    }
+  }
+  for(int i = 0; i < n; i++)
+  {
+    for(int j = 0; j < m; j++)
+    {
+      const uint32_t a = uint32_t(i * m + j);
+      const uint32_t b = uint32_t(((i + 1) % n) * m + j);
+      const uint32_t c = uint32_t(((i + 1) % n) * m + (j + 1) % m);
+      const uint32_t d = uint32_t(i * m + (j + 1) % m);
+      const uint32_t t[6] = {a, b, c, a, c, d};
+      indices.insert(indices.end(), t, t + 6);
+    }
+  }
+}
+
+// Flat n x n grid in the z = 0 plane with some noise in the plane
+static void make_grid(
+    const int n, geometry::Vec3SoA<float> &vertices,
+    std::vector<uint32_t> &indices)
+{
+  vertices.clear();
+  indices.clear();
+  for(int i = 0; i <= n; i++)
+  {
+    for(int j = 0; j <= n; j++)
+    {
+      const bool border = i == 0 || j == 0 || i == n || j == n;
+      const float e = border ? 0.0f : 0.2f;
+      vertices.push_back(
+          float(i) + e * _rand_val<float>(), float(j) + e * _rand_val<float>(),
+          0.0f);
+    }
+  }
+  for(int i = 0; i < n; i++)
+  {
+    for(int j = 0; j < n; j++)
+    {
+      const uint32_t a = uint32_t(i * (n + 1) + j);
+      const uint32_t b = a + uint32_t(n + 1);
+      const uint32_t t[6] = {a, b, b + 1, a, b + 1, a + 1};
+      indices.insert(indices.end(), t, t + 6);
+    }
+  }
+}
+
+// Manifold check : no degenerate face, every directed edge used at most
+// once, and for closed meshes also in the opposite direction. Returns the
+// Euler characteristic, or -100 if the mesh is not manifold.
+static int euler_characteristic(
+    const size_t nv, const std::vector<uint32_t> &indices, const bool closed)
+{
+  std::vector<uint64_t> edges;
+  for(size_t f = 0; f < indices.size() / 3; f++)
+  {
+    const uint32_t *t = &indices[3 * f];
+    if(t[0] == t[1] || t[1] == t[2] || t[2] == t[0])
+      return -100;
+    for(int k = 0; k < 3; k++)
+      edges.push_back((uint64_t(t[k]) << 32) | t[(k + 1) % 3]);
+  }
+  std::sort(edges.begin(), edges.end());
+  if(std::adjacent_find(edges.begin(), edges.end()) != edges.end())
+    return -100;
+
+  size_t undirected = 0;
+  for(size_t i = 0; i < edges.size(); i++)
+  {
+    const uint64_t a = edges[i] >> 32, b = edges[i] & 0xffffffff;
+    const bool twin
+        = std::binary_search(edges.begin(), edges.end(), (b << 32) | a);
+    if(closed && !twin)
+      return -100;
+    undirected += twin ? (a < b ? 1 : 0) : 1;
+  }
+  return int(nv) - int(undirected) + int(indices.size() / 3);
+}
+
+// -----------------------------------------------------------------------------
+
+void test_simplify_closed()
+{
+  // Every edge collapse of a tetrahedron breaks the link condition
+  float tx[4] = {0, 1, 0, 0}, ty[4] = {0, 0, 1, 0}, tz[4] = {0, 0, 0, 1};
+  const uint32_t tf[12] = {0, 2, 1, 0, 1, 3, 0, 3, 2, 1, 2, 3};
+  geometry::Vec3SoA<float> vertices;
+  for(int i = 0; i < 4; i++)
+    vertices.push_back(tx[i], ty[i], tz[i]);
+  std::vector<uint32_t> indices(tf, tf + 12);
+  bool ok = geometry::simplify(vertices, indices, 0) == 4
+            && vertices.size() == 4
+            && std::equal(indices.begin(), indices.end(), tf);
+
+  // A torus keeps its genus, however low the target. Its smallest
+  // triangulation has 14 faces.
+  const size_t targets[3] = {1000, 100, 0};
+  for(int t = 0; t < 3; t++)
+  {
+    make_torus(40, 20, vertices, indices);
+    const size_t nf = geometry::simplify(vertices, indices, targets[t]);
+    ok = ok && nf == indices.size() / 3 && nf <= (targets[t] > 14 ? targets[t] : 20)
+         && euler_characteristic(vertices.size(), indices, true) == 0;
+  }
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_simplify_closed() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_simplify_closed() : success\n");
+}
+
+void test_simplify_open()
+{
+  srand(0);
+  geometry::Vec3SoA<float> vertices;
+  std::vector<uint32_t> indices;
+  make_grid(30, vertices, indices);
+  const size_t nf = geometry::simplify(vertices, indices, 50);
+
+  // Still a disk in the plane, with its corners
+  bool ok = nf == indices.size() / 3 && nf <= 50
+            && euler_characteristic(vertices.size(), indices, false) == 1;
+  int corners = 0;
+  for(size_t i = 0; i < vertices.size(); i++)
+  {
+    ok = ok && fabsf(vertices.z[i]) < 1e-4f;
+    const bool cx = fabsf(vertices.x[i]) < 1e-3f
+                    || fabsf(vertices.x[i] - 30.0f) < 1e-3f;
+    const bool cy = fabsf(vertices.y[i]) < 1e-3f
+                    || fabsf(vertices.y[i] - 30.0f) < 1e-3f;
+    corners += cx && cy ? 1 : 0;
+  }
+  ok = ok && corners == 4;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_simplify_open() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_simplify_open() : success\n");
+}
+
+void test_simplify_untouched()
+{
+  srand(1);
+  geometry::Vec3SoA<float> vertices;
+  std::vector<uint32_t> indices;
+  make_grid(10, vertices, indices);
+
+  // An unreferenced vertex is kept when nothing is collapsed
+  vertices.push_back(5.0f, 5.0f, 5.0f);
+  const geometry::Vec3SoA<float> v0 = vertices;
+  const std::vector<uint32_t> i0 = indices;
+  bool ok = geometry::simplify(vertices, indices, i0.size() / 3) == 200
+            && vertices.x == v0.x && vertices.y == v0.y && vertices.z == v0.z
+            && indices == i0;
+
+  bool thrown = false;
+  indices.push_back(0);
+  try
+  {
+    geometry::simplify(vertices, indices, 0);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  thrown = false;
+  indices.push_back(1);
+  indices.push_back(uint32_t(vertices.size()));
+  try
+  {
+    geometry::simplify(vertices, indices, 0);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_simplify_untouched() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_simplify_untouched() : success\n");
+}
+
+void test_simplify_regions()
+{
+  // Large enough for the regional pass, whose output does not depend on the
+  // number of threads
+  geometry::Vec3SoA<float> vertices[2];
+  std::vector<uint32_t> indices[2];
+  bool ok = true;
+  const int threads[] = {1, 3};
+  for(int t = 0; t < 2; t++)
+  {
+#ifdef _OPENMP
+    const int nThreads = omp_get_max_threads();
+    omp_set_num_threads(threads[t]);
+#endif
+    make_torus(400, 200, vertices[t], indices[t]);
+    const size_t nf = geometry::simplify(vertices[t], indices[t], 4000);
+    ok = ok && nf == indices[t].size() / 3 && nf <= 4000
+         && euler_characteristic(vertices[t].size(), indices[t], true) == 0;
+#ifdef _OPENMP
+    omp_set_num_threads(nThreads);
+#endif
+  }
+  ok = ok && vertices[0].x == vertices[1].x && vertices[0].y == vertices[1].y
+       && vertices[0].z == vertices[1].z && indices[0] == indices[1];
+
+  // The boundary constraints of edges between regions keep the corners
+  srand(2);
+  geometry::Vec3SoA<float> grid;
+  std::vector<uint32_t> gridIndices;
+  make_grid(300, grid, gridIndices);
+  const size_t nf = geometry::simplify(grid, gridIndices, 2000);
+  ok = ok && nf == gridIndices.size() / 3 && nf <= 2000
+       && euler_characteristic(grid.size(), gridIndices, false) == 1;
+  int corners = 0;
+  for(size_t i = 0; i < grid.size(); i++)
+  {
+    ok = ok && fabsf(grid.z[i]) < 1e-4f;
+    const bool cx
+        = fabsf(grid.x[i]) < 1e-3f || fabsf(grid.x[i] - 300.0f) < 1e-3f;
+    const bool cy
+        = fabsf(grid.y[i]) < 1e-3f || fabsf(grid.y[i] - 300.0f) < 1e-3f;
+    corners += cx && cy ? 1 : 0;
+  }
+  ok = ok && corners == 4;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_simplify_regions() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_simplify_regions() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_simplify_closed();
+
+  test_simplify_open();
+
+  test_simplify_untouched();
+
+  test_simplify_regions();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+static geometry::Mat4<float>
+make_pose(const float r[3][3], const float tx, const float ty, const float tz)
+{
+  geometry::Mat4<float> m;
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      m.data.array[i][j] = r[i][j];
+  m.data.array[0][3] = tx;
+  m.data.array[1][3] = ty;
+  m.data.array[2][3] = tz;
+  m.data.array[3][3] = 1.0f;
+  return m;
+}
+
+static bool near3(
+    const geometry::Vec3SoA<float> &v, const size_t i, const float x,
+    const float y, const float z)
+{
+  return fabsf(v.x[i] - x) < 1e-5f && fabsf(v.y[i] - y) < 1e-5f
+         && fabsf(v.z[i] - z) < 1e-5f;
+}
+
+// Two bones : a root at the origin, and a child bound at (0, 1, 0) and
+// posed with a rotation of 90 degrees around z at its joint.
+static void make_skeleton(
+    std::vector<int32_t> &parents, std::vector<geometry::Mat4<float>> &local,
+    std::vector<geometry::Mat4<float>> &inverseBind)
+{
+  const float id[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  const float rz[3][3] = {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}};
+  parents.resize(2);
+  parents[0] = -1;
+  parents[1] = 0;
+  local.resize(2);
+  local[0] = make_pose(id, 0.0f, 0.0f, 0.0f);
+  local[1] = make_pose(rz, 0.0f, 1.0f, 0.0f);
+  inverseBind.resize(2);
+  inverseBind[0] = make_pose(id, 0.0f, 0.0f, 0.0f);
+  inverseBind[1] = make_pose(id, 0.0f, -1.0f, 0.0f);
+}
+
+// Vertices : on the child bone, at the joint, and next to the joint with
+// the weight split between the bones
+static void make_mesh(
+    geometry::Vec3SoA<float> &points, geometry::Vec3SoA<float> &normals,
+    geometry::SkinWeights &weights)
+{
+  points.clear();
+  points.push_back(0.0f, 2.0f, 0.0f);
+  points.push_back(0.0f, 1.0f, 0.0f);
+  points.push_back(1.0f, 1.0f, 0.0f);
+  normals.clear();
+  normals.push_back(1.0f, 0.0f, 0.0f);
+  normals.push_back(0.0f, 0.0f, 1.0f);
+  normals.push_back(1.0f, 0.0f, 0.0f);
+
+  // Third influence unused
+  weights.resize(3, 3);
+  weights.set(0, 0, 1, 1.0f);
+  weights.set(1, 0, 0, 0.5f);
+  weights.set(1, 1, 1, 0.5f);
+  weights.set(2, 0, 0, 0.5f);
+  weights.set(2, 1, 1, 0.5f);
+}
+
+// -----------------------------------------------------------------------------
+
+void test_skinning_palette()
+{
+  std::vector<int32_t> parents;
+  std::vector<geometry::Mat4<float>> local, inverseBind, palette, treePalette;
+  make_skeleton(parents, local, inverseBind);
+  geometry::computeSkinningPalette(parents, local, inverseBind, palette);
+
+  // Rz90 * T(0, -1, 0) followed by T(0, 1, 0) : translation (1, 1, 0)
+  const float rz[3][3] = {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}};
+  const geometry::Mat4<float> ref = make_pose(rz, 1.0f, 1.0f, 0.0f);
+  bool ok = palette.size() == 2
+            && memcmp(&palette[1].data, &ref.data, sizeof(mat4f_t)) == 0;
+
+  // Same palette from a transform tree
+  geometry::TransformTree tree;
+  std::vector<int32_t> nodes(2);
+  nodes[0] = tree.addNode(-1, local[0]);
+  nodes[1] = tree.addNode(nodes[0], local[1]);
+  geometry::computeSkinningPalette(tree, nodes, inverseBind, treePalette);
+  for(size_t b = 0; b < 2; b++)
+  {
+    ok = ok
+         && memcmp(&palette[b].data, &treePalette[b].data, sizeof(mat4f_t))
+                == 0;
+  }
+
+  // Children must come after their parents
+  bool thrown = false;
+  parents[0] = 1;
+  parents[1] = -1;
+  try
+  {
+    geometry::computeSkinningPalette(parents, local, inverseBind, palette);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_skinning_palette() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_skinning_palette() : success\n");
+}
+
+void test_linear_blend_skinning()
+{
+  std::vector<int32_t> parents;
+  std::vector<geometry::Mat4<float>> local, inverseBind, palette;
+  make_skeleton(parents, local, inverseBind);
+  geometry::computeSkinningPalette(parents, local, inverseBind, palette);
+
+  geometry::Vec3SoA<float> points, normals, outPoints, outNormals;
+  geometry::SkinWeights weights;
+  make_mesh(points, normals, weights);
+  geometry::linearBlendSkinning(
+      points, &normals, weights, palette, outPoints, &outNormals);
+
+  // The blended vertex is the average of (1, 1, 0) and (0, 2, 0), closer to
+  // the joint than in the rest pose. Its normal goes through the blended
+  // matrix 0.5 * (I + Rz90) and is renormalized.
+  const float s = 0.5f * sqrtf(2.0f);
+  bool ok = near3(outPoints, 0, -1.0f, 1.0f, 0.0f)
+            && near3(outPoints, 1, 0.0f, 1.0f, 0.0f)
+            && near3(outPoints, 2, 0.5f, 1.5f, 0.0f)
+            && near3(outNormals, 0, 0.0f, 1.0f, 0.0f)
+            && near3(outNormals, 1, 0.0f, 0.0f, 1.0f)
+            && near3(outNormals, 2, s, s, 0.0f);
+
+  // Bone indices are checked
+  bool thrown = false;
+  weights.set(1, 2, 2, 0.0f);
+  try
+  {
+    geometry::linearBlendSkinning(points, NULL, weights, palette, outPoints);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_linear_blend_skinning() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_linear_blend_skinning() : success\n");
+}
+
+void test_dual_quaternion_skinning()
+{
+  std::vector<int32_t> parents;
+  std::vector<geometry::Mat4<float>> local, inverseBind, palette;
+  make_skeleton(parents, local, inverseBind);
+  geometry::computeSkinningPalette(parents, local, inverseBind, palette);
+
+  geometry::Vec3SoA<float> points, normals, outPoints, outNormals;
+  geometry::SkinWeights weights;
+  make_mesh(points, normals, weights);
+  geometry::dualQuaternionSkinning(
+      points, &normals, weights, palette, outPoints, &outNormals);
+
+  // The blended vertex is rotated by 45 degrees around the joint, and keeps
+  // its distance to it
+  const float s = 0.5f * sqrtf(2.0f);
+  bool ok = near3(outPoints, 0, -1.0f, 1.0f, 0.0f)
+            && near3(outPoints, 1, 0.0f, 1.0f, 0.0f)
+            && near3(outPoints, 2, s, 1.0f + s, 0.0f)
+            && near3(outNormals, 0, 0.0f, 1.0f, 0.0f)
+            && near3(outNormals, 1, 0.0f, 0.0f, 1.0f)
+            && near3(outNormals, 2, s, s, 0.0f);
+
+  // Vertices without any influence are rejected
+  bool thrown = false;
+  weights.resize(points.size(), 0);
+  try
+  {
+    geometry::dualQuaternionSkinning(
+        points, NULL, weights, palette, outPoints);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_dual_quaternion_skinning() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_dual_quaternion_skinning() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_skinning_palette();
+
+  test_linear_blend_skinning();
+
+  test_dual_quaternion_skinning();
+
+  return EXIT_SUCCESS;
+}
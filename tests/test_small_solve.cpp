@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// a = m * m^T + shift * I, positive definite for shift > 0 and indefinite
+// for a negative shift of the order of its eigenvalues
+template <int N, typename T>
+static void rand_symmetric(T a[N][N], const T shift)
+{
+  T m[N][N];
+  for(int i = 0; i < N; i++)
+    for(int j = 0; j < N; j++)
+      m[i][j] = _rand_val<T>();
+  for(int i = 0; i < N; i++)
+  {
+    for(int j = 0; j < N; j++)
+    {
+      T s = i == j ? shift : T(0);
+      for(int k = 0; k < N; k++)
+        s += m[i][k] * m[j][k];
+      a[i][j] = s;
+    }
+  }
+}
+
+template <int N, typename T>
+static void mul(const T a[N][N], const T *x, T *b)
+{
+  for(int i = 0; i < N; i++)
+  {
+    b[i] = T(0);
+    for(int j = 0; j < N; j++)
+      b[i] += a[i][j] * x[j];
+  }
+}
+
+template <int N, typename T>
+static T max_error(const T *x, const T *ref)
+{
+  T ret = T(0);
+  for(int i = 0; i < N; i++)
+    ret = fabs(x[i] - ref[i]) > ret ? fabs(x[i] - ref[i]) : ret;
+  return ret;
+}
+
+// Solves a random system with a known solution with the three solvers
+template <int N>
+static bool check_known_solution()
+{
+  bool ok = true;
+  for(int t = 0; t < 100 && ok; t++)
+  {
+    double a[N][N], tmp[N][N], x[N], b[N], res[N];
+    for(int i = 0; i < N; i++)
+      x[i] = _rand_val<double>();
+
+    // Positive definite : all three solvers
+    rand_symmetric<N, double>(a, 0.5);
+    mul<N, double>(a, x, b);
+    memcpy(tmp, a, sizeof(a));
+    ok = ok && geometry::solveCholesky<N, double>(tmp, b, res)
+         && max_error<N, double>(res, x) < 1e-9;
+    memcpy(tmp, a, sizeof(a));
+    ok = ok && geometry::solveLdlt<N, double>(tmp, b, res)
+         && max_error<N, double>(res, x) < 1e-9;
+    memcpy(tmp, a, sizeof(a));
+    ok = ok && geometry::solveQr<N, double>(tmp, b, res)
+         && max_error<N, double>(res, x) < 1e-9;
+
+    // General matrix with a dominant diagonal : QR only
+    for(int i = 0; i < N; i++)
+      for(int j = 0; j < N; j++)
+        a[i][j] = _rand_val<double>() + (i == j ? double(N) : 0.0);
+    mul<N, double>(a, x, b);
+    memcpy(tmp, a, sizeof(a));
+    ok = ok && geometry::solveQr<N, double>(tmp, b, res)
+         && max_error<N, double>(res, x) < 1e-9;
+  }
+  return ok;
+}
+
+// Solution of system s in a batch output, against a scalar solution
+template <int N>
+static bool same_solution(
+    const std::vector<float> &xb, const float *x, const size_t s,
+    const size_t count)
+{
+  for(int i = 0; i < N; i++)
+  {
+    if(fabsf(xb[size_t(i) * count + s] - x[i]) > 1e-4f * (1.0f + fabsf(x[i])))
+      return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_small_solve()
+{
+  srand(0);
+  bool ok = check_known_solution<3>() && check_known_solution<6>()
+            && check_known_solution<7>();
+
+  // Hand computed 3x3 system
+  double a[3][3] = {{4, 2, 0}, {2, 5, 1}, {0, 1, 3}};
+  const double b[3] = {8, 15, 11};
+  const double ref[3] = {1, 2, 3};
+  double x[3];
+  ok = ok && geometry::solveCholesky<3, double>(a, b, x)
+       && max_error<3, double>(x, ref) < 1e-12;
+
+  // x may alias b
+  double y[3] = {8, 15, 11};
+  double a2[3][3] = {{4, 2, 0}, {2, 5, 1}, {0, 1, 3}};
+  ok = ok && geometry::solveQr<3, double>(a2, y, y)
+       && max_error<3, double>(y, ref) < 1e-12;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_small_solve() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_small_solve() : success\n");
+}
+
+void test_small_solve_failures()
+{
+  srand(1);
+  bool ok = true;
+
+  // Indefinite : Cholesky fails, LDLT still solves it
+  for(int t = 0; t < 100 && ok; t++)
+  {
+    double a[6][6], tmp[6][6], x[6], b[6], res[6];
+    rand_symmetric<6, double>(a, 0.0);
+    for(int i = 0; i < 6; i++)
+      a[i][i] -= i < 3 ? 20.0 : 0.0;
+    for(int i = 0; i < 6; i++)
+      x[i] = _rand_val<double>();
+    mul<6, double>(a, x, b);
+    memcpy(tmp, a, sizeof(a));
+    ok = ok && !geometry::solveCholesky<6, double>(tmp, b, res);
+    memcpy(tmp, a, sizeof(a));
+    ok = ok && geometry::solveLdlt<6, double>(tmp, b, res)
+         && max_error<6, double>(res, x) < 1e-8;
+  }
+
+  const double b[3] = {1, 2, 3};
+  double x[3];
+
+  // Semi definite, zero and negative matrices are rejected by Cholesky
+  double psd[3][3] = {{1, 1, 0}, {1, 1, 0}, {0, 0, 1}};
+  double zero[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+  double neg[3][3] = {{-1, 0, 0}, {0, 2, 0}, {0, 0, 3}};
+  ok = ok && !geometry::solveCholesky<3, double>(psd, b, x)
+       && !geometry::solveCholesky<3, double>(zero, b, x)
+       && !geometry::solveCholesky<3, double>(neg, b, x);
+
+  // Vanishing pivot for LDLT, rank deficient matrix for QR
+  double pivot[3][3] = {{0, 1, 0}, {1, 0, 0}, {0, 0, 1}};
+  double rank2[3][3] = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+  double zero2[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+  ok = ok && !geometry::solveLdlt<3, double>(pivot, b, x)
+       && !geometry::solveQr<3, double>(rank2, b, x)
+       && !geometry::solveQr<3, double>(zero2, b, x);
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_small_solve_failures() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_small_solve_failures() : success\n");
+}
+
+void test_small_solve_batch()
+{
+  srand(2);
+  const int N = 6;
+  const size_t count = 1001;
+  std::vector<float> a(N * N * count), b(N * count);
+  std::vector<float> xc(N * count), xl(N * count), xq(N * count);
+  std::vector<uint8_t> okc(count), okl(count), okq(count);
+
+  // Every fifth system is indefinite
+  for(size_t s = 0; s < count; s++)
+  {
+    float m[N][N];
+    rand_symmetric<N, float>(m, s % 5 == 0 ? -4.0f : 1.0f);
+    for(int i = 0; i < N; i++)
+    {
+      for(int j = 0; j < N; j++)
+        a[size_t(i * N + j) * count + s] = m[i][j];
+      b[size_t(i) * count + s] = _rand_val<float>();
+    }
+  }
+
+  geometry::solveCholeskyBatch<N, float>(
+      a.data(), b.data(), xc.data(), okc.data(), count);
+  geometry::solveLdltBatch<N, float>(
+      a.data(), b.data(), xl.data(), okl.data(), count);
+  geometry::solveQrBatch<N, float>(
+      a.data(), b.data(), xq.data(), okq.data(), count);
+
+  // Same results as the scalar solvers
+  bool ok = true;
+  size_t nFailed = 0;
+  for(size_t s = 0; s < count && ok; s++)
+  {
+    float m[N][N], tmp[N][N], v[N], x[N];
+    for(int i = 0; i < N; i++)
+    {
+      for(int j = 0; j < N; j++)
+        m[i][j] = a[size_t(i * N + j) * count + s];
+      v[i] = b[size_t(i) * count + s];
+    }
+
+    memcpy(tmp, m, sizeof(m));
+    const bool c = geometry::solveCholesky<N, float>(tmp, v, x);
+    ok = ok && c == (okc[s] != 0);
+    ok = ok && (!c || same_solution<N>(xc, x, s, count));
+    nFailed += c ? 0 : 1;
+
+    memcpy(tmp, m, sizeof(m));
+    const bool l = geometry::solveLdlt<N, float>(tmp, v, x);
+    ok = ok && l == (okl[s] != 0);
+    ok = ok && (!l || same_solution<N>(xl, x, s, count));
+
+    memcpy(tmp, m, sizeof(m));
+    const bool q = geometry::solveQr<N, float>(tmp, v, x);
+    ok = ok && q == (okq[s] != 0);
+    ok = ok && (!q || same_solution<N>(xq, x, s, count));
+  }
+  ok = ok && nFailed >= count / 5;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_small_solve_batch() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_small_solve_batch() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_small_solve();
+
+  test_small_solve_failures();
+
+  test_small_solve_batch();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+static bool pair_less(const geometry::BodyPair &p, const geometry::BodyPair &q)
+{
+  return p.a < q.a || (p.a == q.a && p.b < q.b);
+}
+
+// Coordinates on a 1/64 grid, so that many boxes exactly touch
+static float snap(const float v) { return floorf(64.0f * v) / 64.0f; }
+
+static void make_boxes(
+    const geometry::Vec3SoA<float> &centers, const float stretchZ,
+    geometry::Vec3SoA<float> &boxMin, geometry::Vec3SoA<float> &boxMax)
+{
+  const size_t n = centers.size();
+  boxMin.resize(n);
+  boxMax.resize(n);
+  for(size_t i = 0; i < n; i++)
+  {
+    const float h = 0.25f + 0.125f * float(i % 5);
+    const float x = centers.x[i], y = centers.y[i];
+    const float z = stretchZ * centers.z[i];
+    boxMin.set(i, snap(x - h), snap(y - h), snap(z - h));
+    boxMax.set(i, snap(x + h), snap(y + h), snap(z + h));
+  }
+}
+
+static std::vector<geometry::BodyPair> brute_force(
+    const geometry::Vec3SoA<float> &boxMin,
+    const geometry::Vec3SoA<float> &boxMax)
+{
+  std::vector<geometry::BodyPair> pairs;
+  for(size_t i = 0; i < boxMin.size(); i++)
+  {
+    for(size_t j = i + 1; j < boxMin.size(); j++)
+    {
+      if(boxMin.x[i] <= boxMax.x[j] && boxMin.x[j] <= boxMax.x[i]
+         && boxMin.y[i] <= boxMax.y[j] && boxMin.y[j] <= boxMax.y[i]
+         && boxMin.z[i] <= boxMax.z[j] && boxMin.z[j] <= boxMax.z[i])
+      {
+        geometry::BodyPair p;
+        p.a = uint32_t(i);
+        p.b = uint32_t(j);
+        pairs.push_back(p);
+      }
+    }
+  }
+  return pairs;
+}
+
+// Same pairs as the brute force, each once
+static bool check_frame(
+    geometry::SweepAndPrune &sap, const geometry::Vec3SoA<float> &boxMin,
+    const geometry::Vec3SoA<float> &boxMax)
+{
+  std::vector<geometry::BodyPair> pairs;
+  sap.update(boxMin, boxMax, pairs);
+  std::sort(pairs.begin(), pairs.end(), pair_less);
+  const std::vector<geometry::BodyPair> ref = brute_force(boxMin, boxMax);
+  if(pairs.size() != ref.size() || ref.empty())
+    return false;
+  for(size_t i = 0; i < ref.size(); i++)
+    if(pairs[i].a != ref[i].a || pairs[i].b != ref[i].b)
+      return false;
+  return sap.size() == boxMin.size();
+}
+
+static bool check_frames(const bool multiAxis)
+{
+  srand(0);
+  const size_t n = 3000;
+  geometry::Vec3SoA<float> centers, boxMin, boxMax;
+  for(size_t i = 0; i < n; i++)
+  {
+    centers.push_back(
+        20.0f * _rand_val<float>(), 20.0f * _rand_val<float>(),
+        5.0f * _rand_val<float>());
+  }
+
+  geometry::SweepAndPrune sap(multiAxis);
+  bool ok = sap.axis() == -1;
+  make_boxes(centers, 1.0f, boxMin, boxMax);
+  ok = ok && check_frame(sap, boxMin, boxMax);
+  const int firstAxis = sap.axis();
+  ok = ok && (firstAxis == 0 || firstAxis == 1);
+
+  // Small motions, repaired by the insertion sort
+  for(int frame = 0; frame < 5 && ok; frame++)
+  {
+    for(size_t i = 0; i < n; i++)
+    {
+      centers.set(
+          i, centers.x[i] + 0.05f * _rand_val<float>(),
+          centers.y[i] + 0.05f * _rand_val<float>(),
+          centers.z[i] + 0.05f * _rand_val<float>());
+    }
+    make_boxes(centers, 1.0f, boxMin, boxMax);
+    ok = ok && check_frame(sap, boxMin, boxMax);
+  }
+
+  // Bodies teleported at random : too many moves, full sort
+  for(size_t i = n - 1; i > 0; i--)
+  {
+    const size_t j = size_t(rand()) % (i + 1);
+    const float x = centers.x[i], y = centers.y[i], z = centers.z[i];
+    centers.set(i, centers.x[j], centers.y[j], centers.z[j]);
+    centers.set(j, x, y, z);
+  }
+  make_boxes(centers, 1.0f, boxMin, boxMax);
+  ok = ok && check_frame(sap, boxMin, boxMax);
+  make_boxes(centers, 1.0f, boxMin, boxMax);
+  ok = ok && check_frame(sap, boxMin, boxMax);
+
+  // Spread along z : only the multi axis mode switches its sweep axis
+  make_boxes(centers, 20.0f, boxMin, boxMax);
+  ok = ok && check_frame(sap, boxMin, boxMax)
+       && sap.axis() == (multiAxis ? 2 : firstAxis);
+  make_boxes(centers, 1.0f, boxMin, boxMax);
+  ok = ok && check_frame(sap, boxMin, boxMax);
+
+  // Fewer bodies, then a reset
+  centers.resize(n - 100);
+  make_boxes(centers, 1.0f, boxMin, boxMax);
+  ok = ok && check_frame(sap, boxMin, boxMax);
+  sap.reset();
+  ok = ok && sap.axis() == -1 && sap.size() == 0
+       && check_frame(sap, boxMin, boxMax);
+  return ok;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_sweep_and_prune()
+{
+  bool ok = true;
+  const int threads[] = {1, 3};
+  for(int t = 0; t < 2; t++)
+  {
+#ifdef _OPENMP
+    const int nThreads = omp_get_max_threads();
+    omp_set_num_threads(threads[t]);
+#endif
+    ok = ok && check_frames(true) && check_frames(false);
+#ifdef _OPENMP
+    omp_set_num_threads(nThreads);
+#endif
+  }
+
+  // Fewer than two bodies and mismatched sizes
+  geometry::SweepAndPrune sap;
+  geometry::Vec3SoA<float> boxMin(1), boxMax(1);
+  std::vector<geometry::BodyPair> pairs(3);
+  sap.update(boxMin, boxMax, pairs);
+  ok = ok && pairs.empty();
+  bool thrown = false;
+  try
+  {
+    boxMax.resize(2);
+    sap.update(boxMin, boxMax, pairs);
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_sweep_and_prune() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_sweep_and_prune() : success\n");
+}
+
+void test_insertion_sort()
+{
+  srand(1);
+  bool ok = true;
+
+  // Sorted, stable, and a permutation when it gives up
+  const size_t n = 1000;
+  for(int pass = 0; pass < 2; pass++)
+  {
+    std::vector<float> keys(n);
+    std::vector<uint32_t> ids(n);
+    for(size_t i = 0; i < n; i++)
+    {
+      keys[i] = float(rand() % 100);
+      ids[i] = uint32_t(i);
+    }
+    const std::vector<float> input = keys;
+    const size_t maxShifts = pass == 0 ? n * n : n;
+    const bool sorted = geometry::broadphase::insertionSort(
+        keys.data(), ids.data(), n, maxShifts);
+    ok = ok && sorted == (pass == 0);
+
+    std::vector<uint32_t> seen(n, 0);
+    for(size_t i = 0; i < n && ok; i++)
+    {
+      ok = ids[i] < n && seen[ids[i]]++ == 0 && keys[i] == input[ids[i]];
+      if(sorted && i > 0)
+      {
+        ok = ok && keys[i - 1] <= keys[i]
+             && (keys[i - 1] < keys[i] || ids[i - 1] < ids[i]);
+      }
+    }
+  }
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_insertion_sort() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_insertion_sort() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_sweep_and_prune();
+
+  test_insertion_sort();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+static geometry::Mat4<float> rand_pose()
+{
+  float xi[6];
+  for(int i = 0; i < 6; i++)
+    xi[i] = 0.5f * _rand_val<float>();
+  return geometry::SE3<float>::exp(xi).toMat4();
+}
+
+// World matrices recomputed from scratch in double precision. Parents always
+// have smaller ids than their children.
+static void world_ref(
+    geometry::TransformTree &tree, std::vector<double> &world)
+{
+  const size_t n = tree.size();
+  world.assign(16 * n, 0.0);
+  for(size_t id = 0; id < n; id++)
+  {
+    const geometry::Mat4<float> l = tree.local(int32_t(id));
+    const int32_t p = tree.parent(int32_t(id));
+    for(int i = 0; i < 4; i++)
+    {
+      for(int j = 0; j < 4; j++)
+      {
+        double v = 0.0;
+        if(p < 0)
+          v = l.data.array[i][j];
+        else
+        {
+          for(int k = 0; k < 4; k++)
+            v += world[16 * p + 4 * i + k] * double(l.data.array[k][j]);
+        }
+        world[16 * id + 4 * i + j] = v;
+      }
+    }
+  }
+}
+
+static bool check_world(geometry::TransformTree &tree)
+{
+  std::vector<double> ref;
+  world_ref(tree, ref);
+  tree.update();
+  const mat4f_t *raw = tree.worldMatrices();
+  for(size_t id = 0; id < tree.size(); id++)
+  {
+    const geometry::Mat4<float> w = tree.world(int32_t(id));
+    const mat4f_t &r = raw[tree.slot(int32_t(id))];
+    for(int i = 0; i < 4; i++)
+    {
+      for(int j = 0; j < 4; j++)
+      {
+        if(fabs(double(w.data.array[i][j]) - ref[16 * id + 4 * i + j]) > 1e-4
+           || r.array[i][j] != w.data.array[i][j])
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_transform_tree_propagation()
+{
+  srand(0);
+  geometry::TransformTree tree;
+
+  // Two roots, and levels wide enough to take the parallel path
+  const size_t n = 4000;
+  tree.addNode(-1, rand_pose());
+  tree.addNode(-1, rand_pose());
+  for(size_t i = 2; i < n; i++)
+    tree.addNode(int32_t(rand() % i), rand_pose());
+
+  bool ok = check_world(tree) && tree.numLevels() > 2;
+
+  // Adding nodes after an update rebuilds the layout, ids stay valid
+  for(size_t i = n; i < n + 100; i++)
+    tree.addNode(int32_t(rand() % i), rand_pose());
+  ok = ok && check_world(tree);
+
+  bool thrown = false;
+  try
+  {
+    tree.addNode(int32_t(tree.size()), rand_pose());
+  }
+  catch(const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ok = ok && thrown;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_transform_tree_propagation() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_transform_tree_propagation() : success\n");
+}
+
+void test_transform_tree_dirty()
+{
+  srand(1);
+  geometry::TransformTree tree;
+  const size_t n = 2000;
+  tree.addNode(-1, rand_pose());
+  for(size_t i = 1; i < n; i++)
+    tree.addNode(int32_t(rand() % i), rand_pose());
+  bool ok = check_world(tree);
+
+  // Changing a deep node must not touch its ancestors, changing the root
+  // must reach every node
+  for(int t = 0; t < 20 && ok; t++)
+  {
+    const int32_t id = t == 0 ? 0 : int32_t(rand() % n);
+    tree.setLocal(id, rand_pose());
+    if(t % 3 == 0)
+      tree.setLocal(int32_t(rand() % n), rand_pose());
+    ok = check_world(tree);
+  }
+
+  // No pending change : update() is a no-op
+  const geometry::Mat4<float> before = tree.world(int32_t(n - 1));
+  tree.update();
+  const geometry::Mat4<float> after = tree.world(int32_t(n - 1));
+  ok = ok && memcmp(&before.data, &after.data, sizeof(mat4f_t)) == 0;
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_transform_tree_dirty() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_transform_tree_dirty() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_transform_tree_propagation();
+
+  test_transform_tree_dirty();
+
+  return EXIT_SUCCESS;
+}
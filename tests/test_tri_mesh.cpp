@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// n x n grid of quads in the z = 0 plane, every quad with its own 4
+// vertices so that the shared corners are duplicated
+static geometry::TriMesh make_quads(const int n)
+{
+  geometry::TriMesh mesh;
+  for(int i = 0; i < n; i++)
+  {
+    for(int j = 0; j < n; j++)
+    {
+      const uint32_t base = uint32_t(mesh.positions.size());
+      const float x = float(i), y = float(j);
+      mesh.positions.push_back(x, y, 0.0f);
+      mesh.positions.push_back(x + 1.0f, y, 0.0f);
+      mesh.positions.push_back(x + 1.0f, y + 1.0f, 0.0f);
+      mesh.positions.push_back(x, y + 1.0f, 0.0f);
+      const uint32_t t[6]
+          = {base, base + 1, base + 2, base, base + 2, base + 3};
+      mesh.indices.insert(mesh.indices.end(), t, t + 6);
+    }
+  }
+  return mesh;
+}
+
+// Closed UV sphere of radius 1
+static geometry::TriMesh make_sphere(const int n, const int m)
+{
+  geometry::TriMesh mesh;
+  mesh.positions.push_back(0.0f, 0.0f, 1.0f);
+  for(int i = 1; i < n; i++)
+  {
+    const float t = float(M_PI) * float(i) / float(n);
+    for(int j = 0; j < m; j++)
+    {
+      const float p = 2.0f * float(M_PI) * float(j) / float(m);
+      mesh.positions.push_back(
+          sinf(t) * cosf(p), sinf(t) * sinf(p), cosf(t));
+    }
+  }
+  mesh.positions.push_back(0.0f, 0.0f, -1.0f);
+  const uint32_t south = uint32_t(mesh.positions.size() - 1);
+  for(int j = 0; j < m; j++)
+  {
+    const uint32_t a = uint32_t(1 + j), b = uint32_t(1 + (j + 1) % m);
+    const uint32_t t[3] = {0, a, b};
+    mesh.indices.insert(mesh.indices.end(), t, t + 3);
+    const uint32_t c = uint32_t(1 + (n - 2) * m + j);
+    const uint32_t d = uint32_t(1 + (n - 2) * m + (j + 1) % m);
+    const uint32_t u[3] = {south, d, c};
+    mesh.indices.insert(mesh.indices.end(), u, u + 3);
+  }
+  for(int i = 0; i < n - 2; i++)
+  {
+    for(int j = 0; j < m; j++)
+    {
+      const uint32_t a = uint32_t(1 + i * m + j);
+      const uint32_t b = uint32_t(1 + i * m + (j + 1) % m);
+      const uint32_t c = a + uint32_t(m), d = b + uint32_t(m);
+      const uint32_t t[6] = {a, c, d, a, d, b};
+      mesh.indices.insert(mesh.indices.end(), t, t + 6);
+    }
+  }
+  return mesh;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_tri_mesh_normals()
+{
+  srand(0);
+
+  // Against a serial double precision accumulation, on a sphere with noisy
+  // vertices and an unreferenced vertex
+  geometry::TriMesh mesh = make_sphere(40, 80);
+  for(size_t v = 0; v < mesh.positions.size(); v++)
+  {
+    mesh.positions.x[v] += 0.002f * _rand_val<float>();
+    mesh.positions.y[v] += 0.002f * _rand_val<float>();
+    mesh.positions.z[v] += 0.002f * _rand_val<float>();
+  }
+  mesh.positions.push_back(5.0f, 5.0f, 5.0f);
+  mesh.computeNormals();
+
+  const size_t nv = mesh.positions.size();
+  std::vector<double> acc(3 * nv, 0.0);
+  for(size_t f = 0; f < mesh.numFaces(); f++)
+  {
+    const uint32_t *t = &mesh.indices[3 * f];
+    double p[3][3];
+    for(int i = 0; i < 3; i++)
+    {
+      p[i][0] = mesh.positions.x[t[i]];
+      p[i][1] = mesh.positions.y[t[i]];
+      p[i][2] = mesh.positions.z[t[i]];
+    }
+    const double u[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1],
+                         p[1][2] - p[0][2]};
+    const double w[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1],
+                         p[2][2] - p[0][2]};
+    const double c[3] = {u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2],
+                         u[0] * w[1] - u[1] * w[0]};
+    for(int i = 0; i < 3; i++)
+      for(int k = 0; k < 3; k++)
+        acc[3 * t[i] + k] += c[k];
+  }
+
+  bool ok = mesh.hasNormals();
+  for(size_t v = 0; v + 1 < nv && ok; v++)
+  {
+    const double *a = &acc[3 * v];
+    const double len = sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    ok = fabs(mesh.normals.x[v] - a[0] / len) < 1e-5
+         && fabs(mesh.normals.y[v] - a[1] / len) < 1e-5
+         && fabs(mesh.normals.z[v] - a[2] / len) < 1e-5;
+
+    // Outward, close to the radial direction
+    const double r = mesh.positions.x[v] * mesh.normals.x[v]
+                     + mesh.positions.y[v] * mesh.normals.y[v]
+                     + mesh.positions.z[v] * mesh.normals.z[v];
+    ok = ok && r > 0.9;
+  }
+  ok = ok && mesh.normals.x[nv - 1] == 0.0f && mesh.normals.y[nv - 1] == 0.0f
+       && mesh.normals.z[nv - 1] == 0.0f;
+
+  // Flat grid : exactly +z
+  geometry::TriMesh grid = make_quads(8);
+  grid.computeNormals();
+  for(size_t v = 0; v < grid.positions.size(); v++)
+  {
+    ok = ok && grid.normals.x[v] == 0.0f && grid.normals.y[v] == 0.0f
+         && grid.normals.z[v] == 1.0f;
+  }
+
+#ifdef _OPENMP
+  // The sums do not depend on the thread count
+  const int nThreads = omp_get_max_threads();
+  const geometry::Vec3SoA<float> ref = mesh.normals;
+  omp_set_num_threads(3);
+  mesh.computeNormals();
+  omp_set_num_threads(nThreads);
+  ok = ok && mesh.normals.x == ref.x && mesh.normals.y == ref.y
+       && mesh.normals.z == ref.z;
+#endif
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_tri_mesh_normals() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_tri_mesh_normals() : success\n");
+}
+
+void test_tri_mesh_weld()
+{
+  srand(1);
+  const int n = 10;
+
+  // Exact welding of the duplicated corners, -0 merged with +0
+  geometry::TriMesh mesh = make_quads(n);
+  mesh.positions.x[0] = -0.0f;
+  const size_t nf = mesh.numFaces();
+  const size_t nv = mesh.numVertices();
+  size_t removed = mesh.weld();
+  bool ok = removed == nv - size_t((n + 1) * (n + 1))
+            && mesh.numVertices() == size_t((n + 1) * (n + 1))
+            && mesh.numFaces() == nf;
+
+  // Every vertex is distinct and every edge shared by at most 2 faces
+  std::vector<uint64_t> keys;
+  for(size_t v = 0; v < mesh.numVertices(); v++)
+  {
+    keys.push_back(
+        uint64_t(mesh.positions.x[v] + 1.0f) * 1000
+        + uint64_t(mesh.positions.y[v] + 1.0f));
+  }
+  std::sort(keys.begin(), keys.end());
+  ok = ok && std::adjacent_find(keys.begin(), keys.end()) == keys.end();
+  std::vector<uint64_t> edges;
+  for(size_t f = 0; f < mesh.numFaces(); f++)
+  {
+    for(int k = 0; k < 3; k++)
+    {
+      const uint64_t a = mesh.indices[3 * f + k];
+      const uint64_t b = mesh.indices[3 * f + (k + 1) % 3];
+      edges.push_back((a << 32) | b);
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  ok = ok && std::adjacent_find(edges.begin(), edges.end()) == edges.end();
+
+  // Welding with a cell size : jittered copies merge, the first vertex of
+  // each cell is kept with its normal, degenerate faces are removed
+  mesh = make_quads(n);
+  mesh.normals.resize(mesh.positions.size());
+  for(size_t v = 0; v < mesh.positions.size(); v++)
+  {
+    mesh.positions.x[v] += 0.1f + 1e-3f * _rand_val<float>();
+    mesh.positions.y[v] += 0.1f + 1e-3f * _rand_val<float>();
+    mesh.normals.set(v, float(v), 0.0f, 1.0f);
+  }
+  // A sliver whose corners fall in the same cell
+  const uint32_t s = uint32_t(mesh.positions.size());
+  mesh.positions.push_back(0.12f, 0.1f, 0.0f);
+  mesh.positions.push_back(0.1f, 0.12f, 0.0f);
+  mesh.normals.push_back(0.0f, 0.0f, 1.0f);
+  mesh.normals.push_back(0.0f, 0.0f, 1.0f);
+  const uint32_t sliver[3] = {0, s, s + 1};
+  mesh.indices.insert(mesh.indices.end(), sliver, sliver + 3);
+
+  removed = mesh.weld(0.25f);
+  ok = ok && mesh.numVertices() == size_t((n + 1) * (n + 1))
+       && mesh.numFaces() == nf && mesh.hasNormals()
+       && mesh.normals.x[0] == 0.0f && mesh.normals.x[1] == 1.0f
+       && removed == 4 * size_t(n * n) + 2 - mesh.numVertices();
+  for(size_t i = 0; i < mesh.indices.size(); i++)
+    ok = ok && mesh.indices[i] < mesh.numVertices();
+
+  if(!ok)
+  {
+    fprintf(stderr, "test_tri_mesh_weld() : failed\n");
+    return;
+  }
+  fprintf(stdout, "test_tri_mesh_weld() : success\n");
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+  test_tri_mesh_normals();
+
+  test_tri_mesh_weld();
+
+  return EXIT_SUCCESS;
+}
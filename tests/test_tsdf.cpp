@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+static const int width = 64;
+static const int height = 48;
+
+static geometry::Mat4<float> identity()
+{
+  geometry::Mat4<float> ret;
+  for(int i = 0; i < 4; i++)
+    ret.data.array[i][i] = 1.0f;
+  return ret;
+}
+
+// Depth map of the plane z = 1 seen by a camera at the origin
+static std::vector<float> plane_depth()
+{
+  return std::vector<float>(width * height, 1.0f);
+}
+
+// Depth of the zero crossing of the TSDF along the voxel column (x, y)
+template <typename Volume>
+static float zero_crossing(const Volume &vol, const int x, const int y,
+                           const int z0, const int z1)
+{
+  float prev = 0.0f, w = 0.0f;
+  if(!vol.voxel(x, y, z0, prev, w))
+    return -1.0f;
+  for(int z = z0 + 1; z <= z1; z++)
+  {
+    float val;
+    if(!vol.voxel(x, y, z, val, w) || w <= 0.0f)
+      return -1.0f;
+    if(prev > 0.0f && val <= 0.0f)
+      return float(z - 1) + prev / (prev - val);
+    prev = val;
+  }
+  return -1.0f;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_tsdf_dense_plane()
+{
+  const geometry::Intrinsics K(50.0f, 50.0f, 32.0f, 24.0f);
+  const float voxelSize = 0.02f;
+  geometry::TsdfVolume vol(
+      40, 30, 40, voxelSize, geometry::Vec3<float>(-0.4f, -0.3f, 0.6f),
+      0.06f);
+  const std::vector<float> depth = plane_depth();
+  vol.integrate(depth.data(), width, height, K, identity());
+
+  // Voxel z of the plane : (1 - 0.6) / 0.02 = 20
+  const float z = zero_crossing(vol, 20, 15, 10, 30);
+  if(fabsf(z - 20.0f) > 0.05f)
+  {
+    fprintf(stderr, "test_tsdf_dense_plane() : failed\n");
+    return;
+  }
+
+  std::vector<float> rendered(width * height);
+  vol.raycast(K, identity(), width, height, 0.7f, 1.3f, rendered.data());
+  for(int v = 20; v < 28; v++)
+  {
+    for(int u = 28; u < 36; u++)
+    {
+      if(fabsf(rendered[v * width + u] - 1.0f) > 2e-3f)
+      {
+        fprintf(stderr, "test_tsdf_dense_plane() : failed\n");
+        return;
+      }
+    }
+  }
+
+  fprintf(stdout, "test_tsdf_dense_plane() : success\n");
+}
+
+void test_tsdf_sparse_plane()
+{
+  const geometry::Intrinsics K(50.0f, 50.0f, 32.0f, 24.0f);
+  geometry::SparseTsdfVolume vol(0.02f, 0.06f, 64.0f, 5.0f);
+  std::vector<float> depth = plane_depth();
+  vol.integrate(depth.data(), width, height, K, identity());
+  const size_t nBlocks = vol.numBlocks();
+
+  // Non finite and out of range depths are skipped and must not allocate
+  std::vector<float> bad(width * height, 0.0f);
+  bad[0] = INFINITY;
+  bad[1] = NAN;
+  bad[2] = 1e30f;
+  bad[3] = 6.0f;
+  vol.integrate(bad.data(), width, height, K, identity());
+
+  // The plane is at voxel z = 50
+  const float z = zero_crossing(vol, 0, 0, 40, 60);
+  if(nBlocks == 0 || vol.numBlocks() != nBlocks || fabsf(z - 50.0f) > 0.05f)
+  {
+    fprintf(stderr, "test_tsdf_sparse_plane() : failed\n");
+    return;
+  }
+
+  fprintf(stdout, "test_tsdf_sparse_plane() : success\n");
+}
+
+int main(int argc, char** argv)
+{
+  test_tsdf_dense_plane();
+
+  test_tsdf_sparse_plane();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2020 Adrien ARNAUD
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <geometry_cxx.hpp>
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+static inline T _rand_val()
+{
+  return T(2) * T(rand()) / T(RAND_MAX) - T(1);
+}
+
+// 8 clusters of points around the corners of a cube of side 10, each one
+// falling in a single voxel of side 3
+static geometry::Vec3SoA<float> make_clusters(const size_t nPerCluster)
+{
+  geometry::Vec3SoA<float> ret;
+  for(size_t i = 0; i < 8; i++)
+  {
+    const float cx = (i & 1) ? 10.0f : 0.0f;
+    const float cy = (i & 2) ? 10.0f : 0.0f;
+    const float cz = (i & 4) ? 10.0f : 0.0f;
+    for(size_t j = 0; j < nPerCluster; j++)
+    {
+      ret.push_back(
+          cx + 0.5f + 0.2f * _rand_val<float>(),
+          cy + 0.5f + 0.2f * _rand_val<float>(),
+          cz + 0.5f + 0.2f * _rand_val<float>());
+    }
+  }
+  return ret;
+}
+
+// -----------------------------------------------------------------------------
+
+void test_voxel_grid_centroid()
+{
+  geometry::Vec3SoA<float> points = make_clusters(1000);
+  geometry::Vec3SoA<float> out;
+  geometry::VoxelGrid<float> grid(3.0f);
+  grid.filter(points, out);
+
+  if(out.size() != 8)
+  {
+    fprintf(stderr, "test_voxel_grid_centroid() : failed\n");
+    return;
+  }
+
+  for(size_t i = 0; i < out.size(); i++)
+  {
+    const float dx = fmodf(out.x[i], 10.0f) - 0.5f;
+    const float dy = fmodf(out.y[i], 10.0f) - 0.5f;
+    const float dz = fmodf(out.z[i], 10.0f) - 0.5f;
+    if(fabsf(dx) > 0.05f || fabsf(dy) > 0.05f || fabsf(dz) > 0.05f)
+    {
+      fprintf(stderr, "test_voxel_grid_centroid() : failed\n");
+      return;
+    }
+  }
+
+  fprintf(stdout, "test_voxel_grid_centroid() : success\n");
+}
+
+void test_voxel_grid_first()
+{
+  geometry::Vec3SoA<float> points = make_clusters(1000);
+  geometry::Vec3SoA<float> out;
+  geometry::VoxelGrid<float> grid(3.0f, geometry::VOXEL_FIRST);
+  grid.filter(points, out);
+
+  if(out.size() != 8)
+  {
+    fprintf(stderr, "test_voxel_grid_first() : failed\n");
+    return;
+  }
+
+  // Clusters are generated in key order, so the first point of each cluster
+  // must be selected
+  for(size_t i = 0; i < 8; i++)
+  {
+    if(out.x[i] != points.x[1000 * i] || out.y[i] != points.y[1000 * i]
+       || out.z[i] != points.z[1000 * i])
+    {
+      fprintf(stderr, "test_voxel_grid_first() : failed\n");
+      return;
+    }
+  }
+
+  fprintf(stdout, "test_voxel_grid_first() : success\n");
+}
+
+void test_voxel_grid_normals()
+{
+  geometry::Vec3SoA<float> points = make_clusters(100);
+  geometry::Vec3SoA<float> normals(points.size());
+  for(size_t i = 0; i < normals.size(); i++)
+    normals.set(i, 0.0f, 0.0f, 2.0f);
+
+  geometry::Vec3SoA<float> out, outNormals;
+  geometry::VoxelGrid<float> grid(3.0f, geometry::VOXEL_RANDOM, 42);
+  grid.filter(points, &normals, NULL, out, &outNormals, NULL);
+
+  if(out.size() != 8 || outNormals.size() != 8)
+  {
+    fprintf(stderr, "test_voxel_grid_normals() : failed\n");
+    return;
+  }
+
+  for(size_t i = 0; i < outNormals.size(); i++)
+  {
+    if(outNormals.z[i] != 2.0f)
+    {
+      fprintf(stderr, "test_voxel_grid_normals() : failed\n");
+      return;
+    }
+  }
+
+  fprintf(stdout, "test_voxel_grid_normals() : success\n");
+}
+
+void test_voxel_grid_non_finite()
+{
+  geometry::Vec3SoA<float> points = make_clusters(10);
+  points.set(3, 0.0f, NAN, 0.0f);
+  geometry::Vec3SoA<float> out;
+  geometry::VoxelGrid<float> grid(3.0f);
+  try
+  {
+    grid.filter(points, out);
+  }
+  catch(const std::invalid_argument &)
+  {
+    fprintf(stdout, "test_voxel_grid_non_finite() : success\n");
+    return;
+  }
+  fprintf(stderr, "test_voxel_grid_non_finite() : failed\n");
+}
+
+int main(int argc, char** argv)
+{
+  test_voxel_grid_centroid();
+
+  test_voxel_grid_first();
+
+  test_voxel_grid_normals();
+
+  test_voxel_grid_non_finite();
+
+  return EXIT_SUCCESS;
+}